@@ -0,0 +1,785 @@
+/*
+**                    TIVTC for AviSynth 2.6 interface
+**
+**   TIVTC includes a field matching filter (TFM) and a decimation
+**   filter (TDecimate) which can be used together to achieve an
+**   IVTC or for other uses. TIVTC currently supports 8 bit planar YUV and
+**   YUY2 colorspaces.
+**
+**   Copyright (C) 2004-2008 Kevin Stone, additional work (C) 2020 pinterf
+**
+**   This program is free software; you can redistribute it and/or modify
+**   it under the terms of the GNU General Public License as published by
+**   the Free Software Foundation; either version 2 of the License, or
+**   (at your option) any later version.
+**
+**   This program is distributed in the hope that it will be useful,
+**   but WITHOUT ANY WARRANTY; without even the implied warranty of
+**   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**   GNU General Public License for more details.
+**
+**   You should have received a copy of the GNU General Public License
+**   along with this program; if not, write to the Free Software
+**   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+** Kernel benchmark: runs the TFM/TDecimate kernels on generated frames and
+** prints the time per pixel of each code path (C, SSE2, SSE4.1, AVX2).
+** Each path's output is first compared with the C path, and the exit code is
+** 1 if any of them differ. A few kernels are also checked against results
+** computed the old way, e.g. compareFields on an odd chroma height.
+**
+** usage: tivtc-bench [name filter] [milliseconds per case]
+**
+** The frames come from a minimal stand-in for the VapourSynth API that only
+** implements the frame functions the kernels call, so no core is needed.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+#include "../src/TCommonASM.h"
+#include "../src/TDecimate.h"
+#include "../src/TDecimateASM.h"
+#include "../src/TFM.h"
+#include "../src/TFMasm.h"
+#include "../src/TFMPP.h"
+
+struct VSFrameRef {
+  const VSFormat *format;
+  int width[3], height[3], stride[3];
+  uint8_t *data[3];
+};
+
+static VSFrameRef * VS_CC fakeNewVideoFrame(const VSFormat *format, int width, int height, const VSFrameRef *, VSCore *)
+{
+  VSFrameRef *f = new VSFrameRef();
+  f->format = format;
+  for (int p = 0; p < format->numPlanes; ++p)
+  {
+    f->width[p] = p ? width >> format->subSamplingW : width;
+    f->height[p] = p ? height >> format->subSamplingH : height;
+    f->stride[p] = (f->width[p] * format->bytesPerSample + 63) & ~63;
+    // four rows of padding above and below for the kernels that look
+    // at neighbouring lines
+    const int rows = f->height[p] + 8;
+    f->data[p] = vs_aligned_malloc<uint8_t>((size_t)f->stride[p] * rows, 64);
+    memset(f->data[p], 0, (size_t)f->stride[p] * rows);
+    f->data[p] += f->stride[p] * 4;
+  }
+  return f;
+}
+
+static void VS_CC fakeFreeFrame(const VSFrameRef *f)
+{
+  if (!f)
+    return;
+  for (int p = 0; p < f->format->numPlanes; ++p)
+    vs_aligned_free(f->data[p] - f->stride[p] * 4);
+  delete f;
+}
+
+static const VSFormat * VS_CC fakeGetFrameFormat(const VSFrameRef *f) { return f->format; }
+static int VS_CC fakeGetStride(const VSFrameRef *f, int plane) { return f->stride[plane]; }
+static const uint8_t * VS_CC fakeGetReadPtr(const VSFrameRef *f, int plane) { return f->data[plane]; }
+static uint8_t * VS_CC fakeGetWritePtr(VSFrameRef *f, int plane) { return f->data[plane]; }
+static int VS_CC fakeGetFrameWidth(const VSFrameRef *f, int plane) { return f->width[plane]; }
+static int VS_CC fakeGetFrameHeight(const VSFrameRef *f, int plane) { return f->height[plane]; }
+
+static VSAPI makeFakeApi()
+{
+  VSAPI api;
+  memset(&api, 0, sizeof(api));
+  api.newVideoFrame = fakeNewVideoFrame;
+  api.freeFrame = fakeFreeFrame;
+  api.getFrameFormat = fakeGetFrameFormat;
+  api.getStride = fakeGetStride;
+  api.getReadPtr = fakeGetReadPtr;
+  api.getWritePtr = fakeGetWritePtr;
+  api.getFrameWidth = fakeGetFrameWidth;
+  api.getFrameHeight = fakeGetFrameHeight;
+  return api;
+}
+
+static const VSAPI fakeApi = makeFakeApi();
+static const VSAPI *vsapi = &fakeApi;
+
+static VSFormat makeFormat(int bits, int ssw, int ssh)
+{
+  VSFormat f;
+  memset(&f, 0, sizeof(f));
+  snprintf(f.name, sizeof(f.name), "YUV%sP%d", ssw ? (ssh ? "420" : "422") : "444", bits);
+  f.colorFamily = cmYUV;
+  f.sampleType = stInteger;
+  f.bitsPerSample = bits;
+  f.bytesPerSample = bits > 8 ? 2 : 1;
+  f.subSamplingW = ssw;
+  f.subSamplingH = ssh;
+  f.numPlanes = 3;
+  return f;
+}
+
+// Fills the frame with noise on top of a gradient. Every other line is
+// shifted, so the comb detection has some work to do.
+static void fillFrame(VSFrameRef *f, uint32_t seed)
+{
+  const int bits = f->format->bitsPerSample;
+  const int maxval = (1 << bits) - 1;
+  for (int p = 0; p < f->format->numPlanes; ++p)
+  {
+    for (int y = -4; y < f->height[p] + 4; ++y)
+    {
+      uint8_t *row = f->data[p] + (ptrdiff_t)f->stride[p] * y;
+      const int w = f->stride[p] / f->format->bytesPerSample;
+      for (int x = 0; x < w; ++x)
+      {
+        seed = seed * 1664525u + 1013904223u;
+        int v = ((x + ((y & 1) ? 24 : 0)) * 2 + y) & 255;
+        v = std::min(std::max(v + (int)(seed >> 28) - 8, 0), 255);
+        v = std::min(v << (bits - 8), maxval);
+        if (bits > 8)
+          reinterpret_cast<uint16_t *>(row)[x] = (uint16_t)v;
+        else
+          row[x] = (uint8_t)v;
+      }
+    }
+  }
+}
+
+// Mask plane with runs of 0x00 and 0xFF, like the deinterlacing masks.
+static void fillMask(VSFrameRef *f)
+{
+  for (int p = 0; p < f->format->numPlanes; ++p)
+    for (int y = -4; y < f->height[p] + 4; ++y)
+    {
+      uint8_t *row = f->data[p] + (ptrdiff_t)f->stride[p] * y;
+      for (int x = 0; x < f->stride[p]; ++x)
+        row[x] = ((x / 24 + y / 8) % 3) == 0 ? 0xFF : 0x00;
+    }
+}
+
+// Code paths, a kernel lists the ones it has an implementation for.
+enum {
+  PATH_C = 1,
+  PATH_SSE2 = 2,
+  PATH_SSE41 = 4,
+  PATH_AVX2 = 8,
+};
+
+struct Path {
+  const char *name;
+  unsigned id;
+  CPUFeatures flags;
+};
+
+static std::vector<Path> getPaths()
+{
+  const CPUFeatures *cpu = getCPUFeatures();
+  std::vector<Path> paths;
+  Path p;
+  memset(&p.flags, 0, sizeof(p.flags));
+  p.name = "C";
+  p.id = PATH_C;
+  paths.push_back(p);
+  if (cpu->sse2)
+  {
+    p.name = "SSE2";
+    p.id = PATH_SSE2;
+    p.flags.sse2 = 1;
+    paths.push_back(p);
+  }
+  if (cpu->sse4_1)
+  {
+    p.name = "SSE4.1";
+    p.id = PATH_SSE41;
+    p.flags.sse3 = p.flags.ssse3 = p.flags.sse4_1 = 1;
+    paths.push_back(p);
+  }
+  if (cpu->avx2)
+  {
+    p.name = "AVX2";
+    p.id = PATH_AVX2;
+    p.flags.sse4_2 = p.flags.avx = p.flags.avx2 = 1;
+    paths.push_back(p);
+  }
+  return paths;
+}
+
+// One compareFields plane, prv/nxt fields from p1, current field from p2.
+// Same kernel selection as TFM::compareFields_core.
+template<typename pixel_t>
+static void compareFieldsPlane(const uint8_t *p1, const uint8_t *p2, int pitch, int width, int height,
+  int bits, const CPUFeatures *flags, uint64_t (&sums)[4])
+{
+  auto compareFieldsRow = compareFieldsRow_c<pixel_t>;
+  if constexpr (sizeof(pixel_t) == 1) {
+    if (flags->avx2) compareFieldsRow = compareFieldsRow_uint8_AVX2;
+    else if (flags->sse4_1) compareFieldsRow = compareFieldsRow_uint8_SSE4;
+  }
+  else {
+    if (flags->avx2) compareFieldsRow = compareFieldsRow_uint16_AVX2;
+    else if (flags->sse4_1) compareFieldsRow = compareFieldsRow_uint16_SSE4;
+  }
+  const int fpitch = pitch / sizeof(pixel_t) * 2;
+  const pixel_t *prv = reinterpret_cast<const pixel_t *>(p1);
+  const pixel_t *nxt = reinterpret_cast<const pixel_t *>(p1 + pitch);
+  const pixel_t *cur = reinterpret_cast<const pixel_t *>(p2) + fpitch;
+  uint64_t *accum = sums;
+  memset(accum, 0, sizeof(sums));
+  for (int y = 2; y < height - 2; y += 2)
+  {
+    compareFieldsRow(prv, prv + fpitch, cur - fpitch, cur, cur + fpitch, nxt, nxt + fpitch,
+      8, width - 8, bits, accum);
+    prv += fpitch;
+    nxt += fpitch;
+    cur += fpitch;
+  }
+}
+
+// compareFields the way TFM did it before the fused kernels: the
+// buildABSDiffMask2 map is built first, then the accumulation reads two map
+// rows per line. The map here covers every row the loop reads; the old
+// code built only Height>>1 rows, so on odd plane heights (4:2:0 chroma of
+// e.g. 720x486) its last line read a map row left over from an earlier call.
+template<typename pixel_t>
+static void compareFieldsMapPlane(const uint8_t *p1, const uint8_t *p2, int pitch, int width, int height,
+  int bits, uint64_t (&sums)[4])
+{
+  const int Const23 = 23 << (bits - 8);
+  const int Const42 = 42 << (bits - 8);
+  const int count = std::max((height - 3) / 2, 0);
+  std::vector<uint8_t> map((size_t)width * (count + 1));
+  CPUFeatures noSimd;
+  memset(&noSimd, 0, sizeof(noSimd));
+  do_buildABSDiffMask2<pixel_t>(p1, p1 + pitch, map.data(), pitch * 2, pitch * 2, width, width, count + 1, &noSimd, bits);
+  const int fpitch = pitch / sizeof(pixel_t) * 2;
+  const pixel_t *prv = reinterpret_cast<const pixel_t *>(p1);
+  const pixel_t *nxt = reinterpret_cast<const pixel_t *>(p1 + pitch);
+  const pixel_t *cur = reinterpret_cast<const pixel_t *>(p2) + fpitch;
+  memset(sums, 0, sizeof(sums));
+  for (int k = 0; k < count; ++k)
+  {
+    const uint8_t *mapp = map.data() + (size_t)width * k;
+    const uint8_t *mapn = mapp + width;
+    for (int x = 8; x < width - 8; ++x)
+    {
+      const int eax = (mapp[x] << 2) + mapn[x];
+      if (eax == 0)
+        continue;
+      const int a_curr = cur[x - fpitch] + (cur[x] << 2) + cur[x + fpitch];
+      const int diff_p_c = abs(3 * (prv[x] + prv[x + fpitch]) - a_curr);
+      if (diff_p_c > Const23) {
+        sums[0] += diff_p_c;
+        if (diff_p_c > Const42 && (eax & 10) != 0)
+          sums[1] += diff_p_c;
+      }
+      const int diff_n_c = abs(3 * (nxt[x] + nxt[x + fpitch]) - a_curr);
+      if (diff_n_c > Const23) {
+        sums[2] += diff_n_c;
+        if (diff_n_c > Const42 && (eax & 10) != 0)
+          sums[3] += diff_n_c;
+      }
+    }
+    prv += fpitch;
+    nxt += fpitch;
+    cur += fpitch;
+  }
+}
+
+// One compareFieldsSlow2 (field 0) plane, the map is taken from the mask frame.
+template<typename pixel_t>
+static void compareFieldsSlow2Plane(const uint8_t *p1, const uint8_t *p2, const uint8_t *mp, int pitch, int mpitch,
+  int width, int height, int bits, const CPUFeatures *flags, uint64_t (&sums)[6])
+{
+  auto slowRow = compareFieldsSlowRow_c<pixel_t>;
+  auto slow2Row = compareFieldsSlow2Row_c<pixel_t>;
+  if constexpr (sizeof(pixel_t) == 1) {
+    if (flags->avx2) { slowRow = compareFieldsSlowRow_uint8_AVX2; slow2Row = compareFieldsSlow2Row_uint8_AVX2; }
+    else if (flags->sse4_1) { slowRow = compareFieldsSlowRow_uint8_SSE4; slow2Row = compareFieldsSlow2Row_uint8_SSE4; }
+  }
+  else {
+    if (flags->avx2) { slowRow = compareFieldsSlowRow_uint16_AVX2; slow2Row = compareFieldsSlow2Row_uint16_AVX2; }
+    else if (flags->sse4_1) { slowRow = compareFieldsSlowRow_uint16_SSE4; slow2Row = compareFieldsSlow2Row_uint16_SSE4; }
+  }
+  const int fpitch = pitch / sizeof(pixel_t) * 2;
+  const pixel_t *prv = reinterpret_cast<const pixel_t *>(p1);
+  const pixel_t *nxt = reinterpret_cast<const pixel_t *>(p1 + pitch);
+  const pixel_t *cur = reinterpret_cast<const pixel_t *>(p2) + fpitch;
+  uint64_t *accum = sums;
+  memset(accum, 0, sizeof(sums));
+  for (int y = 2; y < height - 2; y += 2)
+  {
+    const uint8_t *mapp = mp + (ptrdiff_t)mpitch * y;
+    slowRow(mapp, mapp + 2 * mpitch, prv, prv + fpitch, cur - fpitch, cur, cur + fpitch, nxt, nxt + fpitch,
+      8, width - 8, bits, accum);
+    slow2Row(mapp, prv - fpitch, prv, prv + fpitch, cur - fpitch, cur, nxt - fpitch, nxt, nxt + fpitch,
+      8, width - 8, bits, accum);
+    prv += fpitch;
+    nxt += fpitch;
+    cur += fpitch;
+  }
+}
+
+// ELA deinterlacing of one field (field 0), same rows as TFMPP::elaDeintPlanar.
+template<typename pixel_t, int bits_per_pixel>
+static void elaDeintPlane(const uint8_t *sp, uint8_t *dp, const uint8_t *mp, int pitch, int mpitch,
+  int width, int height, const CPUFeatures *flags)
+{
+  const int fpitch = pitch / sizeof(pixel_t) * 2;
+  const pixel_t *srcp = reinterpret_cast<const pixel_t *>(sp + (ptrdiff_t)pitch * 3);
+  pixel_t *dstp = reinterpret_cast<pixel_t *>(dp + (ptrdiff_t)pitch * 2);
+  const uint8_t *maskp = mp + (ptrdiff_t)mpitch * 2;
+  const int xstart = std::min(4, width);
+  const int xstop = std::max(width - 4, 4);
+  for (int y = 2; y < height - 3; y += 2)
+  {
+    if (flags->avx2)
+      elaDeintRow_AVX2<pixel_t, bits_per_pixel>(srcp - 2 * fpitch, srcp - fpitch, srcp, srcp + fpitch, dstp, maskp, xstart, xstop);
+    else
+      elaDeintRow_C<pixel_t, bits_per_pixel>(srcp - 2 * fpitch, srcp - fpitch, srcp, srcp + fpitch, dstp, maskp, xstart, xstop);
+    srcp += fpitch;
+    dstp += fpitch;
+    maskp += mpitch * 2;
+  }
+}
+
+// log2 of a power of two
+static int ctz(int v)
+{
+  int n = 0;
+  while (v > 1)
+  {
+    v >>= 1;
+    ++n;
+  }
+  return n;
+}
+
+struct Size {
+  const char *name;
+  int width, height;
+};
+
+// A kernel run on one frame with the given code path.
+using KernelFn = std::function<void(const CPUFeatures *flags)>;
+
+// What a kernel writes: clear() is called before every checked run, bytes()
+// returns the result afterwards.
+struct Output {
+  std::function<void()> clear;
+  std::function<std::vector<uint8_t>()> bytes;
+};
+
+// The visible pixels of every plane of f.
+static Output frameOutput(VSFrameRef *f)
+{
+  auto rowBytes = [f](int p) { return (size_t)f->width[p] * f->format->bytesPerSample; };
+  return {
+    [f, rowBytes]() {
+      for (int p = 0; p < f->format->numPlanes; ++p)
+        for (int y = 0; y < f->height[p]; ++y)
+          memset(f->data[p] + (ptrdiff_t)f->stride[p] * y, 0xA5, rowBytes(p));
+    },
+    [f, rowBytes]() {
+      std::vector<uint8_t> v;
+      for (int p = 0; p < f->format->numPlanes; ++p)
+        for (int y = 0; y < f->height[p]; ++y)
+        {
+          const uint8_t *row = f->data[p] + (ptrdiff_t)f->stride[p] * y;
+          v.insert(v.end(), row, row + rowBytes(p));
+        }
+      return v;
+    }
+  };
+}
+
+static Output bufferOutput(void *buf, size_t size)
+{
+  return {
+    [buf, size]() { memset(buf, 0xA5, size); },
+    [buf, size]() { return std::vector<uint8_t>((uint8_t *)buf, (uint8_t *)buf + size); }
+  };
+}
+
+struct Bench {
+  std::string filter;
+  int msPerCase = 50;
+  std::vector<Path> paths = getPaths();
+  int mismatches = 0;
+
+  bool wanted(const std::string &name) const
+  {
+    return filter.empty() || name.find(filter) != std::string::npos;
+  }
+
+  // Prints one line: kernel, size, depth, then ns/pixel for every path in
+  // kernelPaths. The flags of a path also enable the ones before it, so a
+  // kernel without its own implementation would silently time a fallback.
+  // Before the timing every path is run once and its output compared with
+  // the reference path. That is C, unless C is known to round differently;
+  // then C itself is not checked.
+  void run(const std::string &name, const Size &size, int bits, unsigned kernelPaths, const KernelFn &fn,
+    const Output &out, unsigned referencePath = PATH_C)
+  {
+    if (!wanted(name))
+      return;
+    std::string differ;
+    std::vector<uint8_t> reference;
+    bool haveReference = false;
+    auto result = [&](const Path &path) {
+      out.clear();
+      fn(&path.flags);
+      return out.bytes();
+    };
+    for (const Path &path : paths)
+    {
+      if (path.id == referencePath)
+      {
+        reference = result(path);
+        haveReference = true;
+      }
+    }
+    for (const Path &path : paths)
+    {
+      if (!haveReference || path.id == referencePath || !(path.id & kernelPaths) ||
+        (path.id == PATH_C && referencePath != PATH_C))
+        continue;
+      if (result(path) != reference)
+        differ += std::string(" ") + path.name;
+    }
+    printf("%-22s %-4s %2d-bit", name.c_str(), size.name, bits);
+    const double pixels = (double)size.width * size.height;
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+      if (!(paths[i].id & kernelPaths))
+      {
+        printf("  %8s", "-");
+        continue;
+      }
+      fn(&paths[i].flags); // warm up
+      using clock = std::chrono::steady_clock;
+      const auto limit = std::chrono::milliseconds(msPerCase);
+      const auto start = clock::now();
+      auto now = start;
+      int iterations = 0;
+      do {
+        fn(&paths[i].flags);
+        ++iterations;
+        now = clock::now();
+      } while (now - start < limit || iterations < 3);
+      const double ns = std::chrono::duration<double, std::nano>(now - start).count();
+      printf("  %8.3f", ns / iterations / pixels);
+    }
+    if (!differ.empty())
+    {
+      printf("  MISMATCH:%s", differ.c_str());
+      ++mismatches;
+    }
+    printf("\n");
+  }
+
+  // Not timed: checks every path in kernelPaths against a result computed
+  // some other way.
+  void verify(const std::string &name, const Size &size, int bits, unsigned kernelPaths, const KernelFn &fn,
+    const Output &out, const std::vector<uint8_t> &expected)
+  {
+    if (!wanted(name))
+      return;
+    std::string differ;
+    for (const Path &path : paths)
+    {
+      if (!(path.id & kernelPaths))
+        continue;
+      out.clear();
+      fn(&path.flags);
+      if (out.bytes() != expected)
+        differ += std::string(" ") + path.name;
+    }
+    printf("%-22s %-4s %2d-bit  %s", name.c_str(), size.name, bits, differ.empty() ? "ok" : "MISMATCH:");
+    if (!differ.empty())
+    {
+      printf("%s", differ.c_str());
+      ++mismatches;
+    }
+    printf("\n");
+  }
+};
+
+int main(int argc, char **argv)
+{
+  Bench bench;
+  if (argc > 1)
+    bench.filter = argv[1];
+  if (argc > 2)
+    bench.msPerCase = std::max(atoi(argv[2]), 1);
+
+  const Size sizes[] = { { "SD", 720, 480 }, { "HD", 1920, 1080 }, { "UHD", 3840, 2160 } };
+  const int depths[] = { 8, 10, 16 };
+
+  printf("ns/pixel of the luma plane (- : path not implemented for this kernel)\n");
+  printf("%-22s %-4s %6s", "kernel", "size", "depth");
+  for (const auto &p : bench.paths)
+    printf("  %8s", p.name);
+  printf("\n");
+
+  for (int bits : depths)
+  {
+    const VSFormat format = makeFormat(bits, 1, 1);
+    const VSFormat maskFormat = makeFormat(8, 1, 1);
+    const bool hbd = bits > 8;
+
+    for (const Size &size : sizes)
+    {
+      VSFrameRef *src1 = fakeNewVideoFrame(&format, size.width, size.height, nullptr, nullptr);
+      VSFrameRef *src2 = fakeNewVideoFrame(&format, size.width, size.height, nullptr, nullptr);
+      VSFrameRef *dst = fakeNewVideoFrame(&format, size.width, size.height, nullptr, nullptr);
+      VSFrameRef *mask = fakeNewVideoFrame(&maskFormat, size.width, size.height, nullptr, nullptr);
+      fillFrame(src1, 1);
+      fillFrame(src2, 2);
+      fillMask(mask);
+
+      VSVideoInfo vi;
+      memset(&vi, 0, sizeof(vi));
+      vi.format = &format;
+      vi.width = size.width;
+      vi.height = size.height;
+
+      const uint8_t *p1 = src1->data[0], *p2 = src2->data[0], *mp = mask->data[0];
+      uint8_t *dp = dst->data[0];
+      const int pitch = src1->stride[0], mpitch = mask->stride[0];
+      const int width = size.width, height = size.height;
+
+      for (int metric = 0; metric < 2; ++metric)
+      {
+        bench.run(metric ? "check_combing_metric1" : "check_combing", size, bits,
+          hbd ? PATH_C | PATH_SSE41 | PATH_AVX2 : PATH_C | PATH_SSE2 | PATH_AVX2, [&](const CPUFeatures *flags) {
+          if (hbd)
+            checkCombedPlanarAnalyze_core<uint16_t>(&vi, 9, false, flags, metric, src1, src1, mask, vsapi, nullptr);
+          else
+            checkCombedPlanarAnalyze_core<uint8_t>(&vi, 9, false, flags, metric, src1, src1, mask, vsapi, nullptr);
+        }, frameOutput(mask));
+      }
+      fillMask(mask);
+
+      bench.run("buildABSDiffMask", size, bits,
+        PATH_C | PATH_SSE2, [&](const CPUFeatures *flags) {
+        if (hbd)
+          do_buildABSDiffMask<uint16_t>(p1, p2, dp, pitch, pitch, pitch, width, height, flags);
+        else
+          do_buildABSDiffMask<uint8_t>(p1, p2, dp, pitch, pitch, pitch, width, height, flags);
+      }, frameOutput(dst));
+
+      bench.run("buildABSDiffMask2", size, bits,
+        PATH_C | PATH_SSE2, [&](const CPUFeatures *flags) {
+        if (hbd)
+          do_buildABSDiffMask2<uint16_t>(p1, p2, dp, pitch, pitch, pitch, width, height, flags, bits);
+        else
+          do_buildABSDiffMask2<uint8_t>(p1, p2, dp, pitch, pitch, pitch, width, height, flags, bits);
+      }, frameOutput(dst));
+
+      uint64_t fieldSums[4], slow2Sums[6];
+      bench.run("compareFields", size, bits,
+        PATH_C | PATH_SSE41 | PATH_AVX2, [&](const CPUFeatures *flags) {
+        if (hbd)
+          compareFieldsPlane<uint16_t>(p1, p2, pitch, width, height, bits, flags, fieldSums);
+        else
+          compareFieldsPlane<uint8_t>(p1, p2, pitch, width, height, bits, flags, fieldSums);
+      }, bufferOutput(fieldSums, sizeof(fieldSums)));
+
+      bench.run("compareFieldsSlow2", size, bits,
+        PATH_C | PATH_SSE41 | PATH_AVX2, [&](const CPUFeatures *flags) {
+        if (hbd)
+          compareFieldsSlow2Plane<uint16_t>(p1, p2, mp, pitch, mpitch, width, height, bits, flags, slow2Sums);
+        else
+          compareFieldsSlow2Plane<uint8_t>(p1, p2, mp, pitch, mpitch, width, height, bits, flags, slow2Sums);
+      }, bufferOutput(slow2Sums, sizeof(slow2Sums)));
+
+      // TDecimate block metrics, luma only: the default 32x32 blocks, the
+      // generic SSE2 kernel, and the small block/nt path
+      struct BlockSetup {
+        const char *suffix;
+        int blockx, blocky, nt;
+      };
+      const BlockSetup blockSetups[] = { { "", 32, 32, 0 }, { "_64x16", 64, 16, 0 }, { "_8x8_nt5", 8, 8, 5 } };
+      for (const BlockSetup &b : blockSetups)
+      {
+        const int xshift = ctz(b.blockx), yshift = ctz(b.blocky);
+        const int xblocks = ((width + b.blockx / 2) >> xshift) + 1;
+        const int yblocks = ((height + b.blocky / 2) >> yshift) + 1;
+        std::vector<uint64_t> diff((size_t)xblocks * yblocks * 4);
+        uint64_t metricF;
+        const Output diffOutput = {
+          [&]() { metricF = 0; },
+          [&]() {
+            std::vector<uint8_t> v((uint8_t *)diff.data(), (uint8_t *)(diff.data() + diff.size()));
+            v.insert(v.end(), (uint8_t *)&metricF, (uint8_t *)(&metricF + 1));
+            return v;
+          }
+        };
+        // 8 bit blocks of at least 16x16 without nt have their own SSE2 kernels
+        const unsigned diffPaths = !hbd && b.blockx >= 16 && b.blocky >= 16 && b.nt <= 0 ?
+          PATH_C | PATH_SSE2 : PATH_C | PATH_SSE41 | PATH_AVX2;
+        for (int ssd = 0; ssd < 2; ++ssd)
+        {
+          bench.run(std::string(ssd ? "calcDiffSSD" : "calcDiffSAD") + b.suffix, size, bits,
+            diffPaths, [&](const CPUFeatures *flags) {
+            CalcMetricData d{};
+            d.vi = vi;
+            d.cpuFlags = flags;
+            d.blockx = b.blockx;
+            d.blocky = b.blocky;
+            d.blockx_half = b.blockx / 2;
+            d.blocky_half = b.blocky / 2;
+            d.blockx_shift = xshift;
+            d.blocky_shift = yshift;
+            d.diff = diff.data();
+            d.nt = b.nt;
+            d.ssd = ssd != 0;
+            d.metricF_needed = true;
+            d.metricF = &metricF;
+            d.scene = true;
+            CalcMetricsExtracted(src1, src2, d, nullptr, vsapi);
+          }, diffOutput);
+        }
+      }
+
+      bench.run("blurFrame", size, bits,
+        hbd ? PATH_C : PATH_C | PATH_SSE2, [&](const CPUFeatures *flags) {
+        blurFrame(src1, dst, 2, false, flags, nullptr, vsapi);
+      }, frameOutput(dst));
+
+      bench.run("dispatch_blend", size, bits,
+        hbd ? PATH_C | PATH_SSE41 | PATH_AVX2 : PATH_C | PATH_SSE2 | PATH_AVX2, [&](const CPUFeatures *flags) {
+        dispatch_blend(dp, p1, p2, width, height, pitch, pitch, pitch, 10000, bits, flags);
+      }, frameOutput(dst), hbd ? PATH_C : PATH_SSE2); // 8 bit C rounds, SIMD truncates like the old asm
+
+      bench.run("dispatch_blend_5050", size, bits,
+        PATH_C | PATH_SSE2 | PATH_AVX2, [&](const CPUFeatures *flags) {
+        dispatch_blend(dp, p1, p2, width, height, pitch, pitch, pitch, 32768 / 2, bits, flags);
+      }, frameOutput(dst));
+
+      // blend deinterlacing: every line but the first and last one
+      bench.run("blendDeintMask", size, bits,
+        hbd ? PATH_C | PATH_AVX2 : PATH_C | PATH_SSE2 | PATH_AVX2, [&](const CPUFeatures *flags) {
+        const uint8_t *s = p1 + pitch;
+        uint8_t *d = dp + pitch;
+        const uint8_t *m = mp + mpitch;
+        if (hbd && flags->avx2)
+          blendDeintMask_AVX2<uint16_t, true>((const uint16_t *)s, (uint16_t *)d, m, pitch / 2, pitch / 2, mpitch, width, height - 2);
+        else if (hbd)
+          blendDeintMask_C<uint16_t, true>((const uint16_t *)s, (uint16_t *)d, m, pitch / 2, pitch / 2, mpitch, width, height - 2);
+        else if (flags->avx2)
+          blendDeintMask_AVX2<uint8_t, true>(s, d, m, pitch, pitch, mpitch, width, height - 2);
+        else if (flags->sse2)
+          blendDeintMask_SSE2<true>(s, d, m, pitch, pitch, mpitch, width, height - 2);
+        else
+          blendDeintMask_C<uint8_t, true>(s, d, m, pitch, pitch, mpitch, width, height - 2);
+      }, frameOutput(dst));
+
+      // field deinterlacing: every other line of the frame is made from
+      // the lines of the other field
+      const int lines = height / 2 - 3;
+      bench.run("cubicDeintMask", size, bits,
+        hbd ? PATH_C | PATH_SSE41 | PATH_AVX2 : PATH_C | PATH_SSE2, [&](const CPUFeatures *flags) {
+        const uint8_t *s = p1 + pitch * 4;
+        uint8_t *d = dp + pitch * 4;
+        if (bits == 8 && flags->sse2)
+          cubicDeintMask_SSE2<true>(s, d, mp, pitch * 2, pitch * 2, mpitch * 2, width, lines);
+        else if (bits == 8)
+          cubicDeintMask_C<uint8_t, 8, true>(s, d, mp, pitch * 2, pitch * 2, mpitch * 2, width, lines);
+        else if (bits == 10 && flags->avx2)
+          cubicDeintMask_uint16_AVX2<10, true>((const uint16_t *)s, (uint16_t *)d, mp, pitch, pitch, mpitch * 2, width, lines);
+        else if (bits == 10 && flags->sse4_1)
+          cubicDeintMask_uint16_SSE4<10, true>((const uint16_t *)s, (uint16_t *)d, mp, pitch, pitch, mpitch * 2, width, lines);
+        else if (bits == 10)
+          cubicDeintMask_C<uint16_t, 10, true>((const uint16_t *)s, (uint16_t *)d, mp, pitch, pitch, mpitch * 2, width, lines);
+        else if (flags->avx2)
+          cubicDeintMask_uint16_AVX2<16, true>((const uint16_t *)s, (uint16_t *)d, mp, pitch, pitch, mpitch * 2, width, lines);
+        else if (flags->sse4_1)
+          cubicDeintMask_uint16_SSE4<16, true>((const uint16_t *)s, (uint16_t *)d, mp, pitch, pitch, mpitch * 2, width, lines);
+        else
+          cubicDeintMask_C<uint16_t, 16, true>((const uint16_t *)s, (uint16_t *)d, mp, pitch, pitch, mpitch * 2, width, lines);
+      }, frameOutput(dst));
+
+      bench.run("elaDeint", size, bits,
+        PATH_C | PATH_AVX2, [&](const CPUFeatures *flags) {
+        if (bits == 8)
+          elaDeintPlane<uint8_t, 8>(p1, dp, mp, pitch, mpitch, width, height, flags);
+        else if (bits == 10)
+          elaDeintPlane<uint16_t, 10>(p1, dp, mp, pitch, mpitch, width, height, flags);
+        else
+          elaDeintPlane<uint16_t, 16>(p1, dp, mp, pitch, mpitch, width, height, flags);
+      }, frameOutput(dst));
+
+      bench.run("maskClip2", size, bits,
+        hbd ? PATH_C | PATH_SSE41 | PATH_AVX2 : PATH_C | PATH_SSE2 | PATH_SSE41 | PATH_AVX2, [&](const CPUFeatures *flags) {
+        if (flags->avx2)
+        {
+          if (hbd)
+            maskClip2_AVX2<uint16_t>(p1, p2, mp, dp, pitch, pitch, mpitch, pitch, width, height);
+          else
+            maskClip2_AVX2<uint8_t>(p1, p2, mp, dp, pitch, pitch, mpitch, pitch, width, height);
+        }
+        else if (flags->sse4_1)
+        {
+          if (hbd)
+            maskClip2_SSE4<uint16_t>(p1, p2, mp, dp, pitch, pitch, mpitch, pitch, width, height);
+          else
+            maskClip2_SSE4<uint8_t>(p1, p2, mp, dp, pitch, pitch, mpitch, pitch, width, height);
+        }
+        else if (flags->sse2 && !hbd)
+          maskClip2_SSE2(p1, p2, mp, dp, pitch, pitch, mpitch, pitch, width, height);
+        else if (hbd)
+          maskClip2_C<uint16_t>(p1, p2, mp, dp, pitch, pitch, mpitch, pitch, width, height);
+        else
+          maskClip2_C<uint8_t>(p1, p2, mp, dp, pitch, pitch, mpitch, pitch, width, height);
+      }, frameOutput(dst));
+
+      fakeFreeFrame(src1);
+      fakeFreeFrame(src2);
+      fakeFreeFrame(dst);
+      fakeFreeFrame(mask);
+    }
+
+    // 4:2:0 chroma of 720x486 is 243 lines high: the last line of
+    // compareFields uses a map row the old Height>>1 map never had. The
+    // two fields of src1 are made equal everywhere else, so that row
+    // decides the result.
+    const Size odd = { "SD", 720, 486 };
+    VSFrameRef *src1 = fakeNewVideoFrame(&format, odd.width, odd.height, nullptr, nullptr);
+    VSFrameRef *src2 = fakeNewVideoFrame(&format, odd.width, odd.height, nullptr, nullptr);
+    fillFrame(src1, 1);
+    fillFrame(src2, 2);
+    const uint8_t *p1 = src1->data[1], *p2 = src2->data[1];
+    const int pitch = src1->stride[1], width = src1->width[1], height = src1->height[1];
+    for (int y = 0; y < height - 3; y += 2)
+      memcpy(src1->data[1] + (ptrdiff_t)pitch * (y + 1), src1->data[1] + (ptrdiff_t)pitch * y, pitch);
+    uint64_t fieldSums[4];
+    if (hbd)
+      compareFieldsMapPlane<uint16_t>(p1, p2, pitch, width, height, bits, fieldSums);
+    else
+      compareFieldsMapPlane<uint8_t>(p1, p2, pitch, width, height, bits, fieldSums);
+    const std::vector<uint8_t> expected(reinterpret_cast<uint8_t *>(fieldSums),
+      reinterpret_cast<uint8_t *>(fieldSums) + sizeof(fieldSums));
+    bench.verify("compareFields_chroma", odd, bits,
+      PATH_C | PATH_SSE41 | PATH_AVX2, [&](const CPUFeatures *flags) {
+      if (hbd)
+        compareFieldsPlane<uint16_t>(p1, p2, pitch, width, height, bits, flags, fieldSums);
+      else
+        compareFieldsPlane<uint8_t>(p1, p2, pitch, width, height, bits, flags, fieldSums);
+    }, bufferOutput(fieldSums, sizeof(fieldSums)), expected);
+    fakeFreeFrame(src1);
+    fakeFreeFrame(src2);
+  }
+  if (bench.mismatches)
+  {
+    printf("%d kernel(s) give different or wrong results\n", bench.mismatches);
+    return 1;
+  }
+  return 0;
+}
@@ -30,6 +30,7 @@
 //#include <windows.h> // OutputDebugString
 #include <algorithm>
 #include <cstring>
+#include <utility>
 #include "internal.h"
 
 void Cycle::setFrame(int frameIn)
@@ -441,6 +442,7 @@ Cycle::Cycle(int _size, int _sdlim)
   length = frame = frameE = cycleS = cycleE = offE = -20;
   frameSO = frameEO = maxFrame = dupCount = blend = -20;
   type = -1;
+  storage = nullptr;
   dupArray = lowest = match = decimate = decimate2 = filmd2v = nullptr;
   dect = dect2 = nullptr;
   diffMetricsU = diffMetricsUF = tArray = nullptr;
@@ -458,50 +460,34 @@ Cycle::Cycle(int _size, int _sdlim)
 
 Cycle::~Cycle()
 {
-  if (dupArray != nullptr) { free(dupArray); dupArray = nullptr; }
-  if (lowest != nullptr) { free(lowest); lowest = nullptr; }
-  if (match != nullptr) { free(match); match = nullptr; }
-  if (filmd2v != nullptr) { free(filmd2v); filmd2v = nullptr; }
-  if (decimate != nullptr) { free(decimate); decimate = nullptr; }
-  if (decimate2 != nullptr) { free(decimate2); decimate2 = nullptr; }
-  if (dect != nullptr) { free(dect); dect = nullptr; }
-  if (dect2 != nullptr) { free(dect2); dect2 = nullptr; }
-  if (diffMetricsU != nullptr) { free(diffMetricsU); diffMetricsU = nullptr; }
-  if (diffMetricsUF != nullptr) { free(diffMetricsUF); diffMetricsUF = nullptr; }
-  if (tArray != nullptr) { free(tArray); tArray = nullptr; }
-  if (diffMetricsN != nullptr) { free(diffMetricsN); diffMetricsN = nullptr; }
+  free(storage);
 }
 
+// All per-frame arrays live in one block: the 8 byte wide ones first, then the ints.
 bool Cycle::allocSpace()
 {
-  if (dupArray != nullptr) { free(dupArray); dupArray = nullptr; }
-  if (lowest != nullptr) { free(lowest); lowest = nullptr; }
-  if (match != nullptr) { free(match); match = nullptr; }
-  if (filmd2v != nullptr) { free(filmd2v); filmd2v = nullptr; }
-  if (decimate != nullptr) { free(decimate); decimate = nullptr; }
-  if (decimate2 != nullptr) { free(decimate2); decimate2 = nullptr; }
-  if (dect != nullptr) { free(dect); dect = nullptr; }
-  if (dect2 != nullptr) { free(dect2); dect2 = nullptr; }
-  if (diffMetricsU != nullptr) { free(diffMetricsU); diffMetricsU = nullptr; }
-  if (diffMetricsUF != nullptr) { free(diffMetricsUF); diffMetricsUF = nullptr; }
-  if (tArray != nullptr) { free(tArray); tArray = nullptr; }
-  if (diffMetricsN != nullptr) { free(diffMetricsN); diffMetricsN = nullptr; }
-  dupArray = (int *)malloc(cycleSize * sizeof(int));
-  lowest = (int *)malloc(cycleSize * sizeof(int));
-  match = (int *)malloc(cycleSize * sizeof(int));
-  filmd2v = (int *)malloc(cycleSize * sizeof(int));
-  decimate = (int *)malloc(cycleSize * sizeof(int));
-  decimate2 = (int *)malloc(cycleSize * sizeof(int));
-  dect = (int *)malloc(cycleSize * sizeof(int));
-  dect2 = (int *)malloc(cycleSize * sizeof(int));
-  diffMetricsU = (uint64_t *)malloc(cycleSize * sizeof(uint64_t));
-  diffMetricsUF = (uint64_t *)malloc(cycleSize * sizeof(uint64_t));
-  tArray = (uint64_t *)malloc(cycleSize * sizeof(uint64_t));
-  diffMetricsN = (double *)malloc(cycleSize * sizeof(double));
-  if (dupArray == nullptr || lowest == nullptr || match == nullptr || filmd2v == nullptr ||
-    decimate == nullptr || decimate2 == nullptr || diffMetricsU == nullptr ||
-    diffMetricsUF == nullptr || diffMetricsN == nullptr || tArray == nullptr ||
-    dect == nullptr || dect2 == nullptr) return false;
+  free(storage);
+  storage = (unsigned char *)malloc(std::max(cycleSize, 1) * (4 * sizeof(uint64_t) + 8 * sizeof(int)));
+  if (storage == nullptr)
+  {
+    dupArray = lowest = match = decimate = decimate2 = filmd2v = nullptr;
+    dect = dect2 = nullptr;
+    diffMetricsU = diffMetricsUF = tArray = nullptr;
+    diffMetricsN = nullptr;
+    return false;
+  }
+  diffMetricsN = (double *)storage;
+  diffMetricsU = (uint64_t *)(diffMetricsN + cycleSize);
+  diffMetricsUF = diffMetricsU + cycleSize;
+  tArray = diffMetricsUF + cycleSize;
+  dupArray = (int *)(tArray + cycleSize);
+  lowest = dupArray + cycleSize;
+  match = lowest + cycleSize;
+  filmd2v = match + cycleSize;
+  decimate = filmd2v + cycleSize;
+  decimate2 = decimate + cycleSize;
+  dect = decimate2 + cycleSize;
+  dect2 = dect + cycleSize;
   return true;
 }
 
@@ -517,35 +503,62 @@ void Cycle::setSize(int _size)
   }
 }
 
-Cycle& Cycle::operator=(Cycle& ob2)
+// Exchanges the contents of two cycles without copying the per-frame arrays.
+void Cycle::swap(Cycle &ob2)
+{
+  std::swap(cycleSize, ob2.cycleSize);
+  std::swap(storage, ob2.storage);
+  std::swap(sdlim, ob2.sdlim);
+  std::swap(length, ob2.length);
+  std::swap(maxFrame, ob2.maxFrame);
+  std::swap(frame, ob2.frame);
+  std::swap(frameE, ob2.frameE);
+  std::swap(offE, ob2.offE);
+  std::swap(cycleS, ob2.cycleS);
+  std::swap(cycleE, ob2.cycleE);
+  std::swap(frameSO, ob2.frameSO);
+  std::swap(frameEO, ob2.frameEO);
+  std::swap(type, ob2.type);
+  std::swap(diffMetricsN, ob2.diffMetricsN);
+  std::swap(diffMetricsU, ob2.diffMetricsU);
+  std::swap(diffMetricsUF, ob2.diffMetricsUF);
+  std::swap(tArray, ob2.tArray);
+  std::swap(dupArray, ob2.dupArray);
+  std::swap(lowest, ob2.lowest);
+  std::swap(decimate, ob2.decimate);
+  std::swap(decimate2, ob2.decimate2);
+  std::swap(match, ob2.match);
+  std::swap(filmd2v, ob2.filmd2v);
+  std::swap(dupsSet, ob2.dupsSet);
+  std::swap(mSet, ob2.mSet);
+  std::swap(lowSet, ob2.lowSet);
+  std::swap(decSet, ob2.decSet);
+  std::swap(isfilmd2v, ob2.isfilmd2v);
+  std::swap(dupCount, ob2.dupCount);
+  std::swap(blend, ob2.blend);
+  std::swap(dect, ob2.dect);
+  std::swap(dect2, ob2.dect2);
+}
+
+// Makes the next setFrame() start from a cleared cycle, whatever frame it asks for.
+void Cycle::invalidate()
+{
+  frame = INT_MIN;
+}
+
+// Shifts the contents one slot down (p <- c <- n) and recycles the storage of p as n.
+void Cycle::rotate(Cycle &p, Cycle &c, Cycle &n)
+{
+  p.swap(c);
+  c.swap(n);
+  n.invalidate();
+}
+
+// Same with a fourth, pre-buffered slot (p <- c <- n <- b); the storage of p becomes b.
+void Cycle::rotate(Cycle &p, Cycle &c, Cycle &n, Cycle &b)
 {
-  length = ob2.length;
-  maxFrame = ob2.maxFrame;
-  frame = ob2.frame;
-  frameE = ob2.frameE;
-  offE = ob2.offE;
-  cycleS = ob2.cycleS;
-  cycleE = ob2.cycleE;
-  frameSO = ob2.frameSO;
-  frameEO = ob2.frameEO;
-  type = ob2.type;
-  dupsSet = ob2.dupsSet;
-  mSet = ob2.mSet;
-  lowSet = ob2.lowSet;
-  decSet = ob2.decSet;
-  dupCount = ob2.dupCount;
-  blend = ob2.blend;
-  isfilmd2v = ob2.isfilmd2v;
-  cycleSize = std::min(cycleSize, ob2.cycleSize);
-  if (length > cycleSize) length = cycleSize;
-  memcpy(dupArray, ob2.dupArray, cycleSize * sizeof(int));
-  memcpy(lowest, ob2.lowest, cycleSize * sizeof(int));
-  memcpy(match, ob2.match, cycleSize * sizeof(int));
-  memcpy(filmd2v, ob2.filmd2v, cycleSize * sizeof(int));
-  memcpy(decimate, ob2.decimate, cycleSize * sizeof(int));
-  memcpy(decimate2, ob2.decimate2, cycleSize * sizeof(int));
-  memcpy(diffMetricsU, ob2.diffMetricsU, cycleSize * sizeof(uint64_t));
-  memcpy(diffMetricsUF, ob2.diffMetricsUF, cycleSize * sizeof(uint64_t));
-  memcpy(diffMetricsN, ob2.diffMetricsN, cycleSize * sizeof(double));
-  return *this;
+  p.swap(c);
+  c.swap(n);
+  n.swap(b);
+  b.invalidate();
 }
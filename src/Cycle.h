@@ -61,6 +61,7 @@ class Cycle
 {
 private:
   int cycleSize;
+  unsigned char *storage;	// single allocation holding all the per-frame arrays
   bool allocSpace();
   bool checkMatchDup(int mp, int mc);
 
@@ -112,7 +113,12 @@ public:
   Cycle(int _size, int _sdlim);
   void setSize(int _size);
   ~Cycle();
-  Cycle& operator=(Cycle& ob2);
+  Cycle(const Cycle &) = delete;
+  Cycle& operator=(const Cycle &) = delete;
+  void swap(Cycle &ob2);
+  void invalidate();
+  static void rotate(Cycle &p, Cycle &c, Cycle &n);
+  static void rotate(Cycle &p, Cycle &c, Cycle &n, Cycle &b);
 };
 
 #endif // CYCLE_H
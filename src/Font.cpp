@@ -0,0 +1,265 @@
+/*
+**                    TIVTC for AviSynth 2.6 interface
+**
+**   TIVTC includes a field matching filter (TFM) and a decimation
+**   filter (TDecimate) which can be used together to achieve an
+**   IVTC or for other uses. TIVTC currently supports 8 bit planar YUV and
+**   YUY2 colorspaces.
+**
+**   Copyright (C) 2004-2008 Kevin Stone, additional work (C) 2020 pinterf
+**
+**   This program is free software; you can redistribute it and/or modify
+**   it under the terms of the GNU General Public License as published by
+**   the Free Software Foundation; either version 2 of the License, or
+**   (at your option) any later version.
+**
+**   This program is distributed in the hope that it will be useful,
+**   but WITHOUT ANY WARRANTY; without even the implied warranty of
+**   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**   GNU General Public License for more details.
+**
+**   You should have received a copy of the GNU General Public License
+**   along with this program; if not, write to the Free Software
+**   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <algorithm>
+#include <vector>
+#include "Font.h"
+
+/*
+** 8x8 font of the IBM PC BIOS (public domain font8x8_basic), characters
+** 32 to 126. One byte per row, the lowest bit is the leftmost pixel.
+*/
+static const uint8_t font8x8[95][8] = {
+  { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // space
+  { 0x18, 0x3C, 0x3C, 0x18, 0x18, 0x00, 0x18, 0x00 }, // !
+  { 0x36, 0x36, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // "
+  { 0x36, 0x36, 0x7F, 0x36, 0x7F, 0x36, 0x36, 0x00 }, // #
+  { 0x0C, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x0C, 0x00 }, // $
+  { 0x00, 0x63, 0x33, 0x18, 0x0C, 0x66, 0x63, 0x00 }, // %
+  { 0x1C, 0x36, 0x1C, 0x6E, 0x3B, 0x33, 0x6E, 0x00 }, // &
+  { 0x06, 0x06, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '
+  { 0x18, 0x0C, 0x06, 0x06, 0x06, 0x0C, 0x18, 0x00 }, // (
+  { 0x06, 0x0C, 0x18, 0x18, 0x18, 0x0C, 0x06, 0x00 }, // )
+  { 0x00, 0x66, 0x3C, 0xFF, 0x3C, 0x66, 0x00, 0x00 }, // *
+  { 0x00, 0x0C, 0x0C, 0x3F, 0x0C, 0x0C, 0x00, 0x00 }, // +
+  { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x06 }, // ,
+  { 0x00, 0x00, 0x00, 0x3F, 0x00, 0x00, 0x00, 0x00 }, // -
+  { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x00 }, // .
+  { 0x60, 0x30, 0x18, 0x0C, 0x06, 0x03, 0x01, 0x00 }, // /
+  { 0x3E, 0x63, 0x73, 0x7B, 0x6F, 0x67, 0x3E, 0x00 }, // 0
+  { 0x0C, 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x3F, 0x00 }, // 1
+  { 0x1E, 0x33, 0x30, 0x1C, 0x06, 0x33, 0x3F, 0x00 }, // 2
+  { 0x1E, 0x33, 0x30, 0x1C, 0x30, 0x33, 0x1E, 0x00 }, // 3
+  { 0x38, 0x3C, 0x36, 0x33, 0x7F, 0x30, 0x78, 0x00 }, // 4
+  { 0x3F, 0x03, 0x1F, 0x30, 0x30, 0x33, 0x1E, 0x00 }, // 5
+  { 0x1C, 0x06, 0x03, 0x1F, 0x33, 0x33, 0x1E, 0x00 }, // 6
+  { 0x3F, 0x33, 0x30, 0x18, 0x0C, 0x0C, 0x0C, 0x00 }, // 7
+  { 0x1E, 0x33, 0x33, 0x1E, 0x33, 0x33, 0x1E, 0x00 }, // 8
+  { 0x1E, 0x33, 0x33, 0x3E, 0x30, 0x18, 0x0E, 0x00 }, // 9
+  { 0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x00 }, // :
+  { 0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x06 }, // ;
+  { 0x18, 0x0C, 0x06, 0x03, 0x06, 0x0C, 0x18, 0x00 }, // <
+  { 0x00, 0x00, 0x3F, 0x00, 0x00, 0x3F, 0x00, 0x00 }, // =
+  { 0x06, 0x0C, 0x18, 0x30, 0x18, 0x0C, 0x06, 0x00 }, // >
+  { 0x1E, 0x33, 0x30, 0x18, 0x0C, 0x00, 0x0C, 0x00 }, // ?
+  { 0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00 }, // @
+  { 0x0C, 0x1E, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x00 }, // A
+  { 0x3F, 0x66, 0x66, 0x3E, 0x66, 0x66, 0x3F, 0x00 }, // B
+  { 0x3C, 0x66, 0x03, 0x03, 0x03, 0x66, 0x3C, 0x00 }, // C
+  { 0x1F, 0x36, 0x66, 0x66, 0x66, 0x36, 0x1F, 0x00 }, // D
+  { 0x7F, 0x46, 0x16, 0x1E, 0x16, 0x46, 0x7F, 0x00 }, // E
+  { 0x7F, 0x46, 0x16, 0x1E, 0x16, 0x06, 0x0F, 0x00 }, // F
+  { 0x3C, 0x66, 0x03, 0x03, 0x73, 0x66, 0x7C, 0x00 }, // G
+  { 0x33, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x33, 0x00 }, // H
+  { 0x1E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // I
+  { 0x78, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E, 0x00 }, // J
+  { 0x67, 0x66, 0x36, 0x1E, 0x36, 0x66, 0x67, 0x00 }, // K
+  { 0x0F, 0x06, 0x06, 0x06, 0x46, 0x66, 0x7F, 0x00 }, // L
+  { 0x63, 0x77, 0x7F, 0x7F, 0x6B, 0x63, 0x63, 0x00 }, // M
+  { 0x63, 0x67, 0x6F, 0x7B, 0x73, 0x63, 0x63, 0x00 }, // N
+  { 0x1C, 0x36, 0x63, 0x63, 0x63, 0x36, 0x1C, 0x00 }, // O
+  { 0x3F, 0x66, 0x66, 0x3E, 0x06, 0x06, 0x0F, 0x00 }, // P
+  { 0x1E, 0x33, 0x33, 0x33, 0x3B, 0x1E, 0x38, 0x00 }, // Q
+  { 0x3F, 0x66, 0x66, 0x3E, 0x36, 0x66, 0x67, 0x00 }, // R
+  { 0x1E, 0x33, 0x07, 0x0E, 0x38, 0x33, 0x1E, 0x00 }, // S
+  { 0x3F, 0x2D, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // T
+  { 0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x3F, 0x00 }, // U
+  { 0x33, 0x33, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00 }, // V
+  { 0x63, 0x63, 0x63, 0x6B, 0x7F, 0x77, 0x63, 0x00 }, // W
+  { 0x63, 0x63, 0x36, 0x1C, 0x1C, 0x36, 0x63, 0x00 }, // X
+  { 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x0C, 0x1E, 0x00 }, // Y
+  { 0x7F, 0x63, 0x31, 0x18, 0x4C, 0x66, 0x7F, 0x00 }, // Z
+  { 0x1E, 0x06, 0x06, 0x06, 0x06, 0x06, 0x1E, 0x00 }, // [
+  { 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x40, 0x00 }, // backslash
+  { 0x1E, 0x18, 0x18, 0x18, 0x18, 0x18, 0x1E, 0x00 }, // ]
+  { 0x08, 0x1C, 0x36, 0x63, 0x00, 0x00, 0x00, 0x00 }, // ^
+  { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF }, // _
+  { 0x0C, 0x0C, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00 }, // `
+  { 0x00, 0x00, 0x1E, 0x30, 0x3E, 0x33, 0x6E, 0x00 }, // a
+  { 0x07, 0x06, 0x06, 0x3E, 0x66, 0x66, 0x3B, 0x00 }, // b
+  { 0x00, 0x00, 0x1E, 0x33, 0x03, 0x33, 0x1E, 0x00 }, // c
+  { 0x38, 0x30, 0x30, 0x3E, 0x33, 0x33, 0x6E, 0x00 }, // d
+  { 0x00, 0x00, 0x1E, 0x33, 0x3F, 0x03, 0x1E, 0x00 }, // e
+  { 0x1C, 0x36, 0x06, 0x0F, 0x06, 0x06, 0x0F, 0x00 }, // f
+  { 0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x1F }, // g
+  { 0x07, 0x06, 0x36, 0x6E, 0x66, 0x66, 0x67, 0x00 }, // h
+  { 0x0C, 0x00, 0x0E, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // i
+  { 0x30, 0x00, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E }, // j
+  { 0x07, 0x06, 0x66, 0x36, 0x1E, 0x36, 0x67, 0x00 }, // k
+  { 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // l
+  { 0x00, 0x00, 0x33, 0x7F, 0x7F, 0x6B, 0x63, 0x00 }, // m
+  { 0x00, 0x00, 0x1F, 0x33, 0x33, 0x33, 0x33, 0x00 }, // n
+  { 0x00, 0x00, 0x1E, 0x33, 0x33, 0x33, 0x1E, 0x00 }, // o
+  { 0x00, 0x00, 0x3B, 0x66, 0x66, 0x3E, 0x06, 0x0F }, // p
+  { 0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x78 }, // q
+  { 0x00, 0x00, 0x3B, 0x6E, 0x66, 0x06, 0x0F, 0x00 }, // r
+  { 0x00, 0x00, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x00 }, // s
+  { 0x08, 0x0C, 0x3E, 0x0C, 0x0C, 0x2C, 0x18, 0x00 }, // t
+  { 0x00, 0x00, 0x33, 0x33, 0x33, 0x33, 0x6E, 0x00 }, // u
+  { 0x00, 0x00, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00 }, // v
+  { 0x00, 0x00, 0x63, 0x6B, 0x7F, 0x7F, 0x36, 0x00 }, // w
+  { 0x00, 0x00, 0x63, 0x36, 0x1C, 0x36, 0x63, 0x00 }, // x
+  { 0x00, 0x00, 0x33, 0x33, 0x33, 0x3E, 0x30, 0x1F }, // y
+  { 0x00, 0x00, 0x3F, 0x19, 0x0C, 0x26, 0x3F, 0x00 }, // z
+  { 0x38, 0x0C, 0x0C, 0x07, 0x0C, 0x0C, 0x38, 0x00 }, // {
+  { 0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x18, 0x00 }, // |
+  { 0x07, 0x0C, 0x0C, 0x38, 0x0C, 0x0C, 0x07, 0x00 }, // }
+  { 0x6E, 0x3B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // ~
+};
+
+static const int glyphWidth = 8;
+static const int lineHeight = 10; // one empty row above and below the glyph
+
+struct PlaneColors {
+  int fg, bg;
+};
+
+template<typename pixel_t>
+static void drawTextPlane(uint8_t *dstp8, int pitch, int width, int height, int ssw, int ssh,
+  const std::vector<std::string> &lines, int scale, PlaneColors col, bool glyphs)
+{
+  const int cellw = glyphWidth * scale, cellh = lineHeight * scale;
+  for (int l = 0; l < (int)lines.size(); ++l)
+  {
+    const int y0 = (l * cellh) >> ssh, y1 = std::min(((l + 1) * cellh) >> ssh, height);
+    const int x1 = std::min(((int)lines[l].size() * cellw) >> ssw, width);
+    for (int y = y0; y < y1; ++y)
+    {
+      pixel_t *dstp = reinterpret_cast<pixel_t *>(dstp8 + (ptrdiff_t)pitch * y);
+      const int r = ((y << ssh) - l * cellh) / scale - 1; // glyph row
+      for (int x = 0; x < x1; ++x)
+      {
+        int v = col.bg;
+        if (glyphs && r >= 0 && r < 8)
+        {
+          const int xs = x << ssw;
+          const unsigned char c = lines[l][xs / cellw];
+          const int bit = (xs % cellw) / scale;
+          if (c >= 32 && c < 127 && ((font8x8[c - 32][r] >> bit) & 1))
+            v = col.fg;
+        }
+        dstp[x] = (pixel_t)v;
+      }
+    }
+  }
+}
+
+static void getColors(const VSFormat *format, int plane, PlaneColors &col, bool &glyphs)
+{
+  const int shift = format->bitsPerSample - 8;
+  if (format->colorFamily == cmRGB)
+  {
+    col.fg = (1 << format->bitsPerSample) - 1;
+    col.bg = 0;
+    glyphs = true;
+  }
+  else if (plane == 0)
+  {
+    col.fg = 235 << shift;
+    col.bg = 16 << shift;
+    glyphs = true;
+  }
+  else
+  {
+    // neutral chroma behind the text
+    col.fg = col.bg = 128 << shift;
+    glyphs = false;
+  }
+}
+
+void drawDisplayText(VSFrameRef *dst, const std::string &text, const VSAPI *vsapi)
+{
+  const VSFormat *format = vsapi->getFrameFormat(dst);
+  if (format->sampleType != stInteger || format->bitsPerSample > 16)
+    return;
+  const int width = vsapi->getFrameWidth(dst, 0);
+  const int height = vsapi->getFrameHeight(dst, 0);
+  const int scale = std::max(1, width / 960);
+  const int columns = std::max(1, width / (glyphWidth * scale));
+
+  // split into lines, wrap the ones that don't fit
+  std::vector<std::string> lines;
+  size_t start = 0;
+  while (start <= text.size())
+  {
+    size_t end = text.find('\n', start);
+    if (end == std::string::npos)
+      end = text.size();
+    std::string line = text.substr(start, end - start);
+    do {
+      lines.push_back(line.substr(0, columns));
+      line.erase(0, std::min(line.size(), (size_t)columns));
+    } while (!line.empty());
+    start = end + 1;
+  }
+  while (!lines.empty() && lines.back().empty())
+    lines.pop_back();
+  lines.resize(std::min((int)lines.size(), height / (lineHeight * scale)));
+
+  for (int plane = 0; plane < format->numPlanes; ++plane)
+  {
+    PlaneColors col;
+    bool glyphs;
+    getColors(format, plane, col, glyphs);
+    const int ssw = plane && format->colorFamily != cmRGB ? format->subSamplingW : 0;
+    const int ssh = plane && format->colorFamily != cmRGB ? format->subSamplingH : 0;
+    uint8_t *dstp = vsapi->getWritePtr(dst, plane);
+    const int pitch = vsapi->getStride(dst, plane);
+    const int pwidth = vsapi->getFrameWidth(dst, plane);
+    const int pheight = vsapi->getFrameHeight(dst, plane);
+    if (format->bytesPerSample == 1)
+      drawTextPlane<uint8_t>(dstp, pitch, pwidth, pheight, ssw, ssh, lines, scale, col, glyphs);
+    else
+      drawTextPlane<uint16_t>(dstp, pitch, pwidth, pheight, ssw, ssh, lines, scale, col, glyphs);
+  }
+}
+
+void clearFrame(VSFrameRef *dst, const VSAPI *vsapi)
+{
+  const VSFormat *format = vsapi->getFrameFormat(dst);
+  for (int plane = 0; plane < format->numPlanes; ++plane)
+  {
+    uint8_t *dstp = vsapi->getWritePtr(dst, plane);
+    const int pitch = vsapi->getStride(dst, plane);
+    const int width = vsapi->getFrameWidth(dst, plane);
+    const int height = vsapi->getFrameHeight(dst, plane);
+    if (format->sampleType == stFloat)
+    {
+      for (int y = 0; y < height; ++y)
+        std::fill_n(reinterpret_cast<float *>(dstp + (ptrdiff_t)pitch * y), width, 0.0f);
+      continue;
+    }
+    PlaneColors col;
+    bool glyphs;
+    getColors(format, plane, col, glyphs);
+    for (int y = 0; y < height; ++y)
+    {
+      if (format->bytesPerSample == 1)
+        std::fill_n(dstp + (ptrdiff_t)pitch * y, width, (uint8_t)col.bg);
+      else
+        std::fill_n(reinterpret_cast<uint16_t *>(dstp + (ptrdiff_t)pitch * y), width, (uint16_t)col.bg);
+    }
+  }
+}
@@ -0,0 +1,40 @@
+/*
+**                    TIVTC for AviSynth 2.6 interface
+**
+**   TIVTC includes a field matching filter (TFM) and a decimation
+**   filter (TDecimate) which can be used together to achieve an
+**   IVTC or for other uses. TIVTC currently supports 8 bit planar YUV and
+**   YUY2 colorspaces.
+**
+**   Copyright (C) 2004-2008 Kevin Stone, additional work (C) 2020 pinterf
+**
+**   This program is free software; you can redistribute it and/or modify
+**   it under the terms of the GNU General Public License as published by
+**   the Free Software Foundation; either version 2 of the License, or
+**   (at your option) any later version.
+**
+**   This program is distributed in the hope that it will be useful,
+**   but WITHOUT ANY WARRANTY; without even the implied warranty of
+**   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**   GNU General Public License for more details.
+**
+**   You should have received a copy of the GNU General Public License
+**   along with this program; if not, write to the Free Software
+**   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef FONT_H
+#define FONT_H
+
+#include <string>
+#include <VapourSynth.h>
+
+// Draws the text (lines separated by '\n', long lines wrapped) into the top
+// left corner of the frame, white on black. Replaces running text.Text on
+// the display frame property. Integer formats of 8 to 16 bits.
+void drawDisplayText(VSFrameRef *dst, const std::string &text, const VSAPI *vsapi);
+
+// Fills the frame with black.
+void clearFrame(VSFrameRef *dst, const VSAPI *vsapi);
+
+#endif // FONT_H
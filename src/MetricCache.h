@@ -0,0 +1,104 @@
+/*
+**                    TIVTC for AviSynth 2.6 interface
+**
+**   TIVTC includes a field matching filter (TFM) and a decimation
+**   filter (TDecimate) which can be used together to achieve an
+**   IVTC or for other uses. TIVTC currently supports 8 bit planar YUV and
+**   YUY2 colorspaces.
+**
+**   Copyright (C) 2004-2008 Kevin Stone, additional work (C) 2020 pinterf
+**
+**   This program is free software; you can redistribute it and/or modify
+**   it under the terms of the GNU General Public License as published by
+**   the Free Software Foundation; either version 2 of the License, or
+**   (at your option) any later version.
+**
+**   This program is distributed in the hope that it will be useful,
+**   but WITHOUT ANY WARRANTY; without even the implied warranty of
+**   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**   GNU General Public License for more details.
+**
+**   You should have received a copy of the GNU General Public License
+**   along with this program; if not, write to the Free Software
+**   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef METRICCACHE_H
+#define METRICCACHE_H
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+// Metrics of the frame pair (n-1,n), as returned by TDecimate::calcMetric.
+struct MetricCacheEntry
+{
+  int n = -1;
+  bool scene = false; // metricF was computed
+  uint64_t metricU = 0;
+  uint64_t metricF = 0;
+  int blockN = 0;
+  int xblocks = 0;
+};
+
+/*
+** Remembers the metrics of recently scored frames, so seeking back and forth
+** does not compute the same pair again.
+**
+** Direct mapped by frame number: frame n can only live in slot n % size, and
+** a newer frame simply replaces the one in its slot. The cache never holds
+** more than size entries.
+*/
+
+class MetricCache
+{
+private:
+  std::mutex lock;
+  std::vector<MetricCacheEntry> entries;
+  std::atomic<uint64_t> hits{ 0 };
+  std::atomic<uint64_t> misses{ 0 };
+
+public:
+  explicit MetricCache(int size) : entries(size) {}
+
+  // An entry without metricF does not satisfy a lookup that needs it.
+  bool lookup(int n, bool scene, MetricCacheEntry &out)
+  {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      const MetricCacheEntry &e = entries[n % entries.size()];
+      if (e.n == n && (e.scene || !scene))
+      {
+        out = e;
+        ++hits;
+        return true;
+      }
+    }
+    ++misses;
+    return false;
+  }
+
+  // Like lookup, but does not count as a hit or miss. For deciding which
+  // frames to request.
+  bool contains(int n, bool scene)
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    const MetricCacheEntry &e = entries[n % entries.size()];
+    return e.n == n && (e.scene || !scene);
+  }
+
+  void store(const MetricCacheEntry &e)
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    MetricCacheEntry &slot = entries[e.n % entries.size()];
+    if (slot.n == e.n && slot.scene && !e.scene)
+      return;
+    slot = e;
+  }
+
+  uint64_t getHits() const { return hits; }
+  uint64_t getMisses() const { return misses; }
+};
+
+#endif // METRICCACHE_H
@@ -0,0 +1,236 @@
+/*
+**                    TIVTC for AviSynth 2.6 interface
+**
+**   TIVTC includes a field matching filter (TFM) and a decimation
+**   filter (TDecimate) which can be used together to achieve an
+**   IVTC or for other uses. TIVTC currently supports 8 bit planar YUV and
+**   YUY2 colorspaces.
+**
+**   Copyright (C) 2004-2008 Kevin Stone, additional work (C) 2020 pinterf
+**
+**   This program is free software; you can redistribute it and/or modify
+**   it under the terms of the GNU General Public License as published by
+**   the Free Software Foundation; either version 2 of the License, or
+**   (at your option) any later version.
+**
+**   This program is distributed in the hope that it will be useful,
+**   but WITHOUT ANY WARRANTY; without even the implied warranty of
+**   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**   GNU General Public License for more details.
+**
+**   You should have received a copy of the GNU General Public License
+**   along with this program; if not, write to the Free Software
+**   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "MetricsFile.h"
+#include "internal.h"
+
+#ifdef _WIN32
+#include <string>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read only mapping of a whole file.
+class MappedFile
+{
+private:
+  const uint8_t *ptr = nullptr;
+  size_t length = 0;
+#ifdef _WIN32
+  HANDLE mapping = nullptr;
+#endif
+
+public:
+  explicit MappedFile(const char *name)
+  {
+#ifdef _WIN32
+    int len = MultiByteToWideChar(CP_UTF8, 0, name, -1, nullptr, 0);
+    std::wstring wname(len, 0);
+    if (MultiByteToWideChar(CP_UTF8, 0, name, -1, wname.data(), len) != len)
+      return;
+    HANDLE f = CreateFileW(wname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (f == INVALID_HANDLE_VALUE)
+      return;
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(f, &size) && size.QuadPart > 0)
+    {
+      mapping = CreateFileMappingW(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      if (mapping)
+      {
+        ptr = (const uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        length = ptr ? (size_t)size.QuadPart : 0;
+      }
+    }
+    CloseHandle(f);
+#else
+    int fd = open(name, O_RDONLY);
+    if (fd < 0)
+      return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+      void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED)
+      {
+        ptr = (const uint8_t *)p;
+        length = st.st_size;
+      }
+    }
+    close(fd);
+#endif
+  }
+
+  ~MappedFile()
+  {
+#ifdef _WIN32
+    if (ptr)
+      UnmapViewOfFile(ptr);
+    if (mapping)
+      CloseHandle(mapping);
+#else
+    if (ptr)
+      munmap((void *)ptr, length);
+#endif
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const uint8_t *data() const { return ptr; }
+  size_t size() const { return length; }
+};
+
+
+bool isBinaryMetricsFile(const char *name)
+{
+  FILE *f = tivtc_fopen(name, "rb");
+  if (!f)
+    return false;
+  char magic[8];
+  bool ret = fread(magic, 1, sizeof(magic), f) == sizeof(magic) && memcmp(magic, METRICSFILE_MAGIC, sizeof(magic)) == 0;
+  fclose(f);
+  return ret;
+}
+
+
+bool writeBinaryMetricsFile(const char *name, uint32_t crc, int blockx, int blocky, bool chroma,
+  const std::vector<uint64_t> &metrics)
+{
+  FILE *f = tivtc_fopen(name, "wb");
+  if (!f)
+    return false;
+
+  MetricsFileHeader header;
+  memcpy(header.magic, METRICSFILE_MAGIC, sizeof(header.magic));
+  header.crc = crc;
+  header.blockx = blockx;
+  header.blocky = blocky;
+  header.chroma = chroma;
+  header.numFrames = (int32_t)(metrics.size() / 2);
+  header.missing = 0;
+  for (size_t h = 0; h < metrics.size(); h += 2)
+  {
+    if (metrics[h] == UINT64_MAX)
+      ++header.missing;
+  }
+
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+    fwrite(metrics.data(), sizeof(uint64_t), metrics.size(), f) == metrics.size();
+  ok = fclose(f) == 0 && ok;
+  return ok;
+}
+
+
+bool readPlanFile(const char *name, uint64_t key, int numFrames, std::vector<int> &plan)
+{
+  FILE *f = tivtc_fopen(name, "rb");
+  if (!f)
+    return false;
+
+  PlanFileHeader header;
+  bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+    memcmp(header.magic, PLANFILE_MAGIC, sizeof(header.magic)) == 0 &&
+    header.key == key && header.numFrames == numFrames && header.count == (int32_t)plan.size();
+  if (ok)
+  {
+    std::vector<int32_t> frames(plan.size());
+    ok = fread(frames.data(), sizeof(int32_t), frames.size(), f) == frames.size();
+    for (size_t i = 0; ok && i < frames.size(); ++i)
+      ok = frames[i] >= 0 && frames[i] < numFrames;
+    if (ok)
+      plan.assign(frames.begin(), frames.end());
+  }
+  fclose(f);
+  return ok;
+}
+
+
+bool writePlanFile(const char *name, uint64_t key, int numFrames, const std::vector<int> &plan)
+{
+  FILE *f = tivtc_fopen(name, "wb");
+  if (!f)
+    return false;
+
+  PlanFileHeader header;
+  memcpy(header.magic, PLANFILE_MAGIC, sizeof(header.magic));
+  header.key = key;
+  header.numFrames = numFrames;
+  header.count = (int32_t)plan.size();
+
+  std::vector<int32_t> frames(plan.begin(), plan.end());
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+    fwrite(frames.data(), sizeof(int32_t), frames.size(), f) == frames.size();
+  ok = fclose(f) == 0 && ok;
+  return ok;
+}
+
+void MetricsArray::resize(size_t n)
+{
+  file.reset();
+  mapped = nullptr;
+  mappedCount = count = 0;
+  values.resize(n);
+}
+
+
+void MetricsArray::mapBinary(const char *name, int numFrames, uint64_t unsetValue, MetricsFileHeader &header)
+{
+  auto f = std::make_shared<MappedFile>(name);
+  if (!f->data())
+    throw TIVTCError("TDecimate:  input error (cannot open input file)!");
+  if (f->size() < sizeof(header))
+    throw TIVTCError("TDecimate:  input error (truncated binary metrics file)!");
+  memcpy(&header, f->data(), sizeof(header));
+  if (memcmp(header.magic, METRICSFILE_MAGIC, sizeof(header.magic)) != 0)
+    throw TIVTCError("TDecimate:  input error (not a binary metrics file)!");
+  if (header.numFrames < 0 || header.numFrames > numFrames)
+    throw TIVTCError("TDecimate:  input error (out of range frame #)!");
+  if (f->size() < sizeof(header) + (size_t)header.numFrames * 2 * sizeof(uint64_t))
+    throw TIVTCError("TDecimate:  input error (truncated binary metrics file)!");
+
+  const uint64_t *records = reinterpret_cast<const uint64_t *>(f->data() + sizeof(header));
+  // modes 0/1 and 2 skip computing metrics when nothing is missing, so the
+  // count must agree with the records
+  int missing = 0;
+  for (int n = 0; n < header.numFrames; ++n)
+  {
+    if (records[n * 2] == UINT64_MAX)
+      ++missing;
+  }
+  if (missing != header.missing)
+    throw TIVTCError("TDecimate:  input error (corrupt binary metrics file)!");
+
+  values.clear();
+  file = f;
+  mapped = records;
+  mappedCount = (size_t)header.numFrames * 2;
+  count = (size_t)numFrames * 2;
+  unset = unsetValue;
+  // frames beyond the ones in the file are missing
+  header.missing += numFrames - header.numFrames;
+}
@@ -0,0 +1,124 @@
+/*
+**                    TIVTC for AviSynth 2.6 interface
+**
+**   TIVTC includes a field matching filter (TFM) and a decimation
+**   filter (TDecimate) which can be used together to achieve an
+**   IVTC or for other uses. TIVTC currently supports 8 bit planar YUV and
+**   YUY2 colorspaces.
+**
+**   Copyright (C) 2004-2008 Kevin Stone, additional work (C) 2020 pinterf
+**
+**   This program is free software; you can redistribute it and/or modify
+**   it under the terms of the GNU General Public License as published by
+**   the Free Software Foundation; either version 2 of the License, or
+**   (at your option) any later version.
+**
+**   This program is distributed in the hope that it will be useful,
+**   but WITHOUT ANY WARRANTY; without even the implied warranty of
+**   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**   GNU General Public License for more details.
+**
+**   You should have received a copy of the GNU General Public License
+**   along with this program; if not, write to the Free Software
+**   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef METRICSFILE_H
+#define METRICSFILE_H
+
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+/*
+** Binary metrics file of TDecimate, an alternative to the text format of
+** the input/output parameters. Recognized by the magic at the start:
+**
+**   MetricsFileHeader
+**   numFrames records of { uint64_t metricU, uint64_t metricF }
+**
+** Values are native (little) endian, UINT64_MAX marks a missing value just
+** like the text file leaving a frame out. The records are at fixed offsets,
+** so the file is memory mapped and read on demand instead of parsed.
+*/
+
+#define METRICSFILE_MAGIC "TDecMet1"
+
+struct MetricsFileHeader {
+  char magic[8];
+  uint32_t crc;        // crc32 of the clip, as in the text format
+  int32_t blockx;
+  int32_t blocky;
+  int32_t chroma;
+  int32_t numFrames;
+  int32_t missing;     // number of frames without metricU
+};
+
+class MappedFile;
+
+// Returns true if the file starts with METRICSFILE_MAGIC.
+bool isBinaryMetricsFile(const char *name);
+
+// Writes metrics (metricU, metricF pairs per frame) in the binary format.
+// Returns false if the file could not be written completely.
+bool writeBinaryMetricsFile(const char *name, uint32_t crc, int blockx, int blocky, bool chroma,
+  const std::vector<uint64_t> &metrics);
+
+/*
+** Mode 2 plan file: the input frame shown at every output frame, as worked
+** out by buildDecStrategy from a complete set of metrics.
+**
+**   PlanFileHeader
+**   count int32_t input frame numbers
+**
+** key identifies the inputs of the plan (metrics, overrides, rates); a file
+** whose key or frame counts don't match is ignored and rewritten.
+*/
+
+#define PLANFILE_MAGIC "TDecPln1"
+
+struct PlanFileHeader {
+  char magic[8];
+  uint64_t key;
+  int32_t numFrames;   // input frames
+  int32_t count;       // output frames
+};
+
+// Returns true and fills plan if the file holds a plan for key, numFrames
+// and plan.size() output frames.
+bool readPlanFile(const char *name, uint64_t key, int numFrames, std::vector<int> &plan);
+
+bool writePlanFile(const char *name, uint64_t key, int numFrames, const std::vector<int> &plan);
+
+// TDecimate's per-frame metric pairs: index 2*n is metricU, 2*n+1 is metricF.
+// Either an ordinary array or a view of a mapped binary metrics file.
+class MetricsArray
+{
+private:
+  std::vector<uint64_t> values;
+  std::shared_ptr<MappedFile> file;
+  const uint64_t *mapped = nullptr;
+  size_t mappedCount = 0;
+  size_t count = 0;
+  uint64_t unset = UINT64_MAX;
+
+public:
+  uint64_t operator[](size_t i) const
+  {
+    if (!file)
+      return values[i];
+    const uint64_t v = i < mappedCount ? mapped[i] : UINT64_MAX;
+    return v == UINT64_MAX ? unset : v;
+  }
+
+  size_t size() const { return file ? count : values.size(); }
+  bool empty() const { return size() == 0; }
+  void resize(size_t n);
+  void set(size_t i, uint64_t v) { values[i] = v; }
+
+  // Maps a binary metrics file for a clip of numFrames frames. Missing
+  // values read as unsetValue. Throws TIVTCError if the file is invalid.
+  void mapBinary(const char *name, int numFrames, uint64_t unsetValue, MetricsFileHeader &header);
+};
+
+#endif // METRICSFILE_H
@@ -97,44 +97,6 @@ static void VS_CC tfmppFree(void *instanceData, VSCore *core, const VSAPI *vsapi
 }
 
 
-enum DisplayFilters {
-    DisplayTFM,
-    DisplayTDecimate
-};
-
-template <DisplayFilters filter>
-static void VS_CC tivtcDisplayFunc(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
-    VSNodeRef *clip = (VSNodeRef *)userData;
-
-    const char *display_prop = filter == DisplayTFM ? PROP_TFMDisplay : PROP_TDecimateDisplay;
-
-    const VSFrameRef *f = vsapi->propGetFrame(in, "f", 0, nullptr);
-    const VSMap *props = vsapi->getFramePropsRO(f);
-    const char *text = vsapi->propGetData(props, display_prop, 0, nullptr);
-    int text_size = vsapi->propGetDataSize(props, display_prop, 0, nullptr);
-
-    VSMap *params = vsapi->createMap();
-    vsapi->propSetNode(params, "clip", clip, paReplace); // clip is freed by vapoursynth somewhere. We don't free it here.
-    vsapi->propSetData(params, "text", text, text_size, paReplace);
-    vsapi->freeFrame(f);
-
-    VSPlugin *text_plugin = vsapi->getPluginById("com.vapoursynth.text", core);
-    VSMap *ret = vsapi->invoke(text_plugin, "Text", params);
-    vsapi->freeMap(params);
-    if (vsapi->getError(ret)) {
-        char error[512] = { 0 };
-        snprintf(error, 512, "%s: failed to invoke text.Text: %s", filter == DisplayTFM ? "TFM" : "TDecimate", vsapi->getError(ret));
-        vsapi->freeMap(ret);
-        vsapi->setError(out, error);
-        return;
-    }
-    clip = vsapi->propGetNode(ret, "clip", 0, nullptr);
-    vsapi->freeMap(ret);
-    vsapi->propSetNode(out, "val", clip, paReplace);
-    vsapi->freeNode(clip);
-}
-
-
 static void VS_CC tfmCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
     (void)userData;
 
@@ -272,6 +234,10 @@ static void VS_CC tfmCreate(const VSMap *in, VSMap *out, void *userData, VSCore
     if (err)
         mmsco = true;
 
+    bool micexit = !!vsapi->propGetInt(in, "micexit", 0, &err);
+    if (err)
+        micexit = false;
+
     int opt = int64ToIntS(vsapi->propGetInt(in, "opt", 0, &err));
     if (err)
         opt = 4;
@@ -284,7 +250,7 @@ static void VS_CC tfmCreate(const VSMap *in, VSMap *out, void *userData, VSCore
     try {
         tfm_data = new TFM(clip, order, field, mode, PP, ovr, input, output, outputC, debug, display, slow, mChroma, cNum, cthresh,
                        MI, chroma, blockx, blocky, y0, y1, d2v, ovrDefault, flags, scthresh, micout, micmatching, trimIn, hint,
-                       metric, batch, ubsco, mmsco, opt, vsapi, core);
+                       metric, batch, ubsco, mmsco, micexit, opt, vsapi, core);
     } catch (const TIVTCError& e) {
         vsapi->setError(out, e.what());
 
@@ -293,9 +259,12 @@ static void VS_CC tfmCreate(const VSMap *in, VSMap *out, void *userData, VSCore
         return;
     }
 
-    int filter_mode = fmParallelRequests; /// It's possible fmParallel could be used in some situations. Study the matter.
+    // All the state GetFrame modifies is local to the request, except the
+    // previous frame's match and the mode 7 field, which only some settings
+    // look at.
+    int filter_mode = tfm_data->needsPreviousMatch() ? fmParallelRequests : fmParallel;
     int filter_flags = 0;
-    if (mode == 7) {
+    if (tfm_data->needsLinearAccess()) {
         // mode 7 requires linear access to function correctly.
         filter_mode = fmSerial;
         filter_flags = nfMakeLinear;
@@ -335,7 +304,7 @@ static void VS_CC tfmCreate(const VSMap *in, VSMap *out, void *userData, VSCore
         TFMPP *tfmpp_data;
 
         try {
-            tfmpp_data = new TFMPP(node, PP, mthresh, ovr, display, clip2, hint, opt, vsapi, core);
+            tfmpp_data = new TFMPP(node, PP, mthresh, ovr, display, clip2, hint, opt, debug, vsapi);
         } catch (const TIVTCError& e) {
             vsapi->setError(out, e.what());
 
@@ -348,34 +317,7 @@ static void VS_CC tfmCreate(const VSMap *in, VSMap *out, void *userData, VSCore
         // createFilter uses paAppend when adding the node to the "out" map, so clear the existing node first.
         vsapi->propDeleteKey(out, "clip");
 
-        vsapi->createFilter(in, out, "TFMPP", tfmppInit, tfmppGetFrame, tfmppFree, fmParallelRequests, 0, tfmpp_data, core);
-    }
-
-    if (display) {
-        // text.FrameProps won't print the TFMDisplay property because it is too long,
-        // so we use text.Text with std.FrameEval instead.
-        VSMap *params = vsapi->createMap();
-        VSNodeRef *node = vsapi->propGetNode(out, "clip", 0, nullptr);
-        vsapi->propSetNode(params, "clip", node, paReplace);
-        vsapi->propSetNode(params, "prop_src", node, paReplace);
-        VSFuncRef *displayFuncRef = vsapi->createFunc(tivtcDisplayFunc<DisplayTFM>, vsapi->cloneNodeRef(node), (VSFreeFuncData)vsapi->freeNode, core, vsapi);
-        vsapi->freeNode(node);
-        vsapi->propSetFunc(params, "eval", displayFuncRef, paReplace);
-        vsapi->freeFunc(displayFuncRef);
-        VSPlugin *std_plugin = vsapi->getPluginById("com.vapoursynth.std", core);
-        VSMap *ret = vsapi->invoke(std_plugin, "FrameEval", params);
-        vsapi->freeMap(params);
-        if (vsapi->getError(ret)) {
-            char error[512] = { 0 };
-            snprintf(error, 512, "TFM: failed to invoke std.FrameEval: %s", vsapi->getError(ret));
-            vsapi->freeMap(ret);
-            vsapi->setError(out, error);
-            return;
-        }
-        node = vsapi->propGetNode(ret, "clip", 0, nullptr);
-        vsapi->freeMap(ret);
-        vsapi->propSetNode(out, "clip", node, paReplace);
-        vsapi->freeNode(node);
+        vsapi->createFilter(in, out, "TFMPP", tfmppInit, tfmppGetFrame, tfmppFree, fmParallel, 0, tfmpp_data, core);
     }
 }
 
@@ -410,6 +352,35 @@ static void VS_CC tdecimateFree(void *instanceData, VSCore *core, const VSAPI *v
 }
 
 
+static void VS_CC tdecimateMetricsInit(VSMap *in, VSMap *out, void **instanceData, VSNode *node, VSCore *core, const VSAPI *vsapi) {
+    (void)in;
+    (void)out;
+    (void)core;
+
+    TDecimate *d = (TDecimate *) *instanceData;
+
+    vsapi->setVideoInfo(&d->viMetrics, 1, node);
+}
+
+
+static const VSFrameRef *VS_CC tdecimateMetricsGetFrame(int n, int activationReason, void **instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    (void)frameData;
+    (void)vsapi;
+
+    TDecimate *d = (TDecimate *) *instanceData;
+
+    return d->GetFrameMetrics(n, activationReason, frameCtx, core);
+}
+
+
+// The metrics node only borrows the TDecimate instance, which frees the node.
+static void VS_CC tdecimateMetricsFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
+    (void)instanceData;
+    (void)core;
+    (void)vsapi;
+}
+
+
 static void VS_CC tdecimateCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
     (void)userData;
 
@@ -573,11 +544,17 @@ static void VS_CC tdecimateCreate(const VSMap *in, VSMap *out, void *userData, V
     if (err)
         orgOut = "";
 
+    bool binaryOut = !!vsapi->propGetInt(in, "binaryOut", 0, &err);
+
+    const char *m2Plan = vsapi->propGetData(in, "m2Plan", 0, &err);
+    if (err)
+        m2Plan = "";
+
 
     TDecimate *tdecimate_data;
 
     try {
-        tdecimate_data = new TDecimate(clip, mode, cycleR, cycle, rate, dupThresh, vidThresh, sceneThresh, hybrid, vidDetect, conCycle, conCycleTP, ovr, output, input, tfmIn, mkvOut, nt, blockx, blocky, debug, display, vfrDec, batch, tcfv1, se, chroma, exPP, maxndl, m2PA, denoise, noblend, ssd, hint, clip2, sdlim, opt, orgOut, vsapi, core);
+        tdecimate_data = new TDecimate(clip, mode, cycleR, cycle, rate, dupThresh, vidThresh, sceneThresh, hybrid, vidDetect, conCycle, conCycleTP, ovr, output, input, tfmIn, mkvOut, nt, blockx, blocky, debug, display, vfrDec, batch, tcfv1, se, chroma, exPP, maxndl, m2PA, denoise, noblend, ssd, hint, clip2, sdlim, opt, orgOut, binaryOut, m2Plan, vsapi, core);
     } catch (const TIVTCError& e) {
         vsapi->setError(out, e.what());
 
@@ -608,38 +585,18 @@ static void VS_CC tdecimateCreate(const VSMap *in, VSMap *out, void *userData, V
         0
     };
 
-    vsapi->createFilter(in, out, "TDecimate", tdecimateInit, tdecimateGetFrame, tdecimateFree, filter_modes[mode], filter_flags[mode], tdecimate_data, core);
-
-    if (vsapi->getError(out))
-        return;
-
-
-    if (display) {
-        // text.FrameProps won't print the TDecimateDisplay property because it is too long,
-        // so we use text.Text with std.FrameEval instead.
-        VSMap *params = vsapi->createMap();
-        VSNodeRef *node = vsapi->propGetNode(out, "clip", 0, nullptr);
-        vsapi->propSetNode(params, "clip", node, paReplace);
-        vsapi->propSetNode(params, "prop_src", node, paReplace);
-        VSFuncRef *displayFuncRef = vsapi->createFunc(tivtcDisplayFunc<DisplayTDecimate>, vsapi->cloneNodeRef(node), (VSFreeFuncData)vsapi->freeNode, core, vsapi);
-        vsapi->freeNode(node);
-        vsapi->propSetFunc(params, "eval", displayFuncRef, paReplace);
-        vsapi->freeFunc(displayFuncRef);
-        VSPlugin *std_plugin = vsapi->getPluginById("com.vapoursynth.std", core);
-        VSMap *ret = vsapi->invoke(std_plugin, "FrameEval", params);
-        vsapi->freeMap(params);
-        if (vsapi->getError(ret)) {
-            char error[512] = { 0 };
-            snprintf(error, 512, "TDecimate: failed to invoke std.FrameEval: %s", vsapi->getError(ret));
-            vsapi->freeMap(ret);
-            vsapi->setError(out, error);
-            return;
-        }
-        node = vsapi->propGetNode(ret, "clip", 0, nullptr);
-        vsapi->freeMap(ret);
-        vsapi->propSetNode(out, "clip", node, paReplace);
-        vsapi->freeNode(node);
+    // Modes 0/1 make their decisions serially, the metrics they need are
+    // computed in parallel by an internal node, see TDecimate::GetFrameMetrics.
+    if (tdecimate_data->wantsMetricsNode()) {
+        VSMap *metricsOut = vsapi->createMap();
+        vsapi->createFilter(in, metricsOut, "TDecimateMetrics", tdecimateMetricsInit, tdecimateMetricsGetFrame, tdecimateMetricsFree, fmParallel, 0, tdecimate_data, core);
+        VSNodeRef *metricsNode = vsapi->propGetNode(metricsOut, "clip", 0, &err);
+        if (!err)
+            tdecimate_data->setMetricsNode(metricsNode);
+        vsapi->freeMap(metricsOut);
     }
+
+    vsapi->createFilter(in, out, "TDecimate", tdecimateInit, tdecimateGetFrame, tdecimateFree, filter_modes[mode], filter_flags[mode], tdecimate_data, core);
 }
 
 
@@ -681,6 +638,7 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit(VSConfigPlugin configFunc, VSRegiste
                  "batch:int:opt;"
                  "ubsco:int:opt;"
                  "mmsco:int:opt;"
+                 "micexit:int:opt;"
                  "opt:int:opt;"
                  , tfmCreate, nullptr, plugin);
 
@@ -723,5 +681,7 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit(VSConfigPlugin configFunc, VSRegiste
                  "sdlim:int:opt;"
                  "opt:int:opt;"
                  "orgOut:data:opt;"
+                 "binaryOut:int:opt;"
+                 "m2Plan:data:opt;"
                  , tdecimateCreate, nullptr, plugin);
 }
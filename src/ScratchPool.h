@@ -0,0 +1,108 @@
+/*
+**                    TIVTC for AviSynth 2.6 interface
+**
+**   TIVTC includes a field matching filter (TFM) and a decimation
+**   filter (TDecimate) which can be used together to achieve an
+**   IVTC or for other uses. TIVTC currently supports 8 bit planar YUV and
+**   YUY2 colorspaces.
+**
+**   Copyright (C) 2004-2008 Kevin Stone, additional work (C) 2020 pinterf
+**
+**   This program is free software; you can redistribute it and/or modify
+**   it under the terms of the GNU General Public License as published by
+**   the Free Software Foundation; either version 2 of the License, or
+**   (at your option) any later version.
+**
+**   This program is distributed in the hope that it will be useful,
+**   but WITHOUT ANY WARRANTY; without even the implied warranty of
+**   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**   GNU General Public License for more details.
+**
+**   You should have received a copy of the GNU General Public License
+**   along with this program; if not, write to the Free Software
+**   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef SCRATCHPOOL_H
+#define SCRATCHPOOL_H
+
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/*
+** Working buffers that a filter needs while it processes one frame.
+**
+** Every GetFrame call takes one object out of the pool and gives it back
+** when it returns, so the buffers are allocated once per worker instead of
+** once per frame, and concurrent requests never share an object. The number
+** of objects created is the largest number of requests that ran at the
+** same time (the high-water mark).
+*/
+
+template<typename T>
+class ScratchPool
+{
+private:
+  std::mutex lock;
+  std::vector<std::unique_ptr<T>> available;
+  int inUse = 0;
+  int highWater = 0;
+
+  // Returns nullptr when the caller has to create a new object.
+  std::unique_ptr<T> acquire()
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (++inUse > highWater)
+      highWater = inUse;
+    if (available.empty())
+      return nullptr;
+    std::unique_ptr<T> item = std::move(available.back());
+    available.pop_back();
+    return item;
+  }
+
+  void release(std::unique_ptr<T> item)
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    --inUse;
+    available.push_back(std::move(item));
+  }
+
+public:
+  // Keeps an object out of the pool for as long as it lives.
+  class Handle
+  {
+  private:
+    ScratchPool &pool;
+    std::unique_ptr<T> item;
+
+  public:
+    template<typename Create>
+    Handle(ScratchPool &_pool, Create create) : pool(_pool), item(_pool.acquire())
+    {
+      if (!item)
+        item = create();
+    }
+
+    ~Handle()
+    {
+      pool.release(std::move(item));
+    }
+
+    Handle(const Handle &) = delete;
+    Handle &operator=(const Handle &) = delete;
+
+    T &operator*() const { return *item; }
+    T *operator->() const { return item.get(); }
+  };
+
+  int getHighWater()
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    return highWater;
+  }
+};
+
+#endif // SCRATCHPOOL_H
@@ -0,0 +1,196 @@
+/*
+**                    TIVTC for AviSynth 2.6 interface
+**
+**   TIVTC includes a field matching filter (TFM) and a decimation
+**   filter (TDecimate) which can be used together to achieve an
+**   IVTC or for other uses. TIVTC currently supports 8 bit planar YUV and
+**   YUY2 colorspaces.
+**
+**   Copyright (C) 2004-2008 Kevin Stone, additional work (C) 2020 pinterf
+**
+**   This program is free software; you can redistribute it and/or modify
+**   it under the terms of the GNU General Public License as published by
+**   the Free Software Foundation; either version 2 of the License, or
+**   (at your option) any later version.
+**
+**   This program is distributed in the hope that it will be useful,
+**   but WITHOUT ANY WARRANTY; without even the implied warranty of
+**   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**   GNU General Public License for more details.
+**
+**   You should have received a copy of the GNU General Public License
+**   along with this program; if not, write to the Free Software
+**   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef STRIPEPOOL_H
+#define STRIPEPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+** Small set of worker threads that split one frame into horizontal stripes.
+**
+** Only the serial modes (TFM mode 7, TDecimate mode 3) create one: there
+** VapourSynth runs a single GetFrame at a time, so without it the whole
+** pipeline stays on one core. The calling thread always takes part in the
+** work, so a pool of size n starts n - 1 threads.
+*/
+
+class StripePool
+{
+private:
+  std::vector<std::thread> workers;
+  std::mutex runLock; // one run() at a time
+  std::mutex lock;
+  std::condition_variable wake;
+  std::condition_variable finished;
+  const std::function<void(int)> *job = nullptr;
+  int jobCount = 0;
+  std::atomic<int> nextIndex{ 0 };
+  int busy = 0;
+  unsigned generation = 0;
+  bool stop = false;
+  std::exception_ptr error;
+
+  void work()
+  {
+    int i;
+    while ((i = nextIndex.fetch_add(1)) < jobCount) {
+      try {
+        (*job)(i);
+      }
+      catch (...) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!error)
+          error = std::current_exception();
+      }
+    }
+  }
+
+  void workerLoop()
+  {
+    unsigned seen = 0;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        wake.wait(guard, [&] { return stop || generation != seen; });
+        if (stop)
+          return;
+        seen = generation;
+      }
+      work();
+      std::lock_guard<std::mutex> guard(lock);
+      if (--busy == 0)
+        finished.notify_one();
+    }
+  }
+
+public:
+  explicit StripePool(int numThreads)
+  {
+    for (int i = 1; i < numThreads; i++)
+      workers.emplace_back(&StripePool::workerLoop, this);
+  }
+
+  ~StripePool()
+  {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      stop = true;
+    }
+    wake.notify_all();
+    for (auto &t : workers)
+      t.join();
+  }
+
+  StripePool(const StripePool &) = delete;
+  StripePool &operator=(const StripePool &) = delete;
+
+  int size() const { return (int)workers.size() + 1; }
+
+  // Calls fn(0) .. fn(count - 1) on the workers and the calling thread and
+  // returns when all of them are done. The first exception is rethrown.
+  void run(int count, const std::function<void(int)> &fn)
+  {
+    if (count <= 1 || workers.empty()) {
+      for (int i = 0; i < count; i++)
+        fn(i);
+      return;
+    }
+    std::lock_guard<std::mutex> running(runLock);
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      job = &fn;
+      jobCount = count;
+      nextIndex = 0;
+      busy = (int)workers.size();
+      error = nullptr;
+      generation++;
+    }
+    wake.notify_all();
+    work();
+    std::unique_lock<std::mutex> guard(lock);
+    finished.wait(guard, [&] { return busy == 0; });
+    job = nullptr;
+    if (error)
+      std::rethrow_exception(error);
+  }
+
+  // Like run(), but stripe i never runs together with stripe i - 1 or i + 1.
+  // For stripes that add into shared entries of the block row at their seam.
+  void runAlternating(int count, const std::function<void(int)> &fn)
+  {
+    run((count + 1) / 2, [&](int i) { fn(2 * i); });
+    run(count / 2, [&](int i) { fn(2 * i + 1); });
+  }
+
+  // Number of stripes for height rows when every stripe starts on a
+  // multiple of align rows and has at least minRows rows.
+  int stripesFor(int height, int align, int minRows) const
+  {
+    const int units = (height + align - 1) / align;
+    const int minUnits = std::max((minRows + align - 1) / align, 1);
+    return std::max(std::min(size(), units / minUnits), 1);
+  }
+
+  // Rows [ystart, ystop) of stripe i out of count.
+  static void stripeRows(int height, int align, int count, int i, int &ystart, int &ystop)
+  {
+    const int units = (height + align - 1) / align;
+    ystart = std::min(units * i / count * align, height);
+    ystop = i == count - 1 ? height : std::min(units * (i + 1) / count * align, height);
+  }
+};
+
+// Stripe count for a pool that may be missing.
+inline int stripeCount(const StripePool *pool, int height, int align, int minRows)
+{
+  return pool ? pool->stripesFor(height, align, minRows) : 1;
+}
+
+// Runs fn(0) .. fn(count - 1) on the pool, or on this thread without one.
+inline void runStripes(StripePool *pool, int count, const std::function<void(int)> &fn)
+{
+  if (pool)
+    pool->run(count, fn);
+  else
+    for (int i = 0; i < count; i++)
+      fn(i);
+}
+
+// Threads for the stripe pool of a serial filter, 0 when not worth one.
+inline int stripePoolThreads(int coreThreads)
+{
+  const int n = std::min(coreThreads, 8);
+  return n > 1 ? n : 0;
+}
+
+#endif // STRIPEPOOL_H
@@ -22,6 +22,7 @@
 #include "TCommonASM.h"
 #include "emmintrin.h"
 #include "smmintrin.h" // SSE4
+#include "immintrin.h" // AVX2
 #include <algorithm>
 
 void absDiff_SSE2(const uint8_t *srcp1, const uint8_t *srcp2,
@@ -235,7 +236,7 @@ void do_buildABSDiffMask2(const uint8_t* prvp, const uint8_t* nxtp, uint8_t* dst
   if (cpuFlags->sse2 && width >= 8) // yes, width and not row_size
   {
     int mod8Width = width / 8 * 8;
-    if constexpr(sizeof(pixel_t) == 8)
+    if constexpr(sizeof(pixel_t) == 1)
       buildABSDiffMask2_uint8_SSE2(prvp, nxtp, dstp, prv_pitch, nxt_pitch, dst_pitch, mod8Width, height);
     else
       buildABSDiffMask2_uint16_SSE2(prvp, nxtp, dstp, prv_pitch, nxt_pitch, dst_pitch, mod8Width, height, bits_per_pixel);
@@ -385,18 +386,22 @@ static AVS_FORCEINLINE void AnalyzeOnePixel(uint8_t* dstp,
 }
 
 // Common TDeint and TFM version
+// Does the rows y = ystart, ystart + 2, .. below ystop; ystart is even and
+// at least 2, dstp and tbuffer8 are the pointers of y = 2 as for the whole plane.
 template<typename pixel_t, int bits_per_pixel>
-void AnalyzeDiffMask_Planar(uint8_t* dstp, int dst_pitch, uint8_t* tbuffer8, int tpitch, int Width, int Height)
+void AnalyzeDiffMask_Planar(uint8_t* dstp, int dst_pitch, uint8_t* tbuffer8, int tpitch, int Width, int Height, int ystart, int ystop)
 {
   tpitch /= sizeof(pixel_t);
-  const pixel_t* tbuffer = reinterpret_cast<const pixel_t*>(tbuffer8);
+  const int k = (ystart - 2) >> 1;
+  const pixel_t* tbuffer = reinterpret_cast<const pixel_t*>(tbuffer8) + k * tpitch;
   const pixel_t* dppp = tbuffer - tpitch;
   const pixel_t* dpp = tbuffer;
   const pixel_t* dp = tbuffer + tpitch;
   const pixel_t* dpn = tbuffer + tpitch * 2;
   const pixel_t* dpnn = tbuffer + tpitch * 3;
+  dstp += k * dst_pitch;
 
-  for (int y = 2; y < Height - 2; y += 2) {
+  for (int y = ystart; y < std::min(ystop, Height - 2); y += 2) {
     for (int x = 1; x < Width - 1; x++) {
       AnalyzeOnePixel<pixel_t, bits_per_pixel, 1>(dstp, dppp, dpp, dp, dpn, dpnn, x, y, Width, Height);
     }
@@ -409,11 +414,11 @@ void AnalyzeDiffMask_Planar(uint8_t* dstp, int dst_pitch, uint8_t* tbuffer8, int
   }
 }
 // instantiate
-template void AnalyzeDiffMask_Planar<uint8_t,8>(uint8_t* dstp, int dst_pitch, uint8_t* tbuffer8, int tpitch, int Width, int Height);
-template void AnalyzeDiffMask_Planar<uint16_t, 10>(uint8_t* dstp, int dst_pitch, uint8_t* tbuffer8, int tpitch, int Width, int Height);
-template void AnalyzeDiffMask_Planar<uint16_t, 12>(uint8_t* dstp, int dst_pitch, uint8_t* tbuffer8, int tpitch, int Width, int Height);
-template void AnalyzeDiffMask_Planar<uint16_t, 14>(uint8_t* dstp, int dst_pitch, uint8_t* tbuffer8, int tpitch, int Width, int Height);
-template void AnalyzeDiffMask_Planar<uint16_t, 16>(uint8_t* dstp, int dst_pitch, uint8_t* tbuffer8, int tpitch, int Width, int Height);
+template void AnalyzeDiffMask_Planar<uint8_t,8>(uint8_t* dstp, int dst_pitch, uint8_t* tbuffer8, int tpitch, int Width, int Height, int ystart, int ystop);
+template void AnalyzeDiffMask_Planar<uint16_t, 10>(uint8_t* dstp, int dst_pitch, uint8_t* tbuffer8, int tpitch, int Width, int Height, int ystart, int ystop);
+template void AnalyzeDiffMask_Planar<uint16_t, 12>(uint8_t* dstp, int dst_pitch, uint8_t* tbuffer8, int tpitch, int Width, int Height, int ystart, int ystop);
+template void AnalyzeDiffMask_Planar<uint16_t, 14>(uint8_t* dstp, int dst_pitch, uint8_t* tbuffer8, int tpitch, int Width, int Height, int ystart, int ystop);
+template void AnalyzeDiffMask_Planar<uint16_t, 16>(uint8_t* dstp, int dst_pitch, uint8_t* tbuffer8, int tpitch, int Width, int Height, int ystart, int ystop);
 
 // HBD ready
 template<typename pixel_t>
@@ -598,9 +603,9 @@ void buildABSDiffMask2_uint16_SSE2(const uint8_t* prvp, const uint8_t* nxtp,
         auto cmp19_hi = _MM_CMPLE_EPU16(Compare19plus1, diff_hi); // FFFF where 20 <= diff (19 < diff)
         auto cmp3_hi = _MM_CMPLE_EPU16(Compare3plus1, diff_hi); // FFFF where 4 <= diff (3 < diff)
 
-        // make bytes from wordBools
-        auto cmp251 = _mm_packus_epi16(cmp3_lo, cmp3_hi);
-        auto cmp235 = _mm_packus_epi16(cmp19_lo, cmp19_hi);
+        // make bytes from wordBools, signed saturation keeps 0xFFFF as 0xFF
+        auto cmp251 = _mm_packs_epi16(cmp3_lo, cmp3_hi);
+        auto cmp235 = _mm_packs_epi16(cmp19_lo, cmp19_hi);
 
         // target is byte buffer!
         auto tmp1 = _mm_and_si128(cmp251, onesMask);
@@ -637,9 +642,9 @@ void buildABSDiffMask2_uint16_SSE2(const uint8_t* prvp, const uint8_t* nxtp,
         auto cmp19_hi = _MM_CMPLE_EPU16(Compare19plus1, diff_hi); // FFFF where 20 <= diff (19 < diff)
         auto cmp3_hi = _MM_CMPLE_EPU16(Compare3plus1, diff_hi); // FFFF where 4 <= diff (3 < diff)
 
-        // make bytes from wordBools
-        auto cmp251 = _mm_packus_epi16(cmp3_lo, cmp3_hi);
-        auto cmp235 = _mm_packus_epi16(cmp19_lo, cmp19_hi);
+        // make bytes from wordBools, signed saturation keeps 0xFFFF as 0xFF
+        auto cmp251 = _mm_packs_epi16(cmp3_lo, cmp3_hi);
+        auto cmp235 = _mm_packs_epi16(cmp19_lo, cmp19_hi);
 
         // target is byte buffer!
         auto tmp1 = _mm_and_si128(cmp251, onesMask);
@@ -658,8 +663,8 @@ void buildABSDiffMask2_uint16_SSE2(const uint8_t* prvp, const uint8_t* nxtp,
       auto cmp3_lo = _MM_CMPLE_EPU16(Compare3plus1, diff_lo); // FFFF where 4 <= diff (3 < diff)
 
       // make bytes from wordBools
-      auto cmp251 = _mm_packus_epi16(cmp3_lo, cmp3_lo); // 8 bytes valid only
-      auto cmp235 = _mm_packus_epi16(cmp19_lo, cmp19_lo);
+      auto cmp251 = _mm_packs_epi16(cmp3_lo, cmp3_lo); // 8 bytes valid only
+      auto cmp235 = _mm_packs_epi16(cmp19_lo, cmp19_lo);
 
       // target is byte buffer!
       auto tmp1 = _mm_and_si128(cmp251, onesMask);
@@ -675,21 +680,25 @@ void buildABSDiffMask2_uint16_SSE2(const uint8_t* prvp, const uint8_t* nxtp,
   }
 }
 
+// The comb checks read their rows through a row pointer table: rows[0] is
+// the first row to process and rows[-2] .. rows[height + 1] must be valid.
+// The rows may come from different frames, so a weave is checked without
+// building it.
 template<typename pixel_t>
-void check_combing_c(const pixel_t* srcp, uint8_t* cmkp, int width, int height, int src_pitch, int cmk_pitch, int cthresh)
+void check_combing_c(const pixel_t* const* rows, uint8_t* cmkp, int width, int height, int cmk_pitch, int cthresh)
 {
   // cthresh is scaled to actual bit depth
-  const pixel_t* srcppp = srcp - src_pitch * 2;
-  const pixel_t* srcpp = srcp - src_pitch;
-  const pixel_t* srcpn = srcp + src_pitch;
-  const pixel_t* srcpnn = srcp + src_pitch * 2;
-
   int increment = 1;
 
   const int cthresh6 = cthresh * 6;
   // no luma masking
   for (int y = 0; y < height; ++y)
   {
+    const pixel_t* srcppp = rows[y - 2];
+    const pixel_t* srcpp = rows[y - 1];
+    const pixel_t* srcp = rows[y];
+    const pixel_t* srcpn = rows[y + 1];
+    const pixel_t* srcpnn = rows[y + 2];
     for (int x = 0; x < width; x += increment)
     {
       const int sFirst = srcp[x] - srcpp[x];
@@ -700,46 +709,38 @@ void check_combing_c(const pixel_t* srcp, uint8_t* cmkp, int width, int height,
           cmkp[x] = 0xFF;
       }
     }
-    srcppp += src_pitch;
-    srcpp += src_pitch;
-    srcp += src_pitch;
-    srcpn += src_pitch;
-    srcpnn += src_pitch;
     cmkp += cmk_pitch;
   }
 }
 // instantiate
-template void check_combing_c<uint8_t>(const uint8_t* srcp, uint8_t* cmkp, int width, int height, int src_pitch, int cmk_pitch, int cthresh);
-template void check_combing_c<uint16_t>(const uint16_t* srcp, uint8_t* cmkp, int width, int height, int src_pitch, int cmk_pitch, int cthresh);
+template void check_combing_c<uint8_t>(const uint8_t* const* rows, uint8_t* cmkp, int width, int height, int cmk_pitch, int cthresh);
+template void check_combing_c<uint16_t>(const uint16_t* const* rows, uint8_t* cmkp, int width, int height, int cmk_pitch, int cthresh);
 
 template<typename pixel_t, typename safeint_t>
-void check_combing_c_Metric1(const pixel_t* srcp, uint8_t* cmkp, int width, int height, int src_pitch, int cmk_pitch, safeint_t cthreshsq)
+void check_combing_c_Metric1(const pixel_t* const* rows, uint8_t* cmkp, int width, int height, int cmk_pitch, safeint_t cthreshsq)
 {
   // cthresh is scaled to actual bit depth
-  const pixel_t* srcpp = srcp - src_pitch;
-  const pixel_t* srcpn = srcp + src_pitch;
-
   for (int y = 0; y < height; ++y)
   {
+    const pixel_t* srcpp = rows[y - 1];
+    const pixel_t* srcp = rows[y];
+    const pixel_t* srcpn = rows[y + 1];
     for (int x = 0; x < width; ++x)
     {
       if ((safeint_t)(srcp[x] - srcpp[x]) * (srcp[x] - srcpn[x]) > cthreshsq)
         cmkp[x] = 0xFF;
     }
-    srcpp += src_pitch;
-    srcp += src_pitch;
-    srcpn += src_pitch;
     cmkp += cmk_pitch;
   }
 }
 // instantiate
-template void check_combing_c_Metric1<uint8_t, int>(const uint8_t* srcp, uint8_t* cmkp, int width, int height, int src_pitch, int cmk_pitch, int cthreshsq);
-template void check_combing_c_Metric1<uint16_t, int64_t>(const uint16_t* srcp, uint8_t* cmkp, int width, int height, int src_pitch, int cmk_pitch, int64_t cthreshsq);
+template void check_combing_c_Metric1<uint8_t, int>(const uint8_t* const* rows, uint8_t* cmkp, int width, int height, int cmk_pitch, int cthreshsq);
+template void check_combing_c_Metric1<uint16_t, int64_t>(const uint16_t* const* rows, uint8_t* cmkp, int width, int height, int cmk_pitch, int64_t cthreshsq);
 
 
 
-static void check_combing_SSE2_generic(const uint8_t *srcp, uint8_t *dstp, int width,
-  int height, int src_pitch, int dst_pitch, int cthresh)
+static void check_combing_SSE2_generic(const uint8_t * const *rows, uint8_t *dstp, int width,
+  int height, int dst_pitch, int cthresh)
 {
   unsigned int cthresht = std::min(std::max(255 - cthresh - 1, 0), 255);
   auto threshb = _mm_set1_epi8(cthresht);
@@ -749,9 +750,9 @@ static void check_combing_SSE2_generic(const uint8_t *srcp, uint8_t *dstp, int w
   __m128i all_ff = _mm_set1_epi8(-1);
   while (height--) {
     for (int x = 0; x < width; x += 16) {
-      auto next = _mm_load_si128(reinterpret_cast<const __m128i *>(srcp + src_pitch + x));
-      auto curr = _mm_load_si128(reinterpret_cast<const __m128i *>(srcp + x));
-      auto prev = _mm_load_si128(reinterpret_cast<const __m128i *>(srcp - src_pitch + x));
+      auto next = _mm_load_si128(reinterpret_cast<const __m128i *>(rows[1] + x));
+      auto curr = _mm_load_si128(reinterpret_cast<const __m128i *>(rows[0] + x));
+      auto prev = _mm_load_si128(reinterpret_cast<const __m128i *>(rows[-1] + x));
       auto diff_curr_next = _mm_subs_epu8(curr, next);
       auto diff_next_curr = _mm_subs_epu8(next, curr);
       auto diff_curr_prev = _mm_subs_epu8(curr, prev);
@@ -784,7 +785,7 @@ static void check_combing_SSE2_generic(const uint8_t *srcp, uint8_t *dstp, int w
           auto mul_hi = _mm_mullo_epi16(_mm_adds_epu16(next_hi, prev_hi), three);
 
           // compute (pp+c*4+nn)
-          auto prevprev = _mm_load_si128(reinterpret_cast<const __m128i *>(srcp - src_pitch * 2 + x));
+          auto prevprev = _mm_load_si128(reinterpret_cast<const __m128i *>(rows[-2] + x));
           auto prevprev_lo = _mm_unpacklo_epi8(prevprev, zero);
           auto prevprev_hi = _mm_unpackhi_epi8(prevprev, zero);
           auto curr_lo = _mm_unpacklo_epi8(curr, zero);
@@ -792,7 +793,7 @@ static void check_combing_SSE2_generic(const uint8_t *srcp, uint8_t *dstp, int w
           auto sum2_lo = _mm_adds_epu16(_mm_slli_epi16(curr_lo, 2), prevprev_lo); // pp + c*4
           auto sum2_hi = _mm_adds_epu16(_mm_slli_epi16(curr_hi, 2), prevprev_hi); // pp + c*4
 
-          auto nextnext = _mm_load_si128(reinterpret_cast<const __m128i *>(srcp + src_pitch * 2 + x));
+          auto nextnext = _mm_load_si128(reinterpret_cast<const __m128i *>(rows[2] + x));
           auto nextnext_lo = _mm_unpacklo_epi8(nextnext, zero);
           auto nextnext_hi = _mm_unpackhi_epi8(nextnext, zero);
           auto sum3_lo = _mm_adds_epu16(sum2_lo, nextnext_lo);
@@ -821,24 +822,23 @@ static void check_combing_SSE2_generic(const uint8_t *srcp, uint8_t *dstp, int w
           _mm_store_si128(reinterpret_cast<__m128i *>(dstp + x), res);
         }
     }
-    srcp += src_pitch;
+    ++rows;
     dstp += dst_pitch;
   }
 }
 
 
-void check_combing_SSE2(const uint8_t *srcp, uint8_t *dstp, int width, int height, int src_pitch, int dst_pitch, int cthresh)
+void check_combing_SSE2(const uint8_t * const *rows, uint8_t *dstp, int width, int height, int dst_pitch, int cthresh)
 {
-  check_combing_SSE2_generic(srcp, dstp, width, height, src_pitch, dst_pitch, cthresh);
+  check_combing_SSE2_generic(rows, dstp, width, height, dst_pitch, cthresh);
 }
 
 
 #if defined(GCC) || defined(CLANG)
 __attribute__((__target__("sse4.1")))
 #endif 
-void check_combing_uint16_SSE4(const uint16_t* srcp, uint8_t* dstp, int width, int height, int src_pitch, int dst_pitch, int cthresh)
+void check_combing_uint16_SSE4(const uint16_t * const *rows, uint8_t* dstp, int width, int height, int dst_pitch, int cthresh)
 {
-  // src_pitch ok for the 16 bit pointer
 /*
   const int sFirst = srcp[x] - srcpp[x];
   const int sSecond = srcp[x] - srcpn[x];
@@ -857,9 +857,9 @@ void check_combing_uint16_SSE4(const uint16_t* srcp, uint8_t* dstp, int width, i
   while (height--) {
     // sets 8 mask byte by 8x uint16_t pixels
     for (int x = 0; x < width; x += 16 / sizeof(uint16_t)) {
-      auto next = _mm_load_si128(reinterpret_cast<const __m128i*>(srcp + src_pitch + x));
-      auto curr = _mm_load_si128(reinterpret_cast<const __m128i*>(srcp + x));
-      auto prev = _mm_load_si128(reinterpret_cast<const __m128i*>(srcp - src_pitch + x));
+      auto next = _mm_load_si128(reinterpret_cast<const __m128i*>(rows[1] + x));
+      auto curr = _mm_load_si128(reinterpret_cast<const __m128i*>(rows[0] + x));
+      auto prev = _mm_load_si128(reinterpret_cast<const __m128i*>(rows[-1] + x));
       auto diff_curr_next = _mm_subs_epu16(curr, next);
       auto diff_next_curr = _mm_subs_epu16(next, curr);
       auto diff_curr_prev = _mm_subs_epu16(curr, prev);
@@ -893,7 +893,7 @@ void check_combing_uint16_SSE4(const uint16_t* srcp, uint8_t* dstp, int width, i
         auto mul_hi = _mm_mullo_epi32(_mm_add_epi32(next_hi, prev_hi), three);
 
         // compute (pp+c*4+nn)
-        auto prevprev = _mm_load_si128(reinterpret_cast<const __m128i*>(srcp - src_pitch * 2 + x));
+        auto prevprev = _mm_load_si128(reinterpret_cast<const __m128i*>(rows[-2] + x));
         auto prevprev_lo = _mm_unpacklo_epi16(prevprev, zero);
         auto prevprev_hi = _mm_unpackhi_epi16(prevprev, zero);
         auto curr_lo = _mm_unpacklo_epi16(curr, zero);
@@ -904,7 +904,7 @@ void check_combing_uint16_SSE4(const uint16_t* srcp, uint8_t* dstp, int width, i
 /*        if (abs(srcppp[x] + (srcp[x] << 2) + srcpnn[x] - (3 * (srcpp[x] + srcpn[x]))) > cthresh6)
           cmkp[x] = 0xFF;
           */
-        auto nextnext = _mm_load_si128(reinterpret_cast<const __m128i*>(srcp + src_pitch * 2 + x));
+        auto nextnext = _mm_load_si128(reinterpret_cast<const __m128i*>(rows[2] + x));
         auto nextnext_lo = _mm_unpacklo_epi16(nextnext, zero);
         auto nextnext_hi = _mm_unpackhi_epi16(nextnext, zero);
         auto sum3_lo = _mm_add_epi32(sum2_lo, nextnext_lo);
@@ -928,14 +928,14 @@ void check_combing_uint16_SSE4(const uint16_t* srcp, uint8_t* dstp, int width, i
         _mm_storel_epi64(reinterpret_cast<__m128i*>(dstp + x), res);
       }
     }
-    srcp += src_pitch;
+    ++rows;
     dstp += dst_pitch;
   }
 }
 
 
-void check_combing_SSE2_Metric1(const uint8_t *srcp, uint8_t *dstp,
-  int width, int height, int src_pitch, int dst_pitch, int cthreshsq)
+void check_combing_SSE2_Metric1(const uint8_t * const *rows, uint8_t *dstp,
+  int width, int height, int dst_pitch, int cthreshsq)
 {
   __m128i thresh = _mm_set1_epi32(cthreshsq);
   __m128i zero = _mm_setzero_si128();
@@ -943,9 +943,9 @@ void check_combing_SSE2_Metric1(const uint8_t *srcp, uint8_t *dstp,
 
   while (height--) {
     for (int x = 0; x < width; x += 16) {
-      auto next = _mm_load_si128(reinterpret_cast<const __m128i *>(srcp + src_pitch + x));
-      auto curr = _mm_load_si128(reinterpret_cast<const __m128i *>(srcp + x));
-      auto prev = _mm_load_si128(reinterpret_cast<const __m128i *>(srcp - src_pitch + x));
+      auto next = _mm_load_si128(reinterpret_cast<const __m128i *>(rows[1] + x));
+      auto curr = _mm_load_si128(reinterpret_cast<const __m128i *>(rows[0] + x));
+      auto prev = _mm_load_si128(reinterpret_cast<const __m128i *>(rows[-1] + x));
 
       auto prev_lo = _mm_unpacklo_epi8(prev, zero);
       auto prev_hi = _mm_unpackhi_epi8(prev, zero);
@@ -990,24 +990,24 @@ void check_combing_SSE2_Metric1(const uint8_t *srcp, uint8_t *dstp,
       auto res = _mm_packus_epi16(cmp_lo_masked, cmp_hi_masked);
       _mm_store_si128(reinterpret_cast<__m128i *>(dstp + x), res);
     }
-    srcp += src_pitch;
+    ++rows;
     dstp += dst_pitch;
   }
 
 }
 
 
-void check_combing_SSE2_Luma_Metric1(const uint8_t *srcp, uint8_t *dstp,
-  int width, int height, int src_pitch, int dst_pitch, int cthreshsq)
+void check_combing_SSE2_Luma_Metric1(const uint8_t * const *rows, uint8_t *dstp,
+  int width, int height, int dst_pitch, int cthreshsq)
 {
   __m128i thresh = _mm_set1_epi32(cthreshsq);
   __m128i lumaMask = _mm_set1_epi16(0x00FF);
   __m128i zero = _mm_setzero_si128();
   while (height--) {
     for (int x = 0; x < width; x += 16) {
-      auto next = _mm_load_si128(reinterpret_cast<const __m128i *>(srcp + src_pitch + x));
-      auto curr = _mm_load_si128(reinterpret_cast<const __m128i *>(srcp + x));
-      auto prev = _mm_load_si128(reinterpret_cast<const __m128i *>(srcp - src_pitch + x));
+      auto next = _mm_load_si128(reinterpret_cast<const __m128i *>(rows[1] + x));
+      auto curr = _mm_load_si128(reinterpret_cast<const __m128i *>(rows[0] + x));
+      auto prev = _mm_load_si128(reinterpret_cast<const __m128i *>(rows[-1] + x));
       
       next = _mm_and_si128(next, lumaMask);
       curr = _mm_and_si128(curr, lumaMask);
@@ -1032,61 +1032,265 @@ void check_combing_SSE2_Luma_Metric1(const uint8_t *srcp, uint8_t *dstp,
 
       _mm_store_si128(reinterpret_cast<__m128i *>(dstp + x), cmp_masked);
     }
-    srcp += src_pitch;
+    ++rows;
     dstp += dst_pitch;
   }
 }
 
-template<int blockSizeY>
-void compute_sum_8xN_sse2(const uint8_t *srcp, int pitch, int &sum)
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("sse4.1")))
+#endif 
+void check_combing_uint16_SSE4_Metric1(const uint16_t * const *rows, uint8_t *dstp,
+  int width, int height, int dst_pitch, int64_t cthreshsq)
 {
-  // sums masks
-  // if (cmkppT[x + v] == 0xFF && cmkpT[x + v] == 0xFF && cmkpnT[x + v] == 0xFF) sum++;
-  // scrp is prev
-  auto onesMask = _mm_set1_epi8(1);
-  auto all_ff = _mm_set1_epi8(-1);
-  auto prev = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(srcp));
-  auto curr = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(srcp + pitch));
-  auto summa = _mm_setzero_si128();
-  srcp += pitch * 2; // points to next
-  // unroll 2
-  for (int i = 0; i < blockSizeY / 2; i++) { // 4x2=8
-    /*
-    p  #
-    c  # #
-    n  # #
-    nn   #
-    */
-    auto next = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(srcp));
-    auto nextnext = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(srcp + pitch));
+  // (c-p)*(c-n) > cthreshsq with cthreshsq >= 0: both differences must have
+  // the same sign, then |c-p|*|c-n| fits in uint32_t.
+  // The largest product is 65535*65535, nothing can reach a bigger threshold.
+  if (cthreshsq >= 0xFFFFFFFFLL)
+    return;
+  // unsigned compare: prod > thresh <=> max(prod, thresh + 1) == prod
+  auto thresh1 = _mm_set1_epi32((int)(uint32_t)(cthreshsq + 1));
+  auto zero = _mm_setzero_si128();
 
-    auto anded_common = _mm_and_si128(curr, next);
-    auto with_prev = _mm_and_si128(prev, anded_common);
-    auto with_nextnext = _mm_and_si128(anded_common, nextnext);
+  while (height--) {
+    // sets 8 mask bytes by 8x uint16_t pixels
+    for (int x = 0; x < width; x += 16 / sizeof(uint16_t)) {
+      auto next = _mm_load_si128(reinterpret_cast<const __m128i *>(rows[1] + x));
+      auto curr = _mm_load_si128(reinterpret_cast<const __m128i *>(rows[0] + x));
+      auto prev = _mm_load_si128(reinterpret_cast<const __m128i *>(rows[-1] + x));
 
-    // these were missing from the original assembler code (== 0xFF)
-    with_prev = _mm_cmpeq_epi8(with_prev, all_ff);
-    with_nextnext = _mm_cmpeq_epi8(with_nextnext, all_ff);
+      auto diff_curr_prev = _mm_subs_epu16(curr, prev);
+      auto diff_prev_curr = _mm_subs_epu16(prev, curr);
+      auto diff_curr_next = _mm_subs_epu16(curr, next);
+      auto diff_next_curr = _mm_subs_epu16(next, curr);
+      // nonzero when c is above or below both neighbours
+      auto same_sign = _mm_max_epu16(_mm_min_epu16(diff_curr_prev, diff_curr_next), _mm_min_epu16(diff_prev_curr, diff_next_curr));
+      auto same_sign_mask = _mm_xor_si128(_mm_cmpeq_epi16(same_sign, zero), _mm_set1_epi8(-1));
+
+      auto abs_prev = _mm_or_si128(diff_curr_prev, diff_prev_curr);
+      auto abs_next = _mm_or_si128(diff_curr_next, diff_next_curr);
+      auto prod_lo16 = _mm_mullo_epi16(abs_prev, abs_next);
+      auto prod_hi16 = _mm_mulhi_epu16(abs_prev, abs_next);
+      auto prod_lo = _mm_unpacklo_epi16(prod_lo16, prod_hi16);
+      auto prod_hi = _mm_unpackhi_epi16(prod_lo16, prod_hi16);
+
+      auto cmp_lo = _mm_cmpeq_epi32(_mm_max_epu32(prod_lo, thresh1), prod_lo);
+      auto cmp_hi = _mm_cmpeq_epi32(_mm_max_epu32(prod_hi, thresh1), prod_hi);
+
+      auto res = _mm_and_si128(_mm_packs_epi32(cmp_lo, cmp_hi), same_sign_mask);
+      // mask is 8 bits
+      res = _mm_packs_epi16(res, res);
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(dstp + x), res);
+    }
+    ++rows;
+    dstp += dst_pitch;
+  }
+}
 
-    with_prev = _mm_and_si128(with_prev, onesMask);
-    with_nextnext = _mm_and_si128(with_nextnext, onesMask);
 
-    prev = next;
-    curr = nextnext;
+// AVX2 versions of the comb checks above, 32 bytes per iteration.
+// unpack/pack pairs work inside 128 bit lanes, so they keep the pixel order.
 
-    summa = _mm_adds_epu8(summa, with_prev);
-    summa = _mm_adds_epu8(summa, with_nextnext);
-    srcp += pitch * 2;
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif 
+void check_combing_AVX2(const uint8_t * const *rows, uint8_t *dstp, int width, int height, int dst_pitch, int cthresh)
+{
+  unsigned int cthresht = std::min(std::max(255 - cthresh - 1, 0), 255);
+  auto threshb = _mm256_set1_epi8(cthresht);
+  unsigned int cthresh6t = std::min(std::max(65535 - cthresh * 6 - 1, 0), 65535);
+  auto thresh6w = _mm256_set1_epi16(cthresh6t);
+
+  auto all_ff = _mm256_set1_epi8(-1);
+  auto zero = _mm256_setzero_si256();
+  auto three = _mm256_set1_epi16(3);
+  while (height--) {
+    for (int x = 0; x < width; x += 32) {
+      auto next = _mm256_load_si256(reinterpret_cast<const __m256i *>(rows[1] + x));
+      auto curr = _mm256_load_si256(reinterpret_cast<const __m256i *>(rows[0] + x));
+      auto prev = _mm256_load_si256(reinterpret_cast<const __m256i *>(rows[-1] + x));
+      auto diff_curr_next = _mm256_subs_epu8(curr, next);
+      auto diff_next_curr = _mm256_subs_epu8(next, curr);
+      auto diff_curr_prev = _mm256_subs_epu8(curr, prev);
+      auto diff_prev_curr = _mm256_subs_epu8(prev, curr);
+      // max(min(p-s,n-s), min(s-n,s-p))
+      auto xmm2_max = _mm256_max_epu8(_mm256_min_epu8(diff_prev_curr, diff_next_curr), _mm256_min_epu8(diff_curr_next, diff_curr_prev));
+      auto res_part1 = _mm256_cmpeq_epi8(_mm256_adds_epu8(xmm2_max, threshb), all_ff);
+      if (_mm256_testz_si256(res_part1, res_part1))
+        continue;
+
+      // compute 3*(p+n)
+      auto mul_lo = _mm256_mullo_epi16(_mm256_adds_epu16(_mm256_unpacklo_epi8(next, zero), _mm256_unpacklo_epi8(prev, zero)), three);
+      auto mul_hi = _mm256_mullo_epi16(_mm256_adds_epu16(_mm256_unpackhi_epi8(next, zero), _mm256_unpackhi_epi8(prev, zero)), three);
+
+      // compute (pp+c*4+nn)
+      auto prevprev = _mm256_load_si256(reinterpret_cast<const __m256i *>(rows[-2] + x));
+      auto nextnext = _mm256_load_si256(reinterpret_cast<const __m256i *>(rows[2] + x));
+      auto sum2_lo = _mm256_adds_epu16(_mm256_slli_epi16(_mm256_unpacklo_epi8(curr, zero), 2), _mm256_unpacklo_epi8(prevprev, zero));
+      auto sum2_hi = _mm256_adds_epu16(_mm256_slli_epi16(_mm256_unpackhi_epi8(curr, zero), 2), _mm256_unpackhi_epi8(prevprev, zero));
+      auto sum3_lo = _mm256_adds_epu16(sum2_lo, _mm256_unpacklo_epi8(nextnext, zero));
+      auto sum3_hi = _mm256_adds_epu16(sum2_hi, _mm256_unpackhi_epi8(nextnext, zero));
+
+      // abs( (pp+c*4+nn) - mul=3*(p+n) )
+      auto max_lo = _mm256_max_epi16(_mm256_subs_epu16(sum3_lo, mul_lo), _mm256_subs_epu16(mul_lo, sum3_lo));
+      auto max_hi = _mm256_max_epi16(_mm256_subs_epu16(sum3_hi, mul_hi), _mm256_subs_epu16(mul_hi, sum3_hi));
+      // abs( (pp+c*4+nn) - mul=3*(p+n) ) + thresh6w, maximum reached?
+      auto cmp_lo = _mm256_cmpeq_epi16(_mm256_adds_epu16(max_lo, thresh6w), all_ff);
+      auto cmp_hi = _mm256_cmpeq_epi16(_mm256_adds_epu16(max_hi, thresh6w), all_ff);
+
+      auto res_part2 = _mm256_packus_epi16(_mm256_srli_epi16(cmp_lo, 8), _mm256_srli_epi16(cmp_hi, 8));
+
+      auto res = _mm256_and_si256(res_part1, res_part2);
+      _mm256_store_si256(reinterpret_cast<__m256i *>(dstp + x), res);
+    }
+    ++rows;
+    dstp += dst_pitch;
+  }
+}
+
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif 
+void check_combing_uint16_AVX2(const uint16_t * const *rows, uint8_t *dstp, int width, int height, int dst_pitch, int cthresh)
+{
+  unsigned int cthresht = std::min(std::max(65535 - cthresh - 1, 0), 65535);
+  auto thresh = _mm256_set1_epi16(cthresht); // cmp by adds and check saturation
+  auto thresh6 = _mm256_set1_epi32(cthresh * 6);
+
+  auto all_ff = _mm256_set1_epi8(-1);
+  auto zero = _mm256_setzero_si256();
+  auto three = _mm256_set1_epi32(3);
+  while (height--) {
+    // sets 16 mask bytes by 16x uint16_t pixels
+    for (int x = 0; x < width; x += 32 / sizeof(uint16_t)) {
+      auto next = _mm256_load_si256(reinterpret_cast<const __m256i *>(rows[1] + x));
+      auto curr = _mm256_load_si256(reinterpret_cast<const __m256i *>(rows[0] + x));
+      auto prev = _mm256_load_si256(reinterpret_cast<const __m256i *>(rows[-1] + x));
+      auto diff_curr_next = _mm256_subs_epu16(curr, next);
+      auto diff_next_curr = _mm256_subs_epu16(next, curr);
+      auto diff_curr_prev = _mm256_subs_epu16(curr, prev);
+      auto diff_prev_curr = _mm256_subs_epu16(prev, curr);
+      // max(min(p-s,n-s), min(s-n,s-p))
+      auto xmm2_max = _mm256_max_epu16(_mm256_min_epu16(diff_prev_curr, diff_next_curr), _mm256_min_epu16(diff_curr_next, diff_curr_prev));
+      auto res_part1 = _mm256_cmpeq_epi16(_mm256_adds_epu16(xmm2_max, thresh), all_ff);
+      if (_mm256_testz_si256(res_part1, res_part1))
+        continue;
+
+      // compute 3*(p+n)
+      auto mul_lo = _mm256_mullo_epi32(_mm256_add_epi32(_mm256_unpacklo_epi16(next, zero), _mm256_unpacklo_epi16(prev, zero)), three);
+      auto mul_hi = _mm256_mullo_epi32(_mm256_add_epi32(_mm256_unpackhi_epi16(next, zero), _mm256_unpackhi_epi16(prev, zero)), three);
+
+      // compute (pp+c*4+nn)
+      auto prevprev = _mm256_load_si256(reinterpret_cast<const __m256i *>(rows[-2] + x));
+      auto nextnext = _mm256_load_si256(reinterpret_cast<const __m256i *>(rows[2] + x));
+      auto sum2_lo = _mm256_add_epi32(_mm256_slli_epi32(_mm256_unpacklo_epi16(curr, zero), 2), _mm256_unpacklo_epi16(prevprev, zero));
+      auto sum2_hi = _mm256_add_epi32(_mm256_slli_epi32(_mm256_unpackhi_epi16(curr, zero), 2), _mm256_unpackhi_epi16(prevprev, zero));
+      auto sum3_lo = _mm256_add_epi32(sum2_lo, _mm256_unpacklo_epi16(nextnext, zero));
+      auto sum3_hi = _mm256_add_epi32(sum2_hi, _mm256_unpackhi_epi16(nextnext, zero));
+
+      // abs( (pp+c*4+nn) - mul=3*(p+n) ) > thresh6 ??
+      auto cmp_lo = _mm256_cmpgt_epi32(_mm256_abs_epi32(_mm256_sub_epi32(sum3_lo, mul_lo)), thresh6);
+      auto cmp_hi = _mm256_cmpgt_epi32(_mm256_abs_epi32(_mm256_sub_epi32(sum3_hi, mul_hi)), thresh6);
+
+      auto res = _mm256_and_si256(res_part1, _mm256_packs_epi32(cmp_lo, cmp_hi));
+      // mask is 8 bits: the low 8 bytes of each lane hold the result
+      res = _mm256_permute4x64_epi64(_mm256_packs_epi16(res, res), (2 << 2) | 0);
+      _mm_store_si128(reinterpret_cast<__m128i *>(dstp + x), _mm256_castsi256_si128(res));
+    }
+    ++rows;
+    dstp += dst_pitch;
+  }
+}
+
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif 
+void check_combing_AVX2_Metric1(const uint8_t * const *rows, uint8_t *dstp,
+  int width, int height, int dst_pitch, int cthreshsq)
+{
+  auto thresh = _mm256_set1_epi32(cthreshsq);
+  auto zero = _mm256_setzero_si256();
+  auto lumaMask = _mm256_set1_epi16(0x00FF);
+
+  while (height--) {
+    for (int x = 0; x < width; x += 32) {
+      auto next = _mm256_load_si256(reinterpret_cast<const __m256i *>(rows[1] + x));
+      auto curr = _mm256_load_si256(reinterpret_cast<const __m256i *>(rows[0] + x));
+      auto prev = _mm256_load_si256(reinterpret_cast<const __m256i *>(rows[-1] + x));
+
+      auto diff_prev_curr_lo = _mm256_sub_epi16(_mm256_unpacklo_epi8(prev, zero), _mm256_unpacklo_epi8(curr, zero));
+      auto diff_next_curr_lo = _mm256_sub_epi16(_mm256_unpacklo_epi8(next, zero), _mm256_unpacklo_epi8(curr, zero));
+      auto diff_prev_curr_hi = _mm256_sub_epi16(_mm256_unpackhi_epi8(prev, zero), _mm256_unpackhi_epi8(curr, zero));
+      auto diff_next_curr_hi = _mm256_sub_epi16(_mm256_unpackhi_epi8(next, zero), _mm256_unpackhi_epi8(curr, zero));
+
+      // products of the signed differences, zero high words make madd a plain multiply
+      auto res_lo_lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(diff_prev_curr_lo, zero), _mm256_unpacklo_epi16(diff_next_curr_lo, zero));
+      auto res_lo_hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(diff_prev_curr_lo, zero), _mm256_unpackhi_epi16(diff_next_curr_lo, zero));
+      auto res_hi_lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(diff_prev_curr_hi, zero), _mm256_unpacklo_epi16(diff_next_curr_hi, zero));
+      auto res_hi_hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(diff_prev_curr_hi, zero), _mm256_unpackhi_epi16(diff_next_curr_hi, zero));
+
+      auto cmp_lo = _mm256_packs_epi32(_mm256_cmpgt_epi32(res_lo_lo, thresh), _mm256_cmpgt_epi32(res_lo_hi, thresh));
+      auto cmp_hi = _mm256_packs_epi32(_mm256_cmpgt_epi32(res_hi_lo, thresh), _mm256_cmpgt_epi32(res_hi_hi, thresh));
+
+      auto res = _mm256_packus_epi16(_mm256_and_si256(cmp_lo, lumaMask), _mm256_and_si256(cmp_hi, lumaMask));
+      _mm256_store_si256(reinterpret_cast<__m256i *>(dstp + x), res);
+    }
+    ++rows;
+    dstp += dst_pitch;
   }
-  // now we have to sum up lower 8 bytes
-  // in sse2, we use sad
-  auto zero = _mm_setzero_si128();
-  auto tmpsum = _mm_sad_epu8(summa, zero);  // sum(lo 8 bytes)(needed) / sum(hi 8 bytes)(not needed)
-  sum = _mm_cvtsi128_si32(tmpsum);
 }
 
-// instantiate for 8x8
-template void compute_sum_8xN_sse2<8>(const uint8_t* srcp, int pitch, int& sum);
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif 
+void check_combing_uint16_AVX2_Metric1(const uint16_t * const *rows, uint8_t *dstp,
+  int width, int height, int dst_pitch, int64_t cthreshsq)
+{
+  // see check_combing_uint16_SSE4_Metric1
+  if (cthreshsq >= 0xFFFFFFFFLL)
+    return;
+  auto thresh1 = _mm256_set1_epi32((int)(uint32_t)(cthreshsq + 1));
+  auto zero = _mm256_setzero_si256();
+  auto all_ff = _mm256_set1_epi8(-1);
+
+  while (height--) {
+    // sets 16 mask bytes by 16x uint16_t pixels
+    for (int x = 0; x < width; x += 32 / sizeof(uint16_t)) {
+      auto next = _mm256_load_si256(reinterpret_cast<const __m256i *>(rows[1] + x));
+      auto curr = _mm256_load_si256(reinterpret_cast<const __m256i *>(rows[0] + x));
+      auto prev = _mm256_load_si256(reinterpret_cast<const __m256i *>(rows[-1] + x));
+
+      auto diff_curr_prev = _mm256_subs_epu16(curr, prev);
+      auto diff_prev_curr = _mm256_subs_epu16(prev, curr);
+      auto diff_curr_next = _mm256_subs_epu16(curr, next);
+      auto diff_next_curr = _mm256_subs_epu16(next, curr);
+      auto same_sign = _mm256_max_epu16(_mm256_min_epu16(diff_curr_prev, diff_curr_next), _mm256_min_epu16(diff_prev_curr, diff_next_curr));
+      auto same_sign_mask = _mm256_xor_si256(_mm256_cmpeq_epi16(same_sign, zero), all_ff);
+      if (_mm256_testz_si256(same_sign_mask, same_sign_mask))
+        continue;
+
+      auto abs_prev = _mm256_or_si256(diff_curr_prev, diff_prev_curr);
+      auto abs_next = _mm256_or_si256(diff_curr_next, diff_next_curr);
+      auto prod_lo16 = _mm256_mullo_epi16(abs_prev, abs_next);
+      auto prod_hi16 = _mm256_mulhi_epu16(abs_prev, abs_next);
+      auto prod_lo = _mm256_unpacklo_epi16(prod_lo16, prod_hi16);
+      auto prod_hi = _mm256_unpackhi_epi16(prod_lo16, prod_hi16);
+
+      auto cmp_lo = _mm256_cmpeq_epi32(_mm256_max_epu32(prod_lo, thresh1), prod_lo);
+      auto cmp_hi = _mm256_cmpeq_epi32(_mm256_max_epu32(prod_hi, thresh1), prod_hi);
+
+      auto res = _mm256_and_si256(_mm256_packs_epi32(cmp_lo, cmp_hi), same_sign_mask);
+      // mask is 8 bits: the low 8 bytes of each lane hold the result
+      res = _mm256_permute4x64_epi64(_mm256_packs_epi16(res, res), (2 << 2) | 0);
+      _mm_store_si128(reinterpret_cast<__m128i *>(dstp + x), _mm256_castsi256_si128(res));
+    }
+    ++rows;
+    dstp += dst_pitch;
+  }
+}
 
 // YUY2 luma only case
 void compute_sum_16x8_sse2_luma(const uint8_t *srcp, int pitch, int &sum)
@@ -1172,6 +1376,30 @@ void blend_5050_SSE2(uint8_t* dstp, const uint8_t* srcp1, const uint8_t* srcp2,
 template void blend_5050_SSE2<uint8_t>(uint8_t* dstp, const uint8_t* srcp1, const uint8_t* srcp2, int width, int height, int dst_pitch, int src1_pitch, int src2_pitch);
 template void blend_5050_SSE2<uint16_t>(uint8_t* dstp, const uint8_t* srcp1, const uint8_t* srcp2, int width, int height, int dst_pitch, int src1_pitch, int src2_pitch);
 
+template<typename pixel_t>
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void blend_5050_AVX2(uint8_t* dstp, const uint8_t* srcp1, const uint8_t* srcp2, int width, int height, int dst_pitch, int src1_pitch, int src2_pitch)
+{
+  while (height--) {
+    for (int x = 0; x < width * (int)sizeof(pixel_t); x += 32) {
+      auto src1 = _mm256_load_si256(reinterpret_cast<const __m256i*>(srcp1 + x));
+      auto src2 = _mm256_load_si256(reinterpret_cast<const __m256i*>(srcp2 + x));
+      if constexpr (sizeof(pixel_t) == 1)
+        _mm256_store_si256(reinterpret_cast<__m256i*>(dstp + x), _mm256_avg_epu8(src1, src2));
+      else
+        _mm256_store_si256(reinterpret_cast<__m256i*>(dstp + x), _mm256_avg_epu16(src1, src2));
+    }
+    dstp += dst_pitch;
+    srcp1 += src1_pitch;
+    srcp2 += src2_pitch;
+  }
+}
+// instantiate
+template void blend_5050_AVX2<uint8_t>(uint8_t* dstp, const uint8_t* srcp1, const uint8_t* srcp2, int width, int height, int dst_pitch, int src1_pitch, int src2_pitch);
+template void blend_5050_AVX2<uint16_t>(uint8_t* dstp, const uint8_t* srcp1, const uint8_t* srcp2, int width, int height, int dst_pitch, int src1_pitch, int src2_pitch);
+
 template<typename pixel_t>
 void blend_5050_c(uint8_t* dstp, const uint8_t* srcp1, const uint8_t* srcp2, int width, int height, int dst_pitch, int src1_pitch, int src2_pitch)
 {
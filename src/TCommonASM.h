@@ -51,25 +51,54 @@ void absDiff_uint16_c(const uint8_t* srcp1, const uint8_t* srcp2,
   int height, int mthresh);
 
 template<typename pixel_t>
-void check_combing_c(const pixel_t* srcp, uint8_t* dstp, int width, int height, int src_pitch, int dst_pitch, int cthresh);
+void check_combing_c(const pixel_t* const* rows, uint8_t* dstp, int width, int height, int dst_pitch, int cthresh);
 
 
 template<typename pixel_t, typename safeint_t>
-void check_combing_c_Metric1(const pixel_t* srcp, uint8_t* dstp, int width, int height, int src_pitch, int dst_pitch, safeint_t cthreshsq);
+void check_combing_c_Metric1(const pixel_t* const* rows, uint8_t* dstp, int width, int height, int dst_pitch, safeint_t cthreshsq);
 
-void check_combing_SSE2(const uint8_t *srcp, uint8_t *dstp,
-  int width, int height, int src_pitch, int dst_pitch, int cthresh);
+void check_combing_SSE2(const uint8_t * const *rows, uint8_t *dstp,
+  int width, int height, int dst_pitch, int cthresh);
 
 #if defined(GCC) || defined(CLANG)
 __attribute__((__target__("sse4.1")))
 #endif 
-void check_combing_uint16_SSE4(const uint16_t* srcp, uint8_t* dstp, int width, int height, int src_pitch, int dst_pitch, int cthresh);
+void check_combing_uint16_SSE4(const uint16_t * const *rows, uint8_t* dstp, int width, int height, int dst_pitch, int cthresh);
 
-void check_combing_SSE2_Metric1(const uint8_t *srcp, uint8_t *dstp,
-  int width, int height, int src_pitch, int dst_pitch, int cthreshsq);
+void check_combing_SSE2_Metric1(const uint8_t * const *rows, uint8_t *dstp,
+  int width, int height, int dst_pitch, int cthreshsq);
   
-void check_combing_SSE2_Luma_Metric1(const uint8_t *srcp, uint8_t *dstp,
-  int width, int height, int src_pitch, int dst_pitch, int cthreshsq);
+void check_combing_SSE2_Luma_Metric1(const uint8_t * const *rows, uint8_t *dstp,
+  int width, int height, int dst_pitch, int cthreshsq);
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("sse4.1")))
+#endif 
+void check_combing_uint16_SSE4_Metric1(const uint16_t * const *rows, uint8_t *dstp,
+  int width, int height, int dst_pitch, int64_t cthreshsq);
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif 
+void check_combing_AVX2(const uint8_t * const *rows, uint8_t *dstp,
+  int width, int height, int dst_pitch, int cthresh);
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif 
+void check_combing_uint16_AVX2(const uint16_t * const *rows, uint8_t *dstp, int width, int height, int dst_pitch, int cthresh);
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif 
+void check_combing_AVX2_Metric1(const uint8_t * const *rows, uint8_t *dstp,
+  int width, int height, int dst_pitch, int cthreshsq);
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif 
+void check_combing_uint16_AVX2_Metric1(const uint16_t * const *rows, uint8_t *dstp,
+  int width, int height, int dst_pitch, int64_t cthreshsq);
 
 template<typename pixel_t>
 void buildABSDiffMask_SSE2(const uint8_t *prvp, const uint8_t *nxtp,
@@ -84,7 +113,7 @@ void do_buildABSDiffMask(const uint8_t* prvp, const uint8_t* nxtp, uint8_t* tbuf
   int prv_pitch, int nxt_pitch, int tpitch, int width, int height, const CPUFeatures *cpuFlags);
 
 template<typename pixel_t, int bits_per_pixel>
-void AnalyzeDiffMask_Planar(uint8_t* dstp, int dst_pitch, uint8_t* tbuffer, int tpitch, int Width, int Height);
+void AnalyzeDiffMask_Planar(uint8_t* dstp, int dst_pitch, uint8_t* tbuffer, int tpitch, int Width, int Height, int ystart, int ystop);
 void AnalyzeDiffMask_YUY2(uint8_t* dstp, int dst_pitch, uint8_t* tbuffer, int tpitch, int Width, int Height, bool mChroma);
 
 
@@ -103,9 +132,6 @@ void do_buildABSDiffMask2(const uint8_t* prvp, const uint8_t* nxtp, uint8_t* dst
   int prv_pitch, int nxt_pitch, int dst_pitch, int width, int height, const CPUFeatures *cpuFlags, int bits_per_pixel);
 
 
-template<int blockSizeY>
-void compute_sum_8xN_sse2(const uint8_t *srcp, int pitch, int &sum);
-
 void compute_sum_16x8_sse2_luma(const uint8_t *srcp, int pitch, int &sum);
 
 // fixme: put non-asm utility functions into different file
@@ -114,6 +140,11 @@ void copyFrame(VSFrameRef *dst, const VSFrameRef *src, const VSAPI *vsapi);
 template<typename pixel_t>
 void blend_5050_SSE2(uint8_t* dstp, const uint8_t* srcp1, const uint8_t* srcp2, int width, int height, int dst_pitch, int src1_pitch, int src2_pitch);
 template<typename pixel_t>
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void blend_5050_AVX2(uint8_t* dstp, const uint8_t* srcp1, const uint8_t* srcp2, int width, int height, int dst_pitch, int src1_pitch, int src2_pitch);
+template<typename pixel_t>
 void blend_5050_c(uint8_t* dstp, const uint8_t* srcp1, const uint8_t* srcp2, int width, int height, int dst_pitch, int src1_pitch, int src2_pitch);
 
 template<int planarType>
@@ -29,6 +29,10 @@
 #include "TCommonASM.h"
 #include <inttypes.h>
 #include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
 
 const VSFrameRef *TDecimate::GetFrame(int n, int activationReason, void **frameData, VSFrameContext *frameCtx, VSCore *core)
 {
@@ -50,10 +54,52 @@ const VSFrameRef *TDecimate::GetFrame(int n, int activationReason, void **frameD
       return nullptr;
   }
 
+  if (debug && dst)
+  {
+    VSFrameRef *f = vsapi->copyFrame(dst, core);
+    vsapi->freeFrame(dst);
+    VSMap *props = vsapi->getFramePropsRW(f);
+    vsapi->propSetInt(props, PROP_TDecimateMetricCacheHits, metricCache.getHits(), paReplace);
+    vsapi->propSetInt(props, PROP_TDecimateMetricCacheMisses, metricCache.getMisses(), paReplace);
+    dst = f;
+  }
+
   return dst;
 }
 
 
+// Internal node of modes 0/1, computes the metrics of frame n and n-1 into
+// metricCache. GetFrameMode01 requests it for the cycles it evaluates and for
+// the ones after them, so these are computed in parallel and calcMetricCycle,
+// which runs serially, only looks them up. The returned frames are dummies.
+const VSFrameRef *TDecimate::GetFrameMetrics(int n, int activationReason, VSFrameContext *frameCtx, VSCore *core)
+{
+  const int prevn = n > 0 ? n - 1 : 0;
+
+  if (activationReason == arInitial) {
+      const bool inInput = metricsArray.size() && metricsArray[n << 1] != UINT64_MAX && metricsArray[(n << 1) + 1] != UINT64_MAX;
+      if (inInput || metricCache.contains(n, true))
+          return vsapi->newVideoFrame(viMetrics.format, viMetrics.width, viMetrics.height, nullptr, core);
+
+      vsapi->requestFrameFilter(prevn, child, frameCtx);
+      vsapi->requestFrameFilter(n, child, frameCtx);
+      return nullptr;
+  } else if (activationReason != arAllFramesReady) {
+      return nullptr;
+  }
+
+  const VSFrameRef *prv = vsapi->getFrameFilter(prevn, child, frameCtx);
+  const VSFrameRef *src = vsapi->getFrameFilter(n, child, frameCtx);
+  int blockN, xblocks;
+  uint64_t metricF;
+  calcMetric(prv, src, prevn, n, vi_child, blockN, xblocks, metricF, true, core);
+  vsapi->freeFrame(prv);
+  vsapi->freeFrame(src);
+
+  return vsapi->newVideoFrame(viMetrics.format, viMetrics.width, viMetrics.height, nullptr, core);
+}
+
+
 // For modes 0, 1, and 3
 enum OutputType {
     SingleFrame = 0,
@@ -109,6 +155,15 @@ const VSFrameRef * TDecimate::GetFrameMode01(int n, int activationReason, void *
       for (int i = EvalGroup - cycle - 1; i < EvalGroup + (cycle * 3); i++)
           vsapi->requestFrameFilter(std::max(0, std::min(i, vi_child->numFrames - 1)), child, frameCtx);
 
+      // prev, curr and next are evaluated below, the metrics of the cycles
+      // after them are only computed ahead for the following frames
+      if (metricsNode)
+      {
+          const int last = std::min(EvalGroup + cycle * (2 + lookahead), vi_child->numFrames);
+          for (int i = std::max(EvalGroup - cycle, 0); i < last; i++)
+              vsapi->requestFrameFilter(i, metricsNode, frameCtx);
+      }
+
       return nullptr;
   } else if (activationReason == arAllFramesReady && *frameData != nullptr) {
       const OutputInfo *o = (const OutputInfo *)*frameData;
@@ -155,7 +210,7 @@ const VSFrameRef * TDecimate::GetFrameMode01(int n, int activationReason, void *
 //  if (ecf) child->SetCacheHints(EvalGroup, -20);
   if (curr.frame != EvalGroup)
   {
-    prev = curr;
+    Cycle::rotate(prev, curr, next, nbuf);
     if (prev.frame != EvalGroup - cycle)
     {
       prev.setFrame(EvalGroup - cycle);
@@ -168,7 +223,6 @@ const VSFrameRef * TDecimate::GetFrameMode01(int n, int activationReason, void *
       }
       if (output.size()) addMetricCycle(prev);
     }
-    curr = next;
     if (curr.frame != EvalGroup)
     {
       curr.setFrame(EvalGroup);
@@ -181,7 +235,6 @@ const VSFrameRef * TDecimate::GetFrameMode01(int n, int activationReason, void *
       }
       if (output.size()) addMetricCycle(curr);
     }
-    next = nbuf;
     if (next.frame != EvalGroup + cycle)
       next.setFrame(EvalGroup + cycle);
     getOvrCycle(next, false);
@@ -620,7 +673,7 @@ const VSFrameRef * TDecimate::GetFrameMode3(int n, int activationReason, void **
     lastGroup = n;
     lastCycle += cycle;
 //    if (ecf) child->SetCacheHints(lastCycle, -20);
-    prev = curr;
+    Cycle::rotate(prev, curr, next, nbuf);
     if (prev.frame != lastCycle - cycle)
     {
       prev.setFrame(lastCycle - cycle);
@@ -630,7 +683,6 @@ const VSFrameRef * TDecimate::GetFrameMode3(int n, int activationReason, void **
       checkVideoMetrics(prev, vidThresh);
       if (output.size()) addMetricCycle(prev);
     }
-    curr = next;
     if (curr.frame != lastCycle)
     {
       curr.setFrame(lastCycle);
@@ -640,7 +692,6 @@ const VSFrameRef * TDecimate::GetFrameMode3(int n, int activationReason, void **
       checkVideoMetrics(curr, vidThresh);
       if (output.size()) addMetricCycle(curr);
     }
-    next = nbuf;
     if (next.frame != lastCycle + cycle)
       next.setFrame(lastCycle + cycle);
     getOvrCycle(next, false);
@@ -809,49 +860,11 @@ const VSFrameRef * TDecimate::GetFrameMode3(int n, int activationReason, void **
 
   if (retFrames <= -305)
   {
-      // I refuse to copy the text drawing code.
-
       std::string last = "Mode 3:  Last Actual Frame = " + std::to_string(lastFrame);
 
-      VSPlugin *std_plugin = vsapi->getPluginById("com.vapoursynth.std", core);
-      VSPlugin *text_plugin = vsapi->getPluginById("com.vapoursynth.text", core);
-
-      VSMap *args = vsapi->createMap();
-      vsapi->propSetNode(args, "clip", clip2, paReplace);
-      VSMap *ret = vsapi->invoke(std_plugin, "BlankClip", args);
-      vsapi->clearMap(args);
-      if (vsapi->getError(ret)) {
-          std::string msg = "TDecimate: failed to invoke std.BlankClip to show this message: '" + last + "'. " + vsapi->getError(ret);
-          vsapi->setFilterError(msg.c_str(), frameCtx);
-          vsapi->freeMap(args);
-          vsapi->freeMap(ret);
-          return nullptr;
-      }
-      VSNodeRef *node = vsapi->propGetNode(ret, "clip", 0, nullptr);
-      vsapi->freeMap(ret);
-      vsapi->propSetNode(args, "clip", node, paReplace);
-      vsapi->freeNode(node);
-      node = nullptr;
-      vsapi->propSetData(args, "text", last.c_str(), last.size(), paReplace);
-      ret = vsapi->invoke(text_plugin, "Text", args);
-      vsapi->freeMap(args);
-      if (vsapi->getError(ret)) {
-          std::string msg = "TDecimate: failed to invoke text.Text to show this message: '" + last + "'. " + vsapi->getError(ret);
-          vsapi->setFilterError(msg.c_str(), frameCtx);
-          vsapi->freeMap(ret);
-          return nullptr;
-      }
-      node = vsapi->propGetNode(ret, "clip", 0, nullptr);
-      vsapi->freeMap(ret);
-
-      char error[160] = { 0 };
-      const VSFrameRef *dst = vsapi->getFrame(0, node, error, 160);
-      vsapi->freeNode(node);
-      if (dst == nullptr) {
-          std::string msg = "TDecimate: failed to generate the frame with this message: '" + last + "'. " + error;
-          vsapi->setFilterError(msg.c_str(), frameCtx);
-          return nullptr;
-      }
+      VSFrameRef *dst = vsapi->newVideoFrame(vi.format, vi.width, vi.height, nullptr, core);
+      clearFrame(dst, vsapi);
+      drawDisplayText(dst, last, vsapi);
 
       --retFrames;
       return dst;
@@ -879,7 +892,7 @@ const VSFrameRef * TDecimate::GetFrameMode4(int n, int activationReason, VSFrame
   uint64_t metricU = UINT64_MAX, metricF = UINT64_MAX;
   getOvrFrame(n, metricU, metricF);
   if (metricU == UINT64_MAX || metricF == UINT64_MAX || display)
-    metricU = calcMetric(prv, src, vi_child, blockN, xblocks, metricF, true, core);
+    metricU = calcMetric(prv, src, n > 0 ? n - 1 : 0, n, vi_child, blockN, xblocks, metricF, true, core);
 
   vsapi->freeFrame(prv);
 
@@ -922,6 +935,7 @@ const VSFrameRef * TDecimate::GetFrameMode4(int n, int activationReason, VSFrame
 #undef SZ
 
       vsapi->propSetData(props, PROP_TDecimateDisplay, text.c_str(), text.size(), paReplace);
+      drawDisplayText(dst, text, vsapi);
   }
   return dst;
 }
@@ -968,6 +982,7 @@ const VSFrameRef * TDecimate::GetFrameMode56(int n, int activationReason, VSFram
     text += buf;
 #undef SZ
     vsapi->propSetData(props, PROP_TDecimateDisplay, text.c_str(), text.size(), paReplace);
+    drawDisplayText(dst, text, vsapi);
   }
 
   vsapi->propSetInt(props, PROP_DurationNum, durNum, paReplace);
@@ -982,7 +997,7 @@ void TDecimate::rerunFromStart(const int s, VSFrameContext *frameCtx, VSCore *co
   int EvalGroup = 0;
   while (EvalGroup < s)
   {
-    prev = curr;
+    Cycle::rotate(prev, curr, next);
     if (prev.frame != EvalGroup - cycle)
     {
       prev.setFrame(EvalGroup - cycle);
@@ -994,7 +1009,6 @@ void TDecimate::rerunFromStart(const int s, VSFrameContext *frameCtx, VSCore *co
         checkVideoMetrics(prev, vidThresh);
       }
     }
-    curr = next;
     if (curr.frame != EvalGroup)
     {
       curr.setFrame(EvalGroup);
@@ -1083,7 +1097,7 @@ void TDecimate::calcMetricPreBuf(int n1, int n2, int pos, const VSVideoInfo *vit
   {
     src = vsapi->getFrameFilter(n2, child, frameCtx);
     const VSFrameRef *frame = vsapi->getFrameFilter(n1, child, frameCtx);
-    nbuf.diffMetricsU[pos] = calcMetric(frame, src, vit, blockNI, xblocksI, metricF, scene, core);
+    nbuf.diffMetricsU[pos] = calcMetric(frame, src, n1, n2, vit, blockNI, xblocksI, metricF, scene, core);
     vsapi->freeFrame(frame);
     nbuf.diffMetricsN[pos] = (nbuf.diffMetricsU[pos] * 100.0) / MAX_DIFF;
     if (scene) nbuf.diffMetricsUF[pos] = metricF;
@@ -1103,21 +1117,88 @@ void TDecimate::calcMetricPreBuf(int n1, int n2, int pos, const VSVideoInfo *vit
   vsapi->freeFrame(src);
 }
 
-void CalcMetricsExtracted(const VSFrameRef *prevt, const VSFrameRef *currt, CalcMetricData& d, VSCore *core, const VSAPI *vsapi)
+// Block sums of rows [0, height) of one plane, added into diff.
+static void calcDiffPlane(const uint8_t *prvp, const uint8_t *curp, int prv_pitch, int cur_pitch, int width, int height,
+  int plane, int xblocks4, uint64_t *diff, const CalcMetricData &d)
 {
-  VSFrameRef *prev = nullptr, *curr = nullptr;
+  const bool use_sse2 = d.cpuFlags->sse2;
+  const bool use_sse4 = d.cpuFlags->sse4_1;
+  const int pixelsize = d.vi.format->bytesPerSample;
 
-  if (d.predenoise)
+  if (pixelsize == 1 && d.blockx == 32 && d.blocky == 32 && d.nt <= 0)
+  {
+    if (d.ssd && use_sse2)
+      calcDiffSSD_32x32_SSE2(prvp, curp, prv_pitch, cur_pitch, width, height, plane, xblocks4, diff, d.chroma, &d.vi);
+    else if (!d.ssd && use_sse2)
+      calcDiffSAD_32x32_SSE2(prvp, curp, prv_pitch, cur_pitch, width, height, plane, xblocks4, diff, d.chroma, &d.vi);
+    else { goto use_c; }
+  }
+  else if (pixelsize == 1 && d.blockx >= 16 && d.blocky >= 16 && d.nt <= 0)
+  {
+    // YUY2 block size 8 is really 16 in width because luma + chroma
+    if (d.ssd && use_sse2)
+      calcDiffSSD_Generic_SSE2(prvp, curp, prv_pitch, cur_pitch, width, height, plane, xblocks4, diff, d.chroma, d.blockx_shift, d.blocky_shift, d.blockx_half, d.blocky_half, &d.vi);
+    else if (!d.ssd && use_sse2)
+      calcDiffSAD_Generic_SSE2(prvp, curp, prv_pitch, cur_pitch, width, height, plane, xblocks4, diff, d.chroma, d.blockx_shift, d.blocky_shift, d.blockx_half, d.blocky_half, &d.vi);
+    else { goto use_c; }
+  }
+  else if (use_sse4)
   {
-    prev = vsapi->newVideoFrame(d.vi.format, d.vi.width, d.vi.height, nullptr, core);
-    curr = vsapi->newVideoFrame(d.vi.format, d.vi.width, d.vi.height, nullptr, core);
-    blurFrame(prevt, prev, 2, d.chroma, d.cpuFlags, core, vsapi);
-    blurFrame(currt, curr, 2, d.chroma, d.cpuFlags, core, vsapi);
+    // any bit depth, block size and nt
+    if (pixelsize == 1) {
+      if (!d.ssd)
+        calcDiff_SADorSSD_Generic_SIMD<uint8_t, true>(prvp, curp, prv_pitch, cur_pitch, width, height, plane, xblocks4, diff, d.chroma, d.blockx_shift, d.blocky_shift, d.blockx_half, d.blocky_half, d.nt, &d.vi, d.cpuFlags);
+      else
+        calcDiff_SADorSSD_Generic_SIMD<uint8_t, false>(prvp, curp, prv_pitch, cur_pitch, width, height, plane, xblocks4, diff, d.chroma, d.blockx_shift, d.blocky_shift, d.blockx_half, d.blocky_half, d.nt, &d.vi, d.cpuFlags);
+    }
+    else {
+      if (!d.ssd)
+        calcDiff_SADorSSD_Generic_SIMD<uint16_t, true>((const uint16_t*)prvp, (const uint16_t*)curp, prv_pitch, cur_pitch, width, height, plane, xblocks4, diff, d.chroma, d.blockx_shift, d.blocky_shift, d.blockx_half, d.blocky_half, d.nt, &d.vi, d.cpuFlags);
+      else
+        calcDiff_SADorSSD_Generic_SIMD<uint16_t, false>((const uint16_t*)prvp, (const uint16_t*)curp, prv_pitch, cur_pitch, width, height, plane, xblocks4, diff, d.chroma, d.blockx_shift, d.blocky_shift, d.blockx_half, d.blocky_half, d.nt, &d.vi, d.cpuFlags);
+    }
   }
   else
   {
-    prev = vsapi->copyFrame(prevt, core);
-    curr = vsapi->copyFrame(currt, core);
+  use_c:
+    if (pixelsize == 1) {
+      if (!d.ssd) {
+        // SAD
+          calcDiff_SADorSSD_Generic_c<uint8_t, true, 1>(prvp, curp, prv_pitch, cur_pitch, width, height, plane, xblocks4, diff, d.chroma, d.blockx_shift, d.blocky_shift, d.blockx_half, d.blocky_half, d.nt, &d.vi);
+      }
+      else {
+        // SSD
+          calcDiff_SADorSSD_Generic_c<uint8_t, false, 1>(prvp, curp, prv_pitch, cur_pitch, width, height, plane, xblocks4, diff, d.chroma, d.blockx_shift, d.blocky_shift, d.blockx_half, d.blocky_half, d.nt, &d.vi);
+      }
+    }
+    else {
+      // pixelsize == 2, 10-16 bits
+      if (!d.ssd) {
+        // SAD
+        calcDiff_SADorSSD_Generic_c<uint16_t, true, 1>((const uint16_t *)prvp, (const uint16_t*)curp, prv_pitch, cur_pitch, width, height, plane, xblocks4, diff, d.chroma, d.blockx_shift, d.blocky_shift, d.blockx_half, d.blocky_half, d.nt, &d.vi);
+      }
+      else {
+        // SSD
+        calcDiff_SADorSSD_Generic_c<uint16_t, false, 1>((const uint16_t*)prvp, (const uint16_t*)curp, prv_pitch, cur_pitch, width, height, plane, xblocks4, diff, d.chroma, d.blockx_shift, d.blocky_shift, d.blockx_half, d.blocky_half, d.nt, &d.vi);
+      }
+    }
+  }
+}
+
+void CalcMetricsExtracted(const VSFrameRef *prevt, const VSFrameRef *currt, CalcMetricData& d, VSCore *core, const VSAPI *vsapi)
+{
+  // the source frames are only read, no copy is needed without predenoise
+  const VSFrameRef *prev = prevt, *curr = currt;
+  VSFrameRef *prevb = nullptr, *currb = nullptr;
+
+  if (d.predenoise)
+  {
+    prevb = vsapi->newVideoFrame(d.vi.format, d.vi.width, d.vi.height, nullptr, core);
+    currb = vsapi->newVideoFrame(d.vi.format, d.vi.width, d.vi.height, nullptr, core);
+    blurFrame(prevt, prevb, 2, d.chroma, d.cpuFlags, core, vsapi, d.stripes);
+    blurFrame(currt, currb, 2, d.chroma, d.cpuFlags, core, vsapi, d.stripes);
+    prev = prevb;
+    curr = currb;
   }
 
   // core start
@@ -1130,8 +1211,6 @@ void CalcMetricsExtracted(const VSFrameRef *prevt, const VSFrameRef *currt, Calc
   int yblocks = ((d.vi.height + d.blocky_half) >> d.blocky_shift) + 1;
   int arraysize = (xblocks * yblocks) << 2;
 
-  const bool use_sse2 = d.cpuFlags->sse2;
-
   memset(d.diff, 0, arraysize * sizeof(uint64_t));
 
   const int stop = !d.chroma ? 1 : d.vi.format->numPlanes; // luma only (!chroma) only 1 planar planes
@@ -1151,49 +1230,25 @@ void CalcMetricsExtracted(const VSFrameRef *prevt, const VSFrameRef *currt, Calc
     // sum is gathered in uint64_t diff
     // diff[] entries are normalized back to 8 bit
 
-    if (pixelsize == 1 && d.blockx == 32 && d.blocky == 32 && d.nt <= 0)
+    if (d.stripes)
     {
-      if (d.ssd && use_sse2)
-        calcDiffSSD_32x32_SSE2(prvp, curp, prv_pitch, cur_pitch, width, height, plane, xblocks4, d.diff, d.chroma, &d.vi);
-      else if (!d.ssd && use_sse2)
-        calcDiffSAD_32x32_SSE2(prvp, curp, prv_pitch, cur_pitch, width, height, plane, xblocks4, d.diff, d.chroma, &d.vi);
-      else { goto use_c; }
-    }
-    else if (pixelsize == 1 && d.blockx >= 16 && d.blocky >= 16 && d.nt <= 0)
-    {
-      // YUY2 block size 8 is really 16 in width because luma + chroma
-      if (d.ssd && use_sse2)
-        calcDiffSSD_Generic_SSE2(prvp, curp, prv_pitch, cur_pitch, width, height, plane, xblocks4, d.diff, d.chroma, d.blockx_shift, d.blocky_shift, d.blockx_half, d.blocky_half, &d.vi);
-      else if (!d.ssd && use_sse2)
-        calcDiffSAD_Generic_SSE2(prvp, curp, prv_pitch, cur_pitch, width, height, plane, xblocks4, d.diff, d.chroma, d.blockx_shift, d.blocky_shift, d.blockx_half, d.blocky_half, &d.vi);
-      else { goto use_c; }
+      // Stripes start on a block row boundary, so the block rows of a stripe
+      // are those of the whole plane shifted by ystart. The half-overlapping
+      // block row at a seam gets sums from both stripes: run every other
+      // stripe at a time.
+      const int ssH = plane == 0 ? 0 : d.vi.format->subSamplingH;
+      const int count = d.stripes->stripesFor(d.vi.height, d.blocky, 64);
+      d.stripes->runAlternating(count, [&](int i) {
+        int ystart, ystop;
+        StripePool::stripeRows(d.vi.height, d.blocky, count, i, ystart, ystop);
+        const int ys = ystart >> ssH;
+        const int ye = i == count - 1 ? height : ystop >> ssH;
+        calcDiffPlane(prvp + ys * prv_pitch * pixelsize, curp + ys * cur_pitch * pixelsize, prv_pitch, cur_pitch, width, ye - ys,
+          plane, xblocks4, d.diff + (ystart >> d.blocky_shift) * xblocks4, d);
+      });
     }
     else
-    {
-      // fixme: have calcDiffSSD uint16_t to SIMD.
-    use_c:
-      if (pixelsize == 1) {
-        if (!d.ssd) {
-          // SAD
-            calcDiff_SADorSSD_Generic_c<uint8_t, true, 1>(prvp, curp, prv_pitch, cur_pitch, width, height, plane, xblocks4, d.diff, d.chroma, d.blockx_shift, d.blocky_shift, d.blockx_half, d.blocky_half, d.nt, &d.vi);
-        }
-        else {
-          // SSD
-            calcDiff_SADorSSD_Generic_c<uint8_t, false, 1>(prvp, curp, prv_pitch, cur_pitch, width, height, plane, xblocks4, d.diff, d.chroma, d.blockx_shift, d.blocky_shift, d.blockx_half, d.blocky_half, d.nt, &d.vi);
-        }
-      }
-      else {
-        // pixelsize == 2, 10-16 bits
-        if (!d.ssd) {
-          // SAD
-          calcDiff_SADorSSD_Generic_c<uint16_t, true, 1>((const uint16_t *)prvp, (const uint16_t*)curp, prv_pitch, cur_pitch, width, height, plane, xblocks4, d.diff, d.chroma, d.blockx_shift, d.blocky_shift, d.blockx_half, d.blocky_half, d.nt, &d.vi);
-        }
-        else {
-          // SSD
-          calcDiff_SADorSSD_Generic_c<uint16_t, false, 1>((const uint16_t*)prvp, (const uint16_t*)curp, prv_pitch, cur_pitch, width, height, plane, xblocks4, d.diff, d.chroma, d.blockx_shift, d.blocky_shift, d.blockx_half, d.blocky_half, d.nt, &d.vi);
-        }
-      }
-    }
+      calcDiffPlane(prvp, curp, prv_pitch, cur_pitch, width, height, plane, xblocks4, d.diff, d);
 
     if (d.metricF_needed) { // called from TDecimate. from FrameDiff:false
       if (b == 0) // luma
@@ -1214,18 +1269,71 @@ void CalcMetricsExtracted(const VSFrameRef *prevt, const VSFrameRef *currt, Calc
     }
   }
 
-  vsapi->freeFrame(prev);
-  vsapi->freeFrame(curr);
+  vsapi->freeFrame(prevb);
+  vsapi->freeFrame(currb);
 }
 
-uint64_t TDecimate::calcMetric(const VSFrameRef *prevt, const VSFrameRef *currt, const VSVideoInfo *vit, int &blockNI,
+// Returns a new reference to the blurred version of frame n (src) for
+// predenoise. The last two blurred frames are kept, so the frame shared by
+// the (n-1,n) and (n,n+1) pairs is blurred only once.
+const VSFrameRef *TDecimate::getBlurredFrame(int n, const VSFrameRef *src, VSCore *core) const
+{
+  {
+    std::lock_guard<std::mutex> guard(blurLock);
+    for (auto &slot : blurCache)
+    {
+      if (slot.second && slot.first == n)
+        return vsapi->cloneFrameRef(slot.second);
+    }
+  }
+
+  VSFrameRef *blurred = vsapi->newVideoFrame(vi_child->format, vi_child->width, vi_child->height, nullptr, core);
+  blurFrame(src, blurred, 2, chroma, &cpuFlags, core, vsapi, stripes.get());
+
+  std::lock_guard<std::mutex> guard(blurLock);
+  auto &slot = blurCache[blurCacheNext];
+  blurCacheNext ^= 1;
+  vsapi->freeFrame(slot.second);
+  slot.first = n;
+  slot.second = vsapi->cloneFrameRef(blurred);
+  return blurred;
+}
+
+std::unique_ptr<TDecimateDiff> TDecimate::createDiff() const
+{
+  std::unique_ptr<TDecimateDiff> item(new TDecimateDiff());
+  item->buf = decltype(item->buf) (vs_aligned_malloc<uint64_t>(diffSize * sizeof(uint64_t), 16), &vs_aligned_free);
+  return item;
+}
+
+uint64_t TDecimate::calcMetric(const VSFrameRef *prevt, const VSFrameRef *currt, int prevn, int currn, const VSVideoInfo *vit, int &blockNI,
   int &xblocksI, uint64_t &metricF, bool scene, VSCore *core) const
 {
   uint64_t highestDiff = 0;
 
+  const bool cacheable = prevn == std::max(currn - 1, 0);
+  MetricCacheEntry cached;
+  if (cacheable && metricCache.lookup(currn, scene, cached))
+  {
+    blockNI = cached.blockN;
+    xblocksI = cached.xblocks;
+    metricF = scene ? cached.metricF : 0;
+    return cached.metricU;
+  }
+
+  const VSFrameRef *prevb = nullptr, *currb = nullptr;
+  if (predenoise)
+  {
+    prevb = getBlurredFrame(prevn, prevt, core);
+    currb = getBlurredFrame(currn, currt, core);
+  }
+
+  ScratchPool<TDecimateDiff>::Handle diffHandle(diffPool, [&] { return createDiff(); });
+  uint64_t *diffp = diffHandle->buf.get();
+
   struct CalcMetricData d;
   //d.np = np;
-  d.predenoise = predenoise;
+  d.predenoise = false; // blurred frames come from getBlurredFrame
   d.vi = *vit;
   d.chroma = chroma;
   d.cpuFlags = &cpuFlags;
@@ -1235,15 +1343,21 @@ uint64_t TDecimate::calcMetric(const VSFrameRef *prevt, const VSFrameRef *currt,
   d.blocky = blocky;
   d.blocky_half = blocky_half;
   d.blocky_shift = blocky_shift;
-  d.diff = diff.get();
+  d.diff = diffp;
   d.nt = nt;
   d.ssd = ssd;
+  d.stripes = stripes.get();
 
   d.metricF_needed = true;
   d.metricF = &metricF;
   d.scene = scene; 
 
-  CalcMetricsExtracted(prevt, currt, d, core, vsapi);
+  if (predenoise)
+    CalcMetricsExtracted(prevb, currb, d, core, vsapi);
+  else
+    CalcMetricsExtracted(prevt, currt, d, core, vsapi);
+  vsapi->freeFrame(prevb);
+  vsapi->freeFrame(currb);
 
   int xblocks = ((d.vi.width + d.blockx_half) >> d.blockx_shift) + 1;
   int xblocks4 = xblocks << 2;
@@ -1256,9 +1370,9 @@ uint64_t TDecimate::calcMetric(const VSFrameRef *prevt, const VSFrameRef *currt,
 
   for (int x = 0; x < arraysize; ++x)
   {
-    if (diff.get()[x] > highestDiff)
+    if (diffp[x] > highestDiff)
     {
-      highestDiff = diff.get()[x];
+      highestDiff = diffp[x];
       blockNI = x;
     }
   }
@@ -1268,6 +1382,17 @@ uint64_t TDecimate::calcMetric(const VSFrameRef *prevt, const VSFrameRef *currt,
     highestDiff = (uint64_t)(sqrt((double)(highestDiff)));
     metricF = (uint64_t)(sqrt((double)(metricF)));
   }
+
+  if (cacheable)
+  {
+    cached.n = currn;
+    cached.scene = scene;
+    cached.metricU = highestDiff;
+    cached.metricF = metricF;
+    cached.blockN = blockNI;
+    cached.xblocks = xblocksI;
+    metricCache.store(cached);
+  }
   return highestDiff;
 }
 
@@ -1276,125 +1401,71 @@ void TDecimate::calcMetricCycle(Cycle &current, bool scene, bool hnt, VSCore *co
 {
   if (current.mSet || current.cycleS == current.cycleE) 
     return;
-  
+
+  ScratchPool<TDecimateDiff>::Handle diffHandle(diffPool, [&] { return createDiff(); });
+  uint64_t *diffp = diffHandle->buf.get();
+
   int i, w;
   uint64_t highestDiff;
-  int next_num = -20, next_numd = -20;
+  int next_num = -20;
 
-  VSFrameRef *prv = nullptr, *nxt = nullptr;
-  const VSFrameRef *prevt = nullptr, *nextt = nullptr;
-  if (predenoise)
-  {
-    prv = vsapi->newVideoFrame(vi_child->format, vi_child->width, vi_child->height, nullptr, core);
-    nxt = vsapi->newVideoFrame(vi_child->format, vi_child->width, vi_child->height, nullptr, core);
-  }
+  // source frame w, kept for the hints and as the previous frame of w+1
+  const VSFrameRef *nextt = nullptr;
+  auto getSrc = [&](int f) {
+    return frameCtx ? vsapi->getFrameFilter(f, child, frameCtx) : vsapi->getFrame(f, child, nullptr, 0);
+  };
 
   for (w = current.frameSO, i = current.cycleS; i < current.cycleE; ++i, ++w)
   {
     if ((current.match[i] != -20 || !hnt) && current.diffMetricsU[i] != UINT64_MAX &&
       (current.diffMetricsUF[i] != UINT64_MAX || !scene)) continue;
-    if (predenoise)
+    MetricCacheEntry cached;
+    if ((current.diffMetricsU[i] == UINT64_MAX || (current.diffMetricsUF[i] == UINT64_MAX && scene)) &&
+      metricCache.lookup(w, scene, cached))
+    {
+      current.diffMetricsU[i] = cached.metricU;
+      current.diffMetricsUF[i] = scene ? cached.metricF : 0;
+      current.diffMetricsN[i] = (cached.metricU * 100.0) / MAX_DIFF;
+    }
+    if (current.diffMetricsU[i] != UINT64_MAX &&
+      (current.diffMetricsUF[i] != UINT64_MAX || !scene))
     {
-      if (current.diffMetricsU[i] != UINT64_MAX &&
-        (current.diffMetricsUF[i] != UINT64_MAX || !scene))
+      if (current.match[i] == -20 && hnt)
       {
-        if (current.match[i] == -20 && hnt)
+        if (!usehints) current.match[i] = -200;
+        else
         {
-          if (!usehints) current.match[i] = -200;
-          else
-          {
-              vsapi->freeFrame(nextt);
-            if (frameCtx)
-                nextt = vsapi->getFrameFilter(w, child, frameCtx);
-            else
-                nextt = vsapi->getFrame(w, child, nullptr, 0);
-            next_num = w;
-            current.match[i] = getTFMFrameProperties(nextt, current.filmd2v[i]);
-          }
+          vsapi->freeFrame(nextt);
+          nextt = getSrc(w);
+          next_num = w;
+          current.match[i] = getTFMFrameProperties(nextt, current.filmd2v[i]);
         }
-        continue;
-      }
-      
-      vsapi->freeFrame(prevt);
-      if (next_num == w - 1)
-        prevt = vsapi->cloneFrameRef(nextt);
-      else {
-          if (frameCtx)
-            prevt = vsapi->getFrameFilter(w > 0 ? w - 1 : 0, child, frameCtx);
-          else
-            prevt = vsapi->getFrame(w > 0 ? w - 1 : 0, child, nullptr, 0);
       }
+      continue;
+    }
 
-      vsapi->freeFrame(nextt);
-      if (frameCtx)
-        nextt = vsapi->getFrameFilter(w, child, frameCtx);
-      else
-        nextt = vsapi->getFrame(w, child, nullptr, 0);
-      next_num = w;
-      if (current.match[i] == -20 && hnt)
-      {
-        if (!usehints) current.match[i] = -200;
-        else current.match[i] = getTFMFrameProperties(nextt, current.filmd2v[i]);
-      }
-      if (next_numd == w - 1) 
-        copyFrame(prv, nxt, vsapi);
-      else 
-        blurFrame(prevt, prv, 2, chroma, &cpuFlags, core, vsapi);
-      
-      blurFrame(nextt, nxt, 2, chroma, &cpuFlags, core, vsapi);
-      next_numd = w;
+    const VSFrameRef *prevt = next_num == w - 1 ? vsapi->cloneFrameRef(nextt) : getSrc(w > 0 ? w - 1 : 0);
+    vsapi->freeFrame(nextt);
+    nextt = getSrc(w);
+    next_num = w;
+    if (current.match[i] == -20 && hnt)
+    {
+      if (!usehints) current.match[i] = -200;
+      else current.match[i] = getTFMFrameProperties(nextt, current.filmd2v[i]);
+    }
+
+    // the source frames are only read, blurred ones are shared through getBlurredFrame
+    const VSFrameRef *prv, *nxt;
+    if (predenoise)
+    {
+      prv = getBlurredFrame(w > 0 ? w - 1 : 0, prevt, core);
+      nxt = getBlurredFrame(w, nextt, core);
+      vsapi->freeFrame(prevt);
     }
     else
     {
-      if (current.diffMetricsU[i] != UINT64_MAX &&
-        (current.diffMetricsUF[i] != UINT64_MAX || !scene))
-      {
-        if (current.match[i] == -20 && hnt)
-        {
-          if (!usehints) current.match[i] = -200;
-          else
-          {
-            const VSFrameRef *tmp;
-            if (frameCtx)
-                tmp = vsapi->getFrameFilter(w, child, frameCtx);
-            else
-                tmp = vsapi->getFrame(w, child, nullptr, 0);
-            vsapi->freeFrame(nxt);
-            nxt = vsapi->copyFrame(tmp, core);
-            vsapi->freeFrame(tmp);
-            next_num = w;
-            current.match[i] = getTFMFrameProperties(nxt, current.filmd2v[i]);
-          }
-        }
-        continue;
-      }
-
-      vsapi->freeFrame(prv);
-      if (next_num == w - 1) 
-        prv = vsapi->copyFrame(nxt, core);
-      else {
-        const VSFrameRef *tmp;
-        if (frameCtx)
-            tmp = vsapi->getFrameFilter(w > 0 ? w - 1 : 0, child, frameCtx);
-        else
-            tmp = vsapi->getFrame(w > 0 ? w - 1 : 0, child, nullptr, 0);
-        prv = vsapi->copyFrame(tmp, core);
-        vsapi->freeFrame(tmp);
-      }
-      const VSFrameRef *tmp;
-      if (frameCtx)
-          tmp = vsapi->getFrameFilter(w, child, frameCtx);
-      else
-          tmp = vsapi->getFrame(w, child, nullptr, 0);
-      vsapi->freeFrame(nxt);
-      nxt = vsapi->copyFrame(tmp, core);
-      vsapi->freeFrame(tmp);
-      next_num = w;
-      if (current.match[i] == -20 && hnt)
-      {
-        if (!usehints) current.match[i] = -200;
-        else current.match[i] = getTFMFrameProperties(nxt, current.filmd2v[i]);
-      }
+      prv = prevt;
+      nxt = vsapi->cloneFrameRef(nextt);
     }
 
     struct CalcMetricData d;
@@ -1409,9 +1480,10 @@ void TDecimate::calcMetricCycle(Cycle &current, bool scene, bool hnt, VSCore *co
     d.blocky = blocky;
     d.blocky_half = blocky_half;
     d.blocky_shift = blocky_shift;
-    d.diff = diff.get();
+    d.diff = diffp;
     d.nt = nt;
     d.ssd = ssd;
+    d.stripes = stripes.get();
 
     // here we need metrics and has scene
     d.metricF_needed = true;
@@ -1419,16 +1491,22 @@ void TDecimate::calcMetricCycle(Cycle &current, bool scene, bool hnt, VSCore *co
     d.scene = scene;
 
     CalcMetricsExtracted(prv, nxt, d, core, vsapi);
+    vsapi->freeFrame(prv);
+    vsapi->freeFrame(nxt);
 
     int xblocks = ((d.vi.width + d.blockx_half) >> d.blockx_shift) + 1;
     int yblocks = ((d.vi.height + d.blocky_half) >> d.blocky_shift) + 1;
     int arraysize = (xblocks * yblocks) << 2;
 
     highestDiff = 0;
+    int blockN = -20;
     for (int x = 0; x < arraysize; ++x)
     {
-      if (diff.get()[x] > highestDiff)
-        highestDiff = diff.get()[x];
+      if (diffp[x] > highestDiff)
+      {
+        highestDiff = diffp[x];
+        blockN = x;
+      }
     }
     if (ssd)
     {
@@ -1437,12 +1515,17 @@ void TDecimate::calcMetricCycle(Cycle &current, bool scene, bool hnt, VSCore *co
     }
     current.diffMetricsU[i] = highestDiff;
     current.diffMetricsN[i] = (highestDiff * 100.0) / MAX_DIFF;
+
+    cached.n = w;
+    cached.scene = scene;
+    cached.metricU = highestDiff;
+    cached.metricF = current.diffMetricsUF[i];
+    cached.blockN = blockN == -20 ? 0 : blockN;
+    cached.xblocks = xblocks << 2;
+    metricCache.store(cached);
   }
 
-  vsapi->freeFrame(prevt);
   vsapi->freeFrame(nextt);
-  vsapi->freeFrame(prv);
-  vsapi->freeFrame(nxt);
 
   current.mSet = true;
   current.setIsFilmD2V();
@@ -2555,6 +2638,94 @@ static bool FloatToFPS(double n, unsigned &num, unsigned &den)
 
 
 
+// Gathers the metrics of every cycle of the clip for init_mode_5. A cycle
+// only depends on its own frames and the one before it, so whole chunks of
+// cycles are handed out to the core's worker threads. Each cycle is set up
+// exactly as the sequential pass would do it, so the values are identical.
+void TDecimate::precomputeMetricCycles(CycleMetrics &cm, VSCore *core)
+{
+  const int numCycles = nfrms / cycle + 1;
+  const int chunkCycles = 8;
+  const int numChunks = (numCycles + chunkCycles - 1) / chunkCycles;
+
+  cm.diffMetricsU.assign(nfrms + 1, UINT64_MAX);
+  cm.diffMetricsUF.assign(nfrms + 1, UINT64_MAX);
+  cm.diffMetricsN.assign(nfrms + 1, -20.0);
+  cm.match.assign(nfrms + 1, -20);
+  cm.filmd2v.assign(nfrms + 1, -20);
+
+  std::atomic<int> nextChunk(0);
+  std::mutex errorLock;
+  std::exception_ptr error;
+
+  auto worker = [&]() {
+    try {
+      Cycle c(5, sdlim);
+      if (cycle > 5)
+        c.setSize(cycle);
+      c.length = cycle;
+      c.maxFrame = nfrms;
+
+      int chunk;
+      while ((chunk = nextChunk++) < numChunks)
+      {
+        const int last = std::min(numCycles, (chunk + 1) * chunkCycles);
+        for (int x = chunk * chunkCycles; x < last; ++x)
+        {
+          c.setFrame(x * cycle);
+          getOvrCycle(c, false); // PF 180131 uses usehints!
+          calcMetricCycle(c, true, true, core);
+          for (int w = c.frameSO, i = c.cycleS; i < c.cycleE; ++i, ++w)
+          {
+            cm.diffMetricsU[w] = c.diffMetricsU[i];
+            cm.diffMetricsUF[w] = c.diffMetricsUF[i];
+            cm.diffMetricsN[w] = c.diffMetricsN[i];
+            cm.match[w] = c.match[i];
+            cm.filmd2v[w] = c.filmd2v[i];
+          }
+        }
+      }
+    }
+    catch (...) {
+      std::lock_guard<std::mutex> guard(errorLock);
+      if (!error)
+        error = std::current_exception();
+      nextChunk = numChunks;
+    }
+  };
+
+  const int numThreads = std::min(std::max(vsapi->getCoreInfo(core)->numThreads, 1), numChunks);
+  std::vector<std::thread> threads;
+  for (int t = 1; t < numThreads; ++t)
+    threads.emplace_back(worker);
+  worker();
+  for (auto &t : threads)
+    t.join();
+
+  if (error)
+    std::rethrow_exception(error);
+}
+
+// Sequential counterpart of calcMetricCycle() for init_mode_5, fills the
+// cycle from the values gathered by precomputeMetricCycles().
+void TDecimate::loadMetricCycle(Cycle &current, const CycleMetrics &cm) const
+{
+  if (current.mSet || current.cycleS == current.cycleE)
+    return;
+
+  for (int w = current.frameSO, i = current.cycleS; i < current.cycleE; ++i, ++w)
+  {
+    current.diffMetricsU[i] = cm.diffMetricsU[w];
+    current.diffMetricsUF[i] = cm.diffMetricsUF[w];
+    current.diffMetricsN[i] = cm.diffMetricsN[w];
+    current.match[i] = cm.match[w];
+    current.filmd2v[i] = cm.filmd2v[w];
+  }
+
+  current.mSet = true;
+  current.setIsFilmD2V();
+}
+
 void TDecimate::init_mode_5(VSCore *core) {
   FILE *f = nullptr;
 
@@ -2574,6 +2745,8 @@ void TDecimate::init_mode_5(VSCore *core) {
   bool vid, prevVid;
   int i, h, w, firstkv, countprev, filmC, videoC, longestT, longestV, countVT;
   int count, b, passThrough = 0;
+  CycleMetrics cm;
+  precomputeMetricCycles(cm, core);
 twopassrun:
   ++passThrough;
 #if 0
@@ -2590,18 +2763,17 @@ twopassrun:
     {
       currM.setFrame(0);
       getOvrCycle(currM, false); // PF 180131 uses usehints!
-      calcMetricCycle(currM, true, true, core);
+      loadMetricCycle(currM, cm);
       checkVideoMatches(currM, currM);
       checkVideoMetrics(currM, vidThresh);
     }
     else
     {
-      prevM = currM;
-      currM = nextM;
+      Cycle::rotate(prevM, currM, nextM);
     }
     nextM.setFrame(b + cycle);
     getOvrCycle(nextM, false); // PF 180131 uses usehints!
-    calcMetricCycle(nextM, true, true, core); // PF 180131 uses usehints!
+    loadMetricCycle(nextM, cm);
     checkVideoMatches(currM, nextM);
     checkVideoMetrics(nextM, vidThresh);
     if (passThrough == 1)
@@ -2889,7 +3061,8 @@ TDecimate::TDecimate(VSNodeRef *_child, int _mode, int _cycleR, int _cycle, doub
   int _nt, int _blockx, int _blocky, bool _debug, bool _display, int _vfrDec,
   bool _batch, bool _tcfv1, bool _se, bool _chroma, bool _exPP, int _maxndl, bool _m2PA,
   bool _predenoise, bool _noblend, bool _ssd, bool _usehints, VSNodeRef *_clip2,
-  int _sdlim, int _opt, const char* _orgOut, const VSAPI *_vsapi, VSCore *core)
+  int _sdlim, int _opt, const char* _orgOut, bool _binaryOut, const char* _m2Plan,
+  const VSAPI *_vsapi, VSCore *core)
     : vsapi(_vsapi), child(_child),
   mode(_mode),
   cycleR(_cycleR), cycle(_cycle), rate(_rate), dupThresh(_dupThresh),
@@ -2900,8 +3073,9 @@ TDecimate::TDecimate(VSNodeRef *_child, int _mode, int _cycleR, int _cycle, doub
   vfrDec(_vfrDec), debug(_debug), display(_display), batch(_batch), tcfv1(_tcfv1), se(_se),
   maxndl(_maxndl), chroma(_chroma), m2PA(_m2PA), exPP(_exPP),
   noblend(_noblend), predenoise(_predenoise), ssd(_ssd), sdlim(_sdlim),
-  opt(_opt), clip2(_clip2), orgOut(_orgOut),
-  prev(5, 0), curr(5, 0), next(5, 0), nbuf(5, 0), usehints(_usehints), diff(nullptr, nullptr)
+  opt(_opt), clip2(_clip2), orgOut(_orgOut), binaryOut(_binaryOut), m2Plan(_m2Plan),
+  prev(5, 0), curr(5, 0), next(5, 0), nbuf(5, 0), usehints(_usehints),
+  metricsNode(nullptr), lookahead(0), metricCache(4096)
 {
     vi_child = vsapi->getVideoInfo(child);
     vi = *vi_child;
@@ -2969,6 +3143,8 @@ TDecimate::TDecimate(VSNodeRef *_child, int _mode, int _cycleR, int _cycle, doub
     throw TIVTCError("TDecimate:  vfrDec must be set to 0 or 1!");
   if (output.size() && (mode == 5 || mode == 6))
     throw TIVTCError("TDecimate:  output not supported in mode 5 and 6 (you should already have the metrics)!");
+  if (m2Plan.size() && mode != 2)
+    throw TIVTCError("TDecimate:  m2Plan is only supported in mode 2!");
   if (blockx != 4 && blockx != 8 && blockx != 16 && blockx != 32 && blockx != 64 &&
     blockx != 128 && blockx != 256 && blockx != 512 && blockx != 1024 && blockx != 2048)
     throw TIVTCError("TDecimate:  illegal blockx size!");
@@ -3109,31 +3285,54 @@ TDecimate::TDecimate(VSNodeRef *_child, int _mode, int _cycleR, int _cycle, doub
     }
 
 
-  if (mode <= 5 || mode == 7)
-  {
-    diff = decltype(diff) (vs_aligned_malloc<uint64_t>((((vi.width + blockx_half) >> blockx_shift) + 1)*(((vi.height + blocky_half) >> blocky_shift) + 1) * 4 * sizeof(uint64_t), 16), &vs_aligned_free);
-    if (diff == nullptr) throw TIVTCError("TDecimate:  malloc failure (diff)!");
-  }
+  // the buffers are allocated by the metric calculations, see createDiff
+  diffSize = (size_t)(((vi.width + blockx_half) >> blockx_shift) + 1)*(((vi.height + blocky_half) >> blocky_shift) + 1) * 4;
   if (output.size())
   {
     if ((f = tivtc_fopen(output.c_str(), "w")) != nullptr)
     {
-      _fullpath(outputFull, output.c_str(), MAX_PATH);
-      calcCRC(child, 15, outputCrc, vsapi);
       fclose(f);
       f = nullptr;
+      _fullpath(outputFull, output.c_str(), MAX_PATH);
+      calcCRC(child, 15, outputCrc, vsapi);
       metricsOutArray.resize(vi.numFrames * 2, UINT64_MAX);
     }
     else throw TIVTCError("TDecimate:  output error (cannot create output file)!");
   }
-  if (input.size())
+  if (input.size() && isBinaryMetricsFile(input.c_str()))
+  {
+    MetricsFileHeader header;
+    metricsArray.mapBinary(input.c_str(), vi.numFrames, batch && (mode == 5 || mode == 6) ? 0 : UINT64_MAX, header);
+    unsigned int tempCrc;
+    calcCRC(child, 15, tempCrc, vsapi);
+    if (tempCrc != header.crc && !batch)
+    {
+      char msg[160] = { 0 };
+      snprintf(msg, 160, "TDecimate:  crc32 in input file does not match that of the current clip (%#x vs %#x)!",
+        header.crc, tempCrc);
+      throw TIVTCError(msg);
+    }
+    if (header.blockx != blockx)
+      throw TIVTCError("TDecimate:  current blockx value does not match" \
+        " that which was used to create the given input file!");
+    if (header.blocky != blocky)
+      throw TIVTCError("TDecimate:  current blocky value does not match" \
+        " that which was used to create the given input file!");
+    if ((header.chroma != 0) != chroma)
+      throw TIVTCError("TDecimate:  current chroma setting does not match" \
+        " that which was used to create the given input file!");
+    metricsFullInfo = header.missing == 0 || (batch && (mode == 5 || mode == 6));
+    if (header.missing != 0 && (mode == 5 || mode == 6) && !batch)
+      throw TIVTCError("TDecimate:  input error (mode 5 and 6, all frames must have entries)!");
+  }
+  else if (input.size())
   {
     metricsArray.resize(vi.numFrames * 2);
 
     for (int h = 0; h < vi.numFrames * 2; ++h)
     {
-      if (!batch || (mode != 5 && mode != 6)) metricsArray[h] = UINT64_MAX;
-      else metricsArray[h] = 0;
+      if (!batch || (mode != 5 && mode != 6)) metricsArray.set(h, UINT64_MAX);
+      else metricsArray.set(h, 0);
     }
     if ((f = tivtc_fopen(input.c_str(), "r")) != nullptr)
     {
@@ -3156,7 +3355,14 @@ TDecimate::TDecimate(VSNodeRef *_child, int _mode, int _cycleR, int _cycle, doub
             linet++;
             unsigned int z, tempCrc;
             sscanf(linet, "%x", &z);
-            calcCRC(child, 15, tempCrc, vsapi);
+            try {
+              calcCRC(child, 15, tempCrc, vsapi);
+            }
+            catch (...) {
+              fclose(f);
+              f = nullptr;
+              throw;
+            }
             if (tempCrc != z && !batch)
             {
               fclose(f);
@@ -3240,8 +3446,8 @@ TDecimate::TDecimate(VSNodeRef *_child, int _mode, int _cycleR, int _cycle, doub
             f = nullptr;
             throw TIVTCError("TDecimate:  input error (out of range frame #)!");
           }
-          metricsArray[w * 2] = metricU;
-          metricsArray[w * 2 + 1] = metricF;
+          metricsArray.set(w * 2, metricU);
+          metricsArray.set(w * 2 + 1, metricF);
         }
       }
       fclose(f);
@@ -3270,8 +3476,8 @@ TDecimate::TDecimate(VSNodeRef *_child, int _mode, int _cycleR, int _cycle, doub
 
     for (int h = 0; h < vi.numFrames * 2; h += 2)
     {
-      metricsArray[h + 0] = UINT64_MAX - 1;
-      metricsArray[h + 1] = 0;
+      metricsArray.set(h + 0, UINT64_MAX - 1);
+      metricsArray.set(h + 1, 0);
     }
   }
   if (ovr.size())
@@ -3610,6 +3816,23 @@ TDecimate::TDecimate(VSNodeRef *_child, int _mode, int _cycleR, int _cycle, doub
   if (metricsFullInfo && (tfmFullInfo || !usehints)) fullInfo = true;
   else fullInfo = false;
 
+  // mode 3 gets one frame at a time, the other threads work inside the frame
+  if (mode == 3 && !metricsFullInfo)
+  {
+    const int threads = stripePoolThreads(vsapi->getCoreInfo(core)->numThreads);
+    if (threads)
+      stripes.reset(new StripePool(threads));
+  }
+
+  // enough cycles ahead to keep every thread of the core busy
+  if (mode < 2 && !metricsFullInfo)
+  {
+    lookahead = std::max((std::max(vsapi->getCoreInfo(core)->numThreads, 1) + cycle - 1) / cycle, 1);
+    viMetrics = *vi_child;
+    viMetrics.format = vsapi->registerFormat(cmGray, stInteger, 8, 0, 0, core);
+    viMetrics.width = viMetrics.height = 1;
+  }
+
   if (mode < 2)
   {
     if (hybrid != 3)
@@ -3700,7 +3923,6 @@ TDecimate::TDecimate(VSNodeRef *_child, int _mode, int _cycleR, int _cycle, doub
   else if (mode == 5)
   {
     init_mode_5(core);
-    diff = nullptr; // mode 5 is using diff buffer only at init
   } // mode 5
   else if (mode == 6)
   {
@@ -3894,12 +4116,20 @@ TDecimate::TDecimate(VSNodeRef *_child, int _mode, int _cycleR, int _cycle, doub
 
 TDecimate::~TDecimate()
 {
+  for (auto &slot : blurCache)
+    vsapi->freeFrame(slot.second);
   if (metricsOutArray.size())
   {
     if (output.size())
     {
       FILE *f = nullptr;
-      if ((f = tivtc_fopen(outputFull, "w")) != nullptr)
+      if (binaryOut)
+      {
+        // the next run would map a partial file as it is
+        if (!writeBinaryMetricsFile(outputFull, outputCrc, blockx, blocky, chroma, metricsOutArray))
+          tivtc_remove(outputFull);
+      }
+      else if ((f = tivtc_fopen(outputFull, "w")) != nullptr)
       {
         uint64_t metricU, metricF;
         fprintf(f, "#TDecimate %s by tritical\n", VERSION);
@@ -3921,6 +4151,7 @@ TDecimate::~TDecimate()
   }
   if (mkvOutF != nullptr) fclose(mkvOutF);
 
+  vsapi->freeNode(metricsNode);
   vsapi->freeNode(child);
   vsapi->freeNode(clip2);
 }
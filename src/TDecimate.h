@@ -39,6 +39,7 @@
 #include <windows.h>
 #endif
 #include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
 #include <unordered_map>
@@ -46,12 +47,16 @@
 #include <VSHelper.h>
 
 #include "internal.h"
-//#include "Font.h"
+#include "Font.h"
 #include "Cycle.h"
 #include "calcCRC.h"
 //#include "profUtil.h"
 //#include "Cache.h"
 #include "cpufeatures.h"
+#include "MetricCache.h"
+#include "MetricsFile.h"
+#include "ScratchPool.h"
+#include "StripePool.h"
 
 enum {
     RetFrameIsReady = 69,
@@ -74,6 +79,7 @@ struct CalcMetricData {
   uint64_t* diff;
   int nt;
   bool ssd; // ssd or sad
+  StripePool *stripes = nullptr; // splits every plane into horizontal stripes
 
   bool metricF_needed; // from TDecimate: true, from FrameDiff: false
   // TDecimate
@@ -84,7 +90,7 @@ struct CalcMetricData {
 void CalcMetricsExtracted(const VSFrameRef *prevt, const VSFrameRef *currt, CalcMetricData& d, VSCore *core, const VSAPI *vsapi);
 
 void blurFrame(const VSFrameRef *src, VSFrameRef *dst, int iterations,
-  bool bchroma, const CPUFeatures *cpuFlags, VSCore *core, const VSAPI *vsapi);
+  bool bchroma, const CPUFeatures *cpuFlags, VSCore *core, const VSAPI *vsapi, StripePool *stripes = nullptr);
 
 uint64_t calcLumaDiffYUY2_SSD(const uint8_t* prvp, const uint8_t* nxtp,
   int width, int height, int prv_pitch, int nxt_pitch, int nt, int cpuFlags);
@@ -92,6 +98,22 @@ uint64_t calcLumaDiffYUY2_SSD(const uint8_t* prvp, const uint8_t* nxtp,
 uint64_t calcLumaDiffYUY2_SAD(const uint8_t* prvp, const uint8_t* nxtp,
   int width, int height, int prv_pitch, int nxt_pitch, int nt, int cpuFlags);
 
+// Block sums of one metric calculation (CalcMetricData::diff). Every
+// calculation takes its own buffer from the pool, so frames that are
+// processed at the same time do not add into each other's blocks.
+struct TDecimateDiff {
+  std::unique_ptr<uint64_t, decltype (&vs_aligned_free)> buf;
+
+  TDecimateDiff() : buf(nullptr, nullptr) {}
+};
+
+// Per-frame metrics of the whole clip, gathered up front for mode 5.
+struct CycleMetrics {
+  std::vector<uint64_t> diffMetricsU, diffMetricsUF;
+  std::vector<double> diffMetricsN;
+  std::vector<int> match, filmd2v;
+};
+
 class TDecimate
 {
 private:
@@ -134,6 +156,8 @@ private:
   int opt;
   VSNodeRef *clip2;
   std::string orgOut;
+  bool binaryOut;
+  std::string m2Plan; // mode 2: file the global plan is saved to and reloaded from
   Cycle prev, curr, next, nbuf;
 
   int nfrms, nfrmsN, linearCount;
@@ -144,9 +168,23 @@ private:
   double fps, mkvfps, mkvfps2;
   bool useTFMPP, cve, ecf, fullInfo;
   bool usehints;
-  std::unique_ptr<uint64_t, decltype (&vs_aligned_free)> diff;
-  std::vector<uint64_t> metricsArray, metricsOutArray, mode2_metrics;
+  size_t diffSize; // number of uint64_t block sums
+  mutable ScratchPool<TDecimateDiff> diffPool;
+  // modes 0/1: metrics of the coming cycles, computed ahead by an internal
+  // node, see GetFrameMetrics
+  VSNodeRef *metricsNode;
+  int lookahead; // cycles requested from metricsNode past the next one
+  // predenoise: the last two blurred frames, by frame number
+  mutable std::mutex blurLock;
+  mutable std::pair<int, const VSFrameRef *> blurCache[2] = { { -1, nullptr }, { -1, nullptr } };
+  mutable int blurCacheNext = 0;
+  mutable MetricCache metricCache;
+  // mode 3: runs the metric and blur kernels of one frame on several threads
+  std::unique_ptr<StripePool> stripes;
+  MetricsArray metricsArray;
+  std::vector<uint64_t> metricsOutArray, mode2_metrics;
   std::vector<int> aLUT, mode2_decA, mode2_order;
+  std::vector<int> mode2_cycleLUT; // mode 2: output frame -> cycle in aLUT
   std::unordered_map<int, std::pair<int, int>> frame_duration_info;
   unsigned int outputCrc;
   std::vector<uint8_t> ovrArray;
@@ -155,6 +193,8 @@ private:
   char outputFull[MAX_PATH];
 
   void init_mode_5(VSCore *core);
+  void precomputeMetricCycles(CycleMetrics &cm, VSCore *core);
+  void loadMetricCycle(Cycle &current, const CycleMetrics &cm) const;
   void rerunFromStart(const int s, VSFrameContext *frameCtx, VSCore *core);
   void checkVideoMetrics(Cycle &c, double thresh);
   void checkVideoMatches(Cycle &p, Cycle &c);
@@ -197,6 +237,7 @@ private:
   bool checkForTwoDropLongestString(Cycle &p, Cycle &c, Cycle &n);
   int getNonDecMode2(int n, int start, int stop) const;
   double buildDecStrategy();
+  uint64_t mode2PlanKey(const int rc[10]) const;
   void mode2MarkDecFrames(int cycleF);
   void removeMinN(int m, int n, int start, int stop);
   void removeMinN(int m, int n, uint64_t *metricsT, int *orderT, int &ovrC);
@@ -206,8 +247,10 @@ private:
   void sortMetrics(uint64_t *metrics, int *order, int length) const;
   //void SedgeSort(uint64_t *metrics, int *order, int length);
   //void pQuickerSort(uint64_t *metrics, int *order, int lower, int upper);
+  std::unique_ptr<TDecimateDiff> createDiff() const;
   void calcMetricCycle(Cycle &current, bool scene, bool hnt, VSCore *core, VSFrameContext *frameCtx=nullptr) const;
-  uint64_t calcMetric(const VSFrameRef *prevt, const VSFrameRef *currt, const VSVideoInfo *vi, int &blockNI,
+  const VSFrameRef *getBlurredFrame(int n, const VSFrameRef *src, VSCore *core) const;
+  uint64_t calcMetric(const VSFrameRef *prevt, const VSFrameRef *currt, int prevn, int currn, const VSVideoInfo *vi, int &blockNI,
     int &xblocksI, uint64_t &metricF, bool scene, VSCore *core) const;
 
 
@@ -223,8 +266,12 @@ private:
   void calcMetricPreBuf(int n1, int n2, int pos, const VSVideoInfo *vit, bool scene, bool gethint, VSFrameContext *frameCtx, VSCore *core);
 public:
   VSVideoInfo vi;
+  VSVideoInfo viMetrics; // output of the metrics node, 1x1 dummy frames
 
   const VSFrameRef *GetFrame(int n, int activationReason, void **frameData, VSFrameContext *frameCtx, VSCore *core);
+  const VSFrameRef *GetFrameMetrics(int n, int activationReason, VSFrameContext *frameCtx, VSCore *core);
+  bool wantsMetricsNode() const { return lookahead > 0; }
+  void setMetricsNode(VSNodeRef *node) { metricsNode = node; }
   TDecimate(VSNodeRef *_child, int _mode, int _cycleR, int _cycle, double _rate,
     double _dupThresh, double _vidThresh, double _sceneThresh, int _hybrid,
     int _vidDetect, int _conCycle, int _conCycleTP, const char* _ovr,
@@ -232,7 +279,8 @@ public:
     int _nt, int _blockx, int _blocky, bool _debug, bool _display, int _vfrDec,
     bool _batch, bool _tcfv1, bool _se, bool _chroma, bool _exPP, int _maxndl,
     bool _m2PA, bool _predenoise, bool _noblend, bool _ssd, bool _usehints,
-    VSNodeRef *_clip2, int _sdlim, int _opt, const char* _orgOut, const VSAPI *_vsapi, VSCore *core);
+    VSNodeRef *_clip2, int _sdlim, int _opt, const char* _orgOut, bool _binaryOut, const char* _m2Plan,
+    const VSAPI *_vsapi, VSCore *core);
   ~TDecimate();
 
 //  int __stdcall SetCacheHints(int cachehints, int frame_range) override {
@@ -28,6 +28,7 @@
 #include "TCommonASM.h"
 #include "emmintrin.h"
 #include "smmintrin.h" // SSE4
+#include "immintrin.h" // AVX2
 #include <assert.h>
 
 static void blend_uint8_c(uint8_t* dstp, const uint8_t* srcp1,
@@ -167,6 +168,88 @@ static void blend_uint16_SSE4(uint8_t* dstp, const uint8_t* srcp1, const uint8_t
   }
 }
 
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif 
+static void blend_uint8_AVX2(uint8_t* dstp, const uint8_t* srcp1,
+  const uint8_t* srcp2, int width, int height, int dst_pitch,
+  int src1_pitch, int src2_pitch, int weight_i)
+{
+  // same arithmetic as the SSE2 version, results are identical
+  assert(weight_i != 0 && weight_i != 65536);
+  __m256i iw1 = _mm256_set1_epi16((short)weight_i);
+  __m256i iw2 = _mm256_set1_epi16((short)(65536 - weight_i));
+  while (height--) {
+    for (int x = 0; x < width; x += 32) {
+      __m256i src1 = _mm256_load_si256(reinterpret_cast<const __m256i *>(srcp1 + x));
+      __m256i src2 = _mm256_load_si256(reinterpret_cast<const __m256i *>(srcp2 + x));
+      __m256i src1_lo = _mm256_unpacklo_epi8(src1, src1);
+      __m256i src2_lo = _mm256_unpacklo_epi8(src2, src2);
+      __m256i src1_hi = _mm256_unpackhi_epi8(src1, src1);
+      __m256i src2_hi = _mm256_unpackhi_epi8(src2, src2);
+      __m256i mulres_lo = _mm256_adds_epu16(_mm256_mulhi_epu16(src1_lo, iw1), _mm256_mulhi_epu16(src2_lo, iw2));
+      __m256i mulres_hi = _mm256_adds_epu16(_mm256_mulhi_epu16(src1_hi, iw1), _mm256_mulhi_epu16(src2_hi, iw2));
+
+      mulres_lo = _mm256_srli_epi16(mulres_lo, 8);
+      mulres_hi = _mm256_srli_epi16(mulres_hi, 8);
+
+      // unpack and pack both work within 128 bit lanes, so the order is kept
+      __m256i res = _mm256_packus_epi16(mulres_lo, mulres_hi);
+      _mm256_store_si256(reinterpret_cast<__m256i *>(dstp + x), res);
+    }
+    dstp += dst_pitch;
+    srcp1 += src1_pitch;
+    srcp2 += src2_pitch;
+  }
+}
+
+template<bool lessThan16bits>
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif 
+static void blend_uint16_AVX2(uint8_t* dstp, const uint8_t* srcp1, const uint8_t* srcp2,
+  int width, int height,
+  int dst_pitch, int src1_pitch, int src2_pitch, int weight_i, int bits_per_pixel)
+{
+  assert(weight_i != 0 && weight_i != 32768);
+  // 15 bit integer arithmetic, see blend_uint16_SSE4
+  auto round_mask = _mm256_set1_epi32(0x4000);
+  auto weight = _mm256_set1_epi32(weight_i);
+  auto zero = _mm256_setzero_si256();
+
+  const int max_pixel_value = (1 << bits_per_pixel) - 1;
+  auto max_pixel_value_256 = _mm256_set1_epi16((short)max_pixel_value);
+
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width * (int)sizeof(uint16_t); x += 32) {
+      auto src1 = _mm256_load_si256(reinterpret_cast<const __m256i*>(srcp1 + x));
+      auto src2 = _mm256_load_si256(reinterpret_cast<const __m256i*>(srcp2 + x));
+
+      auto src1_lo = _mm256_unpacklo_epi16(src1, zero);
+      auto src1_hi = _mm256_unpackhi_epi16(src1, zero);
+
+      auto src2_lo = _mm256_unpacklo_epi16(src2, zero);
+      auto src2_hi = _mm256_unpackhi_epi16(src2, zero);
+
+      auto lerp_lo = _mm256_mullo_epi32(_mm256_sub_epi32(src1_lo, src2_lo), weight);
+      auto lerp_hi = _mm256_mullo_epi32(_mm256_sub_epi32(src1_hi, src2_hi), weight);
+
+      lerp_lo = _mm256_srai_epi32(_mm256_add_epi32(lerp_lo, round_mask), 15);
+      lerp_hi = _mm256_srai_epi32(_mm256_add_epi32(lerp_hi, round_mask), 15);
+
+      auto result = _mm256_packus_epi32(_mm256_add_epi32(src2_lo, lerp_lo), _mm256_add_epi32(src2_hi, lerp_hi));
+      if constexpr(lessThan16bits) // otherwise no clamp needed
+        result = _mm256_min_epu16(result, max_pixel_value_256);
+
+      _mm256_store_si256(reinterpret_cast<__m256i*>(dstp + x), result);
+    }
+
+    dstp += dst_pitch;
+    srcp1 += src1_pitch;
+    srcp2 += src2_pitch;
+  }
+}
+
 // handles 50% special case as well
 // hbd ready
 void dispatch_blend(uint8_t* dstp, const uint8_t* srcp1, const uint8_t* srcp2, int width, int height,
@@ -174,6 +257,7 @@ void dispatch_blend(uint8_t* dstp, const uint8_t* srcp1, const uint8_t* srcp2, i
 {
   const bool use_sse2 = cpuFlags->sse2;
   const bool use_sse4 = cpuFlags->sse4_1;
+  const bool use_avx2 = cpuFlags->avx2;
 
   // weight_i 0 and max --> copy is already handled!
   // weight_i is of 15 bit scale
@@ -181,13 +265,17 @@ void dispatch_blend(uint8_t* dstp, const uint8_t* srcp1, const uint8_t* srcp2, i
   // special 50% case
   if (weight_i == 32768 / 2) {
     if (bits_per_pixel == 8) {
-      if (use_sse2)
+      if (use_avx2)
+        blend_5050_AVX2<uint8_t>(dstp, srcp1, srcp2, width, height, dst_pitch, src1_pitch, src2_pitch);
+      else if (use_sse2)
         blend_5050_SSE2<uint8_t>(dstp, srcp1, srcp2, width, height, dst_pitch, src1_pitch, src2_pitch);
       else
         blend_5050_c<uint8_t>(dstp, srcp1, srcp2, width, height, dst_pitch, src1_pitch, src2_pitch);
     }
     else {
-      if (use_sse2)
+      if (use_avx2)
+        blend_5050_AVX2<uint16_t>(dstp, srcp1, srcp2, width, height, dst_pitch, src1_pitch, src2_pitch);
+      else if (use_sse2)
         blend_5050_SSE2<uint16_t>(dstp, srcp1, srcp2, width, height, dst_pitch, src1_pitch, src2_pitch);
       else
         blend_5050_c<uint16_t>(dstp, srcp1, srcp2, width, height, dst_pitch, src1_pitch, src2_pitch);
@@ -198,7 +286,9 @@ void dispatch_blend(uint8_t* dstp, const uint8_t* srcp1, const uint8_t* srcp2, i
   // arbitrary blend
   if (bits_per_pixel == 8) {
     // using 16 bit scaled values inside instead of 15 bit scaled
-    if(use_sse2)
+    if (use_avx2)
+      blend_uint8_AVX2(dstp, srcp1, srcp2, width, height, dst_pitch, src1_pitch, src2_pitch, weight_i * 2);
+    else if(use_sse2)
       blend_uint8_SSE2(dstp, srcp1, srcp2, width, height, dst_pitch, src1_pitch, src2_pitch, weight_i * 2);
     else
       blend_uint8_c(dstp, srcp1, srcp2, width, height, dst_pitch, src1_pitch, src2_pitch, weight_i * 2);
@@ -206,7 +296,13 @@ void dispatch_blend(uint8_t* dstp, const uint8_t* srcp1, const uint8_t* srcp2, i
   }
 
   // 10-16 bits
-  if (use_sse4) {
+  if (use_avx2) {
+    if (bits_per_pixel < 16)
+      blend_uint16_AVX2<true>(dstp, srcp1, srcp2, width, height, dst_pitch, src1_pitch, src2_pitch, weight_i, bits_per_pixel);
+    else
+      blend_uint16_AVX2<false>(dstp, srcp1, srcp2, width, height, dst_pitch, src1_pitch, src2_pitch, weight_i, bits_per_pixel);
+  }
+  else if (use_sse4) {
     if (bits_per_pixel < 16)
       blend_uint16_SSE4<true>(dstp, srcp1, srcp2, width, height, dst_pitch, src1_pitch, src2_pitch, weight_i, bits_per_pixel);
     else
@@ -1465,3 +1561,203 @@ template void calcDiff_SADorSSD_Generic_c<uint16_t, true, 1>(const uint16_t* prv
   int prv_pitch, int cur_pitch, int width, int height, int plane, int xblocks4, uint64_t* diff, bool chroma, int xshiftS, int yshiftS, int xhalfS, int yhalfS, int nt, const VSVideoInfo *vi);
 
 
+// SIMD counterpart of calcDiff_SADorSSD_Generic_c for any block size and nt.
+// The thresholded pixel differences of yhalf rows are summed per column with
+// SIMD, then the half-block sums are collected from the column sums.
+// Integer sums, so the result is the same as the C version.
+
+// 8 pixels: |a-b| or (a-b)^2, scaled back to 8 bit range, zeroed when <= nt
+template<typename pixel_t, bool SAD>
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("sse4.1")))
+#endif 
+static void calcColumnDiffs_SSE4(const pixel_t* prvp, const pixel_t* curp,
+  int prv_pitch, int cur_pitch, int width, int rows, int shift_count, int nt, int* colsum)
+{
+  const __m128i shift = _mm_cvtsi32_si128(shift_count);
+  const __m128i ntv = _mm_set1_epi32(nt);
+  memset(colsum, 0, (width + 7) / 8 * 8 * sizeof(int));
+  for (int u = 0; u < rows; ++u)
+  {
+    for (int x = 0; x < width; x += 8)
+    {
+      __m128i prv, cur;
+      if constexpr (sizeof(pixel_t) == 1) {
+        prv = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(prvp + x)));
+        cur = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(curp + x)));
+      }
+      else {
+        prv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prvp + x));
+        cur = _mm_loadu_si128(reinterpret_cast<const __m128i*>(curp + x));
+      }
+      auto absdiff = _mm_or_si128(_mm_subs_epu16(prv, cur), _mm_subs_epu16(cur, prv));
+      auto lo = _mm_cvtepu16_epi32(absdiff);
+      auto hi = _mm_cvtepu16_epi32(_mm_srli_si128(absdiff, 8));
+      if constexpr (!SAD) {
+        // up to 65535^2, the low 32 bits are exact as unsigned
+        lo = _mm_mullo_epi32(lo, lo);
+        hi = _mm_mullo_epi32(hi, hi);
+      }
+      lo = _mm_srl_epi32(lo, shift);
+      hi = _mm_srl_epi32(hi, shift);
+      lo = _mm_and_si128(lo, _mm_cmpgt_epi32(lo, ntv));
+      hi = _mm_and_si128(hi, _mm_cmpgt_epi32(hi, ntv));
+      auto sum_lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(colsum + x));
+      auto sum_hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(colsum + x + 4));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(colsum + x), _mm_add_epi32(sum_lo, lo));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(colsum + x + 4), _mm_add_epi32(sum_hi, hi));
+    }
+    prvp += prv_pitch;
+    curp += cur_pitch;
+  }
+}
+
+// same for 16 pixels
+template<typename pixel_t, bool SAD>
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif 
+static void calcColumnDiffs_AVX2(const pixel_t* prvp, const pixel_t* curp,
+  int prv_pitch, int cur_pitch, int width, int rows, int shift_count, int nt, int* colsum)
+{
+  const __m128i shift = _mm_cvtsi32_si128(shift_count);
+  const __m256i ntv = _mm256_set1_epi32(nt);
+  memset(colsum, 0, (width + 15) / 16 * 16 * sizeof(int));
+  for (int u = 0; u < rows; ++u)
+  {
+    for (int x = 0; x < width; x += 16)
+    {
+      __m256i prv, cur;
+      if constexpr (sizeof(pixel_t) == 1) {
+        prv = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(prvp + x)));
+        cur = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(curp + x)));
+      }
+      else {
+        prv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prvp + x));
+        cur = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(curp + x));
+      }
+      auto absdiff = _mm256_or_si256(_mm256_subs_epu16(prv, cur), _mm256_subs_epu16(cur, prv));
+      auto lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(absdiff));
+      auto hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(absdiff, 1));
+      if constexpr (!SAD) {
+        lo = _mm256_mullo_epi32(lo, lo);
+        hi = _mm256_mullo_epi32(hi, hi);
+      }
+      lo = _mm256_srl_epi32(lo, shift);
+      hi = _mm256_srl_epi32(hi, shift);
+      lo = _mm256_and_si256(lo, _mm256_cmpgt_epi32(lo, ntv));
+      hi = _mm256_and_si256(hi, _mm256_cmpgt_epi32(hi, ntv));
+      auto sum_lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(colsum + x));
+      auto sum_hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(colsum + x + 8));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(colsum + x), _mm256_add_epi32(sum_lo, lo));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(colsum + x + 8), _mm256_add_epi32(sum_hi, hi));
+    }
+    prvp += prv_pitch;
+    curp += cur_pitch;
+  }
+}
+
+// true: SAD, false: SSD
+template<typename pixel_t, bool SAD>
+void calcDiff_SADorSSD_Generic_SIMD(const pixel_t* prvp, const pixel_t* curp,
+  int prv_pitch, int cur_pitch, int width, int height, int plane, int xblocks4, uint64_t* diff,
+  bool chroma, int xshiftS, int yshiftS, int xhalfS, int yhalfS, int nt,
+  const VSVideoInfo *vi, const CPUFeatures *cpuFlags)
+{
+  (void)chroma;
+
+  int temp1, temp2;
+  int box1, box2;
+  int yshift, yhalf, xshift, xhalf;
+  int heighta, widtha;
+
+  const int bits_per_pixel = vi->format->bitsPerSample;
+  const int shift_count = sizeof(pixel_t) == 1 ? 0 : SAD ? (bits_per_pixel - 8) : 2 * (bits_per_pixel - 8);
+
+  {
+    const int ysubsampling = plane == 0 ? 0 : vi->format->subSamplingH;
+    const int xsubsampling = plane == 0 ? 0 : vi->format->subSamplingW;
+    yshift = yshiftS - ysubsampling;
+    yhalf = yhalfS >> ysubsampling;
+    xshift = xshiftS - xsubsampling;
+    xhalf = xhalfS >> xsubsampling;
+  }
+
+  auto columnDiffs = cpuFlags->avx2 ? calcColumnDiffs_AVX2<pixel_t, SAD> : calcColumnDiffs_SSE4<pixel_t, SAD>;
+  // Column sums of up to colsumWidth columns at a time. Every xhalf divides
+  // it, so half blocks never cross a chunk.
+  constexpr int colsumWidth = 2048;
+  alignas(32) int colsum[colsumWidth];
+
+  heighta = (height >> (yshift - 1)) << (yshift - 1);
+  widtha = (width >> (xshift - 1)) << (xshift - 1);
+  // whole blocks
+  for (int y = 0; y < heighta; y += yhalf)
+  {
+    temp1 = (y >> yshift) * xblocks4;
+    temp2 = ((y + yhalf) >> yshift) * xblocks4;
+    for (int xc = 0; xc < width; xc += colsumWidth)
+    {
+      const int xstop = std::min(xc + colsumWidth, width);
+      columnDiffs(prvp + xc, curp + xc, prv_pitch, cur_pitch, xstop - xc, yhalf, shift_count, nt, colsum);
+      for (int x = xc; x < xstop; )
+      {
+        // whole half blocks, then the rest on the right column by column
+        const int step = x < widtha ? xhalf : 1;
+        int diffs = 0;
+        for (int v = 0; v < step; ++v)
+          diffs += colsum[x - xc + v];
+        if (diffs > nt)
+        {
+          box1 = (x >> xshift) << 2;
+          box2 = ((x + xhalf) >> xshift) << 2;
+          diff[temp1 + box1 + 0] += diffs;
+          diff[temp1 + box2 + 1] += diffs;
+          diff[temp2 + box1 + 2] += diffs;
+          diff[temp2 + box2 + 3] += diffs;
+        }
+        x += step;
+      }
+    }
+    prvp += prv_pitch * yhalf;
+    curp += cur_pitch * yhalf;
+  }
+  // rest non-whole block at the bottom, each pixel is its own sum
+  for (int y = heighta; y < height; ++y)
+  {
+    temp1 = (y >> yshift) * xblocks4;
+    temp2 = ((y + yhalf) >> yshift) * xblocks4;
+    for (int xc = 0; xc < width; xc += colsumWidth)
+    {
+      const int xstop = std::min(xc + colsumWidth, width);
+      columnDiffs(prvp + xc, curp + xc, prv_pitch, cur_pitch, xstop - xc, 1, shift_count, nt, colsum);
+      for (int x = xc; x < xstop; ++x)
+      {
+        const int difft = colsum[x - xc];
+        if (difft > nt)
+        {
+          box1 = (x >> xshift) << 2;
+          box2 = ((x + xhalf) >> xshift) << 2;
+          diff[temp1 + box1 + 0] += difft;
+          diff[temp1 + box2 + 1] += difft;
+          diff[temp2 + box1 + 2] += difft;
+          diff[temp2 + box2 + 3] += difft;
+        }
+      }
+    }
+    prvp += prv_pitch;
+    curp += cur_pitch;
+  }
+}
+
+// instantiate
+template void calcDiff_SADorSSD_Generic_SIMD<uint8_t, false>(const uint8_t* prvp, const uint8_t* curp,
+  int prv_pitch, int cur_pitch, int width, int height, int plane, int xblocks4, uint64_t* diff, bool chroma, int xshiftS, int yshiftS, int xhalfS, int yhalfS, int nt, const VSVideoInfo *vi, const CPUFeatures *cpuFlags);
+template void calcDiff_SADorSSD_Generic_SIMD<uint8_t, true>(const uint8_t* prvp, const uint8_t* curp,
+  int prv_pitch, int cur_pitch, int width, int height, int plane, int xblocks4, uint64_t* diff, bool chroma, int xshiftS, int yshiftS, int xhalfS, int yhalfS, int nt, const VSVideoInfo *vi, const CPUFeatures *cpuFlags);
+template void calcDiff_SADorSSD_Generic_SIMD<uint16_t, false>(const uint16_t* prvp, const uint16_t* curp,
+  int prv_pitch, int cur_pitch, int width, int height, int plane, int xblocks4, uint64_t* diff, bool chroma, int xshiftS, int yshiftS, int xhalfS, int yhalfS, int nt, const VSVideoInfo *vi, const CPUFeatures *cpuFlags);
+template void calcDiff_SADorSSD_Generic_SIMD<uint16_t, true>(const uint16_t* prvp, const uint16_t* curp,
+  int prv_pitch, int cur_pitch, int width, int height, int plane, int xblocks4, uint64_t* diff, bool chroma, int xshiftS, int yshiftS, int xhalfS, int yhalfS, int nt, const VSVideoInfo *vi, const CPUFeatures *cpuFlags);
+
+
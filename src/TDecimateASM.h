@@ -90,6 +90,10 @@ template<typename pixel_t, bool SAD, int inc>
 void calcDiff_SADorSSD_Generic_c(const pixel_t* prvp, const pixel_t* curp,
   int prv_pitch, int cur_pitch, int width, int height, int plane, int xblocks4, uint64_t* diff, bool chroma, int xshiftS, int yshiftS, int xhalfS, int yhalfS, int nt, const VSVideoInfo *vi);
 
+template<typename pixel_t, bool SAD>
+void calcDiff_SADorSSD_Generic_SIMD(const pixel_t* prvp, const pixel_t* curp,
+  int prv_pitch, int cur_pitch, int width, int height, int plane, int xblocks4, uint64_t* diff, bool chroma, int xshiftS, int yshiftS, int xhalfS, int yhalfS, int nt, const VSVideoInfo *vi, const CPUFeatures *cpuFlags);
+
 void CalcMetricsExtracted(const VSFrameRef *prevt, const VSFrameRef *currt, CalcMetricData& d, VSCore *core, const VSAPI *vsapi);
 
 template<typename pixel_t>
@@ -107,19 +111,20 @@ void HorizontalBlur_Planar_SSE2(const uint8_t* srcp, uint8_t* dstp, int src_pitc
 //void HorizontalBlur_YUY2_SSE2(const uint8_t* srcp, uint8_t* dstp, int src_pitch,
 //  int dst_pitch, int width, int height);
 
+// blurs only rows of the given stripe (out of stripes) in every plane
 void HorizontalBlur(const VSFrameRef *src, VSFrameRef *dst, bool bchroma,
-  const CPUFeatures *cpuFlags, const VSAPI *vsapi);
+  const CPUFeatures *cpuFlags, const VSAPI *vsapi, int stripe, int stripes);
 
 template<typename pixel_t>
 void VerticalBlur_c(const uint8_t* srcp, uint8_t* dstp, int src_pitch,
-  int dst_pitch, int width, int height);
+  int dst_pitch, int width, int height, int ystart, int ystop);
 //void VerticalBlur_YUY2_c(const uint8_t* srcp, uint8_t* dstp, int src_pitch,
 //  int dst_pitch, int width, int height, int inc);
 
 void VerticalBlur_SSE2(const uint8_t* srcp, uint8_t* dstp, int src_pitch,
-  int dst_pitch, int width, int height);
+  int dst_pitch, int width, int height, int ystart, int ystop);
 
-void VerticalBlur(const VSFrameRef *src, VSFrameRef *dst, bool bchroma, const CPUFeatures *opti, const VSAPI *vsapi);
+void VerticalBlur(const VSFrameRef *src, VSFrameRef *dst, bool bchroma, const CPUFeatures *opti, const VSAPI *vsapi, int stripe, int stripes);
 
 
 // handles 50% special case as well
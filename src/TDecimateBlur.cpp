@@ -27,26 +27,30 @@
 #include "TDecimateASM.h"
 
 // hbd ready
+// With a stripe pool every pass is split into horizontal stripes; the
+// vertical pass starts only when the whole horizontal pass is done.
 void blurFrame(const VSFrameRef *src, VSFrameRef *dst, int iterations,
-  bool bchroma, const CPUFeatures *cpuFlags, VSCore *core, const VSAPI *vsapi)
+  bool bchroma, const CPUFeatures *cpuFlags, VSCore *core, const VSAPI *vsapi, StripePool *stripes)
 {
     const VSFormat *format = vsapi->getFrameFormat(src);
     int width = vsapi->getFrameWidth(src, 0);
     int height = vsapi->getFrameHeight(src, 0);
 
+  const int count = stripeCount(stripes, height, 1, 32);
+
   VSFrameRef *tmp = vsapi->newVideoFrame(format, width, height, nullptr, core);
-  HorizontalBlur(src, tmp, bchroma, cpuFlags, vsapi);
-  VerticalBlur(tmp, dst, bchroma, cpuFlags, vsapi);
+  runStripes(stripes, count, [&](int s) { HorizontalBlur(src, tmp, bchroma, cpuFlags, vsapi, s, count); });
+  runStripes(stripes, count, [&](int s) { VerticalBlur(tmp, dst, bchroma, cpuFlags, vsapi, s, count); });
   for (int i = 1; i < iterations; ++i)
   {
-    HorizontalBlur(dst, tmp, bchroma, cpuFlags, vsapi);
-    VerticalBlur(tmp, dst, bchroma, cpuFlags, vsapi);
+    runStripes(stripes, count, [&](int s) { HorizontalBlur(dst, tmp, bchroma, cpuFlags, vsapi, s, count); });
+    runStripes(stripes, count, [&](int s) { VerticalBlur(tmp, dst, bchroma, cpuFlags, vsapi, s, count); });
   }
   vsapi->freeFrame(tmp);
 }
 
 void HorizontalBlur(const VSFrameRef *src, VSFrameRef *dst, bool bchroma,
-  const CPUFeatures *cpuFlags, const VSAPI *vsapi)
+  const CPUFeatures *cpuFlags, const VSAPI *vsapi, int stripe, int stripes)
 {
     const VSFormat *format = vsapi->getFrameFormat(src);
 
@@ -63,9 +67,13 @@ void HorizontalBlur(const VSFrameRef *src, VSFrameRef *dst, bool bchroma,
     int src_pitch = vsapi->getStride(src, plane);
     int width = vsapi->getFrameWidth(src, plane);
     int widtha = (width >> 3) << 3; // mod 8
-    int height = vsapi->getFrameHeight(src, plane);
+    int ystart, ystop;
+    StripePool::stripeRows(vsapi->getFrameHeight(src, plane), 1, stripes, stripe, ystart, ystop);
+    int height = ystop - ystart;
     uint8_t *dstp = vsapi->getWritePtr(dst, plane);
     int dst_pitch = vsapi->getStride(dst, plane);
+    srcp += ystart * src_pitch;
+    dstp += ystart * dst_pitch;
 
       if (pixelsize == 1 && use_sse2 && width >= 8)
       {
@@ -85,39 +93,36 @@ void HorizontalBlur(const VSFrameRef *src, VSFrameRef *dst, bool bchroma,
   }
 }
 
+// output rows [ystart, ystop) of a height tall plane
 template<typename pixel_t>
 void VerticalBlur_c(const uint8_t* srcp0, uint8_t* dstp0, int src_pitch,
-  int dst_pitch, int width, int height)
+  int dst_pitch, int width, int height, int ystart, int ystop)
 {
   if (width == 0) return;
 
-  pixel_t* dstp = reinterpret_cast<pixel_t *>(dstp0);
-  const pixel_t* srcp = reinterpret_cast<const pixel_t*>(srcp0);
-  const pixel_t* srcpp = reinterpret_cast<const pixel_t*>(srcp0 - src_pitch);
-  const pixel_t* srcpn = reinterpret_cast<const pixel_t*>(srcp0 + src_pitch);
   src_pitch /= sizeof(pixel_t);
   dst_pitch /= sizeof(pixel_t);
+  pixel_t* dstp = reinterpret_cast<pixel_t *>(dstp0) + ystart * dst_pitch;
+  const pixel_t* srcp = reinterpret_cast<const pixel_t*>(srcp0) + ystart * src_pitch;
+  const pixel_t* srcpp = srcp - src_pitch;
+  const pixel_t* srcpn = srcp + src_pitch;
 
-  // top line
-  for (int x = 0; x < width; x++)
-    dstp[x] = (srcp[x] + srcpn[x] + 1) >> 1;
-  srcpp += src_pitch;
-  srcp += src_pitch;
-  srcpn += src_pitch;
-  dstp += dst_pitch;
-  // height - 2 lines in between
-  for (int y = 1; y < height - 1; ++y)
+  for (int y = ystart; y < ystop; ++y)
   {
-    for (int x = 0; x < width; x++)
-      dstp[x] = (srcpp[x] + (srcp[x] << 1) + srcpn[x] + 2) >> 2;
+    if (y == 0) // top line
+      for (int x = 0; x < width; x++)
+        dstp[x] = (srcp[x] + srcpn[x] + 1) >> 1;
+    else if (y == height - 1) // bottom line
+      for (int x = 0; x < width; x++)
+        dstp[x] = (srcpp[x] + srcp[x] + 1) >> 1;
+    else
+      for (int x = 0; x < width; x++)
+        dstp[x] = (srcpp[x] + (srcp[x] << 1) + srcpn[x] + 2) >> 2;
     srcpp += src_pitch;
     srcp += src_pitch;
     srcpn += src_pitch;
     dstp += dst_pitch;
   }
-  // bottom line
-  for (int x = 0; x < width; x++)
-    dstp[x] = (srcpp[x] + srcp[x] + 1) >> 1;
 }
 
 //void VerticalBlur_YUY2_c(const uint8_t* srcp, uint8_t* dstp, int src_pitch,
@@ -150,20 +155,24 @@ void VerticalBlur_c(const uint8_t* srcp0, uint8_t* dstp0, int src_pitch,
 //}
 
 void VerticalBlur_SSE2(const uint8_t* srcp, uint8_t* dstp, int src_pitch,
-  int dst_pitch, int width, int height)
+  int dst_pitch, int width, int height, int ystart, int ystop)
 {
-  VerticalBlurSSE2_R(srcp + src_pitch, dstp + dst_pitch, src_pitch, dst_pitch, width, height - 2);
+  const int mstart = std::max(ystart, 1);
+  const int mstop = std::min(ystop, height - 1);
+  if (mstop > mstart)
+    VerticalBlurSSE2_R(srcp + mstart * src_pitch, dstp + mstart * dst_pitch, src_pitch, dst_pitch, width, mstop - mstart);
   int temps = (height - 1) * src_pitch;
   int tempd = (height - 1) * dst_pitch;
-  for (int x = 0; x < width; ++x)
-  {
-    dstp[x] = (srcp[x] + srcp[x + src_pitch] + 1) >> 1;
-    dstp[tempd + x] = (srcp[temps + x] + srcp[temps + x - src_pitch] + 1) >> 1;
-  }
+  if (ystart == 0)
+    for (int x = 0; x < width; ++x)
+      dstp[x] = (srcp[x] + srcp[x + src_pitch] + 1) >> 1;
+  if (ystop == height)
+    for (int x = 0; x < width; ++x)
+      dstp[tempd + x] = (srcp[temps + x] + srcp[temps + x - src_pitch] + 1) >> 1;
 }
 
 void VerticalBlur(const VSFrameRef *src, VSFrameRef *dst, bool bchroma,
-  const CPUFeatures *cpuFlags, const VSAPI *vsapi)
+  const CPUFeatures *cpuFlags, const VSAPI *vsapi, int stripe, int stripes)
 {
     const VSFormat *format = vsapi->getFrameFormat(src);
 
@@ -183,20 +192,22 @@ void VerticalBlur(const VSFrameRef *src, VSFrameRef *dst, bool bchroma,
     int height = vsapi->getFrameHeight(src, plane);
     uint8_t* dstp = vsapi->getWritePtr(dst, plane);
     int dst_pitch = vsapi->getStride(dst, plane);
+    int ystart, ystop;
+    StripePool::stripeRows(height, 1, stripes, stripe, ystart, ystop);
 
       if (pixelsize == 1 && use_sse2 && widtha >= 16)
       {
         // 16x block is Ok
-        VerticalBlur_SSE2(srcp, dstp, src_pitch, dst_pitch, widtha, height);
+        VerticalBlur_SSE2(srcp, dstp, src_pitch, dst_pitch, widtha, height, ystart, ystop);
         //the rest on the right not covered by SIMD
-        VerticalBlur_c<uint8_t>(srcp + widtha, dstp + widtha, src_pitch, dst_pitch, width - widtha, height);
+        VerticalBlur_c<uint8_t>(srcp + widtha, dstp + widtha, src_pitch, dst_pitch, width - widtha, height, ystart, ystop);
       }
       else {
         // fixme: implement SIMD for 10-16 bits
         if(pixelsize == 1)
-          VerticalBlur_c<uint8_t>(srcp, dstp, src_pitch, dst_pitch, width, height);
+          VerticalBlur_c<uint8_t>(srcp, dstp, src_pitch, dst_pitch, width, height, ystart, ystop);
         else // 10-16 bits
-          VerticalBlur_c<uint16_t>(srcp, dstp, src_pitch, dst_pitch, width, height);
+          VerticalBlur_c<uint16_t>(srcp, dstp, src_pitch, dst_pitch, width, height, ystart, ystop);
       }
 
   }
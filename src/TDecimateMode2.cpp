@@ -35,15 +35,7 @@ const VSFrameRef * TDecimate::GetFrameMode2(int n, int activationReason, void **
   int ret = -20;
   if (mode2_numCycles >= 0)
   {
-    int cycleF = -20;
-    for (int x = 0; x < mode2_numCycles; ++x)
-    {
-      if (aLUT[x * 5 + 1] <= n && aLUT[x * 5 + 3] > n)
-      {
-        cycleF = x;
-        break;
-      }
-    }
+    const int cycleF = n < (int)mode2_cycleLUT.size() ? mode2_cycleLUT[n] : -20;
 
     if (activationReason == arInitial) {
         if (cycleF > 0) {
@@ -72,7 +64,11 @@ const VSFrameRef * TDecimate::GetFrameMode2(int n, int activationReason, void **
 
     if (cycleF > 0 && prev.frame != aLUT[(cycleF - 1) * 5])
     {
-      if (curr.frame == aLUT[(cycleF - 1) * 5]) prev = curr;
+      if (curr.frame == aLUT[(cycleF - 1) * 5])
+      {
+        prev.swap(curr);
+        curr.invalidate();
+      }
       else
       {
         prev.setFrame(aLUT[(cycleF - 1) * 5]);
@@ -85,7 +81,11 @@ const VSFrameRef * TDecimate::GetFrameMode2(int n, int activationReason, void **
 
     if (curr.frame != aLUT[cycleF * 5])
     {
-      if (next.frame == aLUT[cycleF * 5]) curr = next;
+      if (next.frame == aLUT[cycleF * 5])
+      {
+        curr.swap(next);
+        next.invalidate();
+      }
       else
       {
         curr.setFrame(aLUT[cycleF * 5]);
@@ -146,6 +146,7 @@ const VSFrameRef * TDecimate::GetFrameMode2(int n, int activationReason, void **
 
     VSMap *props = vsapi->getFramePropsRW(dst);
     vsapi->propSetData(props, PROP_TDecimateDisplay, text.c_str(), text.size(), paReplace);
+    drawDisplayText(dst, text, vsapi);
 
     return dst;
   }
@@ -369,8 +370,24 @@ void TDecimate::removeMinN(int m, int n, uint64_t *metricsT, int *orderT, int &o
   }
 }
 
+// Ascending and stable. Cycle sized runs use insertion sort, the whole clip
+// runs of the mode 2 planner a merge sort.
 void TDecimate::sortMetrics(uint64_t *metrics, int *order, int length) const
 {
+  if (length > 64)
+  {
+    std::vector<std::pair<uint64_t, int>> sorted(length);
+    for (int i = 0; i < length; ++i)
+      sorted[i] = std::make_pair(metrics[i], order[i]);
+    std::stable_sort(sorted.begin(), sorted.end(),
+      [](const std::pair<uint64_t, int> &a, const std::pair<uint64_t, int> &b) { return a.first < b.first; });
+    for (int i = 0; i < length; ++i)
+    {
+      metrics[i] = sorted[i].first;
+      order[i] = sorted[i].second;
+    }
+    return;
+  }
   for (int i = 1; i < length; ++i)
   {
     int j = i;
@@ -496,33 +513,42 @@ double TDecimate::buildDecStrategy()
   if (aLUT.size()) aLUT.resize(0);
   if (allMetrics)
   {
-    aLUT.resize((int)(vi.numFrames*rate / fps), 0);
+    // one entry per output frame; at the achieved rate there can be more of
+    // them than at the requested one
+    const int tc = (int)(vi.numFrames*aRate / fps);
+    aLUT.resize(std::max({ (int)(vi.numFrames*rate / fps), tc, (int)(vi.numFrames*(aRate / fps)) }), 0);
 
-    std::vector<int> orderT(vi.numFrames, 0);
-    std::vector<uint64_t> metricsT(vi.numFrames, 0);
-    memset(mode2_decA.data(), 0, vi.numFrames * sizeof(int));
-    int ovrC = 0;
-    if (ovrArray.size())
+    const uint64_t planKey = m2Plan.size() ? mode2PlanKey(rc) : 0;
+    if (m2Plan.empty() || !readPlanFile(m2Plan.c_str(), planKey, vi.numFrames, aLUT))
     {
-      for (int i = 0; i < vi.numFrames; ++i)
+      std::vector<int> orderT(vi.numFrames, 0);
+      std::vector<uint64_t> metricsT(vi.numFrames, 0);
+      memset(mode2_decA.data(), 0, vi.numFrames * sizeof(int));
+      int ovrC = 0;
+      if (ovrArray.size())
       {
-        if (ovrArray[i] & DROP_FRAME) ++ovrC;
+        for (int i = 0; i < vi.numFrames; ++i)
+        {
+          if (ovrArray[i] & DROP_FRAME) ++ovrC;
+        }
       }
-    }
-    removeMinN(mode2_num, mode2_den, metricsT.data(), orderT.data(), ovrC);
-    for (int x = 0; x < 10; ++x)
-    {
-      if (rc[x] > 0)
-        removeMinN(1, rc[x], metricsT.data(), orderT.data(), ovrC);
-    }
-    int v = 0, tc = (int)(vi.numFrames*aRate / fps);
-    for (int i = 0; i < vi.numFrames && v < tc; ++i)
-    {
-      if (mode2_decA[i] != 1)
+      removeMinN(mode2_num, mode2_den, metricsT.data(), orderT.data(), ovrC);
+      for (int x = 0; x < 10; ++x)
       {
-        aLUT[v] = i;
-        ++v;
+        if (rc[x] > 0)
+          removeMinN(1, rc[x], metricsT.data(), orderT.data(), ovrC);
       }
+      int v = 0;
+      for (int i = 0; i < vi.numFrames && v < tc; ++i)
+      {
+        if (mode2_decA[i] != 1)
+        {
+          aLUT[v] = i;
+          ++v;
+        }
+      }
+      if (m2Plan.size() && !writePlanFile(m2Plan.c_str(), planKey, vi.numFrames, aLUT))
+        throw TIVTCError("TDecimate:  m2Plan file output error (cannot create file)!");
     }
     mode2_decA.resize(0);
 //    if (debug)
@@ -535,6 +561,8 @@ double TDecimate::buildDecStrategy()
   }
   else
   {
+    if (m2Plan.size())
+      throw TIVTCError("TDecimate:  m2Plan needs input metrics for every frame!");
     aLUT.resize(mode2_numCycles * 5, 0);
 
     int temp = 0;
@@ -571,6 +599,17 @@ double TDecimate::buildDecStrategy()
       }
       aLUT[x * 5 + 3] = x*clength + add - dropCount;
     }
+    int numOut = 0;
+    for (int x = 0; x < mode2_numCycles; ++x)
+      numOut = std::max(numOut, aLUT[x * 5 + 3]);
+    mode2_cycleLUT.assign(numOut, -20);
+    for (int x = 0; x < mode2_numCycles; ++x)
+    {
+      for (int n = std::max(aLUT[x * 5 + 1], 0); n < aLUT[x * 5 + 3]; ++n)
+      {
+        if (mode2_cycleLUT[n] == -20) mode2_cycleLUT[n] = x;
+      }
+    }
 //    if (debug)
 //    {
 //      sprintf(buf, "drop count = %d  expected = %d\n", dropCount,
@@ -601,3 +640,31 @@ double TDecimate::buildDecStrategy()
 //  }
   return aRate;
 }
+
+// FNV-1a over everything the global plan of buildDecStrategy depends on.
+uint64_t TDecimate::mode2PlanKey(const int rc[10]) const
+{
+  uint64_t key = 14695981039346656037ULL;
+  auto mix = [&key](uint64_t v) {
+    for (int i = 0; i < 8; ++i, v >>= 8)
+    {
+      key ^= v & 0xFF;
+      key *= 1099511628211ULL;
+    }
+  };
+  uint64_t bits;
+  memcpy(&bits, &fps, sizeof(bits));
+  mix(bits);
+  memcpy(&bits, &rate, sizeof(bits));
+  mix(bits);
+  mix(vi.numFrames);
+  mix(mode2_num);
+  mix(mode2_den);
+  for (int x = 0; x < 10; ++x)
+    mix(rc[x]);
+  for (int i = 0; i < vi.numFrames; ++i)
+    mix(metricsArray[(size_t)i << 1]);
+  for (size_t i = 0; i < ovrArray.size(); ++i)
+    mix(ovrArray[i] & DROP_FRAME);
+  return key;
+}
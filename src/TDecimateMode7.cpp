@@ -67,7 +67,7 @@ const VSFrameRef * TDecimate::GetFrameMode7(int n, int activationReason, void **
               const VSFrameRef *frame1 = vsapi->getFrameFilter(i - 1, child, frameCtx);
               const VSFrameRef *frame2 = vsapi->getFrameFilter(i, child, frameCtx);
               metricsOutArray[i << 1] =
-                calcMetric(frame1, frame2,
+                calcMetric(frame1, frame2, i - 1, i,
                   vi_child, blockNI, blocksI, metricF, false, core);
               vsapi->freeFrame(frame1);
               vsapi->freeFrame(frame2);
@@ -188,6 +188,7 @@ const VSFrameRef * TDecimate::GetFrameMode7(int n, int activationReason, void **
 
     VSMap *props = vsapi->getFramePropsRW(dst);
     vsapi->propSetData(props, PROP_TDecimateDisplay, text.c_str(), text.size(), paReplace);
+    drawDisplayText(dst, text, vsapi);
 
     return dst;
   }
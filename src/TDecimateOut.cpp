@@ -336,4 +336,5 @@ void TDecimate::displayOutput(VSFrameRef *dst, int n,
 
     VSMap *props = vsapi->getFramePropsRW(dst);
     vsapi->propSetData(props, PROP_TDecimateDisplay, text.c_str(), text.size(), paReplace);
+    drawDisplayText(dst, text, vsapi);
 }
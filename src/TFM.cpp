@@ -53,23 +53,27 @@ const VSFrameRef *TFM::GetFrame(int n, int activationReason, VSFrameContext *fra
   const VSFrameRef *src = vsapi->getFrameFilter(n, child, frameCtx);
   const VSFrameRef *nxt = vsapi->getFrameFilter(std::min(n + 1, nfrms), child, frameCtx);
 
-  int dfrm = -20, tfrm = -20;
+  int dfrm = -20;
   int mmatch1, nmatch1, nmatch2, mmatch2, fmatch, tmatch;
   int combed = -1, tcombed = -1, xblocks = -20;
   bool d2vfilm = false, d2vmatch = false, isSC = true;
   int mics[5] = { -20, -20, -20, -20, -20 };
   int blockN[5] = { -20, -20, -20, -20, -20 };
-  order = order_origSaved;
-  mode = mode_origSaved;
-  field = field_origSaved;
-  PP = PP_origSaved;
-  MI = MI_origSaved;
-  getSettingOvr(n); // process overrides
+  ScratchPool<TFMFrameState>::Handle scratchHandle(scratch, [&] { return createFrameState(core); });
+  TFMFrameState &fs = *scratchHandle;
+  fs.sclast.frame = -20;
+  fs.sclast.sc = true;
+  fs.order = order_origSaved;
+  fs.mode = mode_origSaved;
+  fs.field = field_origSaved;
+  fs.PP = PP_origSaved;
+  fs.MI = MI_origSaved;
+  getSettingOvr(n, fs); // process overrides
 
   const VSMap *props = vsapi->getFramePropsRO(src);
   int err;
 
-  if (order == -1) {
+  if (fs.order == -1) {
       int64_t field_based = vsapi->propGetInt(props, "_FieldBased", 0, &err);
       if (err) { // prop not present
           vsapi->setFilterError("TFM: Couldn't find the '_FieldBased' frame property. The 'order' parameter must be used.", frameCtx);
@@ -80,15 +84,15 @@ const VSFrameRef *TFM::GetFrame(int n, int activationReason, VSFrameContext *fra
       }
 
       /// Pretend it's top field first when it says progressive?
-      order = (field_based == TopFieldFirst || field_based == Progressive);
+      fs.order = (field_based == TopFieldFirst || field_based == Progressive);
 //      order = child->GetParity(n) ? 1 : 0;
   }
-  if (field == -1) field = order;
-  int frstT = field^order ? 2 : 0;
-  int scndT = (mode == 2 || mode == 6) ? (field^order ? 3 : 4) : (field^order ? 0 : 2);
+  lastOrder = fs.order;
+  if (fs.field == -1) fs.field = fs.order;
+  int frstT = fs.field^fs.order ? 2 : 0;
+  int scndT = (fs.mode == 2 || fs.mode == 6) ? (fs.field^fs.order ? 3 : 4) : (fs.field^fs.order ? 0 : 2);
 
   VSFrameRef *dst = vsapi->newVideoFrame(vi->format, vi->width, vi->height, src, core);
-  VSFrameRef *tmp = vsapi->newVideoFrame(vi->format, vi->width, vi->height, nullptr, core);
 
 //  if (debug)
 //  {
@@ -96,12 +100,12 @@ const VSFrameRef *TFM::GetFrame(int n, int activationReason, VSFrameContext *fra
 //    OutputDebugString(buf);
 //  }
   if (getMatchOvr(n, fmatch, combed, d2vmatch,
-    flags == 5 ? checkSceneChange(prv, src, nxt, n) : false))
+    flags == 5 ? checkSceneChange(prv, src, nxt, n, fs) : false, fs))
   {
-    createWeaveFrame(dst, prv, src, nxt, fmatch, dfrm);
-    if (PP > 0 && combed == -1)
+    createWeaveFrame(dst, prv, src, nxt, fmatch, dfrm, fs.field);
+    if (fs.PP > 0 && combed == -1)
     {
-      if (checkCombed(dst, n, fmatch, blockN, xblocks, mics, false))
+      if (checkCombed(prv, src, nxt, n, fmatch, blockN, xblocks, mics, false, fs))
       {
         if (d2vmatch)
         {
@@ -114,21 +118,20 @@ const VSFrameRef *TFM::GetFrame(int n, int activationReason, VSFrameContext *fra
       }
       else combed = 0;
     }
-    d2vfilm = d2vduplicate(fmatch, combed, n);
+    d2vfilm = d2vduplicate(fmatch, combed, n, fs);
     if (micout > 0)
     {
       for (int i = 0; i < 5; ++i)
       {
         if (mics[i] == -20 && (i < 3 || micout > 1))
         {
-          createWeaveFrame(tmp, prv, src, nxt, i, tfrm);
-          checkCombed(tmp, n, i, blockN, xblocks, mics, true);
+          checkCombed(prv, src, nxt, n, i, blockN, xblocks, mics, true, fs);
         }
       }
     }
-    fileOut(fmatch, combed, d2vfilm, n, mics[fmatch], mics);
+    fileOut(fmatch, combed, d2vfilm, n, mics[fmatch], mics, fs);
     if (display) writeDisplay(dst, n, fmatch, combed, true, blockN[fmatch], xblocks,
-      d2vmatch, mics, prv, src, nxt);
+      d2vmatch, mics, prv, src, nxt, fs);
 //    if (debug)
 //    {
 //      char buft[20];
@@ -159,66 +162,62 @@ const VSFrameRef *TFM::GetFrame(int n, int activationReason, VSFrameContext *fra
 //        OutputDebugString(buf);
 //      }
 //    }
-    if (usehints || PP >= 2) putFrameProperties(dst, fmatch, combed, d2vfilm, mics);
-    lastMatch.frame = n;
-    lastMatch.match = fmatch;
-    lastMatch.field = field;
-    lastMatch.combed = combed;
+    if (usehints || fs.PP >= 2) putFrameProperties(dst, fmatch, combed, d2vfilm, mics, fs);
+    if (debug) putScratchProperties(dst, fs);
+    if (needsPreviousMatch())
+    {
+      lastMatch.frame = n;
+      lastMatch.match = fmatch;
+      lastMatch.field = fs.field;
+      lastMatch.combed = combed;
+    }
     vsapi->freeFrame(prv);
     vsapi->freeFrame(src);
     vsapi->freeFrame(nxt);
-    vsapi->freeFrame(tmp);
     return dst;
   }
 d2vCJump:
-  if (mode == 6)
+  // The candidate matches are checked for combing straight from the source
+  // fields, dst is woven once the final match is known.
+  if (fs.mode == 6)
   {
-    int thrdT = field^order ? 0 : 2;
-    int frthT = field^order ? 4 : 3;
+    int thrdT = fs.field^fs.order ? 0 : 2;
+    int frthT = fs.field^fs.order ? 4 : 3;
     tcombed = 0;
-    if (!slow) fmatch = compareFields(prv, src, nxt, 1, frstT, nmatch1, nmatch2, mmatch1, mmatch2, n);
-    else fmatch = compareFieldsSlow(prv, src, nxt, 1, frstT, nmatch1, nmatch2, mmatch1, mmatch2, n);
+    if (!slow) fmatch = compareFields(prv, src, nxt, 1, frstT, nmatch1, nmatch2, mmatch1, mmatch2, n, fs);
+    else fmatch = compareFieldsSlow(prv, src, nxt, 1, frstT, nmatch1, nmatch2, mmatch1, mmatch2, n, fs);
     if (micmatching > 0)
-      checkmm(fmatch, 1, frstT, dst, dfrm, tmp, tfrm, prv, src, nxt, n, blockN, xblocks, mics);
-    createWeaveFrame(dst, prv, src, nxt, fmatch, dfrm);
-    if (checkCombed(dst, n, fmatch, blockN, xblocks, mics, false))
+      checkmm(fmatch, 1, frstT, prv, src, nxt, n, blockN, xblocks, mics, fs);
+    if (checkCombed(prv, src, nxt, n, fmatch, blockN, xblocks, mics, false, fs))
     {
       tcombed = 2;
-      if (ubsco) isSC = checkSceneChange(prv, src, nxt, n);
-      if (isSC) createWeaveFrame(tmp, prv, src, nxt, scndT, tfrm);
-      if (isSC && !checkCombed(tmp, n, scndT, blockN, xblocks, mics, false))
+      if (ubsco) isSC = checkSceneChange(prv, src, nxt, n, fs);
+      if (isSC && !checkCombed(prv, src, nxt, n, scndT, blockN, xblocks, mics, false, fs))
       {
         fmatch = scndT;
         tcombed = 0;
-        copyFrame(dst, tmp, vsapi);
-        dfrm = fmatch;
       }
       else
       {
-        createWeaveFrame(tmp, prv, src, nxt, thrdT, tfrm);
-        if (!checkCombed(tmp, n, thrdT, blockN, xblocks, mics, false))
+        if (!checkCombed(prv, src, nxt, n, thrdT, blockN, xblocks, mics, false, fs))
         {
           fmatch = thrdT;
           tcombed = 0;
-          copyFrame(dst, tmp, vsapi);
-          dfrm = fmatch;
         }
         else
         {
-          if (isSC) createWeaveFrame(tmp, prv, src, nxt, frthT, tfrm);
-          if (isSC && !checkCombed(tmp, n, frthT, blockN, xblocks, mics, false))
+          if (isSC && !checkCombed(prv, src, nxt, n, frthT, blockN, xblocks, mics, false, fs))
           {
             fmatch = frthT;
             tcombed = 0;
-            copyFrame(dst, tmp, vsapi);
-            dfrm = fmatch;
           }
         }
       }
     }
-    if (combed == -1 && PP > 0) combed = tcombed;
+    createWeaveFrame(dst, prv, src, nxt, fmatch, dfrm, fs.field);
+    if (combed == -1 && fs.PP > 0) combed = tcombed;
   }
-  else if (mode == 7)
+  else if (fs.mode == 7)
   {
 //    if (debug && lastMatch.frame != n && n != 0)
 //    {
@@ -227,135 +226,110 @@ d2vCJump:
 //    }
     combed = 0;
     bool combed1 = false, combed2 = false;
-    if (!slow) fmatch = compareFields(prv, src, nxt, 1, frstT, nmatch1, nmatch2, mmatch1, mmatch2, n);
-    else fmatch = compareFieldsSlow(prv, src, nxt, 1, frstT, nmatch1, nmatch2, mmatch1, mmatch2, n);
-    createWeaveFrame(dst, prv, src, nxt, 1, dfrm);
-    combed1 = checkCombed(dst, n, 1, blockN, xblocks, mics, false);
-    createWeaveFrame(dst, prv, src, nxt, frstT, dfrm);
-    combed2 = checkCombed(dst, n, frstT, blockN, xblocks, mics, false);
+    if (!slow) fmatch = compareFields(prv, src, nxt, 1, frstT, nmatch1, nmatch2, mmatch1, mmatch2, n, fs);
+    else fmatch = compareFieldsSlow(prv, src, nxt, 1, frstT, nmatch1, nmatch2, mmatch1, mmatch2, n, fs);
+    combed1 = checkCombed(prv, src, nxt, n, 1, blockN, xblocks, mics, false, fs);
+    combed2 = checkCombed(prv, src, nxt, n, frstT, blockN, xblocks, mics, false, fs);
     if (!combed1 && !combed2)
     {
-      createWeaveFrame(dst, prv, src, nxt,fmatch, dfrm);
-      if (field == 0) mode7_field = 1;
+      if (fs.field == 0) mode7_field = 1;
       else mode7_field = 0;
     }
     else if (!combed2 && combed1)
     {
-      createWeaveFrame(dst, prv, src, nxt, frstT, dfrm);
       mode7_field = 1;
       fmatch = frstT;
     }
     else if (!combed1 && combed2)
     {
-      createWeaveFrame(dst, prv, src, nxt, 1, dfrm);
       mode7_field = 0;
       fmatch = 1;
     }
     else
     {
-      createWeaveFrame(dst, prv, src, nxt, 1, dfrm);
       combed = 2;
-      field = mode7_field;
+      fs.field = mode7_field;
       fmatch = 1;
     }
+    createWeaveFrame(dst, prv, src, nxt, fmatch, dfrm, fs.field);
   }
   else
   {
     if (!slow) 
-      fmatch = compareFields(prv, src, nxt, 1, frstT, nmatch1, nmatch2, mmatch1, mmatch2, n);
+      fmatch = compareFields(prv, src, nxt, 1, frstT, nmatch1, nmatch2, mmatch1, mmatch2, n, fs);
     else 
-      fmatch = compareFieldsSlow(prv, src, nxt, 1, frstT, nmatch1, nmatch2, mmatch1, mmatch2, n);
+      fmatch = compareFieldsSlow(prv, src, nxt, 1, frstT, nmatch1, nmatch2, mmatch1, mmatch2, n, fs);
     if (micmatching > 0)
-      checkmm(fmatch, 1, frstT, dst, dfrm, tmp, tfrm, prv, src, nxt, n, blockN, xblocks, mics);
-    createWeaveFrame(dst, prv, src, nxt, fmatch, dfrm);
-    if (mode > 3 || (mode > 0 && checkCombed(dst, n, fmatch, blockN, xblocks, mics, false)))
+      checkmm(fmatch, 1, frstT, prv, src, nxt, n, blockN, xblocks, mics, fs);
+    if (fs.mode > 3 || (fs.mode > 0 && checkCombed(prv, src, nxt, n, fmatch, blockN, xblocks, mics, false, fs)))
     {
-      if (mode < 4) tcombed = 2;
-      if (mode != 2)
+      if (fs.mode < 4) tcombed = 2;
+      if (fs.mode != 2)
       {
         if (!slow) 
-          tmatch = compareFields(prv, src, nxt, fmatch, scndT, nmatch1, nmatch2, mmatch1, mmatch2, n);
+          tmatch = compareFields(prv, src, nxt, fmatch, scndT, nmatch1, nmatch2, mmatch1, mmatch2, n, fs);
         else 
-          tmatch = compareFieldsSlow(prv, src, nxt, fmatch, scndT, nmatch1, nmatch2, mmatch1, mmatch2, n);
+          tmatch = compareFieldsSlow(prv, src, nxt, fmatch, scndT, nmatch1, nmatch2, mmatch1, mmatch2, n, fs);
         if (micmatching > 0)
-          checkmm(tmatch, fmatch, scndT, dst, dfrm, tmp, tfrm, prv, src, nxt, n, blockN, xblocks, mics);
-        createWeaveFrame(dst, prv, src, nxt, fmatch, dfrm);
+          checkmm(tmatch, fmatch, scndT, prv, src, nxt, n, blockN, xblocks, mics, fs);
       }
       else tmatch = scndT;
       if (tmatch == scndT)
       {
-        if (mode > 3)
+        if (fs.mode > 3)
         {
           fmatch = tmatch;
-          createWeaveFrame(dst, prv, src, nxt, fmatch, dfrm);
         }
-        else if (mode != 2 || !ubsco || checkSceneChange(prv, src, nxt, n))
+        else if (fs.mode != 2 || !ubsco || checkSceneChange(prv, src, nxt, n, fs))
         {
-          createWeaveFrame(tmp, prv, src, nxt, tmatch, tfrm);
-          if (!checkCombed(tmp, n, tmatch, blockN, xblocks, mics, false))
+          if (!checkCombed(prv, src, nxt, n, tmatch, blockN, xblocks, mics, false, fs))
           {
             fmatch = tmatch;
             tcombed = 0;
-            copyFrame(dst, tmp, vsapi);
-            dfrm = fmatch;
           }
         }
       }
-      if ((mode == 3 && tcombed == 2) || (mode == 5 && checkCombed(dst, n, fmatch, blockN, xblocks, mics, false)))
+      if ((fs.mode == 3 && tcombed == 2) || (fs.mode == 5 && checkCombed(prv, src, nxt, n, fmatch, blockN, xblocks, mics, false, fs)))
       {
         tcombed = 2;
-        if (!ubsco || checkSceneChange(prv, src, nxt, n))
+        if (!ubsco || checkSceneChange(prv, src, nxt, n, fs))
         {
           if (!slow) 
-            tmatch = compareFields(prv, src, nxt, 3, 4, nmatch1, nmatch2, mmatch1, mmatch2, n);
+            tmatch = compareFields(prv, src, nxt, 3, 4, nmatch1, nmatch2, mmatch1, mmatch2, n, fs);
           else 
-            tmatch = compareFieldsSlow(prv, src, nxt, 3, 4, nmatch1, nmatch2, mmatch1, mmatch2, n);
+            tmatch = compareFieldsSlow(prv, src, nxt, 3, 4, nmatch1, nmatch2, mmatch1, mmatch2, n, fs);
           if (micmatching > 0)
-            checkmm(tmatch, 3, 4, dst, dfrm, tmp, tfrm, prv, src, nxt, n, blockN, xblocks, mics);
-          createWeaveFrame(tmp, prv, src, nxt, tmatch, tfrm);
-          if (!checkCombed(tmp, n, tmatch, blockN, xblocks, mics, false))
+            checkmm(tmatch, 3, 4, prv, src, nxt, n, blockN, xblocks, mics, fs);
+          if (!checkCombed(prv, src, nxt, n, tmatch, blockN, xblocks, mics, false, fs))
           {
             fmatch = tmatch;
             tcombed = 0;
-            copyFrame(dst, tmp, vsapi);
-            dfrm = fmatch;
           }
-          else
-            createWeaveFrame(dst, prv, src, nxt, fmatch, dfrm);
         }
       }
-      if (mode == 5 && tcombed == -1) tcombed = 0;
+      if (fs.mode == 5 && tcombed == -1) tcombed = 0;
     }
-    if ((mode == 1 || mode == 2 || mode == 3) && tcombed == -1) tcombed = 0;
-    if (combed == -1 && PP > 0) combed = tcombed;
-    if (PP > 0 && combed == -1)
+    if ((fs.mode == 1 || fs.mode == 2 || fs.mode == 3) && tcombed == -1) tcombed = 0;
+    if (combed == -1 && fs.PP > 0) combed = tcombed;
+    if (fs.PP > 0 && combed == -1)
     {
-      if (checkCombed(dst, n, fmatch, blockN, xblocks, mics, false)) combed = 2;
+      if (checkCombed(prv, src, nxt, n, fmatch, blockN, xblocks, mics, false, fs)) combed = 2;
       else combed = 0;
     }
-    if (dfrm != fmatch) {
-        vsapi->setFilterError("TFM: internal error (dfrm!=fmatch). Please report this.", frameCtx);
-        vsapi->freeFrame(prv);
-        vsapi->freeFrame(src);
-        vsapi->freeFrame(nxt);
-        vsapi->freeFrame(dst);
-        vsapi->freeFrame(tmp);
-        return nullptr;
-    }
+    createWeaveFrame(dst, prv, src, nxt, fmatch, dfrm, fs.field);
   }
-  if (micout > 0 || (micmatching > 0 && mics[fmatch] > 15 && mode != 7 && !(micmatching == 2 && (mode == 0 || mode == 4))
-    && (!mmsco || checkSceneChange(prv, src, nxt, n))))
+  if (micout > 0 || (micmatching > 0 && mics[fmatch] > 15 && fs.mode != 7 && !(micmatching == 2 && (fs.mode == 0 || fs.mode == 4))
+    && (!mmsco || checkSceneChange(prv, src, nxt, n, fs))))
   {
     for (int i = 0; i < 5; ++i)
     {
       if (mics[i] == -20 && (i < 3 || micout > 1 || micmatching > 0))
       {
-        createWeaveFrame(tmp, prv, src, nxt, i, tfrm);
-        checkCombed(tmp, n, i, blockN, xblocks, mics, true);
+        checkCombed(prv, src, nxt, n, i, blockN, xblocks, mics, true, fs);
       }
     }
-    if (micmatching > 0 && mode != 7 && mics[fmatch] > 15 &&
-      (!mmsco || checkSceneChange(prv, src, nxt, n)))
+    if (micmatching > 0 && fs.mode != 7 && mics[fmatch] > 15 &&
+      (!mmsco || checkSceneChange(prv, src, nxt, n, fs)))
     {
       int i, j, temp1, temp2, order1[5], order2[5] = { 0, 1, 2, 3, 4 };
       for (i = 0; i < 5; ++i) order1[i] = mics[i];
@@ -377,106 +351,106 @@ d2vCJump:
       {
       othertest:
         if (order1[0] * 3 < order1[1] && abs(order1[0] - order1[1]) > 15 &&
-          order1[0] < MI && order2[0] != fmatch &&
-          (((field^order) && (order2[0] == 1 || order2[0] == 2 || order2[0] == 3)) ||
-          (!(field^order) && (order2[0] == 0 || order2[0] == 1 || order2[0] == 4))))
+          order1[0] < fs.MI && order2[0] != fmatch &&
+          (((fs.field^fs.order) && (order2[0] == 1 || order2[0] == 2 || order2[0] == 3)) ||
+          (!(fs.field^fs.order) && (order2[0] == 0 || order2[0] == 1 || order2[0] == 4))))
         {
-          bool xfield = (field^order) == 0 ? false : true;
+          bool xfield = (fs.field^fs.order) == 0 ? false : true;
           int lmatch = lastMatch.frame == n - 1 ? lastMatch.match : -20;
           if (!((order2[0] == 4 && lmatch == 0 && !xfield && (order2[1] == 0 || order2[2] == 0)) ||
             (order2[0] == 3 && lmatch == 2 && xfield && (order2[1] == 2 || order2[2] == 2))))
           {
             micChange(n, fmatch, order2[0], dst, prv, src, nxt,
-              fmatch, combed, dfrm);
+              fmatch, combed, dfrm, fs);
           }
         }
         if (order1[0] * 4 < order1[1] && abs(order1[0] - order1[1]) > 30 &&
-          order1[0] < MI && order1[1] >= MI && order2[0] != fmatch)
+          order1[0] < fs.MI && order1[1] >= fs.MI && order2[0] != fmatch)
         {
           micChange(n, fmatch, order2[0], dst, prv, src, nxt,
-            fmatch, combed, dfrm);
+            fmatch, combed, dfrm, fs);
         }
       }
       else if (micmatching == 2 || micmatching == 3)
       {
-        int try1 = field^order ? 2 : 0, try2, minm, mint, try3, try4;
-        if (mode == 1) // p/c + n
+        int try1 = fs.field^fs.order ? 2 : 0, try2, minm, mint, try3, try4;
+        if (fs.mode == 1) // p/c + n
         {
           try2 = try1 == 2 ? 0 : 2;
           minm = std::min(mics[1], mics[try1]);
-          if (mics[try2] * 3 < minm && mics[try2] < MI && abs(mics[try2] - minm) >= 30 && try2 != fmatch)
+          if (mics[try2] * 3 < minm && mics[try2] < fs.MI && abs(mics[try2] - minm) >= 30 && try2 != fmatch)
             micChange(n, fmatch, try2, dst, prv, src, nxt,
-              fmatch, combed, dfrm);
+              fmatch, combed, dfrm, fs);
         }
-        else if (mode == 2) // p/c + u
+        else if (fs.mode == 2) // p/c + u
         {
           try2 = try1 == 2 ? 3 : 4;
           minm = std::min(mics[1], mics[try1]);
-          if (mics[try2] * 3 < minm && mics[try2] < MI && abs(mics[try2] - minm) >= 30 && try2 != fmatch)
+          if (mics[try2] * 3 < minm && mics[try2] < fs.MI && abs(mics[try2] - minm) >= 30 && try2 != fmatch)
             micChange(n, fmatch, try2, dst, prv, src, nxt,
-              fmatch, combed, dfrm);
+              fmatch, combed, dfrm, fs);
         }
-        else if (mode == 3) // p/c + n + u/b
+        else if (fs.mode == 3) // p/c + n + u/b
         {
           try2 = try1 == 2 ? 0 : 2;
           minm = std::min(mics[1], mics[try1]);
           mint = std::min(mics[3], mics[4]);
           try3 = try1 == 2 ? (mint == mics[3] ? 3 : 4) : (mint == mics[4] ? 4 : 3);
-          if (mics[try2] * 3 < minm && mics[try2] < MI && abs(mics[try2] - minm) >= 30 && try2 != fmatch &&
+          if (mics[try2] * 3 < minm && mics[try2] < fs.MI && abs(mics[try2] - minm) >= 30 && try2 != fmatch &&
             fmatch != 3 && fmatch != 4)
           {
             micChange(n, fmatch, try2, dst, prv, src, nxt,
-              fmatch, combed, dfrm);
+              fmatch, combed, dfrm, fs);
             minm = mics[try2];
           }
           else if (fmatch == try2) minm = std::min(mics[try2], minm);
-          if (mint * 3 < minm && mint < MI && abs(mint - minm) >= 30 && fmatch != 3 && fmatch != 4)
+          if (mint * 3 < minm && mint < fs.MI && abs(mint - minm) >= 30 && fmatch != 3 && fmatch != 4)
             micChange(n, fmatch, try3, dst, prv, src, nxt,
-              fmatch, combed, dfrm);
+              fmatch, combed, dfrm, fs);
         }
-        else if (mode == 5) // p/c/n + u/b
+        else if (fs.mode == 5) // p/c/n + u/b
         {
           minm = std::min(mics[0], std::min(mics[1], mics[2]));
           mint = std::min(mics[3], mics[4]);
           try3 = try1 == 2 ? (mint == mics[3] ? 3 : 4) : (mint == mics[4] ? 4 : 3);
-          if (mint * 3 < minm && mint < MI && abs(mint - minm) >= 30 && fmatch != 3 && fmatch != 4)
+          if (mint * 3 < minm && mint < fs.MI && abs(mint - minm) >= 30 && fmatch != 3 && fmatch != 4)
             micChange(n, fmatch, try3, dst, prv, src, nxt,
-              fmatch, combed, dfrm);
+              fmatch, combed, dfrm, fs);
         }
-        else if (mode == 6) // p/c + u + n + b
+        else if (fs.mode == 6) // p/c + u + n + b
         {
           try2 = try1 == 2 ? 3 : 4;
           try3 = try1 == 2 ? 0 : 2;
           try4 = try2 == 3 ? 4 : 3;
           minm = std::min(mics[1], mics[try1]);
-          if (mics[try2] * 3 < minm && mics[try2] < MI && abs(mics[try2] - minm) >= 30 && fmatch != try2 &&
+          if (mics[try2] * 3 < minm && mics[try2] < fs.MI && abs(mics[try2] - minm) >= 30 && fmatch != try2 &&
             fmatch != try3 && fmatch != try4)
           {
             micChange(n, fmatch, try2, dst, prv, src, nxt,
-              fmatch, combed, dfrm);
+              fmatch, combed, dfrm, fs);
             minm = mics[try2];
           }
           else if (fmatch == try2) minm = std::min(mics[try2], minm);
-          if (mics[try3] * 3 < minm && mics[try3] < MI && abs(mics[try3] - minm) >= 30 && fmatch != try3 &&
+          if (mics[try3] * 3 < minm && mics[try3] < fs.MI && abs(mics[try3] - minm) >= 30 && fmatch != try3 &&
             fmatch != try4)
           {
             micChange(n, fmatch, try3, dst, prv, src, nxt,
-              fmatch, combed, dfrm);
+              fmatch, combed, dfrm, fs);
             minm = mics[try3];
           }
           else if (fmatch == try3) minm = std::min(mics[try3], minm);
-          if (mics[try4] * 3 < minm && mics[try4] < MI && abs(mics[try4] - minm) >= 30 && fmatch != try4)
+          if (mics[try4] * 3 < minm && mics[try4] < fs.MI && abs(mics[try4] - minm) >= 30 && fmatch != try4)
             micChange(n, fmatch, try4, dst, prv, src, nxt,
-              fmatch, combed, dfrm);
+              fmatch, combed, dfrm, fs);
         }
         if (micmatching == 3) { goto othertest; }
       }
     }
   }
-  d2vfilm = d2vduplicate(fmatch, combed, n);
-  fileOut(fmatch, combed, d2vfilm, n, mics[fmatch], mics);
+  d2vfilm = d2vduplicate(fmatch, combed, n, fs);
+  fileOut(fmatch, combed, d2vfilm, n, mics[fmatch], mics, fs);
   if (display) writeDisplay(dst, n, fmatch, combed, false, blockN[fmatch], xblocks,
-    d2vmatch, mics, prv, src, nxt);
+    d2vmatch, mics, prv, src, nxt, fs);
 //  if (debug)
 //  {
 //    char buft[20];
@@ -507,22 +481,92 @@ d2vCJump:
 //      OutputDebugString(buf);
 //    }
 //  }
-  if (usehints || PP >= 2) putFrameProperties(dst, fmatch, combed, d2vfilm, mics);
-  lastMatch.frame = n;
-  lastMatch.match = fmatch;
-  lastMatch.field = field;
-  lastMatch.combed = combed;
+  if (usehints || fs.PP >= 2) putFrameProperties(dst, fmatch, combed, d2vfilm, mics, fs);
+  if (debug) putScratchProperties(dst, fs);
+  if (needsPreviousMatch())
+  {
+    lastMatch.frame = n;
+    lastMatch.match = fmatch;
+    lastMatch.field = fs.field;
+    lastMatch.combed = combed;
+  }
 
   vsapi->freeFrame(prv);
   vsapi->freeFrame(src);
   vsapi->freeFrame(nxt);
-  vsapi->freeFrame(tmp);
   return dst;
 }
 
-void TFM::checkmm(int &cmatch, int m1, int m2, VSFrameRef *dst, int &dfrm, VSFrameRef *tmp, int &tfrm,
-  const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt, int n,
-  int *blockN, int &xblocks, int *mics)
+bool TFM::needsPreviousMatch() const
+{
+  return d2vfilmarray.size() || micmatching == 1 || micmatching == 3;
+}
+
+bool TFM::needsLinearAccess() const
+{
+  if (mode_origSaved == 7)
+    return true;
+  for (int x = 0; x < (int)setArray.size(); x += 4)
+  {
+    if (setArray[x] == 109 && setArray[x + 3] == 7) // m
+      return true;
+  }
+  return false;
+}
+
+static size_t frameBytes(const VSFrameRef *frame, const VSAPI *vsapi)
+{
+  size_t bytes = 0;
+  for (int plane = 0; plane < vsapi->getFrameFormat(frame)->numPlanes; plane++)
+    bytes += (size_t)vsapi->getStride(frame, plane) * vsapi->getFrameHeight(frame, plane);
+  return bytes;
+}
+
+// scratch buffers for the field matching and comb detection of one frame,
+// reused by later frames through the scratch pool
+std::unique_ptr<TFMFrameState> TFM::createFrameState(VSCore *core) const
+{
+  std::unique_ptr<TFMFrameState> fs(new TFMFrameState());
+  fs->bytes = 0;
+
+  if (cArraySize)
+  {
+    fs->cArray = decltype(fs->cArray) (vs_aligned_malloc<int>(cArraySize * sizeof(int), 16), &vs_aligned_free);
+    fs->bytes += cArraySize * sizeof(int);
+  }
+  if (allocCmask)
+  {
+    fs->cmask = decltype(fs->cmask) (vsapi->newVideoFrame(vi->format, vi->width, vi->height, nullptr, core), vsapi->freeFrame);
+    fs->bytes += frameBytes(fs->cmask.get(), vsapi);
+    const size_t bitsSize = (size_t)cmaskBitsPitch * vi->height * sizeof(uint64_t);
+    fs->cmaskBits = decltype(fs->cmaskBits) (vs_aligned_malloc<uint64_t>(bitsSize, 32), &vs_aligned_free);
+    fs->bytes += bitsSize;
+    const size_t countsSize = (size_t)cmaskCountsPitch * (stripes ? stripes->size() : 1) * sizeof(int);
+    fs->cmaskCounts = decltype(fs->cmaskCounts) (vs_aligned_malloc<int>(countsSize, 32), &vs_aligned_free);
+    fs->bytes += countsSize;
+  }
+  fs->map = decltype(fs->map) (vsapi->newVideoFrame(map_format, vi->width, vi->height, nullptr, core), vsapi->freeFrame);
+  fs->bytes += frameBytes(fs->map.get(), vsapi);
+
+  // 16 would be is enough for sse2 but maybe we'll do AVX2?
+  fs->tbuffer = decltype(fs->tbuffer) (vs_aligned_malloc<uint8_t>((vi->height >> 1) * tpitchy, 64), &vs_aligned_free);
+  fs->bytes += (vi->height >> 1) * tpitchy;
+
+  return fs;
+}
+
+// how many frame states were in use at the same time, to help sizing memory
+void TFM::putScratchProperties(VSFrameRef *dst, const TFMFrameState &fs)
+{
+  const int highWater = scratch.getHighWater();
+
+  VSMap *props = vsapi->getFramePropsRW(dst);
+  vsapi->propSetInt(props, PROP_TFMScratchHighWater, highWater, paReplace);
+  vsapi->propSetInt(props, PROP_TFMScratchBytes, (int64_t)(highWater * fs.bytes), paReplace);
+}
+
+void TFM::checkmm(int &cmatch, int m1, int m2, const VSFrameRef *prv, const VSFrameRef *src,
+  const VSFrameRef *nxt, int n, int *blockN, int &xblocks, int *mics, TFMFrameState &fs) const
 {
   if (cmatch != m1)
   {
@@ -530,44 +574,12 @@ void TFM::checkmm(int &cmatch, int m1, int m2, VSFrameRef *dst, int &dfrm, VSFra
     m1 = m2;
     m2 = tx;
   }
-  if (dfrm == m1)
-    checkCombed(dst, n, m1, blockN, xblocks, mics, false);
-  else if (tfrm == m1)
-    checkCombed(tmp, n, m1, blockN, xblocks, mics, false);
-  else
-  {
-    if (tfrm != m2)
-    {
-      createWeaveFrame(tmp, prv, src, nxt, m1, tfrm);
-      checkCombed(tmp, n, m1, blockN, xblocks, mics, false);
-    }
-    else
-    {
-      createWeaveFrame(dst, prv, src, nxt, m1, dfrm);
-      checkCombed(dst, n, m1, blockN, xblocks, mics, false);
-    }
-  }
+  checkCombed(prv, src, nxt, n, m1, blockN, xblocks, mics, false, fs);
   if (mics[m1] < 30)
     return;
-  if (dfrm == m2)
-    checkCombed(dst, n, m2, blockN, xblocks, mics, false);
-  else if (tfrm == m2)
-    checkCombed(tmp, n, m2, blockN, xblocks, mics, false);
-  else
-  {
-    if (tfrm != m1)
-    {
-      createWeaveFrame(tmp, prv, src, nxt, m2, tfrm);
-      checkCombed(tmp, n, m2, blockN, xblocks, mics, false);
-    }
-    else
-    {
-      createWeaveFrame(dst, prv, src, nxt, m2, dfrm);
-      checkCombed(dst, n, m2, blockN, xblocks, mics, false);
-    }
-  }
-  if ((mics[m2] * 3 < mics[m1] || (mics[m2] * 2 < mics[m1] && mics[m1] > MI)) &&
-    abs(mics[m2] - mics[m1]) >= 30 && mics[m2] < MI)
+  checkCombed(prv, src, nxt, n, m2, blockN, xblocks, mics, false, fs);
+  if ((mics[m2] * 3 < mics[m1] || (mics[m2] * 2 < mics[m1] && mics[m1] > fs.MI)) &&
+    abs(mics[m2] - mics[m1]) >= 30 && mics[m2] < fs.MI)
   {
 //    if (debug)
 //    {
@@ -581,7 +593,7 @@ void TFM::checkmm(int &cmatch, int m1, int m2, VSFrameRef *dst, int &dfrm, VSFra
 
 void TFM::micChange(int n, int m1, int m2, VSFrameRef *dst, const VSFrameRef *prv,
   const VSFrameRef *src, const VSFrameRef *nxt, int &fmatch,
-  int &combed, int &cfrm) const
+  int &combed, int &cfrm, const TFMFrameState &fs) const
 {
 //  if (debug)
 //  {
@@ -591,19 +603,19 @@ void TFM::micChange(int n, int m1, int m2, VSFrameRef *dst, const VSFrameRef *pr
 //  }
   fmatch = m2;
   combed = 0;
-  createWeaveFrame(dst, prv, src, nxt, m2, cfrm);
+  createWeaveFrame(dst, prv, src, nxt, m2, cfrm, fs.field);
 }
 
 void TFM::writeDisplay(VSFrameRef *dst, int n, int fmatch, int combed, bool over,
   int blockN, int xblocks, bool d2vmatch, int *mics, const VSFrameRef *prv,
-  const VSFrameRef *src, const VSFrameRef *nxt)
+  const VSFrameRef *src, const VSFrameRef *nxt, TFMFrameState &fs) const
 {
-    // Doesn't actually display anything, just sets a frame property which text.Text will display.
+    // Sets the frame property and draws its text into the frame.
 
 #define SZ 160
     char buf[SZ];
 
-  if (combed > 1 && PP > 1) return; // TFMPP will display things instead
+  if (combed > 1 && fs.PP > 1) return; // TFMPP will display things instead
 
   /// TODO: draw the box
   (void)blockN;
@@ -615,18 +627,18 @@ void TFM::writeDisplay(VSFrameRef *dst, int n, int fmatch, int combed, bool over
 
   std::string text = "TFM " VERSION " by tritical\n";
 
-  if (PP > 0)
-    snprintf(buf, SZ, "order = %d  field = %d  mode = %d  MI = %d\n", order, field, mode, MI);
+  if (fs.PP > 0)
+    snprintf(buf, SZ, "order = %d  field = %d  mode = %d  MI = %d\n", fs.order, fs.field, fs.mode, fs.MI);
   else
-    snprintf(buf, SZ, "order = %d  field = %d  mode = %d\n", order, field, mode);
+    snprintf(buf, SZ, "order = %d  field = %d  mode = %d\n", fs.order, fs.field, fs.mode);
   text += buf;
 
   if (!over && !d2vmatch) snprintf(buf, SZ, "frame: %d  match = %c %s\n", n, MTC(fmatch),
-    ((ubsco || mmsco || flags == 5) && checkSceneChange(prv, src, nxt, n)) ? " (SC) " : "");
+    ((ubsco || mmsco || flags == 5) && checkSceneChange(prv, src, nxt, n, fs)) ? " (SC) " : "");
   else if (d2vmatch) snprintf(buf, SZ, "frame: %d  match = %c (D2V) %s\n", n, MTC(fmatch),
-    ((ubsco || mmsco || flags == 5) && checkSceneChange(prv, src, nxt, n)) ? " (SC) " : "");
+    ((ubsco || mmsco || flags == 5) && checkSceneChange(prv, src, nxt, n, fs)) ? " (SC) " : "");
   else snprintf(buf, SZ, "frame: %d  match = %c (OVR) %s\n", n, MTC(fmatch),
-    ((ubsco || mmsco || flags == 5) && checkSceneChange(prv, src, nxt, n)) ? " (SC) " : "");
+    ((ubsco || mmsco || flags == 5) && checkSceneChange(prv, src, nxt, n, fs)) ? " (SC) " : "");
   text += buf;
 
   if (micout > 0 || (micmatching > 0 && mics[0] != -20 && mics[1] != -20 && mics[2] != -20
@@ -649,10 +661,10 @@ void TFM::writeDisplay(VSFrameRef *dst, int n, int fmatch, int combed, bool over
 
   if (combed != -1)
   {
-    if (combed == 1) snprintf(buf, SZ, "PP = %d  CLEAN FRAME (forced!) ", PP);
-    else if (combed == 5) snprintf(buf, SZ, "PP = %d  COMBED FRAME  (forced!) ", PP);
-    else if (combed == 0) snprintf(buf, SZ, "PP = %d  CLEAN FRAME ", PP);
-    else snprintf(buf, SZ, "PP = %d  COMBED FRAME ", PP);
+    if (combed == 1) snprintf(buf, SZ, "PP = %d  CLEAN FRAME (forced!) ", fs.PP);
+    else if (combed == 5) snprintf(buf, SZ, "PP = %d  COMBED FRAME  (forced!) ", fs.PP);
+    else if (combed == 0) snprintf(buf, SZ, "PP = %d  CLEAN FRAME ", fs.PP);
+    else snprintf(buf, SZ, "PP = %d  COMBED FRAME ", fs.PP);
     if (mics[fmatch] >= 0)
     {
       char buft[20];
@@ -673,26 +685,29 @@ void TFM::writeDisplay(VSFrameRef *dst, int n, int fmatch, int combed, bool over
 
   VSMap *props = vsapi->getFramePropsRW(dst);
   vsapi->propSetData(props, PROP_TFMDisplay, text.c_str(), text.size(), paReplace);
+  // TFMPP draws the text when it follows, after deinterlacing
+  if (PP_origSaved < 2)
+    drawDisplayText(dst, text, vsapi);
 }
 
 // override from ovr file
-void TFM::getSettingOvr(int n)
+void TFM::getSettingOvr(int n, TFMFrameState &fs) const
 {
   if (setArray.size() == 0) return;
   for (int x = 0; x < (int)setArray.size(); x += 4)
   {
     if (n >= setArray[x + 1] && n <= setArray[x + 2])
     {
-      if (setArray[x] == 111) order = setArray[x + 3]; // o
-      else if (setArray[x] == 109) mode = setArray[x + 3]; // m
-      else if (setArray[x] == 102) field = setArray[x + 3]; // f
-      else if (setArray[x] == 80) PP = setArray[x + 3]; // P
-      else if (setArray[x] == 105) MI = setArray[x + 3]; // i
+      if (setArray[x] == 111) fs.order = setArray[x + 3]; // o
+      else if (setArray[x] == 109) fs.mode = setArray[x + 3]; // m
+      else if (setArray[x] == 102) fs.field = setArray[x + 3]; // f
+      else if (setArray[x] == 80) fs.PP = setArray[x + 3]; // P
+      else if (setArray[x] == 105) fs.MI = setArray[x + 3]; // i
     }
   }
 }
 
-bool TFM::getMatchOvr(int n, int &match, int &combed, bool &d2vmatch, bool isSC)
+bool TFM::getMatchOvr(int n, int &match, int &combed, bool &d2vmatch, bool isSC, TFMFrameState &fs) const
 {
   bool combedset = false;
   d2vmatch = false;
@@ -700,7 +715,7 @@ bool TFM::getMatchOvr(int n, int &match, int &combed, bool &d2vmatch, bool isSC)
   {
     int value = ovrArray[n], temp;
     temp = value & 0x00000020;
-    if (temp == 0 && PP > 0)
+    if (temp == 0 && fs.PP > 0)
     {
       if (value & 0x00000010) combed = 5;
       else combed = 1;
@@ -710,15 +725,15 @@ bool TFM::getMatchOvr(int n, int &match, int &combed, bool &d2vmatch, bool isSC)
     if (temp >= 0 && temp <= 6)
     {
       match = temp;
-      if (field != fieldO)
+      if (fs.field != fieldO)
       {
         if (match == 0) match = 3;
         else if (match == 2) match = 4;
         else if (match == 3) match = 0;
         else if (match == 4) match = 2;
       }
-      if (match == 5) { combed = 5; match = 1; field = 0; }
-      else if (match == 6) { combed = 5; match = 1; field = 1; }
+      if (match == 5) { combed = 5; match = 1; fs.field = 0; }
+      else if (match == 6) { combed = 5; match = 1; fs.field = 1; }
       return true;
     }
   }
@@ -730,56 +745,57 @@ bool TFM::getMatchOvr(int n, int &match, int &combed, bool &d2vmatch, bool isSC)
     temp = (temp&D2VARRAY_MATCH_MASK) >> 2;
     if (temp != 1 && temp != 2) return false;
     if (temp == 1) { match = 1; combed = combedset ? combed : ct; }
-    else if (temp == 2) { match = field^order ? 2 : 0; combed = combedset ? combed : ct; }
+    else if (temp == 2) { match = fs.field^fs.order ? 2 : 0; combed = combedset ? combed : ct; }
     d2vmatch = true;
     return true;
   }
   return false;
 }
 
-bool TFM::d2vduplicate(int match, int combed, int n)
+bool TFM::d2vduplicate(int match, int combed, int n, const TFMFrameState &fs) const
 {
   if (d2vfilmarray.size() == 0 || d2vfilmarray[n] == 0) return false;
-  if (n - 1 != lastMatch.frame)
-    lastMatch.field = lastMatch.frame = lastMatch.combed = lastMatch.match = -20;
+  MTRACK last = lastMatch;
+  if (n - 1 != last.frame)
+    last.field = last.frame = last.combed = last.match = -20;
   if ((d2vfilmarray[n] & D2VARRAY_DUP_MASK) == 0x3) // indicates possible top field duplicate
   {
-    if (lastMatch.field == 1)
+    if (last.field == 1)
     {
-      if ((lastMatch.combed > 1 || lastMatch.match != 3) && field == 1 &&
+      if ((last.combed > 1 || last.match != 3) && fs.field == 1 &&
         (match != 4 || combed > 1)) return true;
-      else if ((lastMatch.combed > 1 || lastMatch.match != 3) && field == 0 &&
+      else if ((last.combed > 1 || last.match != 3) && fs.field == 0 &&
         combed < 2 && match != 2) return true;
     }
-    else if (lastMatch.field == 0)
+    else if (last.field == 0)
     {
-      if (lastMatch.combed < 2 && lastMatch.match != 0 && field == 1 &&
+      if (last.combed < 2 && last.match != 0 && fs.field == 1 &&
         (match != 4 || combed > 1)) return true;
-      else if (lastMatch.combed < 2 && lastMatch.match != 0 && field == 0 &&
+      else if (last.combed < 2 && last.match != 0 && fs.field == 0 &&
         combed < 2 && match != 2) return true;
     }
   }
   else if ((d2vfilmarray[n] & D2VARRAY_DUP_MASK) == 0x1) // indicates possible bottom field duplicate
   {
-    if (lastMatch.field == 1)
+    if (last.field == 1)
     {
-      if (lastMatch.combed < 2 && lastMatch.match != 0 && field == 0 &&
+      if (last.combed < 2 && last.match != 0 && fs.field == 0 &&
         (match != 4 || combed > 1)) return true;
-      else if (lastMatch.combed < 2 && lastMatch.match != 0 && field == 1 &&
+      else if (last.combed < 2 && last.match != 0 && fs.field == 1 &&
         combed < 2 && match != 2) return true;
     }
-    else if (lastMatch.field == 0)
+    else if (last.field == 0)
     {
-      if ((lastMatch.combed > 1 || lastMatch.match != 3) && field == 0 &&
+      if ((last.combed > 1 || last.match != 3) && fs.field == 0 &&
         (match != 4 || combed > 1)) return true;
-      else if ((lastMatch.combed > 1 || lastMatch.match != 3) && field == 1 &&
+      else if ((last.combed > 1 || last.match != 3) && fs.field == 1 &&
         combed < 2 && match != 2) return true;
     }
   }
   return false;
 }
 
-void TFM::fileOut(int match, int combed, bool d2vfilm, int n, int MICount, int mics[5])
+void TFM::fileOut(int match, int combed, bool d2vfilm, int n, int MICount, int mics[5], const TFMFrameState &fs)
 {
   if (moutArray.size() && MICount != -1) moutArray[n] = MICount;
   if (micout > 0 && moutArrayE.size())
@@ -791,15 +807,15 @@ void TFM::fileOut(int match, int combed, bool d2vfilm, int n, int MICount, int m
   if (outArray.size() == 0) return;
   if (output.size() || outputC.size())
   {
-    if (field != fieldO)
+    if (fs.field != fieldO)
     {
       if (match == 0) match = 3;
       else if (match == 2) match = 4;
       else if (match == 3) match = 0;
       else if (match == 4) match = 2;
     }
-    if (match == 1 && combed > 1 && field == 0) match = 5;
-    else if (match == 1 && combed > 1 && field == 1) match = 6;
+    if (match == 1 && combed > 1 && fs.field == 0) match = 5;
+    else if (match == 1 && combed > 1 && fs.field == 1) match = 6;
     unsigned char hint = 0;
     hint |= match;
     if (combed > 1) hint |= FILE_COMBED;
@@ -807,29 +823,142 @@ void TFM::fileOut(int match, int combed, bool d2vfilm, int n, int MICount, int m
     if (d2vfilm) hint |= FILE_D2V;
     hint |= FILE_ENTRY;
     outArray[n] = hint;
+    streamOutput(n);
   }
 }
 
 
-bool TFM::checkCombed(const VSFrameRef *src, int n, int match,
-  int *blockN, int &xblocksi, int *mics, bool ddebug)
+void TFM::formatOutputLine(int h, std::string &buf) const
 {
-    return checkCombedPlanar(src, n, match, blockN, xblocksi, mics, ddebug, vi->format->numPlanes > 1 && chroma);
+  if (!(outArray[h] & FILE_ENTRY))
+    return;
+  char tempBuf[40], tb2[40];
+  int match = (outArray[h] & 0x07);
+  sprintf(tempBuf, "%d %c", h, MTC(match));
+  if (outArray[h] & 0x20)
+  {
+    if (outArray[h] & 0x10) strcat(tempBuf, " +");
+    else strcat(tempBuf, " -");
+  }
+  if (outArray[h] & FILE_D2V) strcat(tempBuf, " 1");
+  if (moutArray.size() && moutArray[h] != -1)
+  {
+    sprintf(tb2, " [%d]", moutArray[h]);
+    strcat(tempBuf, tb2);
+  }
+  if (moutArrayE.size())
+  {
+    // -20 marks the values that were not calculated
+    int sn = micout == 1 ? 3 : 5, th = h*sn, e[5];
+    for (int i = 0; i < sn; ++i)
+      e[i] = moutArrayE[th + i] == -20 ? -1 : moutArrayE[th + i];
+    if (sn == 3) sprintf(tb2, " (%d %d %d)", e[0], e[1], e[2]);
+    else sprintf(tb2, " (%d %d %d %d %d)", e[0], e[1], e[2], e[3], e[4]);
+    strcat(tempBuf, tb2);
+  }
+  strcat(tempBuf, "\n");
+  buf += tempBuf;
+}
+
+
+void TFM::formatOutputCFrame(int h, std::string &buf)
+{
+  int match = 0;
+  if (outArray[h] & FILE_ENTRY) match = (outArray[h] & 0x07);
+  if (match == 1 || match == 5 || match == 6) ++outputCCount;
+  else
+  {
+    if (outputCCount > cNum)
+    {
+      char tempBuf[40];
+      sprintf(tempBuf, "%d,%d\n", h - outputCCount, h - 1);
+      buf += tempBuf;
+    }
+    outputCCount = 0;
+  }
+}
+
+
+// Called by fileOut after the entry of frame n is stored.
+void TFM::streamOutput(int n)
+{
+  if (!outputF && !outputCF)
+    return;
+  std::lock_guard<std::mutex> guard(outputLock);
+  outputDone[n] = 1;
+  for (; outputNext <= nfrms && outputDone[outputNext]; ++outputNext)
+  {
+    if (outputF) formatOutputLine(outputNext, outputBuf);
+    if (outputCF) formatOutputCFrame(outputNext, outputCBuf);
+  }
+  flushOutput(false);
+}
+
+
+void TFM::flushOutput(bool force)
+{
+  const size_t flushSize = 16384;
+  if (outputF && outputBuf.size() && (force || outputBuf.size() >= flushSize))
+  {
+    fwrite(outputBuf.data(), 1, outputBuf.size(), outputF.get());
+    fflush(outputF.get());
+    outputBuf.clear();
+  }
+  if (outputCF && outputCBuf.size() && (force || outputCBuf.size() >= flushSize))
+  {
+    fwrite(outputCBuf.data(), 1, outputCBuf.size(), outputCF.get());
+    fflush(outputCF.get());
+    outputCBuf.clear();
+  }
+}
+
+
+// Calls rows(kstart, kstop, sums) for the row pairs y = 2 + 2 * k, y < Height - 2,
+// of a plane and adds the sums to accum. With a stripe pool each stripe sums
+// into its own array; the integer totals do not depend on the split.
+template<int N, typename Rows>
+static void sumRowPairs(StripePool *stripes, int Height, uint64_t (&accum)[N], const Rows &rows)
+{
+  const int count = std::max((Height - 3) / 2, 0);
+  const int nstripes = stripeCount(stripes, count, 1, 16);
+  if (nstripes == 1)
+  {
+    rows(0, count, accum);
+    return;
+  }
+  std::vector<uint64_t> sums((size_t)nstripes * N, 0);
+  stripes->run(nstripes, [&](int i) {
+    int kstart, kstop;
+    StripePool::stripeRows(count, 1, nstripes, i, kstart, kstop);
+    rows(kstart, kstop, sums.data() + i * N);
+  });
+  for (int i = 0; i < nstripes; ++i)
+    for (int j = 0; j < N; ++j)
+      accum[j] += sums[i * N + j];
+}
+
+// Checks the weave of a match for combing without building it.
+bool TFM::checkCombed(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt, int n, int match,
+  int *blockN, int &xblocksi, int *mics, bool ddebug, TFMFrameState &fs) const
+{
+    const VSFrameRef *srcEven, *srcOdd;
+    getWeaveFields(prv, src, nxt, match, fs.field, srcEven, srcOdd);
+    return checkCombedPlanar(srcEven, srcOdd, n, match, blockN, xblocksi, mics, ddebug, vi->format->numPlanes > 1 && chroma, fs);
 }
 
 int TFM::compareFields(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt, int match1,
-  int match2, int& norm1, int& norm2, int& mtn1, int& mtn2, int n)
+  int match2, int& norm1, int& norm2, int& mtn1, int& mtn2, int n, TFMFrameState &fs) const
 {
   if (vi->format->bytesPerSample == 1)
-    return compareFields_core<uint8_t>(prv, src, nxt, match1, match2, norm1, norm2, mtn1, mtn2, n);
+    return compareFields_core<uint8_t>(prv, src, nxt, match1, match2, norm1, norm2, mtn1, mtn2, n, fs);
   else
-    return compareFields_core<uint16_t>(prv, src, nxt, match1, match2, norm1, norm2, mtn1, mtn2, n);
+    return compareFields_core<uint16_t>(prv, src, nxt, match1, match2, norm1, norm2, mtn1, mtn2, n, fs);
 }
 
 
 template<typename pixel_t>
 int TFM::compareFields_core(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt, int match1,
-  int match2, int &norm1, int &norm2, int &mtn1, int &mtn2, int n)
+  int match2, int &norm1, int &norm2, int &mtn1, int &mtn2, int n, TFMFrameState &fs) const
 {
     (void)n;
 
@@ -839,20 +968,28 @@ int TFM::compareFields_core(const VSFrameRef *prv, const VSFrameRef *src, const
   int y0a, y1a; // exclusion regio
 
   const int stop = vi->format->numPlanes == 1 || !mChroma ? 1 : 3;
-  const int incl = 1;  // pixel increments: 2 if YUY2 with no-chroma option otherwise 1
 
-  uint64_t accumPc = 0, accumNc = 0;
-  uint64_t accumPm = 0, accumNm = 0;
+  uint64_t accum[4] = {}; // Pc, Pm, Nc, Nm
   norm1 = norm2 = mtn1 = mtn2 = 0;
 
+  decltype(&compareFieldsRow_c<pixel_t>) compareFieldsRow = compareFieldsRow_c<pixel_t>;
+  if constexpr (sizeof(pixel_t) == 1) {
+    if (cpuFlags.avx2)
+      compareFieldsRow = compareFieldsRow_uint8_AVX2;
+    else if (cpuFlags.sse4_1)
+      compareFieldsRow = compareFieldsRow_uint8_SSE4;
+  }
+  else {
+    if (cpuFlags.avx2)
+      compareFieldsRow = compareFieldsRow_uint16_AVX2;
+    else if (cpuFlags.sse4_1)
+      compareFieldsRow = compareFieldsRow_uint16_SSE4;
+  }
 
   for (int b = 0; b < stop; ++b)
   {
     const int plane = b;
 
-    uint8_t *mapp = vsapi->getWritePtr(map.get(), b);
-    int map_pitch = vsapi->getStride(map.get(), b);
-
     const pixel_t* prvp = reinterpret_cast<const pixel_t*>(vsapi->getReadPtr(prv, plane));
     const int prv_pitch = vsapi->getStride(prv, plane) / sizeof(pixel_t);
 
@@ -890,62 +1027,59 @@ int TFM::compareFields_core(const VSFrameRef *prv, const VSFrameRef *src, const
 
     if (match1 < 3)
     {
-      curf = srcp + ((3 - field)*src_pitch);
-      mapp = mapp + ((field == 1 ? 1 : 2)*map_pitch);
+      curf = srcp + ((3 - fs.field)*src_pitch);
     }
     if (match1 == 0)
     {
       prvf_pitch = prv_pitch << 1;
-      prvpf = prvp + ((field == 1 ? 1 : 2)*prv_pitch);
+      prvpf = prvp + ((fs.field == 1 ? 1 : 2)*prv_pitch);
     }
     else if (match1 == 1)
     {
       prvf_pitch = src_pitch << 1;
-      prvpf = srcp + ((field == 1 ? 1 : 2)*src_pitch);
+      prvpf = srcp + ((fs.field == 1 ? 1 : 2)*src_pitch);
     }
     else if (match1 == 2)
     {
       prvf_pitch = nxt_pitch << 1;
-      prvpf = nxtp + ((field == 1 ? 1 : 2)*nxt_pitch);
+      prvpf = nxtp + ((fs.field == 1 ? 1 : 2)*nxt_pitch);
     }
     else if (match1 == 3)
     {
-      curf = srcp + ((2 + field)*src_pitch);
+      curf = srcp + ((2 + fs.field)*src_pitch);
       prvf_pitch = prv_pitch << 1;
-      prvpf = prvp + ((field == 1 ? 2 : 1)*prv_pitch);
-      mapp = mapp + ((field == 1 ? 2 : 1)*map_pitch);
+      prvpf = prvp + ((fs.field == 1 ? 2 : 1)*prv_pitch);
     }
     else if (match1 == 4)
     {
-      curf = srcp + ((2 + field)*src_pitch);
+      curf = srcp + ((2 + fs.field)*src_pitch);
       prvf_pitch = nxt_pitch << 1;
-      prvpf = nxtp + ((field == 1 ? 2 : 1)*nxt_pitch);
-      mapp = mapp + ((field == 1 ? 2 : 1)*map_pitch);
+      prvpf = nxtp + ((fs.field == 1 ? 2 : 1)*nxt_pitch);
     }
     if (match2 == 0)
     {
       nxtf_pitch = prv_pitch << 1;
-      nxtpf = prvp + ((field == 1 ? 1 : 2)*prv_pitch);
+      nxtpf = prvp + ((fs.field == 1 ? 1 : 2)*prv_pitch);
     }
     else if (match2 == 1)
     {
       nxtf_pitch = src_pitch << 1;
-      nxtpf = srcp + ((field == 1 ? 1 : 2)*src_pitch);
+      nxtpf = srcp + ((fs.field == 1 ? 1 : 2)*src_pitch);
     }
     else if (match2 == 2)
     {
       nxtf_pitch = nxt_pitch << 1;
-      nxtpf = nxtp + ((field == 1 ? 1 : 2)*nxt_pitch);
+      nxtpf = nxtp + ((fs.field == 1 ? 1 : 2)*nxt_pitch);
     }
     else if (match2 == 3)
     {
       nxtf_pitch = prv_pitch << 1;
-      nxtpf = prvp + ((field == 1 ? 2 : 1)*prv_pitch);
+      nxtpf = prvp + ((fs.field == 1 ? 2 : 1)*prv_pitch);
     }
     else if (match2 == 4)
     {
       nxtf_pitch = nxt_pitch << 1;
-      nxtpf = nxtp + ((field == 1 ? 2 : 1)*nxt_pitch);
+      nxtpf = nxtp + ((fs.field == 1 ? 2 : 1)*nxt_pitch);
     }
 
     const pixel_t* prvnf = prvpf + prvf_pitch;
@@ -953,193 +1087,29 @@ int TFM::compareFields_core(const VSFrameRef *prv, const VSFrameRef *src, const
     const pixel_t* curnf = curf + curf_pitch;
     const pixel_t* nxtnf = nxtpf + nxtf_pitch;
 
-    map_pitch <<= 1;
-    uint8_t* mapn = mapp + map_pitch;
-
-    // back to byte pointers
-    if ((match1 >= 3 && field == 1) || (match1 < 3 && field != 1))
-      buildDiffMapPlane2<pixel_t>(
-        reinterpret_cast<const uint8_t*>(prvpf - prvf_pitch),
-        reinterpret_cast<const uint8_t*>(nxtpf - nxtf_pitch),
-        mapp - map_pitch,
-        prvf_pitch * sizeof(pixel_t),
-        nxtf_pitch * sizeof(pixel_t),
-        map_pitch, Height >> 1, Width, bits_per_pixel);
-    else
-      buildDiffMapPlane2<pixel_t>(
-        reinterpret_cast<const uint8_t*>(prvnf - prvf_pitch),
-        reinterpret_cast<const uint8_t*>(nxtnf - nxtf_pitch),
-        mapn - map_pitch,
-        prvf_pitch * sizeof(pixel_t),
-        nxtf_pitch * sizeof(pixel_t),
-        map_pitch, Height >> 1, Width, bits_per_pixel);
-
-    const int Const23 = 23 << (bits_per_pixel - 8);
-    const int Const42 = 42 << (bits_per_pixel - 8);
-
     // TFM 874
-    for (int y = 2; y < Height - 2; y += 2) {
-      if ((y < y0a) || noBandExclusion || (y > y1a))  // exclusion area check
-      {
-        for (int x = startx; x < stopx; x += incl)
-        {
-          int eax = (mapp[x] << 2) + mapn[x];
-          if ((eax & 0xFF) == 0)
-            continue;
-
-          int a_curr = curpf[x] + (curf[x] << 2) + curnf[x];
-          int a_prev = 3 * (prvpf[x] + prvnf[x]);
-          int diff_p_c = abs(a_prev - a_curr);
-          if (diff_p_c > Const23) {
-            accumPc += diff_p_c;
-            if (diff_p_c > Const42 && ((eax & 10) != 0))
-              accumPm += diff_p_c;
-          }
-          int a_next = 3 * (nxtpf[x] + nxtnf[x]);
-          int diff_n_c = abs(a_next - a_curr);
-          if (diff_n_c > Const23) {
-            accumNc += diff_n_c;
-            if (diff_n_c > Const42 && ((eax & 10) != 0))
-              accumNm += diff_n_c;
-          }
-        }
-      } // if
-
-      mapp += map_pitch;
-      prvpf += prvf_pitch;
-      curpf += curf_pitch;
-      prvnf += prvf_pitch;
-      curf += curf_pitch;
-      nxtpf += nxtf_pitch;
-      curnf += curf_pitch;
-      nxtnf += nxtf_pitch;
-      mapn += map_pitch;
-    }
-
-#if 0
-    // TFM 874
-    __asm
-    {
-      push ebx // pf170421
-
-      mov y, 2
-      yloop:
-      mov ecx, y0a
-        mov edx, y1a
-        cmp ecx, edx
-        je xloop_pre
-        mov eax, y
-        cmp eax, ecx
-        jl xloop_pre
-        cmp eax, edx
-        jle end_yloop
-        xloop_pre :
-      mov esi, incl
-        mov ebx, startx
-        mov edi, mapp
-        mov edx, mapn
-        mov ecx, stopx
-        xloop :
-      movzx eax, BYTE PTR[edi + ebx]
-        shl eax, 2
-        add al, BYTE PTR[edx + ebx]
-        jnz b1
-        add ebx, esi
-        cmp ebx, ecx
-        jl xloop
-        jmp end_yloop
-        b1 :
-      mov edx, curf
-        mov edi, curpf
-        movzx ecx, BYTE PTR[edx + ebx]
-        movzx esi, BYTE PTR[edi + ebx]
-        shl ecx, 2
-        mov edx, curnf
-        add ecx, esi
-        mov edi, prvpf
-        movzx esi, BYTE PTR[edx + ebx]
-        movzx edx, BYTE PTR[edi + ebx]
-        add ecx, esi
-        mov edi, prvnf
-        movzx esi, BYTE PTR[edi + ebx]
-        add edx, esi
-        mov edi, edx
-        add edx, edx
-        sub edi, ecx
-        add edx, edi
-        jge b2
-        neg edx
-        b2 :
-      cmp edx, 23
-        jle p1
-        add accumPc, edx
-        cmp edx, 42
-        jle p1
-        test eax, 10
-        jz p1
-        add accumPm, edx
-        p1 :
-      mov edi, nxtpf
-        mov esi, nxtnf
-        movzx edx, BYTE PTR[edi + ebx]
-        movzx edi, BYTE PTR[esi + ebx]
-        add edx, edi
-        mov esi, edx
-        add edx, edx
-        sub esi, ecx
-        add edx, esi
-        jge b3
-        neg edx
-        b3 :
-      cmp edx, 23
-        jle p2
-        add accumNc, edx
-        cmp edx, 42
-        jle p2
-        test eax, 10
-        jz p2
-        add accumNm, edx
-        p2 :
-      mov esi, incl
-        mov ecx, stopx
-        mov edi, mapp
-        add ebx, esi
-        mov edx, mapn
-        cmp ebx, ecx
-        jl xloop
-        end_yloop :
-      mov esi, Height
-        mov eax, prvf_pitch
-        mov ebx, curf_pitch
-        mov ecx, nxtf_pitch
-        mov edi, map_pitch
-        sub esi, 2
-        add y, 2
-        add mapp, edi
-        add prvpf, eax
-        add curpf, ebx
-        add prvnf, eax
-        add curf, ebx
-        add nxtpf, ecx
-        add curnf, ebx
-        add nxtnf, ecx
-        add mapn, edi
-        cmp y, esi
-        jl yloop
-
-        pop ebx // pf170421
-    }
-#endif
+    // The diff map of buildABSDiffMask2 is computed on the fly for the two rows
+    // (prvpf/nxtpf and prvnf/nxtnf) it was read from, rows in the exclusion band
+    // are not touched at all. On odd plane heights this includes the last
+    // pair, whose map row was never built (and read stale) before.
+    sumRowPairs(stripes.get(), Height, accum, [&](int kstart, int kstop, uint64_t *sums) {
+      for (int k = kstart; k < kstop; ++k) {
+        const int y = 2 + 2 * k;
+        if ((y < y0a) || noBandExclusion || (y > y1a))  // exclusion area check
+          compareFieldsRow(prvpf + k * prvf_pitch, prvnf + k * prvf_pitch, curpf + k * curf_pitch, curf + k * curf_pitch,
+            curnf + k * curf_pitch, nxtpf + k * nxtf_pitch, nxtnf + k * nxtf_pitch, startx, stopx, bits_per_pixel, sums);
+      }
+    });
   }
 
   // High bit depth: I chose to scale back to 8 bit range.
   // Or else we should treat them as int64 and act upon them outside
   const double factor = 1.0 / (1 << (bits_per_pixel - 8));
 
-  norm1 = (int)((accumPc / 6.0 * factor) + 0.5);
-  norm2 = (int)((accumNc / 6.0 * factor) + 0.5);
-  mtn1 = (int)((accumPm / 6.0 * factor) + 0.5);
-  mtn2 = (int)((accumNm / 6.0 * factor) + 0.5);
+  norm1 = (int)((accum[0] / 6.0 * factor) + 0.5);
+  norm2 = (int)((accum[2] / 6.0 * factor) + 0.5);
+  mtn1 = (int)((accum[1] / 6.0 * factor) + 0.5);
+  mtn2 = (int)((accum[3] / 6.0 * factor) + 0.5);
   // TODO:  improve this decision about whether to use the mtn metrics or
   //        the normal metrics.  mtn metrics give better recognition of
   //        small areas ("mouths")... the hard part is telling when they
@@ -1177,23 +1147,23 @@ int TFM::compareFields_core(const VSFrameRef *prv, const VSFrameRef *src, const
 }
 
 int TFM::compareFieldsSlow(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt, int match1,
-  int match2, int& norm1, int& norm2, int& mtn1, int& mtn2, int n)
+  int match2, int& norm1, int& norm2, int& mtn1, int& mtn2, int n, TFMFrameState &fs) const
 {
   if (slow == 2) {
     if (vi->format->bytesPerSample == 1)
-      return compareFieldsSlow2_core<uint8_t>(prv, src, nxt, match1, match2, norm1, norm2, mtn1, mtn2, n);
+      return compareFieldsSlow2_core<uint8_t>(prv, src, nxt, match1, match2, norm1, norm2, mtn1, mtn2, n, fs);
     else
-      return compareFieldsSlow2_core<uint16_t>(prv, src, nxt, match1, match2, norm1, norm2, mtn1, mtn2, n);
+      return compareFieldsSlow2_core<uint16_t>(prv, src, nxt, match1, match2, norm1, norm2, mtn1, mtn2, n, fs);
   }
   if (vi->format->bytesPerSample == 1)
-    return compareFieldsSlow_core<uint8_t>(prv, src, nxt, match1, match2, norm1, norm2, mtn1, mtn2, n);
+    return compareFieldsSlow_core<uint8_t>(prv, src, nxt, match1, match2, norm1, norm2, mtn1, mtn2, n, fs);
   else
-    return compareFieldsSlow_core<uint16_t>(prv, src, nxt, match1, match2, norm1, norm2, mtn1, mtn2, n);
+    return compareFieldsSlow_core<uint16_t>(prv, src, nxt, match1, match2, norm1, norm2, mtn1, mtn2, n, fs);
 }
 
 template<typename pixel_t>
 int TFM::compareFieldsSlow_core(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt, int match1,
-  int match2, int &norm1, int &norm2, int &mtn1, int &mtn2, int n)
+  int match2, int &norm1, int &norm2, int &mtn1, int &mtn2, int n, TFMFrameState &fs) const
 {
     (void)n;
 
@@ -1205,19 +1175,29 @@ int TFM::compareFieldsSlow_core(const VSFrameRef *prv, const VSFrameRef *src, co
   int tpitch_current;
 
   const int stop = vi->format->numPlanes == 1 || !mChroma ? 1 : 3;
-  const int incl = 1;  // pixel increments: 2 if YUY2 with no-chroma option otherwise 1
-
-  uint64_t accumPc = 0, accumNc = 0;
-  uint64_t accumPm = 0, accumNm = 0;
-  uint64_t accumPml = 0, accumNml = 0; // plus compared to CompareFields
+  uint64_t accum[6] = {}; // Pc, Pm, Pml, Nc, Nm, Nml; ml: plus compared to CompareFields
   norm1 = norm2 = mtn1 = mtn2 = 0;
 
+  decltype(&compareFieldsSlowRow_c<pixel_t>) compareFieldsSlowRow = compareFieldsSlowRow_c<pixel_t>;
+  if constexpr (sizeof(pixel_t) == 1) {
+    if (cpuFlags.avx2)
+      compareFieldsSlowRow = compareFieldsSlowRow_uint8_AVX2;
+    else if (cpuFlags.sse4_1)
+      compareFieldsSlowRow = compareFieldsSlowRow_uint8_SSE4;
+  }
+  else {
+    if (cpuFlags.avx2)
+      compareFieldsSlowRow = compareFieldsSlowRow_uint16_AVX2;
+    else if (cpuFlags.sse4_1)
+      compareFieldsSlowRow = compareFieldsSlowRow_uint16_SSE4;
+  }
+
   for (int b = 0; b < stop; ++b)
   {
     const int plane = b;
 
-    uint8_t* mapp = vsapi->getWritePtr(map.get(), b);
-    int map_pitch = vsapi->getStride(map.get(), b);
+    uint8_t* mapp = vsapi->getWritePtr(fs.map.get(), b);
+    int map_pitch = vsapi->getStride(fs.map.get(), b);
 
     const pixel_t* prvp = reinterpret_cast<const pixel_t*>(vsapi->getReadPtr(prv, plane));
     const int prv_pitch = vsapi->getStride(prv, plane) / sizeof(pixel_t);
@@ -1261,62 +1241,62 @@ int TFM::compareFieldsSlow_core(const VSFrameRef *prv, const VSFrameRef *src, co
 
     if (match1 < 3)
     {
-      curf = srcp + ((3 - field)*src_pitch);
-      mapp = mapp + ((field == 1 ? 1 : 2)*map_pitch);
+      curf = srcp + ((3 - fs.field)*src_pitch);
+      mapp = mapp + ((fs.field == 1 ? 1 : 2)*map_pitch);
     }
     if (match1 == 0)
     {
       prvf_pitch = prv_pitch << 1;
-      prvpf = prvp + ((field == 1 ? 1 : 2)*prv_pitch);
+      prvpf = prvp + ((fs.field == 1 ? 1 : 2)*prv_pitch);
     }
     else if (match1 == 1)
     {
       prvf_pitch = src_pitch << 1;
-      prvpf = srcp + ((field == 1 ? 1 : 2)*src_pitch);
+      prvpf = srcp + ((fs.field == 1 ? 1 : 2)*src_pitch);
     }
     else if (match1 == 2)
     {
       prvf_pitch = nxt_pitch << 1;
-      prvpf = nxtp + ((field == 1 ? 1 : 2)*nxt_pitch);
+      prvpf = nxtp + ((fs.field == 1 ? 1 : 2)*nxt_pitch);
     }
     else if (match1 == 3)
     {
-      curf = srcp + ((2 + field)*src_pitch);
+      curf = srcp + ((2 + fs.field)*src_pitch);
       prvf_pitch = prv_pitch << 1;
-      prvpf = prvp + ((field == 1 ? 2 : 1)*prv_pitch);
-      mapp = mapp + ((field == 1 ? 2 : 1)*map_pitch);
+      prvpf = prvp + ((fs.field == 1 ? 2 : 1)*prv_pitch);
+      mapp = mapp + ((fs.field == 1 ? 2 : 1)*map_pitch);
     }
     else if (match1 == 4)
     {
-      curf = srcp + ((2 + field)*src_pitch);
+      curf = srcp + ((2 + fs.field)*src_pitch);
       prvf_pitch = nxt_pitch << 1;
-      prvpf = nxtp + ((field == 1 ? 2 : 1)*nxt_pitch);
-      mapp = mapp + ((field == 1 ? 2 : 1)*map_pitch);
+      prvpf = nxtp + ((fs.field == 1 ? 2 : 1)*nxt_pitch);
+      mapp = mapp + ((fs.field == 1 ? 2 : 1)*map_pitch);
     }
     if (match2 == 0)
     {
       nxtf_pitch = prv_pitch << 1;
-      nxtpf = prvp + ((field == 1 ? 1 : 2)*prv_pitch);
+      nxtpf = prvp + ((fs.field == 1 ? 1 : 2)*prv_pitch);
     }
     else if (match2 == 1)
     {
       nxtf_pitch = src_pitch << 1;
-      nxtpf = srcp + ((field == 1 ? 1 : 2)*src_pitch);
+      nxtpf = srcp + ((fs.field == 1 ? 1 : 2)*src_pitch);
     }
     else if (match2 == 2)
     {
       nxtf_pitch = nxt_pitch << 1;
-      nxtpf = nxtp + ((field == 1 ? 1 : 2)*nxt_pitch);
+      nxtpf = nxtp + ((fs.field == 1 ? 1 : 2)*nxt_pitch);
     }
     else if (match2 == 3)
     {
       nxtf_pitch = prv_pitch << 1;
-      nxtpf = prvp + ((field == 1 ? 2 : 1)*prv_pitch);
+      nxtpf = prvp + ((fs.field == 1 ? 2 : 1)*prv_pitch);
     }
     else if (match2 == 4)
     {
       nxtf_pitch = nxt_pitch << 1;
-      nxtpf = nxtp + ((field == 1 ? 2 : 1)*nxt_pitch);
+      nxtpf = nxtp + ((fs.field == 1 ? 2 : 1)*nxt_pitch);
     }
 
     const pixel_t* prvnf = prvpf + prvf_pitch;
@@ -1328,11 +1308,12 @@ int TFM::compareFieldsSlow_core(const VSFrameRef *prv, const VSFrameRef *src, co
     uint8_t* mapn = mapp + map_pitch;
 
     // back to byte pointers
-      if ((match1 >= 3 && field == 1) || (match1 < 3 && field != 1))
+      if ((match1 >= 3 && fs.field == 1) || (match1 < 3 && fs.field != 1))
         buildDiffMapPlane_Planar<pixel_t>(
           reinterpret_cast<const uint8_t*>(prvpf),
           reinterpret_cast<const uint8_t*>(nxtpf),
-          mapp, 
+          mapp,
+          fs.tbuffer.get(),
           prvf_pitch * sizeof(pixel_t),
           nxtf_pitch * sizeof(pixel_t),
           map_pitch, Height, Width, tpitch_current, bits_per_pixel);
@@ -1340,197 +1321,28 @@ int TFM::compareFieldsSlow_core(const VSFrameRef *prv, const VSFrameRef *src, co
         buildDiffMapPlane_Planar<pixel_t>(
           reinterpret_cast<const uint8_t*>(prvnf),
           reinterpret_cast<const uint8_t*>(nxtnf),
-          mapn, 
+          mapn,
+          fs.tbuffer.get(),
           prvf_pitch * sizeof(pixel_t),
           nxtf_pitch * sizeof(pixel_t),
           map_pitch, Height, Width, tpitch_current, bits_per_pixel);
 
-#ifdef USE_C_NO_ASM
-    const int Const23 = 23 << (bits_per_pixel - 8);
-    const int Const42 = 42 << (bits_per_pixel - 8);
-
-    // TFM 1144
-    // almost the same as in compareFields and buildDiffMapPlane2
-    for (int y = 2; y < Height - 2; y += 2) {
-      if ((y < y0a) || noBandExclusion || (y > y1a)) // exclusion area check
-      {
-        for (int x = startx; x < stopx; x += incl)
-        {
-          // diff from prev asm block (at buildDiffMapPlane2): <<3 instead of <<2
-          int eax = (mapp[x] << 3) + mapn[x];
-          if ((eax & 0xFF) == 0)
-            continue;
-
-          int a_curr = curpf[x] + (curf[x] << 2) + curnf[x];
-          int a_prev = 3 * (prvpf[x] + prvnf[x]);
-          int diff_p_c = abs(a_prev - a_curr);
-          if (diff_p_c > Const23) {
-            if((eax & 9) != 0) // diff from previous similar asm block: condition
-              accumPc += diff_p_c;
-            if (diff_p_c > Const42) {
-              if ((eax & 18) != 0) // diff: &18 instead of &10
-                accumPm += diff_p_c;
-              if ((eax & 36) != 0) // diff: new condition and accumulator
-                accumPml += diff_p_c;
-            }
-          }
-          int a_next = 3 * (nxtpf[x] + nxtnf[x]);
-          int diff_n_c = abs(a_next - a_curr);
-          if (diff_n_c > Const23) {
-            if ((eax & 9) != 0) // diff from previous similar asm block: condition
-              accumNc += diff_n_c;
-            if (diff_n_c > Const42) {
-              if ((eax & 18) != 0) // diff: &18 instead of &10
-                accumNm += diff_n_c;
-              if ((eax & 36) != 0) // diff: &18 instead of &10
-                accumNml += diff_n_c;
-            }
-          }
-        }
-      } // if
-
-      mapp += map_pitch;
-      prvpf += prvf_pitch;
-      curpf += curf_pitch;
-      prvnf += prvf_pitch;
-      curf += curf_pitch;
-      nxtpf += nxtf_pitch;
-      curnf += curf_pitch;
-      nxtnf += nxtf_pitch;
-      mapn += map_pitch;
-    }
-
-#else
     // TFM 1144
-    __asm
-    {
-      push ebx // pf170421
-
-      mov y, 2
-      yloop:
-      mov ecx, y0a
-        mov edx, y1a
-        cmp ecx, edx
-        je xloop_pre
-        mov eax, y
-        cmp eax, ecx
-        jl xloop_pre
-        cmp eax, edx
-        jle end_yloop
-        xloop_pre :
-      mov esi, incl
-        mov ebx, startx
-        mov edi, mapp
-        mov edx, mapn
-        mov ecx, stopx
-        xloop :
-      movzx eax, BYTE PTR[edi + ebx]
-        shl eax, 3
-        add al, BYTE PTR[edx + ebx]
-        jnz b1
-        add ebx, esi
-        cmp ebx, ecx
-        jl xloop
-        jmp end_yloop
-        b1 :
-      mov edx, curf
-        mov edi, curpf
-        movzx ecx, BYTE PTR[edx + ebx]
-        movzx esi, BYTE PTR[edi + ebx]
-        shl ecx, 2
-        mov edx, curnf
-        add ecx, esi
-        mov edi, prvpf
-        movzx esi, BYTE PTR[edx + ebx]
-        movzx edx, BYTE PTR[edi + ebx]
-        add ecx, esi
-        mov edi, prvnf
-        movzx esi, BYTE PTR[edi + ebx]
-        add edx, esi
-        mov edi, edx
-        add edx, edx
-        sub edi, ecx
-        add edx, edi
-        jge b3
-        neg edx
-        b3 :
-      cmp edx, 23
-        jle p3
-        test eax, 9
-        jz p1
-        add accumPc, edx
-        p1 :
-      cmp edx, 42
-        jle p3
-        test eax, 18
-        jz p2
-        add accumPm, edx
-        p2 :
-      test eax, 36
-        jz p3
-        add accumPml, edx
-        p3 :
-      mov edi, nxtpf
-        mov esi, nxtnf
-        movzx edx, BYTE PTR[edi + ebx]
-        movzx edi, BYTE PTR[esi + ebx]
-        add edx, edi
-        mov esi, edx
-        add edx, edx
-        sub esi, ecx
-        add edx, esi
-        jge b2
-        neg edx
-        b2 :
-      cmp edx, 23
-        jle p6
-        test eax, 9
-        jz p4
-        add accumNc, edx
-        p4 :
-      cmp edx, 42
-        jle p6
-        test eax, 18
-        jz p5
-        add accumNm, edx
-        p5 :
-      test eax, 36
-        jz p6
-        add accumNml, edx
-        p6 :
-      mov esi, incl
-        mov ecx, stopx
-        mov edi, mapp
-        add ebx, esi
-        mov edx, mapn
-        cmp ebx, ecx
-        jl xloop
-        end_yloop :
-      mov esi, Height
-        mov eax, prvf_pitch
-        mov ebx, curf_pitch
-        mov ecx, nxtf_pitch
-        mov edi, map_pitch
-        sub esi, 2
-        add y, 2
-        add mapp, edi
-        add prvpf, eax
-        add curpf, ebx
-        add prvnf, eax
-        add curf, ebx
-        add nxtpf, ecx
-        add curnf, ebx
-        add nxtnf, ecx
-        add mapn, edi
-        cmp y, esi
-        jl yloop
-
-        pop ebx // pf170421
-
-    }
-#endif
+    // almost the same as in compareFields, different map
+    sumRowPairs(stripes.get(), Height, accum, [&](int kstart, int kstop, uint64_t *sums) {
+      for (int k = kstart; k < kstop; ++k) {
+        const int y = 2 + 2 * k;
+        if ((y < y0a) || noBandExclusion || (y > y1a)) // exclusion area check
+          compareFieldsSlowRow(mapp + k * map_pitch, mapn + k * map_pitch, prvpf + k * prvf_pitch, prvnf + k * prvf_pitch,
+            curpf + k * curf_pitch, curf + k * curf_pitch, curnf + k * curf_pitch, nxtpf + k * nxtf_pitch, nxtnf + k * nxtf_pitch,
+            startx, stopx, bits_per_pixel, sums);
+      }
+    });
   }
 
+  uint64_t accumPc = accum[0], accumPm = accum[1], accumPml = accum[2];
+  uint64_t accumNc = accum[3], accumNm = accum[4], accumNml = accum[5];
+
   const unsigned int Const500 = 500 << (bits_per_pixel - 8);
   if (accumPm < Const500 && accumNm < Const500 && (accumPml >= Const500 || accumNml >= Const500) &&
     std::max(accumPml, accumNml) > 3 * std::min(accumPml, accumNml))
@@ -1583,7 +1395,7 @@ int TFM::compareFieldsSlow_core(const VSFrameRef *prv, const VSFrameRef *src, co
 
 template<typename pixel_t>
 int TFM::compareFieldsSlow2_core(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt, int match1,
-  int match2, int &norm1, int &norm2, int &mtn1, int &mtn2, int n)
+  int match2, int &norm1, int &norm2, int &mtn1, int &mtn2, int n, TFMFrameState &fs) const
 {
     (void)n;
 
@@ -1595,18 +1407,38 @@ int TFM::compareFieldsSlow2_core(const VSFrameRef *prv, const VSFrameRef *src, c
   int tpitch_current;
 
   const int stop = vi->format->numPlanes == 1 || !mChroma ? 1 : 3;
-  int incl = 1;  // pixel increments: 2 if YUY2 with no-chroma option otherwise 1
 
-  uint64_t accumPc = 0, accumNc = 0;
-  uint64_t accumPm = 0, accumNm = 0;
-  uint64_t accumPml = 0, accumNml = 0; // plus compared to CompareFields
+  uint64_t accum[6] = {}; // Pc, Pm, Pml, Nc, Nm, Nml; ml: plus compared to CompareFields
   norm1 = norm2 = mtn1 = mtn2 = 0;
+
+  decltype(&compareFieldsSlowRow_c<pixel_t>) compareFieldsSlowRow = compareFieldsSlowRow_c<pixel_t>;
+  decltype(&compareFieldsSlow2Row_c<pixel_t>) compareFieldsSlow2Row = compareFieldsSlow2Row_c<pixel_t>;
+  if constexpr (sizeof(pixel_t) == 1) {
+    if (cpuFlags.avx2) {
+      compareFieldsSlowRow = compareFieldsSlowRow_uint8_AVX2;
+      compareFieldsSlow2Row = compareFieldsSlow2Row_uint8_AVX2;
+    }
+    else if (cpuFlags.sse4_1) {
+      compareFieldsSlowRow = compareFieldsSlowRow_uint8_SSE4;
+      compareFieldsSlow2Row = compareFieldsSlow2Row_uint8_SSE4;
+    }
+  }
+  else {
+    if (cpuFlags.avx2) {
+      compareFieldsSlowRow = compareFieldsSlowRow_uint16_AVX2;
+      compareFieldsSlow2Row = compareFieldsSlow2Row_uint16_AVX2;
+    }
+    else if (cpuFlags.sse4_1) {
+      compareFieldsSlowRow = compareFieldsSlowRow_uint16_SSE4;
+      compareFieldsSlow2Row = compareFieldsSlow2Row_uint16_SSE4;
+    }
+  }
   
   for (int b = 0; b < stop; ++b)
   {
     const int plane = b;
-    uint8_t* mapp = vsapi->getWritePtr(map.get(), b);
-    int map_pitch = vsapi->getStride(map.get(), b);
+    uint8_t* mapp = vsapi->getWritePtr(fs.map.get(), b);
+    int map_pitch = vsapi->getStride(fs.map.get(), b);
 
     const pixel_t* prvp = reinterpret_cast<const pixel_t*>(vsapi->getReadPtr(prv, plane));
     const int prv_pitch = vsapi->getStride(prv, plane) / sizeof(pixel_t);
@@ -1650,62 +1482,62 @@ int TFM::compareFieldsSlow2_core(const VSFrameRef *prv, const VSFrameRef *src, c
 
     if (match1 < 3)
     {
-      curf = srcp + ((3 - field)*src_pitch);
-      mapp = mapp + ((field == 1 ? 1 : 2)*map_pitch);
+      curf = srcp + ((3 - fs.field)*src_pitch);
+      mapp = mapp + ((fs.field == 1 ? 1 : 2)*map_pitch);
     }
     if (match1 == 0)
     {
       prvf_pitch = prv_pitch << 1;
-      prvpf = prvp + ((field == 1 ? 1 : 2)*prv_pitch);
+      prvpf = prvp + ((fs.field == 1 ? 1 : 2)*prv_pitch);
     }
     else if (match1 == 1)
     {
       prvf_pitch = src_pitch << 1;
-      prvpf = srcp + ((field == 1 ? 1 : 2)*src_pitch);
+      prvpf = srcp + ((fs.field == 1 ? 1 : 2)*src_pitch);
     }
     else if (match1 == 2)
     {
       prvf_pitch = nxt_pitch << 1;
-      prvpf = nxtp + ((field == 1 ? 1 : 2)*nxt_pitch);
+      prvpf = nxtp + ((fs.field == 1 ? 1 : 2)*nxt_pitch);
     }
     else if (match1 == 3)
     {
-      curf = srcp + ((2 + field)*src_pitch);
+      curf = srcp + ((2 + fs.field)*src_pitch);
       prvf_pitch = prv_pitch << 1;
-      prvpf = prvp + ((field == 1 ? 2 : 1)*prv_pitch);
-      mapp = mapp + ((field == 1 ? 2 : 1)*map_pitch);
+      prvpf = prvp + ((fs.field == 1 ? 2 : 1)*prv_pitch);
+      mapp = mapp + ((fs.field == 1 ? 2 : 1)*map_pitch);
     }
     else if (match1 == 4)
     {
-      curf = srcp + ((2 + field)*src_pitch);
+      curf = srcp + ((2 + fs.field)*src_pitch);
       prvf_pitch = nxt_pitch << 1;
-      prvpf = nxtp + ((field == 1 ? 2 : 1)*nxt_pitch);
-      mapp = mapp + ((field == 1 ? 2 : 1)*map_pitch);
+      prvpf = nxtp + ((fs.field == 1 ? 2 : 1)*nxt_pitch);
+      mapp = mapp + ((fs.field == 1 ? 2 : 1)*map_pitch);
     }
     if (match2 == 0)
     {
       nxtf_pitch = prv_pitch << 1;
-      nxtpf = prvp + ((field == 1 ? 1 : 2)*prv_pitch);
+      nxtpf = prvp + ((fs.field == 1 ? 1 : 2)*prv_pitch);
     }
     else if (match2 == 1)
     {
       nxtf_pitch = src_pitch << 1;
-      nxtpf = srcp + ((field == 1 ? 1 : 2)*src_pitch);
+      nxtpf = srcp + ((fs.field == 1 ? 1 : 2)*src_pitch);
     }
     else if (match2 == 2)
     {
       nxtf_pitch = nxt_pitch << 1;
-      nxtpf = nxtp + ((field == 1 ? 1 : 2)*nxt_pitch);
+      nxtpf = nxtp + ((fs.field == 1 ? 1 : 2)*nxt_pitch);
     }
     else if (match2 == 3)
     {
       nxtf_pitch = prv_pitch << 1;
-      nxtpf = prvp + ((field == 1 ? 2 : 1)*prv_pitch);
+      nxtpf = prvp + ((fs.field == 1 ? 2 : 1)*prv_pitch);
     }
     else if (match2 == 4)
     {
       nxtf_pitch = nxt_pitch << 1;
-      nxtpf = nxtp + ((field == 1 ? 2 : 1)*nxt_pitch);
+      nxtpf = nxtp + ((fs.field == 1 ? 2 : 1)*nxt_pitch);
     }
 
     const pixel_t* prvppf = prvpf - prvf_pitch;
@@ -1723,11 +1555,12 @@ int TFM::compareFieldsSlow2_core(const VSFrameRef *prv, const VSFrameRef *src, c
     uint8_t* mapn = mapp + map_pitch;
 
     // back to byte pointers
-      if ((match1 >= 3 && field == 1) || (match1 < 3 && field != 1))
+      if ((match1 >= 3 && fs.field == 1) || (match1 < 3 && fs.field != 1))
         buildDiffMapPlane_Planar<pixel_t>(
           reinterpret_cast<const uint8_t*>(prvpf),
           reinterpret_cast<const uint8_t*>(nxtpf),
           mapp,
+          fs.tbuffer.get(),
           prvf_pitch * sizeof(pixel_t),
           nxtf_pitch * sizeof(pixel_t),
           map_pitch, Height, Width, tpitch_current, bits_per_pixel);
@@ -1736,601 +1569,52 @@ int TFM::compareFieldsSlow2_core(const VSFrameRef *prv, const VSFrameRef *src, c
           reinterpret_cast<const uint8_t*>(prvnf),
           reinterpret_cast<const uint8_t*>(nxtnf),
           mapn,
+          fs.tbuffer.get(),
           prvf_pitch * sizeof(pixel_t),
           nxtf_pitch * sizeof(pixel_t),
           map_pitch, Height, Width, tpitch_current, bits_per_pixel);
 
-    const int Const23 = 23 << (bits_per_pixel - 8);
-    const int Const42 = 42 << (bits_per_pixel - 8);
-
-    if (field == 0) {
+    if (fs.field == 0) {
     // TFM 1436
-    // almost the same as in TFM 1144
-      for (int y = 2; y < Height - 2; y += 2) {
-        if ((y < y0a) || noBandExclusion || (y > y1a))
-        {
-          for (int x = startx; x < stopx; x += incl)
+    // TFM 1144 plus prv/nxt 5 tap against cur 3 tap, flags from mapp
+      sumRowPairs(stripes.get(), Height, accum, [&](int kstart, int kstop, uint64_t *sums) {
+        for (int k = kstart; k < kstop; ++k) {
+          const int y = 2 + 2 * k;
+          if ((y < y0a) || noBandExclusion || (y > y1a))
           {
-            int eax = (mapp[x] << 3) + mapn[x]; // diff from prev asm block (at buildDiffMapPlane2): <<3 instead of <<2
-            if ((eax & 0xFF) == 0)
-              continue;
-
-            int a_curr = curpf[x] + (curf[x] << 2) + curnf[x];
-            int a_prev = 3 * (prvpf[x] + prvnf[x]);
-            int diff_p_c = abs(a_prev - a_curr);
-            if (diff_p_c > Const23) {
-              if ((eax & 9) != 0) // diff from previous similar asm block: condition
-                accumPc += diff_p_c;
-              if (diff_p_c > Const42) {
-                if ((eax & 18) != 0) // diff: &18 instead of &10
-                  accumPm += diff_p_c;
-                if ((eax & 36) != 0) // diff: new condition and accumulator
-                  accumPml += diff_p_c;
-              }
-            }
-            int a_next = 3 * (nxtpf[x] + nxtnf[x]);
-            int diff_n_c = abs(a_next - a_curr);
-            if (diff_n_c > Const23) {
-              if ((eax & 9) != 0) // diff from previous similar asm block: condition
-                accumNc += diff_n_c;
-              if (diff_n_c > Const42) {
-                if ((eax & 18) != 0) // diff: &18 instead of &10
-                  accumNm += diff_n_c;
-                if ((eax & 36) != 0) // diff: &18 instead of &10
-                  accumNml += diff_n_c;
-              }
-            }
-
-            // additional difference from TFM 1144
-            if ((eax & 56) != 0) {
-
-              a_prev = prvppf[x] + (prvpf[x] << 2) + prvnf[x];
-              a_curr = 3 * (curpf[x] + curf[x]);
-              diff_p_c = abs(a_prev - a_curr);
-              if (diff_p_c > Const23) {
-                if ((eax & 8) != 0) // diff from previous similar asm block: condition
-                  accumPc += diff_p_c;
-                if (diff_p_c > Const42) {
-                  if ((eax & 16) != 0) // diff: &16 instead of &18
-                    accumPm += diff_p_c;
-                  if ((eax & 32) != 0) // diff: new condition and accumulator
-                    accumPml += diff_p_c;
-                }
-              }
-              a_next = nxtppf[x] + (nxtpf[x] << 2) + nxtnf[x]; // really! not 3*
-              diff_n_c = abs(a_next - a_curr);
-              if (diff_n_c > Const23) {
-                if ((eax & 8) != 0) // diff: &8 instead of &9
-                  accumNc += diff_n_c;
-                if (diff_n_c > Const42) {
-                  if ((eax & 16) != 0) // diff: &16 instead of &18
-                    accumNm += diff_n_c;
-                  if ((eax & 32) != 0) // diff: &32 instead of &36
-                    accumNml += diff_n_c;
-                }
-              }
-            }
+            const uint8_t *mappk = mapp + k * map_pitch;
+            const pixel_t *prvpfk = prvpf + k * prvf_pitch, *prvnfk = prvnf + k * prvf_pitch;
+            const pixel_t *curpfk = curpf + k * curf_pitch, *curfk = curf + k * curf_pitch;
+            const pixel_t *nxtpfk = nxtpf + k * nxtf_pitch, *nxtnfk = nxtnf + k * nxtf_pitch;
+            compareFieldsSlowRow(mappk, mapn + k * map_pitch, prvpfk, prvnfk, curpfk, curfk, curnf + k * curf_pitch, nxtpfk, nxtnfk, startx, stopx, bits_per_pixel, sums);
+            compareFieldsSlow2Row(mappk, prvppf + k * prvf_pitch, prvpfk, prvnfk, curpfk, curfk, nxtppf + k * nxtf_pitch, nxtpfk, nxtnfk, startx, stopx, bits_per_pixel, sums);
           }
-        } // if
-
-        mapp += map_pitch;
-        prvpf += prvf_pitch;
-        curpf += curf_pitch;
-        prvnf += prvf_pitch;
-        curf += curf_pitch;
-        nxtpf += nxtf_pitch;
-        curnf += curf_pitch;
-        nxtnf += nxtf_pitch;
-        mapn += map_pitch;
-
-        prvppf += prvf_pitch;
-        nxtppf += nxtf_pitch;
-      }
+        }
+      });
     }
     else {
       // TFM 1633
-      // almost the same as in TFM 1436 (field==0= case)
-      // differences are after eax&56 block, see later
-
-      for (int y = 2; y < Height - 2; y += 2) {
-        if ((y < y0a) || noBandExclusion || (y > y1a))
-        {
-          for (int x = startx; x < stopx; x += incl)
+      // same as TFM 1436 with the extra block one field row lower, flags from mapn
+      sumRowPairs(stripes.get(), Height, accum, [&](int kstart, int kstop, uint64_t *sums) {
+        for (int k = kstart; k < kstop; ++k) {
+          const int y = 2 + 2 * k;
+          if ((y < y0a) || noBandExclusion || (y > y1a))
           {
-            int eax = (mapp[x] << 3) + mapn[x]; // diff from prev asm block (at buildDiffMapPlane2): <<3 instead of <<2
-            if ((eax & 0xFF) == 0)
-              continue;
-
-            int a_curr = curpf[x] + (curf[x] << 2) + curnf[x];
-            int a_prev = 3 * (prvpf[x] + prvnf[x]);
-            int diff_p_c = abs(a_prev - a_curr);
-            if (diff_p_c > Const23) {
-              if ((eax & 9) != 0) // diff from previous similar asm block: condition
-                accumPc += diff_p_c;
-              if (diff_p_c > Const42) {
-                if ((eax & 18) != 0) // diff: &18 instead of &10
-                  accumPm += diff_p_c;
-                if ((eax & 36) != 0) // diff: new condition and accumulator
-                  accumPml += diff_p_c;
-              }
-            }
-            int a_next = 3 * (nxtpf[x] + nxtnf[x]); // L2008
-            int diff_n_c = abs(a_next - a_curr);
-            if (diff_n_c > Const23) {
-              if ((eax & 9) != 0) // diff from previous similar asm block: condition
-                accumNc += diff_n_c;
-              if (diff_n_c > Const42) {
-                if ((eax & 18) != 0) // diff: &18 instead of &10
-                  accumNm += diff_n_c;
-                if ((eax & 36) != 0) // diff: &18 instead of &10
-                  accumNml += diff_n_c;
-              }
-            }
-
-            // difference from TFM 1436
-            // prvpf  -> prvnf
-            // prvppf -> prvpf
-            // prvnf  -> prvnnf
-            // curpf  -> curf
-            // curf   -> curnf
-            // nxtpf  -> nxtnf
-            // nxtppf -> nxtpf
-            // nxtnf  -> nxtnnf
-            // mask 8/16/32 -> 1/2/4
-            if ((eax & 7) != 0) { // 1.0.12: diff: &7 instead of &56 L2036
-
-              a_prev = prvpf[x] + (prvnf[x] << 2) + prvnnf[x];
-              a_curr = 3 * (curf[x] + curnf[x]);
-              diff_p_c = abs(a_prev - a_curr);
-              if (diff_p_c > Const23) {
-                if ((eax & 1) != 0) // diff: &1 instead of &8
-                  accumPc += diff_p_c;
-                if (diff_p_c > Const42) {
-                  if ((eax & 2) != 0) // diff: &2 instead of &16
-                    accumPm += diff_p_c;
-                  if ((eax & 4) != 0) // diff: &4 instead of &32
-                    accumPml += diff_p_c;
-                }
-              }
-              //int a_next = *(nxtppf + ebx) + (*(nxtpf + ebx) << 2) + *(nxtnf + ebx); // really! not 3*
-              a_next = nxtpf[x] + (nxtnf[x] << 2) + nxtnnf[x]; // really! not 3* L2075
-              diff_n_c = abs(a_next - a_curr);
-              if (diff_n_c > Const23) { // L2088
-                if ((eax & 1) != 0) // diff: &1 instead of &8
-                  accumNc += diff_n_c;
-                if (diff_n_c > Const42) { // L2094
-                  if ((eax & 2) != 0) // diff: &2 instead of &16 // 1.0.12 really 2
-                    accumNm += diff_n_c;
-                  if ((eax & 4) != 0) // diff: &4 instead of &32
-                    accumNml += diff_n_c;
-                }
-              }
-            }
+            const uint8_t *mapnk = mapn + k * map_pitch;
+            const pixel_t *prvpfk = prvpf + k * prvf_pitch, *prvnfk = prvnf + k * prvf_pitch;
+            const pixel_t *curfk = curf + k * curf_pitch, *curnfk = curnf + k * curf_pitch;
+            const pixel_t *nxtpfk = nxtpf + k * nxtf_pitch, *nxtnfk = nxtnf + k * nxtf_pitch;
+            compareFieldsSlowRow(mapp + k * map_pitch, mapnk, prvpfk, prvnfk, curpf + k * curf_pitch, curfk, curnfk, nxtpfk, nxtnfk, startx, stopx, bits_per_pixel, sums);
+            compareFieldsSlow2Row(mapnk, prvpfk, prvnfk, prvnnf + k * prvf_pitch, curfk, curnfk, nxtpfk, nxtnfk, nxtnnf + k * nxtf_pitch, startx, stopx, bits_per_pixel, sums);
           }
-        } // if
-
-        mapp += map_pitch;
-        prvpf += prvf_pitch;
-        curpf += curf_pitch;
-        prvnf += prvf_pitch;
-        curf += curf_pitch;
-        prvnnf += prvf_pitch; // 1.0.12
-        nxtpf += nxtf_pitch;
-        curnf += curf_pitch;
-        nxtnf += nxtf_pitch;
-        nxtnnf += nxtf_pitch;
-        mapn += map_pitch;
-
-        // not used prvppf += prvf_pitch;
-        // not used nxtppf += nxtf_pitch;
-
-      }
-
-    }
-
-#if 0
-    if (field == 0)
-    {
-      // TFM 1436
-      __asm
-      {
-        push ebx // pf170421
-
-        mov y, 2
-        yloop0:
-        mov ecx, y0a
-          mov edx, y1a
-          cmp ecx, edx
-          je xloop_pre0
-          mov eax, y
-          cmp eax, ecx
-          jl xloop_pre0
-          cmp eax, edx
-          jle end_yloop0
-          xloop_pre0 :
-        mov esi, incl
-          mov ebx, startx
-          mov edi, mapp
-          mov edx, mapn
-          mov ecx, stopx
-          xloop0 :
-        movzx eax, BYTE PTR[edi + ebx]
-          shl eax, 3
-          add al, BYTE PTR[edx + ebx]
-          jnz b10
-          add ebx, esi
-          cmp ebx, ecx
-          jl xloop0
-          jmp end_yloop0
-          b10 :
-        mov edx, curf
-          mov edi, curpf
-          movzx ecx, BYTE PTR[edx + ebx]
-          movzx esi, BYTE PTR[edi + ebx]
-          shl ecx, 2
-          mov edx, curnf
-          add ecx, esi
-          mov edi, prvpf
-          movzx esi, BYTE PTR[edx + ebx]
-          movzx edx, BYTE PTR[edi + ebx]
-          add ecx, esi
-          mov edi, prvnf
-          movzx esi, BYTE PTR[edi + ebx]
-          add edx, esi
-          mov edi, edx
-          add edx, edx
-          sub edi, ecx
-          add edx, edi
-          jge b30
-          neg edx
-          b30 :
-        cmp edx, 23
-          jle p30
-          test eax, 9
-          jz p10
-          add accumPc, edx
-          p10 :
-        cmp edx, 42
-          jle p30
-          test eax, 18
-          jz p20
-          add accumPm, edx
-          p20 :
-        test eax, 36
-          jz p30
-          add accumPml, edx
-          p30 :
-        mov edi, nxtpf
-          mov esi, nxtnf
-          movzx edx, BYTE PTR[edi + ebx]
-          movzx edi, BYTE PTR[esi + ebx]
-          add edx, edi
-          mov esi, edx
-          add edx, edx
-          sub esi, ecx
-          add edx, esi
-          jge b20
-          neg edx
-          b20 :
-        cmp edx, 23
-          jle p60
-          test eax, 9
-          jz p40
-          add accumNc, edx
-          p40 :
-        cmp edx, 42
-          jle p60
-          test eax, 18
-          jz p50
-          add accumNm, edx
-          p50 :
-        test eax, 36
-          jz p60
-          add accumNml, edx
-          p60 :
-        test eax, 56
-          jz p120
-          mov ecx, prvpf
-          mov edi, prvppf
-          movzx edx, BYTE PTR[ecx + ebx]
-          movzx esi, BYTE PTR[edi + ebx]
-          shl edx, 2
-          mov ecx, prvnf
-          add edx, esi
-          mov edi, curpf
-          movzx esi, BYTE PTR[ecx + ebx]
-          movzx ecx, BYTE PTR[edi + ebx]
-          add edx, esi
-          mov edi, curf
-          movzx esi, BYTE PTR[edi + ebx]
-          add ecx, esi
-          mov edi, ecx
-          add ecx, ecx
-          add ecx, edi
-          sub edx, ecx
-          jge b40
-          neg edx
-          b40 :
-        cmp edx, 23
-          jle p90
-          test eax, 8
-          jz p70
-          add accumPc, edx
-          p70 :
-        cmp edx, 42
-          jle p90
-          test eax, 16
-          jz p80
-          add accumPm, edx
-          p80 :
-        test eax, 32
-          jz p90
-          add accumPml, edx
-          p90 :
-        mov edi, nxtpf
-          mov esi, nxtppf
-          movzx edx, BYTE PTR[edi + ebx]
-          movzx edi, BYTE PTR[esi + ebx]
-          shl edx, 2
-          mov esi, nxtnf
-          add edx, edi
-          movzx edi, BYTE PTR[esi + ebx]
-          add edx, edi
-          sub edx, ecx
-          jge b50
-          neg edx
-          b50 :
-        cmp edx, 23
-          jle p120
-          test eax, 8
-          jz p100
-          add accumNc, edx
-          p100 :
-        cmp edx, 42
-          jle p120
-          test eax, 16
-          jz p110
-          add accumNm, edx
-          p110 :
-        test eax, 32
-          jz p120
-          add accumNml, edx
-          p120 :
-        mov esi, incl
-          mov ecx, stopx
-          mov edi, mapp
-          add ebx, esi
-          mov edx, mapn
-          cmp ebx, ecx
-          jl xloop0
-          end_yloop0 :
-        mov esi, Height
-          mov eax, prvf_pitch
-          mov ebx, curf_pitch
-          mov ecx, nxtf_pitch
-          mov edi, map_pitch
-          sub esi, 2
-          add y, 2
-          add mapp, edi
-          add prvpf, eax
-          add curpf, ebx
-          add prvnf, eax
-          add curf, ebx
-          add nxtpf, ecx
-          add prvppf, eax
-          add curnf, ebx
-          add nxtnf, ecx
-          add mapn, edi
-          add nxtppf, ecx
-          cmp y, esi
-          jl yloop0
-
-          pop ebx // pf170421
-      }
-    }
-    else
-    {
-      // TFM 1633
-      __asm
-      {
-        push ebx // pf170421
-
-        mov y, 2
-        yloop1:
-        mov ecx, y0a
-          mov edx, y1a
-          cmp ecx, edx
-          je xloop_pre1
-          mov eax, y
-          cmp eax, ecx
-          jl xloop_pre1
-          cmp eax, edx
-          jle end_yloop1
-          xloop_pre1 :
-        mov esi, incl
-          mov ebx, startx
-          mov edi, mapp
-          mov edx, mapn
-          mov ecx, stopx
-          xloop1 :
-        movzx eax, BYTE PTR[edi + ebx]
-          shl eax, 3
-          add al, BYTE PTR[edx + ebx]
-          jnz b11
-          add ebx, esi
-          cmp ebx, ecx
-          jl xloop1
-          jmp end_yloop1
-          b11 :
-        mov edx, curf
-          mov edi, curpf
-          movzx ecx, BYTE PTR[edx + ebx]
-          movzx esi, BYTE PTR[edi + ebx]
-          shl ecx, 2
-          mov edx, curnf
-          add ecx, esi
-          mov edi, prvpf
-          movzx esi, BYTE PTR[edx + ebx]
-          movzx edx, BYTE PTR[edi + ebx]
-          add ecx, esi
-          mov edi, prvnf
-          movzx esi, BYTE PTR[edi + ebx]
-          add edx, esi
-          mov edi, edx
-          add edx, edx
-          sub edi, ecx
-          add edx, edi
-          jge b31
-          neg edx
-          b31 :
-        cmp edx, 23
-          jle p31
-          test eax, 9
-          jz p11
-          add accumPc, edx
-          p11 :
-        cmp edx, 42
-          jle p31
-          test eax, 18
-          jz p21
-          add accumPm, edx
-          p21 :
-        test eax, 36
-          jz p31
-          add accumPml, edx
-          p31 :
-        mov edi, nxtpf
-          mov esi, nxtnf
-          movzx edx, BYTE PTR[edi + ebx]
-          movzx edi, BYTE PTR[esi + ebx]
-          add edx, edi
-          mov esi, edx
-          add edx, edx
-          sub esi, ecx
-          add edx, esi
-          jge b21
-          neg edx
-          b21 :
-        cmp edx, 23
-          jle p61
-          test eax, 9
-          jz p41
-          add accumNc, edx
-          p41 :
-        cmp edx, 42
-          jle p61
-          test eax, 18
-          jz p51
-          add accumNm, edx
-          p51 :
-        test eax, 36
-          jz p61
-          add accumNml, edx
-          p61 :
-        test eax, 7
-          jz p121
-          mov ecx, prvnf
-          mov edi, prvpf
-          movzx edx, BYTE PTR[ecx + ebx]
-          movzx esi, BYTE PTR[edi + ebx]
-          shl edx, 2
-          mov ecx, prvnnf
-          add edx, esi
-          mov edi, curf
-          movzx esi, BYTE PTR[ecx + ebx]
-          movzx ecx, BYTE PTR[edi + ebx]
-          add edx, esi
-          mov edi, curnf
-          movzx esi, BYTE PTR[edi + ebx]
-          add ecx, esi
-          mov edi, ecx
-          add ecx, ecx
-          add ecx, edi
-          sub edx, ecx
-          jge b41
-          neg edx
-          b41 :
-        cmp edx, 23
-          jle p91
-          test eax, 1
-          jz p71
-          add accumPc, edx
-          p71 :
-        cmp edx, 42
-          jle p91
-          test eax, 2
-          jz p81
-          add accumPm, edx
-          p81 :
-        test eax, 4
-          jz p91
-          add accumPml, edx
-          p91 :
-        mov edi, nxtnf
-          mov esi, nxtpf
-          movzx edx, BYTE PTR[edi + ebx]
-          movzx edi, BYTE PTR[esi + ebx]
-          shl edx, 2
-          mov esi, nxtnnf
-          add edx, edi
-          movzx edi, BYTE PTR[esi + ebx]
-          add edx, edi
-          sub edx, ecx
-          jge b51
-          neg edx
-          b51 :
-        cmp edx, 23
-          jle p121
-          test eax, 1
-          jz p101
-          add accumNc, edx
-          p101 :
-        cmp edx, 42
-          jle p121
-          test eax, 2
-          jz p111
-          add accumNm, edx
-          p111 :
-        test eax, 4
-          jz p121
-          add accumNml, edx
-          p121 :
-        mov esi, incl
-          mov ecx, stopx
-          mov edi, mapp
-          add ebx, esi
-          mov edx, mapn
-          cmp ebx, ecx
-          jl xloop1
-          end_yloop1 :
-        mov esi, Height
-          mov eax, prvf_pitch
-          mov ebx, curf_pitch
-          mov ecx, nxtf_pitch
-          mov edi, map_pitch
-          sub esi, 2
-          add y, 2
-          add mapp, edi
-          add prvpf, eax
-          add curpf, ebx
-          add prvnf, eax
-          add curf, ebx
-          add prvnnf, eax
-          add nxtpf, ecx
-          add curnf, ebx
-          add nxtnf, ecx
-          add mapn, edi
-          add nxtnnf, ecx
-          cmp y, esi
-          jl yloop1
-
-          pop ebx // pf170421
-
-      }
+        }
+      });
     }
-#endif
   }
 
+  uint64_t accumPc = accum[0], accumPm = accum[1], accumPml = accum[2];
+  uint64_t accumNc = accum[3], accumNm = accum[4], accumNml = accum[5];
+
   const unsigned int Const500 = 500 << (bits_per_pixel - 8);
   if (accumPm < Const500 && accumNm < Const500 && (accumPml >= Const500 || accumNml >= Const500) &&
     std::max(accumPml, accumNml) > 3 * std::min(accumPml, accumNml))
@@ -2476,20 +1760,20 @@ static void checkSceneChangePlanar_2_c(const pixel_t* prvp, const pixel_t* srcp,
 //  }
 //}
 
-bool TFM::checkSceneChange(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt, int n)
+bool TFM::checkSceneChange(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt, int n, TFMFrameState &fs) const
 {
   const int bits_per_pixel = vi->format->bitsPerSample;
   if (bits_per_pixel == 8)
-    return checkSceneChange_core<uint8_t>(prv, src, nxt, n, bits_per_pixel);
+    return checkSceneChange_core<uint8_t>(prv, src, nxt, n, bits_per_pixel, fs);
   else
-    return checkSceneChange_core<uint16_t>(prv, src, nxt, n, bits_per_pixel);
+    return checkSceneChange_core<uint16_t>(prv, src, nxt, n, bits_per_pixel, fs);
 }
 
 template<typename pixel_t>
 bool TFM::checkSceneChange_core(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt,
-  int n, int bits_per_pixel)
+  int n, int bits_per_pixel, TFMFrameState &fs) const
 {
-  if (sclast.frame == n + 1) return sclast.sc;
+  if (fs.sclast.frame == n + 1) return fs.sclast.sc;
   uint64_t diffp = 0;
   uint64_t diffn = 0;
   const uint8_t *prvp = vsapi->getReadPtr(prv, 0);
@@ -2507,15 +1791,15 @@ bool TFM::checkSceneChange_core(const VSFrameRef *prv, const VSFrameRef *src, co
   int prv_pitch = vsapi->getStride(prv, 0) << 1;
   int src_pitch = prv_pitch;
   int nxt_pitch = prv_pitch;
-  prvp += (1 - field)*(prv_pitch >> 1);
-  srcp += (1 - field)*(src_pitch >> 1);
-  nxtp += (1 - field)*(nxt_pitch >> 1);
+  prvp += (1 - fs.field)*(prv_pitch >> 1);
+  srcp += (1 - fs.field)*(src_pitch >> 1);
+  nxtp += (1 - fs.field)*(nxt_pitch >> 1);
 
   bool use_sse2 = cpuFlags.sse2;
 
-  if (sclast.frame == n)
+  if (fs.sclast.frame == n)
   {
-    diffp = ((uint64_t)sclast.diff) << (bits_per_pixel - 8);
+    diffp = ((uint64_t)fs.sclast.diff) << (bits_per_pixel - 8);
       if (sizeof(pixel_t) == 1 && use_sse2)
         checkSceneChangePlanar_1_SSE2(srcp, nxtp, height, width, src_pitch, nxt_pitch, diffn);
       else
@@ -2553,16 +1837,16 @@ bool TFM::checkSceneChange_core(const VSFrameRef *prv, const VSFrameRef *src, co
 //      (diffp > diffmaxsc || diffn > diffmaxsc) ? 'T' : 'F');
 //    OutputDebugString(buf);
 //  }
-  sclast.frame = n + 1;
-  sclast.diff = (unsigned long)diffn;
-  sclast.sc = true;
+  fs.sclast.frame = n + 1;
+  fs.sclast.diff = (unsigned long)diffn;
+  fs.sclast.sc = true;
   if (diffp > diffmaxsc || diffn > diffmaxsc) return true;
-  sclast.sc = false;
+  fs.sclast.sc = false;
   return false;
 }
 
 void TFM::createWeaveFrame(VSFrameRef *dst, const VSFrameRef *prv, const VSFrameRef *src,
-  const VSFrameRef *nxt, int match, int &cfrm) const
+  const VSFrameRef *nxt, int match, int &cfrm, int field) const
 {
   if (cfrm == match)
     return;
@@ -2617,17 +1901,31 @@ void TFM::createWeaveFrame(VSFrameRef *dst, const VSFrameRef *prv, const VSFrame
   cfrm = match;
 }
 
-void TFM::putFrameProperties(VSFrameRef *dst, int match, int combed, bool d2vfilm, const int mics[5]) const
+// The frames that supply the even and the odd rows of createWeaveFrame's output
+void TFM::getWeaveFields(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt,
+  int match, int field, const VSFrameRef *&srcEven, const VSFrameRef *&srcOdd) const
+{
+  const VSFrameRef *fieldFrame = src; // rows of the 'field' parity
+  const VSFrameRef *otherFrame = src;
+  if (match == 0) fieldFrame = prv;
+  else if (match == 2) fieldFrame = nxt;
+  else if (match == 3) otherFrame = prv;
+  else if (match == 4) otherFrame = nxt;
+  srcEven = field == 0 ? fieldFrame : otherFrame;
+  srcOdd = field == 0 ? otherFrame : fieldFrame;
+}
+
+void TFM::putFrameProperties(VSFrameRef *dst, int match, int combed, bool d2vfilm, const int mics[5], const TFMFrameState &fs) const
 {
     VSMap *props = vsapi->getFramePropsRW(dst);
 
     vsapi->propSetInt(props, PROP_TFMMATCH, match, paReplace);
     vsapi->propSetInt(props, PROP_Combed, combed > 1, paReplace);
     vsapi->propSetInt(props, PROP_TFMD2VFilm, d2vfilm, paReplace);
-    vsapi->propSetInt(props, PROP_TFMField, field, paReplace);
+    vsapi->propSetInt(props, PROP_TFMField, fs.field, paReplace);
     for (int i = 0; i < 5; i++)
         vsapi->propSetInt(props, PROP_TFMMics, mics[i], i ? paAppend : paReplace);
-    vsapi->propSetInt(props, PROP_TFMPP, PP, paReplace);
+    vsapi->propSetInt(props, PROP_TFMPP, fs.PP, paReplace);
 }
 
 //template<typename pixel_t>
@@ -2676,34 +1974,17 @@ void TFM::putFrameProperties(VSFrameRef *dst, int match, int combed, bool d2vfil
 //}
 
 
-// check in TDeint, plus don't call with aligned width!
 template<typename pixel_t>
-void TFM::buildDiffMapPlane2(const uint8_t *prvp, const uint8_t *nxtp,
-  uint8_t *dstp, int prv_pitch, int nxt_pitch, int dst_pitch, int Height,
-  int Width, int bits_per_pixel) const
-{
-  do_buildABSDiffMask2<pixel_t>(prvp, nxtp, dstp, prv_pitch, nxt_pitch, dst_pitch, Width, Height, &cpuFlags, bits_per_pixel);
-}
-
-// instantiate
-template void TFM::buildDiffMapPlane2<uint8_t>(const uint8_t* prvp, const uint8_t* nxtp,
-  uint8_t* dstp, int prv_pitch, int nxt_pitch, int dst_pitch, int Height,
-  int Width, int bits_per_pixel) const;
-template void TFM::buildDiffMapPlane2<uint16_t>(const uint8_t* prvp, const uint8_t* nxtp,
-  uint8_t* dstp, int prv_pitch, int nxt_pitch, int dst_pitch, int Height,
-  int Width, int bits_per_pixel) const;
-
-template<typename pixel_t>
-void TFM::buildABSDiffMask(const uint8_t *prvp, const uint8_t *nxtp,
+void TFM::buildABSDiffMask(const uint8_t *prvp, const uint8_t *nxtp, uint8_t *tbuffer,
   int prv_pitch, int nxt_pitch, int tpitch, int width, int height) const
 {
-  do_buildABSDiffMask<pixel_t>(prvp, nxtp, tbuffer.get(), prv_pitch, nxt_pitch, tpitch, width, height, &cpuFlags);
+  do_buildABSDiffMask<pixel_t>(prvp, nxtp, tbuffer, prv_pitch, nxt_pitch, tpitch, width, height, &cpuFlags);
 }
 
 // instantiate
-template void TFM::buildABSDiffMask<uint8_t>(const uint8_t* prvp, const uint8_t* nxtp,
+template void TFM::buildABSDiffMask<uint8_t>(const uint8_t* prvp, const uint8_t* nxtp, uint8_t* tbuffer,
   int prv_pitch, int nxt_pitch, int tpitch, int width, int height) const;
-template void TFM::buildABSDiffMask<uint16_t>(const uint8_t* prvp, const uint8_t* nxtp,
+template void TFM::buildABSDiffMask<uint16_t>(const uint8_t* prvp, const uint8_t* nxtp, uint8_t* tbuffer,
   int prv_pitch, int nxt_pitch, int tpitch, int width, int height) const;
 
 
@@ -2740,15 +2021,15 @@ TFM::TFM(VSNodeRef *_child, int _order, int _field, int _mode, int _PP, const ch
   int _slow, bool _mChroma, int _cNum, int _cthresh, int _MI, bool _chroma, int _blockx,
   int _blocky, int _y0, int _y1, const char* _d2v, int _ovrDefault, int _flags, double _scthresh,
   int _micout, int _micmatching, const char* _trimIn, bool _usehints, int _metric, bool _batch,
-  bool _ubsco, bool _mmsco, int _opt, const VSAPI *_vsapi, VSCore *core)
+  bool _ubsco, bool _mmsco, bool _micexit, int _opt, const VSAPI *_vsapi, VSCore *core)
     : vsapi(_vsapi), child(_child),
-  order(_order), field(_field), mode(_mode), PP(_PP), ovr(_ovr), input(_input), output(_output),
+  ovr(_ovr), input(_input), output(_output),
   outputC(_outputC), debug(_debug), display(_display), slow(_slow), mChroma(_mChroma), cNum(_cNum),
-  cthresh(_cthresh), MI(_MI), chroma(_chroma), blockx(_blockx), blocky(_blocky), y0(_y0),
+  cthresh(_cthresh), chroma(_chroma), blockx(_blockx), blocky(_blocky), y0(_y0),
   y1(_y1), d2v(_d2v), ovrDefault(_ovrDefault), flags(_flags), scthresh(_scthresh), micout(_micout),
   micmatching(_micmatching), trimIn(_trimIn), usehints(_usehints), metric(_metric),
-  batch(_batch), ubsco(_ubsco), mmsco(_mmsco), opt(_opt), cArray(nullptr, nullptr), tbuffer(nullptr, nullptr),
-  map(nullptr, nullptr), cmask(nullptr, nullptr)
+  batch(_batch), ubsco(_ubsco), mmsco(_mmsco), micexit(_micexit), opt(_opt),
+  PP_origSaved(_PP), MI_origSaved(_MI), order_origSaved(_order), field_origSaved(_field), mode_origSaved(_mode)
 {
     vi = vsapi->getVideoInfo(child);
 
@@ -2778,13 +2059,13 @@ TFM::TFM(VSNodeRef *_child, int _order, int _field, int _mode, int _PP, const ch
     throw TIVTCError("TFM:  height and width must be divisible by 2!");
   if (vi->height < 6 || vi->width < 64)
     throw TIVTCError("TFM:  frame dimensions too small!");
-  if (mode < 0 || mode > 7)
+  if (mode_origSaved < 0 || mode_origSaved > 7)
     throw TIVTCError("TFM:  mode must be set to 0, 1, 2, 3, 4, 5, 6, or 7!");
-  if (field < -1 || field > 1)
+  if (field_origSaved < -1 || field_origSaved > 1)
     throw TIVTCError("TFM:  field must be set to -1, 0, or 1!");
-  if (PP < 0 || PP > 7)
+  if (PP_origSaved < 0 || PP_origSaved > 7)
     throw TIVTCError("TFM:  PP must be at least 0 and less than 8!");
-  if (order < -1 || order > 1)
+  if (order_origSaved < -1 || order_origSaved > 1)
     throw TIVTCError("TFM:  order must be set to -1, 0, or 1!");
   if (blockx != 4 && blockx != 8 && blockx != 16 && blockx != 32 && blockx != 64 &&
     blockx != 128 && blockx != 256 && blockx != 512 && blockx != 1024 && blockx != 2048)
@@ -2820,10 +2101,8 @@ TFM::TFM(VSNodeRef *_child, int _order, int _field, int _mode, int _PP, const ch
 //  child->SetCacheHints(CACHE_GENERIC, 3);  // fixed to diameter (07/30/2005)
 
   lastMatch.frame = lastMatch.field = lastMatch.combed = lastMatch.match = -20;
+  lastOrder = order_origSaved;
   nfrms = vi->numFrames - 1;
-  mode_origSaved = mode;
-  PP_origSaved = PP;
-  MI_origSaved = MI;
   d2vpercent = -20.00f;
   vidCount = 0;
 
@@ -2842,22 +2121,28 @@ TFM::TFM(VSNodeRef *_child, int _order, int _field, int _mode, int _PP, const ch
   // Warning: this mod16 must match with the calculation in "checkSceneChange"
   diffmaxsc = int((double(((vi->width >> 4) << 4)*vi->height * (235-16))*scthresh*0.5) / 100.0);
 
-  sclast.frame = -20;
-  sclast.sc = true;
-
-  if (mode == 1 || mode == 2 || mode == 3 || mode == 5 || mode == 6 || mode == 7 ||
-    PP > 0 || micout > 0 || micmatching > 0)
+  if (mode_origSaved == 1 || mode_origSaved == 2 || mode_origSaved == 3 || mode_origSaved == 5 ||
+    mode_origSaved == 6 || mode_origSaved == 7 || PP_origSaved > 0 || micout > 0 || micmatching > 0)
   {
-    cArray = decltype(cArray) (vs_aligned_malloc<int>((((vi->width + xhalf) >> xshift) + 1)*(((vi->height + yhalf) >> yshift) + 1) * 4 * sizeof(int), 16), &vs_aligned_free);
-    if (!cArray) {
-        throw TIVTCError("TFM:  malloc failure (cArray)!");
-    }
-    cmask = decltype(cmask) (vsapi->newVideoFrame(vi->format, vi->width, vi->height, nullptr, core), vsapi->freeFrame);
+    cArraySize = (((vi->width + xhalf) >> xshift) + 1)*(((vi->height + yhalf) >> yshift) + 1) * 4;
+    cmaskBitsPitch = ((vi->width + 255) >> 8) << 2; // multiple of 256 bits for AVX2
+    cmaskCountsPitch = ((cmaskBitsPitch * (64 / std::min(xhalf, 64))) + 7) & ~7; // 32 byte aligned
+    allocCmask = true;
+  }
+  else
+  {
+    cArraySize = 0;
+    cmaskBitsPitch = 0;
+    cmaskCountsPitch = 0;
+    allocCmask = false;
   }
 
+  // A match only needs to know whether its highest block count is over MI,
+  // unless the counts themselves are shown, written out or compared.
+  micexitActive = micexit && micout == 0 && micmatching == 0 && !display && output.empty();
+
   // prepare map format: always 8 bits
-  const VSFormat *map_format = vsapi->registerFormat(vi->format->colorFamily, vi->format->sampleType, 8, vi->format->subSamplingW, vi->format->subSamplingH, core);
-  map = decltype(map) (vsapi->newVideoFrame(map_format, vi->width, vi->height, nullptr, core), vsapi->freeFrame);
+  map_format = vsapi->registerFormat(vi->format->colorFamily, vi->format->sampleType, 8, vi->format->subSamplingW, vi->format->subSamplingH, core);
 
   if (d2v.size())
   {
@@ -2865,11 +2150,10 @@ TFM::TFM(VSNodeRef *_child, int _order, int _field, int _mode, int _PP, const ch
 
     trimArray.resize(0);
   }
-  order_origSaved = order;
-  field_origSaved = fieldO = field;
+  fieldO = field_origSaved;
   if (fieldO == -1)
   {
-    if (order == -1) {
+    if (order_origSaved == -1) {
         char error[512] = "TFM: Couldn't fetch the first frame from the input clip to determine the clip's field order. Reason: ";
         size_t len = strlen(error);
 
@@ -2891,7 +2175,7 @@ TFM::TFM(VSNodeRef *_child, int _order, int _field, int _mode, int _PP, const ch
 
 //        fieldO = child->GetParity(0) ? 1 : 0;
     }
-    else fieldO = order;
+    else fieldO = order_origSaved;
   }
   tpitchy = tpitchuv = -20;
   
@@ -2909,10 +2193,7 @@ TFM::TFM(VSNodeRef *_child, int _order, int _field, int _mode, int _PP, const ch
   }
 #undef ALIGN_NUMBER
 
-  // 16 would be is enough for sse2 but maybe we'll do AVX2?
-  tbuffer = decltype(tbuffer) (vs_aligned_malloc<uint8_t>((vi->height >> 1) * tpitchy, ALIGN_BUF), &vs_aligned_free);
-  if (!tbuffer) throw TIVTCError("TFM:  malloc failure (tbuffer)!");
-  mode7_field = field;
+  mode7_field = field_origSaved;
   if (input.size())
   {
     bool d2vmarked, micmarked;
@@ -3494,10 +2775,13 @@ TFM::TFM(VSNodeRef *_child, int _order, int _field, int _mode, int _PP, const ch
 emptyovr:
   if (output.size())
   {
-    if ((f = decltype (f)(tivtc_fopen(output.c_str(), "w"), &fclose)) != nullptr)
+    outputF.reset(tivtc_fopen(output.c_str(), "w"));
+    if (outputF)
     {
-      _fullpath(outputFull, output.c_str(), MAX_PATH);
       calcCRC(child, 15, outputCrc, vsapi);
+      fprintf(outputF.get(), "#TFM %s by tritical\n", VERSION);
+      fprintf(outputF.get(), "field = %s\n", fieldO == 1 ? "top" : "bottom");
+      fprintf(outputF.get(), "crc32 = %x\n", outputCrc);
       outArray.resize(vi->numFrames, 0);
       moutArray.resize(vi->numFrames, -1);
       if (micout > 0)
@@ -3512,9 +2796,10 @@ emptyovr:
   }
   if (outputC.size())
   {
-    if ((f = decltype (f)(tivtc_fopen(outputC.c_str(), "w"), &fclose)) != nullptr)
+    outputCF.reset(tivtc_fopen(outputC.c_str(), "w"));
+    if (outputCF)
     {
-      _fullpath(outputCFull, outputC.c_str(), MAX_PATH);
+      fprintf(outputCF.get(), "#TFM %s by tritical\n", VERSION);
       if (outArray.size() == 0)
       {
         outArray.resize(vi->numFrames, 0);
@@ -3524,6 +2809,16 @@ emptyovr:
         throw TIVTCError("TFM:  outputC file error (cannot create file)!");
     }
   }
+  if (outArray.size())
+    outputDone.resize(vi->numFrames, 0);
+
+  // mode 7 gets one frame at a time, the other threads work inside the frame
+  if (needsLinearAccess())
+  {
+    const int threads = stripePoolThreads(vsapi->getCoreInfo(core)->numThreads);
+    if (threads)
+      stripes.reset(new StripePool(threads));
+  }
   /// attach the value of PP to the first frame? TDecimate uses this to do something in the constructor while processing the tfmIn file.
   ///
 //  AVSValue tfmPassValue(PP);
@@ -3533,93 +2828,44 @@ emptyovr:
 
 TFM::~TFM()
 {
-  if (outArray.size())
+  // frames that were not processed in order (or at all)
+  for (int h = outputNext; h <= nfrms && (outputF || outputCF); ++h)
   {
-    FILE *f = nullptr;
-    if (output.size())
-    {
-      if ((f = tivtc_fopen(outputFull, "w")) != nullptr)
-      {
-        char tempBuf[40], tb2[40];
-        int match, sn = micout == 1 ? 3 : 5;
-        if (moutArrayE.size())
-        {
-          for (int i = 0; i < sn * vi->numFrames; ++i)
-          {
-            if (moutArrayE[i] == -20) moutArrayE[i] = -1;
-          }
-        }
-        fprintf(f, "#TFM %s by tritical\n", VERSION);
-        fprintf(f, "field = %s\n", fieldO == 1 ? "top" : "bottom");
-        fprintf(f, "crc32 = %x\n", outputCrc);
-        for (int h = 0; h <= nfrms; ++h)
-        {
-          if (outArray[h] & FILE_ENTRY)
-          {
-            match = (outArray[h] & 0x07);
-            sprintf(tempBuf, "%d %c", h, MTC(match));
-            if (outArray[h] & 0x20)
-            {
-              if (outArray[h] & 0x10) strcat(tempBuf, " +");
-              else strcat(tempBuf, " -");
-            }
-            if (outArray[h] & FILE_D2V) strcat(tempBuf, " 1");
-            if (moutArray.size() && moutArray[h] != -1)
-            {
-              sprintf(tb2, " [%d]", moutArray[h]);
-              strcat(tempBuf, tb2);
-            }
-            if (moutArrayE.size())
-            {
-              int th = h*sn;
-              if (sn == 3) sprintf(tb2, " (%d %d %d)", moutArrayE[th + 0],
-                moutArrayE[th + 1], moutArrayE[th + 2]);
-              else sprintf(tb2, " (%d %d %d %d %d)", moutArrayE[th + 0],
-                moutArrayE[th + 1], moutArrayE[th + 2], moutArrayE[th + 3],
-                moutArrayE[th + 4]);
-              strcat(tempBuf, tb2);
-            }
-            strcat(tempBuf, "\n");
-            fprintf(f, "%s", tempBuf);
-          }
-        }
-        generateOvrHelpOutput(f);
-        fclose(f);
-        f = nullptr;
-      }
-    }
-    if (outputC.size())
-    {
-      if ((f = tivtc_fopen(outputCFull, "w")) != nullptr)
-      {
-        int count = 0, match;
-        fprintf(f, "#TFM %s by tritical\n", VERSION);
-        for (int h = 0; h <= nfrms; ++h)
-        {
-          if (outArray[h] & FILE_ENTRY) match = (outArray[h] & 0x07);
-          else match = 0;
-          if (match == 1 || match == 5 || match == 6) ++count;
-          else
-          {
-            if (count > cNum) fprintf(f, "%d,%d\n", h - count, h - 1);
-            count = 0;
-          }
-        }
-        if (count > cNum) fprintf(f, "%d,%d\n", nfrms - count + 1, nfrms);
-        fclose(f);
-        f = nullptr;
-      }
-    }
-    if (f != nullptr) fclose(f);
+    if (outputF) formatOutputLine(h, outputBuf);
+    if (outputCF) formatOutputCFrame(h, outputCBuf);
+  }
+  if (outputCF && outputCCount > cNum)
+  {
+    char tempBuf[40];
+    sprintf(tempBuf, "%d,%d\n", nfrms - outputCCount + 1, nfrms);
+    outputCBuf += tempBuf;
   }
+  flushOutput(true);
+  if (outputF)
+  {
+    generateOvrHelpOutput(outputF.get());
+    outputF.reset();
+  }
+  outputCF.reset();
 
   vsapi->freeNode(child);
 }
 
 void TFM::generateOvrHelpOutput(FILE *f) const
 {
+  // Use the settings of the last frame, like the frames were requested in order.
+  TFMFrameState fs;
+  fs.order = order_origSaved;
+  fs.mode = mode_origSaved;
+  fs.field = field_origSaved;
+  fs.PP = PP_origSaved;
+  fs.MI = MI_origSaved;
+  getSettingOvr(nfrms, fs);
+  if (fs.order == -1)
+    fs.order = lastOrder;
+
   int ccount = 0, mcount = 0, acount = 0;
-  int ordert = /*order == -1 ? child->GetParity(0) :*/ order; /// can order be -1 at this point? I think not, but test it
+  int ordert = fs.order;
   int ao = fieldO^ordert ? 0 : 2;
   for (int i = 0; i < vi->numFrames; ++i)
   {
@@ -3633,7 +2879,7 @@ void TFM::generateOvrHelpOutput(FILE *f) const
   fprintf(f, "# [COMBED FRAMES]\n#\n");
   fprintf(f, "#   [Individual Frames]\n");
   fprintf(f, "#   FORMAT:  frame_number (mic_value)\n#\n");
-  if (PP == 0) fprintf(f, "#   none detected (PP=0)\n");
+  if (fs.PP == 0) fprintf(f, "#   none detected (PP=0)\n");
   else if (ccount)
   {
     for (int i = 0; i < vi->numFrames; ++i)
@@ -3648,7 +2894,7 @@ void TFM::generateOvrHelpOutput(FILE *f) const
   else fprintf(f, "#   none detected\n");
   fprintf(f, "#\n#   [Grouped Ranges Allowing Small Breaks]\n");
   fprintf(f, "#   FORMAT:  frame_start, frame_end (percentage combed)\n#\n");
-  if (PP == 0) fprintf(f, "#   none detected (PP=0)\n");
+  if (fs.PP == 0) fprintf(f, "#   none detected (PP=0)\n");
   else if (ccount)
   {
     int icount = 0, pcount = 0, rcount = 0, i = 0;
@@ -3680,11 +2926,11 @@ void TFM::generateOvrHelpOutput(FILE *f) const
   else fprintf(f, "#   none detected\n");
   fprintf(f, "#\n#\n# [POSSIBLE MISSED COMBED FRAMES]\n#\n");
   fprintf(f, "#   FORMAT:  frame_number (mic_value)\n#\n");
-  if (PP == 0) fprintf(f, "#   none detected (PP=0)\n");
+  if (fs.PP == 0) fprintf(f, "#   none detected (PP=0)\n");
   else if (mcount)
   {
-    int maxcp = int(MI*0.85), count = 0;
-    int mt = std::max(int(MI*0.1875), 5);
+    int maxcp = int(fs.MI*0.85), count = 0;
+    int mt = std::max(int(fs.MI*0.1875), 5);
     for (int i = 0; i < vi->numFrames; ++i)
     {
       if ((outArray[i] & 0x30) == 0x30)
@@ -3692,10 +2938,10 @@ void TFM::generateOvrHelpOutput(FILE *f) const
       const int prev = i > 0 ? moutArray[i - 1] : 0;
       const int curr = moutArray[i];
       const int next = i < vi->numFrames - 1 ? moutArray[i + 1] : 0;
-      if (curr <= MI && ((curr >= mt && curr > next * 2 && curr > prev * 2 &&
+      if (curr <= fs.MI && ((curr >= mt && curr > next * 2 && curr > prev * 2 &&
         curr - next > mt && curr - prev > mt) || (curr > maxcp) ||
-        (prev > MI && next > MI && curr > MI*0.5) ||
-        ((prev > MI || next > MI) && curr > MI*0.75)))
+        (prev > fs.MI && next > fs.MI && curr > fs.MI*0.5) ||
+        ((prev > fs.MI || next > fs.MI) && curr > fs.MI*0.75)))
       {
         fprintf(f, "#   %d (%d)\n", i, moutArray[i]);
         ++count;
@@ -35,7 +35,9 @@
 #else
 #include <windows.h>
 #endif
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
 #include <VapourSynth.h>
@@ -43,13 +45,16 @@
 #include "calcCRC.h"
 #include "internal.h"
 #include "cpufeatures.h"
+#include "ScratchPool.h"
+#include "StripePool.h"
+#include "Font.h"
 
 
 template<int planarType>
 void FillCombedPlanarUpdateCmaskByUV(VSFrameRef* cmask, const VSAPI *vsapi);
 
 template<typename pixel_t>
-void checkCombedPlanarAnalyze_core(const VSVideoInfo *vi, int cthresh, bool chroma, int cpuFlags, int metric, const VSFrameRef *src, VSFrameRef* cmask, const VSAPI *vsapi);
+void checkCombedPlanarAnalyze_core(const VSVideoInfo *vi, int cthresh, bool chroma, const CPUFeatures *cpuFlags, int metric, const VSFrameRef *srcEven, const VSFrameRef *srcOdd, VSFrameRef* cmask, const VSAPI *vsapi, StripePool *stripes);
 
 struct MTRACK {
   int frame, match;
@@ -62,6 +67,25 @@ struct SCTRACK {
   bool sc;
 };
 
+// Everything TFM::GetFrame modifies while processing a frame. The settings can
+// be changed per frame by the ovr file and the scratch buffers are written by
+// the field matching and comb detection code, so every request works on its
+// own copy, taken from the filter's scratch pool.
+struct TFMFrameState {
+  int order, field, mode, PP, MI;
+  SCTRACK sclast;
+
+  std::unique_ptr<int, decltype (&vs_aligned_free)> cArray;
+  std::unique_ptr<uint8_t, decltype (&vs_aligned_free)> tbuffer; // absdiff buffer
+  std::unique_ptr<VSFrameRef, decltype (VSAPI::freeFrame)> map;
+  std::unique_ptr<VSFrameRef, decltype (VSAPI::freeFrame)> cmask;
+  std::unique_ptr<uint64_t, decltype (&vs_aligned_free)> cmaskBits; // luma of cmask, one bit per pixel
+  std::unique_ptr<int, decltype (&vs_aligned_free)> cmaskCounts; // combed pixels per block of a row band
+  size_t bytes; // size of the buffers above
+
+  TFMFrameState() : cArray(nullptr, nullptr), tbuffer(nullptr, nullptr), map(nullptr, nullptr), cmask(nullptr, nullptr), cmaskBits(nullptr, nullptr), cmaskCounts(nullptr, nullptr) {}
+};
+
 class TFM
 {
 private:
@@ -70,8 +94,6 @@ private:
 
   CPUFeatures cpuFlags;
 
-  int order, field, mode; // modified in GetFrame
-  int PP; // modified in GetFrame
   // TFM must store a copy of the string obtained from propGetData, because that pointer doesn't live forever.
   std::string ovr; // override file name
   std::string input;
@@ -82,7 +104,6 @@ private:
   bool mChroma;
   int cNum;
   int cthresh;
-  int MI; // modified in GetFrame
   bool chroma;
   int blockx, blocky;
   int y0, y1; // band exclusion
@@ -95,17 +116,19 @@ private:
   bool usehints;
   bool metric;
   bool batch, ubsco, mmsco;
+  bool micexit;
   int opt;
 
+  // The settings from the parameters (and the d2v). GetFrame copies them into
+  // its TFMFrameState before applying the ovr file.
   int PP_origSaved, MI_origSaved;
   int order_origSaved, field_origSaved, mode_origSaved;
   int nfrms;
   int xhalf, yhalf, xshift, yshift;
-  int vidCount, fieldO, mode7_field; // mode7_field modified in GetFrame, but only when mode is 7
+  int vidCount, fieldO, mode7_field; // mode7_field modified in GetFrame, but only when needsLinearAccess() is true
   uint32_t outputCrc;
   unsigned long diffmaxsc;
   
-  std::unique_ptr<int, decltype (&vs_aligned_free)> cArray; // modified in GetFrame
   std::vector<int> setArray;
 
   std::vector<bool> trimArray;
@@ -116,69 +139,88 @@ private:
   std::vector<uint8_t> outArray; // modified in GetFrame, but only the element corresponding to frame n, so multithreaded access is fine
   std::vector<uint8_t> d2vfilmarray;
 
-  std::unique_ptr<uint8_t, decltype (&vs_aligned_free)> tbuffer; // absdiff buffer // modified in GetFrame
   int tpitchy, tpitchuv;
+  int cArraySize;
+  int cmaskBitsPitch; // in 64 bit words
+  int cmaskCountsPitch; // in ints, band counts of one stripe
+  bool micexitActive; // nothing needs the exact mics, stop counting at MI
+  const VSFormat *map_format;
+  bool allocCmask;
 
   std::vector<int> moutArray; // modified in GetFrame, but only the element corresponding to frame n
   std::vector<int> moutArrayE; // modified in GetFrame, but only the elements corresponding to frame n
   
-  MTRACK lastMatch; // modified in GetFrame
-  SCTRACK sclast;  // modified in GetFrame
-  char outputFull[MAX_PATH], outputCFull[MAX_PATH];
-  std::unique_ptr<VSFrameRef, decltype (VSAPI::freeFrame)> map; // modified in GetFrame
-  std::unique_ptr<VSFrameRef, decltype (VSAPI::freeFrame)> cmask; // modified in GetFrame
+  MTRACK lastMatch; // modified in GetFrame, but only when needsPreviousMatch() is true
+  std::atomic<int> lastOrder; // order of the last processed frame, for the ovr help output
+
+  // output and outputC are written while the clip is processed: the lines of
+  // the frames are appended in frame order as soon as all the frames before
+  // them are done, and flushed every few kilobytes. The destructor adds the
+  // frames that are still missing and the summary.
+  std::mutex outputLock;
+  std::unique_ptr<FILE, decltype (&fclose)> outputF{ nullptr, &fclose };
+  std::unique_ptr<FILE, decltype (&fclose)> outputCF{ nullptr, &fclose };
+  std::vector<uint8_t> outputDone;
+  std::string outputBuf, outputCBuf;
+  int outputNext = 0; // first frame that is not written yet
+  int outputCCount = 0; // length of the current run of c matches for outputC
+
+  ScratchPool<TFMFrameState> scratch;
+  // mode 7: runs the comb detection and field comparison kernels of one
+  // frame on several threads
+  std::unique_ptr<StripePool> stripes;
+
+  std::unique_ptr<TFMFrameState> createFrameState(VSCore *core) const;
+  void putScratchProperties(VSFrameRef *dst, const TFMFrameState &fs);
 
   template<typename pixel_t>
   void buildDiffMapPlane_Planar(const uint8_t *prvp, const uint8_t *nxtp,
-    uint8_t *dstp, int prv_pitch, int nxt_pitch, int dst_pitch, int Height,
-    int Width, int tpitch, int bits_per_pixel);
+    uint8_t *dstp, uint8_t *tbuffer, int prv_pitch, int nxt_pitch, int dst_pitch, int Height,
+    int Width, int tpitch, int bits_per_pixel) const;
 //  void buildDiffMapPlaneYUY2(const uint8_t *prvp, const uint8_t *nxtp,
 //    uint8_t *dstp, int prv_pitch, int nxt_pitch, int dst_pitch, int Height,
 //    int Width, int tpitch, IScriptEnvironment *env);
   
-  template<typename pixel_t>
-  void buildDiffMapPlane2(const uint8_t *prvp, const uint8_t *nxtp,
-    uint8_t *dstp, int prv_pitch, int nxt_pitch, int dst_pitch, int Height,
-    int Width, int bits_per_pixel) const;
-
-  void fileOut(int match, int combed, bool d2vfilm, int n, int MICount, int mics[5]);
+  void fileOut(int match, int combed, bool d2vfilm, int n, int MICount, int mics[5], const TFMFrameState &fs);
 
   int compareFields(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt, int match1,
-    int match2, int &norm1, int &norm2, int &mtn1, int &mtn2, int n);
+    int match2, int &norm1, int &norm2, int &mtn1, int &mtn2, int n, TFMFrameState &fs) const;
   template<typename pixel_t>
   int compareFields_core(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt, int match1,
-    int match2, int& norm1, int& norm2, int& mtn1, int& mtn2, int n);
+    int match2, int& norm1, int& norm2, int& mtn1, int& mtn2, int n, TFMFrameState &fs) const;
 
   int compareFieldsSlow(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt, int match1,
-    int match2, int &norm1, int &norm2, int &mtn1, int &mtn2, int n);
+    int match2, int &norm1, int &norm2, int &mtn1, int &mtn2, int n, TFMFrameState &fs) const;
   template<typename pixel_t>
   int compareFieldsSlow_core(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt, int match1,
-    int match2, int& norm1, int& norm2, int& mtn1, int& mtn2, int n);
+    int match2, int& norm1, int& norm2, int& mtn1, int& mtn2, int n, TFMFrameState &fs) const;
   template<typename pixel_t>
   int compareFieldsSlow2_core(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt, int match1,
-    int match2, int& norm1, int& norm2, int& mtn1, int& mtn2, int n);
+    int match2, int& norm1, int& norm2, int& mtn1, int& mtn2, int n, TFMFrameState &fs) const;
 
   void createWeaveFrame(VSFrameRef *dst, const VSFrameRef *prv, const VSFrameRef *src,
-    const VSFrameRef *nxt, int match, int &cfrm) const;
+    const VSFrameRef *nxt, int match, int &cfrm, int field) const;
+  void getWeaveFields(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt,
+    int match, int field, const VSFrameRef *&srcEven, const VSFrameRef *&srcOdd) const;
   
-  bool getMatchOvr(int n, int &match, int &combed, bool &d2vmatch, bool isSC);
-  void getSettingOvr(int n);
+  bool getMatchOvr(int n, int &match, int &combed, bool &d2vmatch, bool isSC, TFMFrameState &fs) const;
+  void getSettingOvr(int n, TFMFrameState &fs) const;
   
-  bool checkCombed(const VSFrameRef *src, int n, int match,
-    int *blockN, int &xblocksi, int *mics, bool ddebug);
-  bool checkCombedPlanar(const VSFrameRef *src, int n, int match,
-    int *blockN, int &xblocksi, int *mics, bool ddebug, bool _chroma);
+  bool checkCombed(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt, int n, int match,
+    int *blockN, int &xblocksi, int *mics, bool ddebug, TFMFrameState &fs) const;
+  bool checkCombedPlanar(const VSFrameRef *srcEven, const VSFrameRef *srcOdd, int n, int match,
+    int *blockN, int &xblocksi, int *mics, bool ddebug, bool _chroma, TFMFrameState &fs) const;
   template<typename pixel_t>
-  bool checkCombedPlanar_core(const VSFrameRef *src, int n, int match,
-    int* blockN, int& xblocksi, int* mics, bool ddebug, int bits_per_pixel);
+  bool checkCombedPlanar_core(const VSFrameRef *srcEven, const VSFrameRef *srcOdd, int n, int match,
+    int* blockN, int& xblocksi, int* mics, bool ddebug, int bits_per_pixel, bool verdictOnly, TFMFrameState &fs) const;
 //  bool checkCombedYUY2(const VSFrameRef *src, int n, int match,
 //    int *blockN, int &xblocksi, int *mics, bool ddebug, bool chroma,int cthresh);
   
   void writeDisplay(VSFrameRef *dst, int n, int fmatch, int combed, bool over,
     int blockN, int xblocks, bool d2vmatch, int *mics, const VSFrameRef *prv,
-    const VSFrameRef *src, const VSFrameRef *nxt);
+    const VSFrameRef *src, const VSFrameRef *nxt, TFMFrameState &fs) const;
 
-  void putFrameProperties(VSFrameRef *dst, int match, int combed, bool d2vfilm, const int mics[5]) const;
+  void putFrameProperties(VSFrameRef *dst, int match, int combed, bool d2vfilm, const int mics[5], const TFMFrameState &fs) const;
 //  template<typename pixel_t>
 //  void putHint_core(VSFrameRef *dst, int match, int combed, bool d2vfilm);
 
@@ -191,35 +233,46 @@ private:
   int D2V_write_array(const std::vector<int> &array, char wfile[]) const;
   int D2V_get_output_filename(char wfile[]) const;
   int D2V_fill_d2vfilmarray(const std::vector<int> &array, int frames);
-  bool d2vduplicate(int match, int combed, int n);
+  bool d2vduplicate(int match, int combed, int n, const TFMFrameState &fs) const;
   bool checkD2VCase(int check) const;
   bool checkInPatternD2V(const std::vector<int> &array, int i) const;
   int fillTrimArray(int frames);
 
-  bool checkSceneChange(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt, int n);
+  bool checkSceneChange(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt, int n, TFMFrameState &fs) const;
   template<typename pixel_t>
   bool checkSceneChange_core(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt,
-    int n, int bits_per_pixel);
+    int n, int bits_per_pixel, TFMFrameState &fs) const;
 
   void micChange(int n, int m1, int m2, VSFrameRef *dst, const VSFrameRef *prv,
     const VSFrameRef *src, const VSFrameRef *nxt, int &fmatch,
-    int &combed, int &cfrm) const;
-  void checkmm(int &cmatch, int m1, int m2, VSFrameRef *dst, int &dfrm, VSFrameRef *tmp, int &tfrm,
-    const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt, int n,
-    int *blockN, int &xblocks, int *mics);
+    int &combed, int &cfrm, const TFMFrameState &fs) const;
+  void checkmm(int &cmatch, int m1, int m2, const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt, int n,
+    int *blockN, int &xblocks, int *mics, TFMFrameState &fs) const;
 
   // O.K. common parts with TDeint
   // fixme: hbd!
   template<typename pixel_t>
-  void buildABSDiffMask(const uint8_t *prvp, const uint8_t *nxtp,
+  void buildABSDiffMask(const uint8_t *prvp, const uint8_t *nxtp, uint8_t *tbuffer,
     int prv_pitch, int nxt_pitch, int tpitch, int width, int height) const;
 
   void generateOvrHelpOutput(FILE *f) const;
+  void formatOutputLine(int h, std::string &buf) const;
+  void formatOutputCFrame(int h, std::string &buf);
+  void streamOutput(int n);
+  void flushOutput(bool force);
 
 public:
       const VSVideoInfo *vi;
 
   const VSFrameRef *GetFrame(int n, int activationReason, VSFrameContext *frameCtx, VSCore *core);
+  // True when the match of a frame depends on the final match of the previous
+  // frame (d2v duplicate detection, micmatching=1 and 3), so the frames must
+  // not be processed concurrently.
+  bool needsPreviousMatch() const;
+  // True when mode 7 is used, globally or for a range in the ovr file. Its
+  // field choice carries over from frame to frame, so the frames must come
+  // in order and one at a time.
+  bool needsLinearAccess() const;
 /// implement as tivtc.IsCombed(), if it's different from tdm.IsCombed().
   //  AVSValue ConditionalIsCombedTIVTC(int n, IScriptEnvironment* env);
   TFM(VSNodeRef *_child, int _order, int _field, int _mode, int _PP, const char* _ovr, const char* _input,
@@ -227,7 +280,7 @@ public:
     bool _mChroma, int _cNum, int _cthresh, int _MI, bool _chroma, int _blockx, int _blocky,
     int _y0, int _y1, const char* _d2v, int _ovrDefault, int _flags, double _scthresh, int _micout,
     int _micmatching, const char* _trimIn, bool _usehints, int _metric, bool _batch, bool _ubsco,
-    bool _mmsco, int _opt, const VSAPI *_vsapi, VSCore *core);
+    bool _mmsco, bool _micexit, int _opt, const VSAPI *_vsapi, VSCore *core);
   ~TFM();
 
 //  int __stdcall SetCacheHints(int cachehints, int frame_range) override {
@@ -25,6 +25,11 @@
 
 #include "TFMasm.h"
 #include "emmintrin.h"
+#include "smmintrin.h" // SSE4
+#include "immintrin.h" // AVX2
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 
 void checkSceneChangePlanar_1_SSE2(const uint8_t *prvp, const uint8_t *srcp,
   int height, int width, int prv_pitch, int src_pitch, uint64_t &diffp)
@@ -128,3 +133,1029 @@ void checkSceneChangeYUY2_2_SSE2(const uint8_t *prvp, const uint8_t *srcp,
   diffn = _mm_cvtsi128_si32(resn);
 }
 
+
+
+/*
+  Fused replacement of buildABSDiffMask2 + the accumulation loop of compareFields.
+  The map bytes are never stored, their two flags are computed on the fly:
+    map = 0 when abs(prv - nxt) <= 3, 1 when <= 19, 3 above (thresholds scaled with bit depth)
+    eax = (mapp << 2) + mapn
+    any: eax != 0, mv: (eax & 10) != 0 i.e. either map has bit 1 set
+*/
+template<typename pixel_t>
+void compareFieldsRow_c(const pixel_t* prvpf, const pixel_t* prvnf,
+  const pixel_t* curpf, const pixel_t* curf, const pixel_t* curnf,
+  const pixel_t* nxtpf, const pixel_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum)
+{
+  const int Const3 = 3 << (bits_per_pixel - 8);
+  const int Const19 = 19 << (bits_per_pixel - 8);
+  const int Const23 = 23 << (bits_per_pixel - 8);
+  const int Const42 = 42 << (bits_per_pixel - 8);
+
+  for (int x = startx; x < stopx; x++)
+  {
+    const int diffp = abs(prvpf[x] - nxtpf[x]);
+    const int diffn = abs(prvnf[x] - nxtnf[x]);
+    if (diffp <= Const3 && diffn <= Const3)
+      continue;
+    const bool moving = diffp > Const19 || diffn > Const19;
+
+    int a_curr = curpf[x] + (curf[x] << 2) + curnf[x];
+    int a_prev = 3 * (prvpf[x] + prvnf[x]);
+    int diff_p_c = abs(a_prev - a_curr);
+    if (diff_p_c > Const23) {
+      accum[0] += diff_p_c;
+      if (diff_p_c > Const42 && moving)
+        accum[1] += diff_p_c;
+    }
+    int a_next = 3 * (nxtpf[x] + nxtnf[x]);
+    int diff_n_c = abs(a_next - a_curr);
+    if (diff_n_c > Const23) {
+      accum[2] += diff_n_c;
+      if (diff_n_c > Const42 && moving)
+        accum[3] += diff_n_c;
+    }
+  }
+}
+
+template void compareFieldsRow_c<uint8_t>(const uint8_t* prvpf, const uint8_t* prvnf,
+  const uint8_t* curpf, const uint8_t* curf, const uint8_t* curnf,
+  const uint8_t* nxtpf, const uint8_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum);
+template void compareFieldsRow_c<uint16_t>(const uint16_t* prvpf, const uint16_t* prvnf,
+  const uint16_t* curpf, const uint16_t* curf, const uint16_t* curnf,
+  const uint16_t* nxtpf, const uint16_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum);
+
+// The 32 bit lane sums are moved to the 64 bit totals after this many pixels,
+// 16 bit input stays below 2^31 per lane (6*65535 per add) even with SSE4.
+static constexpr int compareFieldsChunk = 8192;
+
+static uint64_t hsum_epu32(__m128i v)
+{
+  alignas(16) uint32_t t[4];
+  _mm_store_si128(reinterpret_cast<__m128i*>(t), v);
+  return (uint64_t)t[0] + t[1] + t[2] + t[3];
+}
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+static uint64_t hsum256_epu32(__m256i v)
+{
+  return hsum_epu32(_mm256_castsi256_si128(v)) + hsum_epu32(_mm256_extracti128_si256(v, 1));
+}
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("sse4.1")))
+#endif
+void compareFieldsRow_uint8_SSE4(const uint8_t* prvpf, const uint8_t* prvnf,
+  const uint8_t* curpf, const uint8_t* curf, const uint8_t* curnf,
+  const uint8_t* nxtpf, const uint8_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum)
+{
+  // 8 pixels in 16 bit lanes, 6*255 fits
+  const __m128i Const3 = _mm_set1_epi16(3);
+  const __m128i Const19 = _mm_set1_epi16(19);
+  const __m128i Const23 = _mm_set1_epi16(23);
+  const __m128i Const42 = _mm_set1_epi16(42);
+  const __m128i ones = _mm_set1_epi16(1);
+
+  int x = startx;
+  const int simdStop = startx + std::max(stopx - startx, 0) / 8 * 8;
+  while (x < simdStop)
+  {
+    const int chunkStop = std::min(simdStop, x + compareFieldsChunk);
+    __m128i sumPc = _mm_setzero_si128(), sumPm = _mm_setzero_si128();
+    __m128i sumNc = _mm_setzero_si128(), sumNm = _mm_setzero_si128();
+    for (; x < chunkStop; x += 8)
+    {
+      auto prvp = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(prvpf + x)));
+      auto prvn = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(prvnf + x)));
+      auto nxtp = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(nxtpf + x)));
+      auto nxtn = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(nxtnf + x)));
+      auto curp = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(curpf + x)));
+      auto curc = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(curf + x)));
+      auto curn = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(curnf + x)));
+
+      // diff map flags
+      auto diffp = _mm_abs_epi16(_mm_sub_epi16(prvp, nxtp));
+      auto diffn = _mm_abs_epi16(_mm_sub_epi16(prvn, nxtn));
+      auto any = _mm_or_si128(_mm_cmpgt_epi16(diffp, Const3), _mm_cmpgt_epi16(diffn, Const3));
+      auto moving = _mm_or_si128(_mm_cmpgt_epi16(diffp, Const19), _mm_cmpgt_epi16(diffn, Const19));
+
+      auto a_curr = _mm_add_epi16(_mm_add_epi16(curp, curn), _mm_slli_epi16(curc, 2));
+      auto sum_prev = _mm_add_epi16(prvp, prvn);
+      auto a_prev = _mm_add_epi16(sum_prev, _mm_slli_epi16(sum_prev, 1));
+      auto sum_next = _mm_add_epi16(nxtp, nxtn);
+      auto a_next = _mm_add_epi16(sum_next, _mm_slli_epi16(sum_next, 1));
+      auto diff_p_c = _mm_abs_epi16(_mm_sub_epi16(a_prev, a_curr));
+      auto diff_n_c = _mm_abs_epi16(_mm_sub_epi16(a_next, a_curr));
+
+      // moving implies any and Const42 > Const23
+      auto pc = _mm_and_si128(any, _mm_cmpgt_epi16(diff_p_c, Const23));
+      auto pm = _mm_and_si128(moving, _mm_cmpgt_epi16(diff_p_c, Const42));
+      auto nc = _mm_and_si128(any, _mm_cmpgt_epi16(diff_n_c, Const23));
+      auto nm = _mm_and_si128(moving, _mm_cmpgt_epi16(diff_n_c, Const42));
+      sumPc = _mm_add_epi32(sumPc, _mm_madd_epi16(_mm_and_si128(diff_p_c, pc), ones));
+      sumPm = _mm_add_epi32(sumPm, _mm_madd_epi16(_mm_and_si128(diff_p_c, pm), ones));
+      sumNc = _mm_add_epi32(sumNc, _mm_madd_epi16(_mm_and_si128(diff_n_c, nc), ones));
+      sumNm = _mm_add_epi32(sumNm, _mm_madd_epi16(_mm_and_si128(diff_n_c, nm), ones));
+    }
+    accum[0] += hsum_epu32(sumPc);
+    accum[1] += hsum_epu32(sumPm);
+    accum[2] += hsum_epu32(sumNc);
+    accum[3] += hsum_epu32(sumNm);
+  }
+  compareFieldsRow_c<uint8_t>(prvpf, prvnf, curpf, curf, curnf, nxtpf, nxtnf, x, stopx, bits_per_pixel, accum);
+}
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("sse4.1")))
+#endif
+void compareFieldsRow_uint16_SSE4(const uint16_t* prvpf, const uint16_t* prvnf,
+  const uint16_t* curpf, const uint16_t* curf, const uint16_t* curnf,
+  const uint16_t* nxtpf, const uint16_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum)
+{
+  // 4 pixels in 32 bit lanes
+  const __m128i Const3 = _mm_set1_epi32(3 << (bits_per_pixel - 8));
+  const __m128i Const19 = _mm_set1_epi32(19 << (bits_per_pixel - 8));
+  const __m128i Const23 = _mm_set1_epi32(23 << (bits_per_pixel - 8));
+  const __m128i Const42 = _mm_set1_epi32(42 << (bits_per_pixel - 8));
+
+  int x = startx;
+  const int simdStop = startx + std::max(stopx - startx, 0) / 4 * 4;
+  while (x < simdStop)
+  {
+    const int chunkStop = std::min(simdStop, x + compareFieldsChunk);
+    __m128i sumPc = _mm_setzero_si128(), sumPm = _mm_setzero_si128();
+    __m128i sumNc = _mm_setzero_si128(), sumNm = _mm_setzero_si128();
+    for (; x < chunkStop; x += 4)
+    {
+      auto prvp = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(prvpf + x)));
+      auto prvn = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(prvnf + x)));
+      auto nxtp = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(nxtpf + x)));
+      auto nxtn = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(nxtnf + x)));
+      auto curp = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(curpf + x)));
+      auto curc = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(curf + x)));
+      auto curn = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(curnf + x)));
+
+      auto diffp = _mm_abs_epi32(_mm_sub_epi32(prvp, nxtp));
+      auto diffn = _mm_abs_epi32(_mm_sub_epi32(prvn, nxtn));
+      auto any = _mm_or_si128(_mm_cmpgt_epi32(diffp, Const3), _mm_cmpgt_epi32(diffn, Const3));
+      auto moving = _mm_or_si128(_mm_cmpgt_epi32(diffp, Const19), _mm_cmpgt_epi32(diffn, Const19));
+
+      auto a_curr = _mm_add_epi32(_mm_add_epi32(curp, curn), _mm_slli_epi32(curc, 2));
+      auto sum_prev = _mm_add_epi32(prvp, prvn);
+      auto a_prev = _mm_add_epi32(sum_prev, _mm_slli_epi32(sum_prev, 1));
+      auto sum_next = _mm_add_epi32(nxtp, nxtn);
+      auto a_next = _mm_add_epi32(sum_next, _mm_slli_epi32(sum_next, 1));
+      auto diff_p_c = _mm_abs_epi32(_mm_sub_epi32(a_prev, a_curr));
+      auto diff_n_c = _mm_abs_epi32(_mm_sub_epi32(a_next, a_curr));
+
+      auto pc = _mm_and_si128(any, _mm_cmpgt_epi32(diff_p_c, Const23));
+      auto pm = _mm_and_si128(moving, _mm_cmpgt_epi32(diff_p_c, Const42));
+      auto nc = _mm_and_si128(any, _mm_cmpgt_epi32(diff_n_c, Const23));
+      auto nm = _mm_and_si128(moving, _mm_cmpgt_epi32(diff_n_c, Const42));
+      sumPc = _mm_add_epi32(sumPc, _mm_and_si128(diff_p_c, pc));
+      sumPm = _mm_add_epi32(sumPm, _mm_and_si128(diff_p_c, pm));
+      sumNc = _mm_add_epi32(sumNc, _mm_and_si128(diff_n_c, nc));
+      sumNm = _mm_add_epi32(sumNm, _mm_and_si128(diff_n_c, nm));
+    }
+    accum[0] += hsum_epu32(sumPc);
+    accum[1] += hsum_epu32(sumPm);
+    accum[2] += hsum_epu32(sumNc);
+    accum[3] += hsum_epu32(sumNm);
+  }
+  compareFieldsRow_c<uint16_t>(prvpf, prvnf, curpf, curf, curnf, nxtpf, nxtnf, x, stopx, bits_per_pixel, accum);
+}
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void compareFieldsRow_uint8_AVX2(const uint8_t* prvpf, const uint8_t* prvnf,
+  const uint8_t* curpf, const uint8_t* curf, const uint8_t* curnf,
+  const uint8_t* nxtpf, const uint8_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum)
+{
+  // 16 pixels in 16 bit lanes
+  const __m256i Const3 = _mm256_set1_epi16(3);
+  const __m256i Const19 = _mm256_set1_epi16(19);
+  const __m256i Const23 = _mm256_set1_epi16(23);
+  const __m256i Const42 = _mm256_set1_epi16(42);
+  const __m256i ones = _mm256_set1_epi16(1);
+
+  int x = startx;
+  const int simdStop = startx + std::max(stopx - startx, 0) / 16 * 16;
+  while (x < simdStop)
+  {
+    const int chunkStop = std::min(simdStop, x + compareFieldsChunk);
+    __m256i sumPc = _mm256_setzero_si256(), sumPm = _mm256_setzero_si256();
+    __m256i sumNc = _mm256_setzero_si256(), sumNm = _mm256_setzero_si256();
+    for (; x < chunkStop; x += 16)
+    {
+      auto prvp = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(prvpf + x)));
+      auto prvn = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(prvnf + x)));
+      auto nxtp = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(nxtpf + x)));
+      auto nxtn = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(nxtnf + x)));
+      auto curp = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(curpf + x)));
+      auto curc = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(curf + x)));
+      auto curn = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(curnf + x)));
+
+      auto diffp = _mm256_abs_epi16(_mm256_sub_epi16(prvp, nxtp));
+      auto diffn = _mm256_abs_epi16(_mm256_sub_epi16(prvn, nxtn));
+      auto any = _mm256_or_si256(_mm256_cmpgt_epi16(diffp, Const3), _mm256_cmpgt_epi16(diffn, Const3));
+      auto moving = _mm256_or_si256(_mm256_cmpgt_epi16(diffp, Const19), _mm256_cmpgt_epi16(diffn, Const19));
+
+      auto a_curr = _mm256_add_epi16(_mm256_add_epi16(curp, curn), _mm256_slli_epi16(curc, 2));
+      auto sum_prev = _mm256_add_epi16(prvp, prvn);
+      auto a_prev = _mm256_add_epi16(sum_prev, _mm256_slli_epi16(sum_prev, 1));
+      auto sum_next = _mm256_add_epi16(nxtp, nxtn);
+      auto a_next = _mm256_add_epi16(sum_next, _mm256_slli_epi16(sum_next, 1));
+      auto diff_p_c = _mm256_abs_epi16(_mm256_sub_epi16(a_prev, a_curr));
+      auto diff_n_c = _mm256_abs_epi16(_mm256_sub_epi16(a_next, a_curr));
+
+      auto pc = _mm256_and_si256(any, _mm256_cmpgt_epi16(diff_p_c, Const23));
+      auto pm = _mm256_and_si256(moving, _mm256_cmpgt_epi16(diff_p_c, Const42));
+      auto nc = _mm256_and_si256(any, _mm256_cmpgt_epi16(diff_n_c, Const23));
+      auto nm = _mm256_and_si256(moving, _mm256_cmpgt_epi16(diff_n_c, Const42));
+      sumPc = _mm256_add_epi32(sumPc, _mm256_madd_epi16(_mm256_and_si256(diff_p_c, pc), ones));
+      sumPm = _mm256_add_epi32(sumPm, _mm256_madd_epi16(_mm256_and_si256(diff_p_c, pm), ones));
+      sumNc = _mm256_add_epi32(sumNc, _mm256_madd_epi16(_mm256_and_si256(diff_n_c, nc), ones));
+      sumNm = _mm256_add_epi32(sumNm, _mm256_madd_epi16(_mm256_and_si256(diff_n_c, nm), ones));
+    }
+    accum[0] += hsum256_epu32(sumPc);
+    accum[1] += hsum256_epu32(sumPm);
+    accum[2] += hsum256_epu32(sumNc);
+    accum[3] += hsum256_epu32(sumNm);
+  }
+  compareFieldsRow_c<uint8_t>(prvpf, prvnf, curpf, curf, curnf, nxtpf, nxtnf, x, stopx, bits_per_pixel, accum);
+}
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void compareFieldsRow_uint16_AVX2(const uint16_t* prvpf, const uint16_t* prvnf,
+  const uint16_t* curpf, const uint16_t* curf, const uint16_t* curnf,
+  const uint16_t* nxtpf, const uint16_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum)
+{
+  // 8 pixels in 32 bit lanes
+  const __m256i Const3 = _mm256_set1_epi32(3 << (bits_per_pixel - 8));
+  const __m256i Const19 = _mm256_set1_epi32(19 << (bits_per_pixel - 8));
+  const __m256i Const23 = _mm256_set1_epi32(23 << (bits_per_pixel - 8));
+  const __m256i Const42 = _mm256_set1_epi32(42 << (bits_per_pixel - 8));
+
+  int x = startx;
+  const int simdStop = startx + std::max(stopx - startx, 0) / 8 * 8;
+  while (x < simdStop)
+  {
+    const int chunkStop = std::min(simdStop, x + compareFieldsChunk);
+    __m256i sumPc = _mm256_setzero_si256(), sumPm = _mm256_setzero_si256();
+    __m256i sumNc = _mm256_setzero_si256(), sumNm = _mm256_setzero_si256();
+    for (; x < chunkStop; x += 8)
+    {
+      auto prvp = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(prvpf + x)));
+      auto prvn = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(prvnf + x)));
+      auto nxtp = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(nxtpf + x)));
+      auto nxtn = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(nxtnf + x)));
+      auto curp = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(curpf + x)));
+      auto curc = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(curf + x)));
+      auto curn = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(curnf + x)));
+
+      auto diffp = _mm256_abs_epi32(_mm256_sub_epi32(prvp, nxtp));
+      auto diffn = _mm256_abs_epi32(_mm256_sub_epi32(prvn, nxtn));
+      auto any = _mm256_or_si256(_mm256_cmpgt_epi32(diffp, Const3), _mm256_cmpgt_epi32(diffn, Const3));
+      auto moving = _mm256_or_si256(_mm256_cmpgt_epi32(diffp, Const19), _mm256_cmpgt_epi32(diffn, Const19));
+
+      auto a_curr = _mm256_add_epi32(_mm256_add_epi32(curp, curn), _mm256_slli_epi32(curc, 2));
+      auto sum_prev = _mm256_add_epi32(prvp, prvn);
+      auto a_prev = _mm256_add_epi32(sum_prev, _mm256_slli_epi32(sum_prev, 1));
+      auto sum_next = _mm256_add_epi32(nxtp, nxtn);
+      auto a_next = _mm256_add_epi32(sum_next, _mm256_slli_epi32(sum_next, 1));
+      auto diff_p_c = _mm256_abs_epi32(_mm256_sub_epi32(a_prev, a_curr));
+      auto diff_n_c = _mm256_abs_epi32(_mm256_sub_epi32(a_next, a_curr));
+
+      auto pc = _mm256_and_si256(any, _mm256_cmpgt_epi32(diff_p_c, Const23));
+      auto pm = _mm256_and_si256(moving, _mm256_cmpgt_epi32(diff_p_c, Const42));
+      auto nc = _mm256_and_si256(any, _mm256_cmpgt_epi32(diff_n_c, Const23));
+      auto nm = _mm256_and_si256(moving, _mm256_cmpgt_epi32(diff_n_c, Const42));
+      sumPc = _mm256_add_epi32(sumPc, _mm256_and_si256(diff_p_c, pc));
+      sumPm = _mm256_add_epi32(sumPm, _mm256_and_si256(diff_p_c, pm));
+      sumNc = _mm256_add_epi32(sumNc, _mm256_and_si256(diff_n_c, nc));
+      sumNm = _mm256_add_epi32(sumNm, _mm256_and_si256(diff_n_c, nm));
+    }
+    accum[0] += hsum256_epu32(sumPc);
+    accum[1] += hsum256_epu32(sumPm);
+    accum[2] += hsum256_epu32(sumNc);
+    accum[3] += hsum256_epu32(sumNm);
+  }
+  compareFieldsRow_c<uint16_t>(prvpf, prvnf, curpf, curf, curnf, nxtpf, nxtnf, x, stopx, bits_per_pixel, accum);
+}
+
+/*
+  compareFieldsSlow / compareFieldsSlow2 accumulation over one field row.
+  Unlike compareFields the map is the one of AnalyzeDiffMask_Planar (bits 1, 2, 4),
+  the original tests on eax = (mapp << 3) + mapn reduce to:
+    Slow:  &9, &18, &36  ->  bit 1, 2, 4 of (mapp | mapn)
+    Slow2 extra block:  &8, &16, &32 of field 0 -> bits of mapp
+                        &1, &2, &4 of field 1   -> bits of mapn
+  accum: Pc, Pm, Pml, Nc, Nm, Nml
+*/
+template<typename pixel_t>
+void compareFieldsSlowRow_c(const uint8_t* mapp, const uint8_t* mapn,
+  const pixel_t* prvpf, const pixel_t* prvnf,
+  const pixel_t* curpf, const pixel_t* curf, const pixel_t* curnf,
+  const pixel_t* nxtpf, const pixel_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum)
+{
+  const int Const23 = 23 << (bits_per_pixel - 8);
+  const int Const42 = 42 << (bits_per_pixel - 8);
+
+  for (int x = startx; x < stopx; x++)
+  {
+    const int flags = mapp[x] | mapn[x];
+    if (flags == 0)
+      continue;
+
+    int a_curr = curpf[x] + (curf[x] << 2) + curnf[x];
+    int a_prev = 3 * (prvpf[x] + prvnf[x]);
+    int diff_p_c = abs(a_prev - a_curr);
+    if (diff_p_c > Const23) {
+      if (flags & 1)
+        accum[0] += diff_p_c;
+      if (diff_p_c > Const42) {
+        if (flags & 2)
+          accum[1] += diff_p_c;
+        if (flags & 4)
+          accum[2] += diff_p_c;
+      }
+    }
+    int a_next = 3 * (nxtpf[x] + nxtnf[x]);
+    int diff_n_c = abs(a_next - a_curr);
+    if (diff_n_c > Const23) {
+      if (flags & 1)
+        accum[3] += diff_n_c;
+      if (diff_n_c > Const42) {
+        if (flags & 2)
+          accum[4] += diff_n_c;
+        if (flags & 4)
+          accum[5] += diff_n_c;
+      }
+    }
+  }
+}
+
+// Slow2 extra block: 5 tap prv/nxt against 3 tap current field, rows a-b-c
+template<typename pixel_t>
+void compareFieldsSlow2Row_c(const uint8_t* map,
+  const pixel_t* prva, const pixel_t* prvb, const pixel_t* prvc,
+  const pixel_t* cura, const pixel_t* curb,
+  const pixel_t* nxta, const pixel_t* nxtb, const pixel_t* nxtc,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum)
+{
+  const int Const23 = 23 << (bits_per_pixel - 8);
+  const int Const42 = 42 << (bits_per_pixel - 8);
+
+  for (int x = startx; x < stopx; x++)
+  {
+    const int flags = map[x];
+    if (flags == 0)
+      continue;
+
+    int a_curr = 3 * (cura[x] + curb[x]);
+    int a_prev = prva[x] + (prvb[x] << 2) + prvc[x];
+    int diff_p_c = abs(a_prev - a_curr);
+    if (diff_p_c > Const23) {
+      if (flags & 1)
+        accum[0] += diff_p_c;
+      if (diff_p_c > Const42) {
+        if (flags & 2)
+          accum[1] += diff_p_c;
+        if (flags & 4)
+          accum[2] += diff_p_c;
+      }
+    }
+    int a_next = nxta[x] + (nxtb[x] << 2) + nxtc[x]; // really! not 3*
+    int diff_n_c = abs(a_next - a_curr);
+    if (diff_n_c > Const23) {
+      if (flags & 1)
+        accum[3] += diff_n_c;
+      if (diff_n_c > Const42) {
+        if (flags & 2)
+          accum[4] += diff_n_c;
+        if (flags & 4)
+          accum[5] += diff_n_c;
+      }
+    }
+  }
+}
+
+template void compareFieldsSlowRow_c<uint8_t>(const uint8_t* mapp, const uint8_t* mapn,
+  const uint8_t* prvpf, const uint8_t* prvnf,
+  const uint8_t* curpf, const uint8_t* curf, const uint8_t* curnf,
+  const uint8_t* nxtpf, const uint8_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum);
+template void compareFieldsSlowRow_c<uint16_t>(const uint8_t* mapp, const uint8_t* mapn,
+  const uint16_t* prvpf, const uint16_t* prvnf,
+  const uint16_t* curpf, const uint16_t* curf, const uint16_t* curnf,
+  const uint16_t* nxtpf, const uint16_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum);
+template void compareFieldsSlow2Row_c<uint8_t>(const uint8_t* map,
+  const uint8_t* prva, const uint8_t* prvb, const uint8_t* prvc,
+  const uint8_t* cura, const uint8_t* curb,
+  const uint8_t* nxta, const uint8_t* nxtb, const uint8_t* nxtc,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum);
+template void compareFieldsSlow2Row_c<uint16_t>(const uint8_t* map,
+  const uint16_t* prva, const uint16_t* prvb, const uint16_t* prvc,
+  const uint16_t* cura, const uint16_t* curb,
+  const uint16_t* nxta, const uint16_t* nxtb, const uint16_t* nxtc,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum);
+
+// Adds diff to sum[0..2] (c, m, ml) where the map flag bits 1, 2, 4 and the thresholds allow.
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("sse4.1")))
+#endif
+static AVS_FORCEINLINE void slowAccum_epi16(__m128i diff, __m128i flags, __m128i Const23, __m128i Const42, __m128i* sum)
+{
+  const __m128i ones = _mm_set1_epi16(1);
+  const __m128i bit2 = _mm_set1_epi16(2);
+  const __m128i bit4 = _mm_set1_epi16(4);
+  auto gt23 = _mm_cmpgt_epi16(diff, Const23);
+  auto gt42 = _mm_cmpgt_epi16(diff, Const42);
+  auto c = _mm_and_si128(gt23, _mm_cmpeq_epi16(_mm_and_si128(flags, ones), ones));
+  auto m = _mm_and_si128(gt42, _mm_cmpeq_epi16(_mm_and_si128(flags, bit2), bit2));
+  auto ml = _mm_and_si128(gt42, _mm_cmpeq_epi16(_mm_and_si128(flags, bit4), bit4));
+  sum[0] = _mm_add_epi32(sum[0], _mm_madd_epi16(_mm_and_si128(diff, c), ones));
+  sum[1] = _mm_add_epi32(sum[1], _mm_madd_epi16(_mm_and_si128(diff, m), ones));
+  sum[2] = _mm_add_epi32(sum[2], _mm_madd_epi16(_mm_and_si128(diff, ml), ones));
+}
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("sse4.1")))
+#endif
+static AVS_FORCEINLINE void slowAccum_epi32(__m128i diff, __m128i flags, __m128i Const23, __m128i Const42, __m128i* sum)
+{
+  const __m128i bit1 = _mm_set1_epi32(1);
+  const __m128i bit2 = _mm_set1_epi32(2);
+  const __m128i bit4 = _mm_set1_epi32(4);
+  auto gt23 = _mm_cmpgt_epi32(diff, Const23);
+  auto gt42 = _mm_cmpgt_epi32(diff, Const42);
+  auto c = _mm_and_si128(gt23, _mm_cmpeq_epi32(_mm_and_si128(flags, bit1), bit1));
+  auto m = _mm_and_si128(gt42, _mm_cmpeq_epi32(_mm_and_si128(flags, bit2), bit2));
+  auto ml = _mm_and_si128(gt42, _mm_cmpeq_epi32(_mm_and_si128(flags, bit4), bit4));
+  sum[0] = _mm_add_epi32(sum[0], _mm_and_si128(diff, c));
+  sum[1] = _mm_add_epi32(sum[1], _mm_and_si128(diff, m));
+  sum[2] = _mm_add_epi32(sum[2], _mm_and_si128(diff, ml));
+}
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+static AVS_FORCEINLINE void slowAccum256_epi16(__m256i diff, __m256i flags, __m256i Const23, __m256i Const42, __m256i* sum)
+{
+  const __m256i ones = _mm256_set1_epi16(1);
+  const __m256i bit2 = _mm256_set1_epi16(2);
+  const __m256i bit4 = _mm256_set1_epi16(4);
+  auto gt23 = _mm256_cmpgt_epi16(diff, Const23);
+  auto gt42 = _mm256_cmpgt_epi16(diff, Const42);
+  auto c = _mm256_and_si256(gt23, _mm256_cmpeq_epi16(_mm256_and_si256(flags, ones), ones));
+  auto m = _mm256_and_si256(gt42, _mm256_cmpeq_epi16(_mm256_and_si256(flags, bit2), bit2));
+  auto ml = _mm256_and_si256(gt42, _mm256_cmpeq_epi16(_mm256_and_si256(flags, bit4), bit4));
+  sum[0] = _mm256_add_epi32(sum[0], _mm256_madd_epi16(_mm256_and_si256(diff, c), ones));
+  sum[1] = _mm256_add_epi32(sum[1], _mm256_madd_epi16(_mm256_and_si256(diff, m), ones));
+  sum[2] = _mm256_add_epi32(sum[2], _mm256_madd_epi16(_mm256_and_si256(diff, ml), ones));
+}
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+static AVS_FORCEINLINE void slowAccum256_epi32(__m256i diff, __m256i flags, __m256i Const23, __m256i Const42, __m256i* sum)
+{
+  const __m256i bit1 = _mm256_set1_epi32(1);
+  const __m256i bit2 = _mm256_set1_epi32(2);
+  const __m256i bit4 = _mm256_set1_epi32(4);
+  auto gt23 = _mm256_cmpgt_epi32(diff, Const23);
+  auto gt42 = _mm256_cmpgt_epi32(diff, Const42);
+  auto c = _mm256_and_si256(gt23, _mm256_cmpeq_epi32(_mm256_and_si256(flags, bit1), bit1));
+  auto m = _mm256_and_si256(gt42, _mm256_cmpeq_epi32(_mm256_and_si256(flags, bit2), bit2));
+  auto ml = _mm256_and_si256(gt42, _mm256_cmpeq_epi32(_mm256_and_si256(flags, bit4), bit4));
+  sum[0] = _mm256_add_epi32(sum[0], _mm256_and_si256(diff, c));
+  sum[1] = _mm256_add_epi32(sum[1], _mm256_and_si256(diff, m));
+  sum[2] = _mm256_add_epi32(sum[2], _mm256_and_si256(diff, ml));
+}
+
+// 4 map bytes for the 4 pixels of a 16 bit SSE4 step
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("sse4.1")))
+#endif
+static AVS_FORCEINLINE __m128i loadMap4_epi32(const uint8_t* p)
+{
+  int32_t v;
+  memcpy(&v, p, 4);
+  return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(v));
+}
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("sse4.1")))
+#endif
+void compareFieldsSlowRow_uint8_SSE4(const uint8_t* mapp, const uint8_t* mapn,
+  const uint8_t* prvpf, const uint8_t* prvnf,
+  const uint8_t* curpf, const uint8_t* curf, const uint8_t* curnf,
+  const uint8_t* nxtpf, const uint8_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum)
+{
+  const __m128i Const23 = _mm_set1_epi16(23);
+  const __m128i Const42 = _mm_set1_epi16(42);
+
+  int x = startx;
+  const int simdStop = startx + std::max(stopx - startx, 0) / 8 * 8;
+  while (x < simdStop)
+  {
+    const int chunkStop = std::min(simdStop, x + compareFieldsChunk);
+    __m128i sum[6];
+    for (int i = 0; i < 6; i++)
+      sum[i] = _mm_setzero_si128();
+    for (; x < chunkStop; x += 8)
+    {
+      auto flags = _mm_cvtepu8_epi16(_mm_or_si128(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(mapp + x)),
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(mapn + x))));
+      auto prvp = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(prvpf + x)));
+      auto prvn = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(prvnf + x)));
+      auto nxtp = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(nxtpf + x)));
+      auto nxtn = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(nxtnf + x)));
+      auto curp = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(curpf + x)));
+      auto curc = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(curf + x)));
+      auto curn = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(curnf + x)));
+
+      auto a_curr = _mm_add_epi16(_mm_add_epi16(curp, curn), _mm_slli_epi16(curc, 2));
+      auto sum_prev = _mm_add_epi16(prvp, prvn);
+      auto a_prev = _mm_add_epi16(sum_prev, _mm_slli_epi16(sum_prev, 1));
+      auto sum_next = _mm_add_epi16(nxtp, nxtn);
+      auto a_next = _mm_add_epi16(sum_next, _mm_slli_epi16(sum_next, 1));
+      slowAccum_epi16(_mm_abs_epi16(_mm_sub_epi16(a_prev, a_curr)), flags, Const23, Const42, sum);
+      slowAccum_epi16(_mm_abs_epi16(_mm_sub_epi16(a_next, a_curr)), flags, Const23, Const42, sum + 3);
+    }
+    for (int i = 0; i < 6; i++)
+      accum[i] += hsum_epu32(sum[i]);
+  }
+  compareFieldsSlowRow_c<uint8_t>(mapp, mapn, prvpf, prvnf, curpf, curf, curnf, nxtpf, nxtnf, x, stopx, bits_per_pixel, accum);
+}
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("sse4.1")))
+#endif
+void compareFieldsSlowRow_uint16_SSE4(const uint8_t* mapp, const uint8_t* mapn,
+  const uint16_t* prvpf, const uint16_t* prvnf,
+  const uint16_t* curpf, const uint16_t* curf, const uint16_t* curnf,
+  const uint16_t* nxtpf, const uint16_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum)
+{
+  const __m128i Const23 = _mm_set1_epi32(23 << (bits_per_pixel - 8));
+  const __m128i Const42 = _mm_set1_epi32(42 << (bits_per_pixel - 8));
+
+  int x = startx;
+  const int simdStop = startx + std::max(stopx - startx, 0) / 4 * 4;
+  while (x < simdStop)
+  {
+    const int chunkStop = std::min(simdStop, x + compareFieldsChunk);
+    __m128i sum[6];
+    for (int i = 0; i < 6; i++)
+      sum[i] = _mm_setzero_si128();
+    for (; x < chunkStop; x += 4)
+    {
+      auto flags = _mm_or_si128(loadMap4_epi32(mapp + x), loadMap4_epi32(mapn + x));
+      auto prvp = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(prvpf + x)));
+      auto prvn = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(prvnf + x)));
+      auto nxtp = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(nxtpf + x)));
+      auto nxtn = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(nxtnf + x)));
+      auto curp = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(curpf + x)));
+      auto curc = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(curf + x)));
+      auto curn = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(curnf + x)));
+
+      auto a_curr = _mm_add_epi32(_mm_add_epi32(curp, curn), _mm_slli_epi32(curc, 2));
+      auto sum_prev = _mm_add_epi32(prvp, prvn);
+      auto a_prev = _mm_add_epi32(sum_prev, _mm_slli_epi32(sum_prev, 1));
+      auto sum_next = _mm_add_epi32(nxtp, nxtn);
+      auto a_next = _mm_add_epi32(sum_next, _mm_slli_epi32(sum_next, 1));
+      slowAccum_epi32(_mm_abs_epi32(_mm_sub_epi32(a_prev, a_curr)), flags, Const23, Const42, sum);
+      slowAccum_epi32(_mm_abs_epi32(_mm_sub_epi32(a_next, a_curr)), flags, Const23, Const42, sum + 3);
+    }
+    for (int i = 0; i < 6; i++)
+      accum[i] += hsum_epu32(sum[i]);
+  }
+  compareFieldsSlowRow_c<uint16_t>(mapp, mapn, prvpf, prvnf, curpf, curf, curnf, nxtpf, nxtnf, x, stopx, bits_per_pixel, accum);
+}
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void compareFieldsSlowRow_uint8_AVX2(const uint8_t* mapp, const uint8_t* mapn,
+  const uint8_t* prvpf, const uint8_t* prvnf,
+  const uint8_t* curpf, const uint8_t* curf, const uint8_t* curnf,
+  const uint8_t* nxtpf, const uint8_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum)
+{
+  const __m256i Const23 = _mm256_set1_epi16(23);
+  const __m256i Const42 = _mm256_set1_epi16(42);
+
+  int x = startx;
+  const int simdStop = startx + std::max(stopx - startx, 0) / 16 * 16;
+  while (x < simdStop)
+  {
+    const int chunkStop = std::min(simdStop, x + compareFieldsChunk);
+    __m256i sum[6];
+    for (int i = 0; i < 6; i++)
+      sum[i] = _mm256_setzero_si256();
+    for (; x < chunkStop; x += 16)
+    {
+      auto flags = _mm256_cvtepu8_epi16(_mm_or_si128(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(mapp + x)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(mapn + x))));
+      auto prvp = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(prvpf + x)));
+      auto prvn = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(prvnf + x)));
+      auto nxtp = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(nxtpf + x)));
+      auto nxtn = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(nxtnf + x)));
+      auto curp = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(curpf + x)));
+      auto curc = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(curf + x)));
+      auto curn = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(curnf + x)));
+
+      auto a_curr = _mm256_add_epi16(_mm256_add_epi16(curp, curn), _mm256_slli_epi16(curc, 2));
+      auto sum_prev = _mm256_add_epi16(prvp, prvn);
+      auto a_prev = _mm256_add_epi16(sum_prev, _mm256_slli_epi16(sum_prev, 1));
+      auto sum_next = _mm256_add_epi16(nxtp, nxtn);
+      auto a_next = _mm256_add_epi16(sum_next, _mm256_slli_epi16(sum_next, 1));
+      slowAccum256_epi16(_mm256_abs_epi16(_mm256_sub_epi16(a_prev, a_curr)), flags, Const23, Const42, sum);
+      slowAccum256_epi16(_mm256_abs_epi16(_mm256_sub_epi16(a_next, a_curr)), flags, Const23, Const42, sum + 3);
+    }
+    for (int i = 0; i < 6; i++)
+      accum[i] += hsum256_epu32(sum[i]);
+  }
+  compareFieldsSlowRow_c<uint8_t>(mapp, mapn, prvpf, prvnf, curpf, curf, curnf, nxtpf, nxtnf, x, stopx, bits_per_pixel, accum);
+}
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void compareFieldsSlowRow_uint16_AVX2(const uint8_t* mapp, const uint8_t* mapn,
+  const uint16_t* prvpf, const uint16_t* prvnf,
+  const uint16_t* curpf, const uint16_t* curf, const uint16_t* curnf,
+  const uint16_t* nxtpf, const uint16_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum)
+{
+  const __m256i Const23 = _mm256_set1_epi32(23 << (bits_per_pixel - 8));
+  const __m256i Const42 = _mm256_set1_epi32(42 << (bits_per_pixel - 8));
+
+  int x = startx;
+  const int simdStop = startx + std::max(stopx - startx, 0) / 8 * 8;
+  while (x < simdStop)
+  {
+    const int chunkStop = std::min(simdStop, x + compareFieldsChunk);
+    __m256i sum[6];
+    for (int i = 0; i < 6; i++)
+      sum[i] = _mm256_setzero_si256();
+    for (; x < chunkStop; x += 8)
+    {
+      auto flags = _mm256_cvtepu8_epi32(_mm_or_si128(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(mapp + x)),
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(mapn + x))));
+      auto prvp = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(prvpf + x)));
+      auto prvn = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(prvnf + x)));
+      auto nxtp = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(nxtpf + x)));
+      auto nxtn = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(nxtnf + x)));
+      auto curp = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(curpf + x)));
+      auto curc = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(curf + x)));
+      auto curn = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(curnf + x)));
+
+      auto a_curr = _mm256_add_epi32(_mm256_add_epi32(curp, curn), _mm256_slli_epi32(curc, 2));
+      auto sum_prev = _mm256_add_epi32(prvp, prvn);
+      auto a_prev = _mm256_add_epi32(sum_prev, _mm256_slli_epi32(sum_prev, 1));
+      auto sum_next = _mm256_add_epi32(nxtp, nxtn);
+      auto a_next = _mm256_add_epi32(sum_next, _mm256_slli_epi32(sum_next, 1));
+      slowAccum256_epi32(_mm256_abs_epi32(_mm256_sub_epi32(a_prev, a_curr)), flags, Const23, Const42, sum);
+      slowAccum256_epi32(_mm256_abs_epi32(_mm256_sub_epi32(a_next, a_curr)), flags, Const23, Const42, sum + 3);
+    }
+    for (int i = 0; i < 6; i++)
+      accum[i] += hsum256_epu32(sum[i]);
+  }
+  compareFieldsSlowRow_c<uint16_t>(mapp, mapn, prvpf, prvnf, curpf, curf, curnf, nxtpf, nxtnf, x, stopx, bits_per_pixel, accum);
+}
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("sse4.1")))
+#endif
+void compareFieldsSlow2Row_uint8_SSE4(const uint8_t* map,
+  const uint8_t* prva, const uint8_t* prvb, const uint8_t* prvc,
+  const uint8_t* cura, const uint8_t* curb,
+  const uint8_t* nxta, const uint8_t* nxtb, const uint8_t* nxtc,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum)
+{
+  const __m128i Const23 = _mm_set1_epi16(23);
+  const __m128i Const42 = _mm_set1_epi16(42);
+
+  int x = startx;
+  const int simdStop = startx + std::max(stopx - startx, 0) / 8 * 8;
+  while (x < simdStop)
+  {
+    const int chunkStop = std::min(simdStop, x + compareFieldsChunk);
+    __m128i sum[6];
+    for (int i = 0; i < 6; i++)
+      sum[i] = _mm_setzero_si128();
+    for (; x < chunkStop; x += 8)
+    {
+      auto flags = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(map + x)));
+      auto pa = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(prva + x)));
+      auto pb = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(prvb + x)));
+      auto pc = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(prvc + x)));
+      auto ca = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(cura + x)));
+      auto cb = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(curb + x)));
+      auto na = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(nxta + x)));
+      auto nb = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(nxtb + x)));
+      auto nc = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(nxtc + x)));
+
+      auto sum_curr = _mm_add_epi16(ca, cb);
+      auto a_curr = _mm_add_epi16(sum_curr, _mm_slli_epi16(sum_curr, 1));
+      auto a_prev = _mm_add_epi16(_mm_add_epi16(pa, pc), _mm_slli_epi16(pb, 2));
+      auto a_next = _mm_add_epi16(_mm_add_epi16(na, nc), _mm_slli_epi16(nb, 2));
+      slowAccum_epi16(_mm_abs_epi16(_mm_sub_epi16(a_prev, a_curr)), flags, Const23, Const42, sum);
+      slowAccum_epi16(_mm_abs_epi16(_mm_sub_epi16(a_next, a_curr)), flags, Const23, Const42, sum + 3);
+    }
+    for (int i = 0; i < 6; i++)
+      accum[i] += hsum_epu32(sum[i]);
+  }
+  compareFieldsSlow2Row_c<uint8_t>(map, prva, prvb, prvc, cura, curb, nxta, nxtb, nxtc, x, stopx, bits_per_pixel, accum);
+}
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("sse4.1")))
+#endif
+void compareFieldsSlow2Row_uint16_SSE4(const uint8_t* map,
+  const uint16_t* prva, const uint16_t* prvb, const uint16_t* prvc,
+  const uint16_t* cura, const uint16_t* curb,
+  const uint16_t* nxta, const uint16_t* nxtb, const uint16_t* nxtc,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum)
+{
+  const __m128i Const23 = _mm_set1_epi32(23 << (bits_per_pixel - 8));
+  const __m128i Const42 = _mm_set1_epi32(42 << (bits_per_pixel - 8));
+
+  int x = startx;
+  const int simdStop = startx + std::max(stopx - startx, 0) / 4 * 4;
+  while (x < simdStop)
+  {
+    const int chunkStop = std::min(simdStop, x + compareFieldsChunk);
+    __m128i sum[6];
+    for (int i = 0; i < 6; i++)
+      sum[i] = _mm_setzero_si128();
+    for (; x < chunkStop; x += 4)
+    {
+      auto flags = loadMap4_epi32(map + x);
+      auto pa = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(prva + x)));
+      auto pb = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(prvb + x)));
+      auto pc = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(prvc + x)));
+      auto ca = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(cura + x)));
+      auto cb = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(curb + x)));
+      auto na = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(nxta + x)));
+      auto nb = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(nxtb + x)));
+      auto nc = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(nxtc + x)));
+
+      auto sum_curr = _mm_add_epi32(ca, cb);
+      auto a_curr = _mm_add_epi32(sum_curr, _mm_slli_epi32(sum_curr, 1));
+      auto a_prev = _mm_add_epi32(_mm_add_epi32(pa, pc), _mm_slli_epi32(pb, 2));
+      auto a_next = _mm_add_epi32(_mm_add_epi32(na, nc), _mm_slli_epi32(nb, 2));
+      slowAccum_epi32(_mm_abs_epi32(_mm_sub_epi32(a_prev, a_curr)), flags, Const23, Const42, sum);
+      slowAccum_epi32(_mm_abs_epi32(_mm_sub_epi32(a_next, a_curr)), flags, Const23, Const42, sum + 3);
+    }
+    for (int i = 0; i < 6; i++)
+      accum[i] += hsum_epu32(sum[i]);
+  }
+  compareFieldsSlow2Row_c<uint16_t>(map, prva, prvb, prvc, cura, curb, nxta, nxtb, nxtc, x, stopx, bits_per_pixel, accum);
+}
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void compareFieldsSlow2Row_uint8_AVX2(const uint8_t* map,
+  const uint8_t* prva, const uint8_t* prvb, const uint8_t* prvc,
+  const uint8_t* cura, const uint8_t* curb,
+  const uint8_t* nxta, const uint8_t* nxtb, const uint8_t* nxtc,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum)
+{
+  const __m256i Const23 = _mm256_set1_epi16(23);
+  const __m256i Const42 = _mm256_set1_epi16(42);
+
+  int x = startx;
+  const int simdStop = startx + std::max(stopx - startx, 0) / 16 * 16;
+  while (x < simdStop)
+  {
+    const int chunkStop = std::min(simdStop, x + compareFieldsChunk);
+    __m256i sum[6];
+    for (int i = 0; i < 6; i++)
+      sum[i] = _mm256_setzero_si256();
+    for (; x < chunkStop; x += 16)
+    {
+      auto flags = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(map + x)));
+      auto pa = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(prva + x)));
+      auto pb = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(prvb + x)));
+      auto pc = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(prvc + x)));
+      auto ca = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(cura + x)));
+      auto cb = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(curb + x)));
+      auto na = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(nxta + x)));
+      auto nb = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(nxtb + x)));
+      auto nc = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(nxtc + x)));
+
+      auto sum_curr = _mm256_add_epi16(ca, cb);
+      auto a_curr = _mm256_add_epi16(sum_curr, _mm256_slli_epi16(sum_curr, 1));
+      auto a_prev = _mm256_add_epi16(_mm256_add_epi16(pa, pc), _mm256_slli_epi16(pb, 2));
+      auto a_next = _mm256_add_epi16(_mm256_add_epi16(na, nc), _mm256_slli_epi16(nb, 2));
+      slowAccum256_epi16(_mm256_abs_epi16(_mm256_sub_epi16(a_prev, a_curr)), flags, Const23, Const42, sum);
+      slowAccum256_epi16(_mm256_abs_epi16(_mm256_sub_epi16(a_next, a_curr)), flags, Const23, Const42, sum + 3);
+    }
+    for (int i = 0; i < 6; i++)
+      accum[i] += hsum256_epu32(sum[i]);
+  }
+  compareFieldsSlow2Row_c<uint8_t>(map, prva, prvb, prvc, cura, curb, nxta, nxtb, nxtc, x, stopx, bits_per_pixel, accum);
+}
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void compareFieldsSlow2Row_uint16_AVX2(const uint8_t* map,
+  const uint16_t* prva, const uint16_t* prvb, const uint16_t* prvc,
+  const uint16_t* cura, const uint16_t* curb,
+  const uint16_t* nxta, const uint16_t* nxtb, const uint16_t* nxtc,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum)
+{
+  const __m256i Const23 = _mm256_set1_epi32(23 << (bits_per_pixel - 8));
+  const __m256i Const42 = _mm256_set1_epi32(42 << (bits_per_pixel - 8));
+
+  int x = startx;
+  const int simdStop = startx + std::max(stopx - startx, 0) / 8 * 8;
+  while (x < simdStop)
+  {
+    const int chunkStop = std::min(simdStop, x + compareFieldsChunk);
+    __m256i sum[6];
+    for (int i = 0; i < 6; i++)
+      sum[i] = _mm256_setzero_si256();
+    for (; x < chunkStop; x += 8)
+    {
+      auto flags = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(map + x)));
+      auto pa = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(prva + x)));
+      auto pb = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(prvb + x)));
+      auto pc = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(prvc + x)));
+      auto ca = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(cura + x)));
+      auto cb = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(curb + x)));
+      auto na = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(nxta + x)));
+      auto nb = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(nxtb + x)));
+      auto nc = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(nxtc + x)));
+
+      auto sum_curr = _mm256_add_epi32(ca, cb);
+      auto a_curr = _mm256_add_epi32(sum_curr, _mm256_slli_epi32(sum_curr, 1));
+      auto a_prev = _mm256_add_epi32(_mm256_add_epi32(pa, pc), _mm256_slli_epi32(pb, 2));
+      auto a_next = _mm256_add_epi32(_mm256_add_epi32(na, nc), _mm256_slli_epi32(nb, 2));
+      slowAccum256_epi32(_mm256_abs_epi32(_mm256_sub_epi32(a_prev, a_curr)), flags, Const23, Const42, sum);
+      slowAccum256_epi32(_mm256_abs_epi32(_mm256_sub_epi32(a_next, a_curr)), flags, Const23, Const42, sum + 3);
+    }
+    for (int i = 0; i < 6; i++)
+      accum[i] += hsum256_epu32(sum[i]);
+  }
+  compareFieldsSlow2Row_c<uint16_t>(map, prva, prvb, prvc, cura, curb, nxta, nxtb, nxtc, x, stopx, bits_per_pixel, accum);
+}
+
+
+void packCombMaskRow_c(const uint8_t* cmkp, uint64_t* dstp, int width, int words)
+{
+  memset(dstp, 0, words * sizeof(uint64_t));
+  for (int x = 0; x < width; ++x)
+  {
+    if (cmkp[x] == 0xFF)
+      dstp[x >> 6] |= (uint64_t)1 << (x & 63);
+  }
+}
+
+// The mask holds 0 or 0xFF, so the byte sign bits are the mask bits.
+// Loads may go past width up to the next multiple of 16/32 (inside the stride).
+static void clearCombMaskTail(uint64_t* dstp, int width, int words, int done)
+{
+  memset(reinterpret_cast<uint8_t*>(dstp) + done / 8, 0, words * sizeof(uint64_t) - done / 8);
+  if (width & 63)
+    dstp[width >> 6] &= ((uint64_t)1 << (width & 63)) - 1;
+}
+
+void packCombMaskRow_SSE2(const uint8_t* cmkp, uint64_t* dstp, int width, int words)
+{
+  uint16_t* dst16 = reinterpret_cast<uint16_t*>(dstp);
+  int x = 0;
+  for (; x < width; x += 16)
+    dst16[x >> 4] = (uint16_t)_mm_movemask_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(cmkp + x)));
+  clearCombMaskTail(dstp, width, words, x);
+}
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void packCombMaskRow_AVX2(const uint8_t* cmkp, uint64_t* dstp, int width, int words)
+{
+  uint32_t* dst32 = reinterpret_cast<uint32_t*>(dstp);
+  int x = 0;
+  for (; x < width; x += 32)
+    dst32[x >> 5] = (uint32_t)_mm256_movemask_epi8(_mm256_load_si256(reinterpret_cast<const __m256i*>(cmkp + x)));
+  clearCombMaskTail(dstp, width, words, x);
+}
+
+static inline int popcount64_c(uint64_t v)
+{
+  v = v - ((v >> 1) & 0x5555555555555555ULL);
+  v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+  v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  return (int)((v * 0x0101010101010101ULL) >> 56);
+}
+
+void countCombMaskRow_c(const uint64_t* bitsp, const uint64_t* bits, const uint64_t* bitsn,
+  int words, int xhalf, int* counts)
+{
+  if (xhalf >= 64)
+  {
+    const int wordsPerBlock = xhalf >> 6;
+    for (int w = 0; w < words; ++w)
+      counts[w / wordsPerBlock] += popcount64_c(bitsp[w] & bits[w] & bitsn[w]);
+    return;
+  }
+  const uint64_t blockMask = ((uint64_t)1 << xhalf) - 1;
+  const int blocksPerWord = 64 / xhalf;
+  for (int w = 0; w < words; ++w)
+  {
+    uint64_t v = bitsp[w] & bits[w] & bitsn[w];
+    int* c = counts + w * blocksPerWord;
+    for (int k = 0; v; ++k, v >>= xhalf)
+      c[k] += popcount64_c(v & blockMask);
+  }
+}
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("popcnt")))
+#endif
+void countCombMaskRow_POPCNT(const uint64_t* bitsp, const uint64_t* bits, const uint64_t* bitsn,
+  int words, int xhalf, int* counts)
+{
+#if defined(_M_X64) || defined(__x86_64__)
+#define POPCNT64(v) (int)_mm_popcnt_u64(v)
+#else
+#define POPCNT64(v) (_mm_popcnt_u32((uint32_t)(v)) + _mm_popcnt_u32((uint32_t)((v) >> 32)))
+#endif
+  if (xhalf >= 64)
+  {
+    const int wordsPerBlock = xhalf >> 6;
+    for (int w = 0; w < words; ++w)
+    {
+      const uint64_t v = bitsp[w] & bits[w] & bitsn[w];
+      counts[w / wordsPerBlock] += POPCNT64(v);
+    }
+    return;
+  }
+  const uint64_t blockMask = ((uint64_t)1 << xhalf) - 1;
+  const int blocksPerWord = 64 / xhalf;
+  for (int w = 0; w < words; ++w)
+  {
+    uint64_t v = bitsp[w] & bits[w] & bitsn[w];
+    int* c = counts + w * blocksPerWord;
+    for (int k = 0; v; ++k, v >>= xhalf)
+    {
+      const uint64_t b = v & blockMask;
+      c[k] += POPCNT64(b);
+    }
+  }
+#undef POPCNT64
+}
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void countCombMaskRow8_AVX2(const uint64_t* bitsp, const uint64_t* bits, const uint64_t* bitsn,
+  int words, int* counts)
+{
+  // popcount of each byte by nibble lookup
+  const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i lowNibble = _mm256_set1_epi8(0x0F);
+  for (int w = 0; w < words; w += 4)
+  {
+    __m256i v = _mm256_and_si256(_mm256_load_si256(reinterpret_cast<const __m256i*>(bitsp + w)),
+      _mm256_and_si256(_mm256_load_si256(reinterpret_cast<const __m256i*>(bits + w)),
+        _mm256_load_si256(reinterpret_cast<const __m256i*>(bitsn + w))));
+    if (_mm256_testz_si256(v, v))
+      continue;
+    __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, _mm256_and_si256(v, lowNibble)),
+      _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), lowNibble)));
+    int* c = counts + w * 8;
+    const __m128i cntLo = _mm256_castsi256_si128(cnt);
+    const __m128i cntHi = _mm256_extracti128_si256(cnt, 1);
+    __m256i* c256 = reinterpret_cast<__m256i*>(c);
+    _mm256_store_si256(c256 + 0, _mm256_add_epi32(_mm256_load_si256(c256 + 0), _mm256_cvtepu8_epi32(cntLo)));
+    _mm256_store_si256(c256 + 1, _mm256_add_epi32(_mm256_load_si256(c256 + 1), _mm256_cvtepu8_epi32(_mm_srli_si128(cntLo, 8))));
+    _mm256_store_si256(c256 + 2, _mm256_add_epi32(_mm256_load_si256(c256 + 2), _mm256_cvtepu8_epi32(cntHi)));
+    _mm256_store_si256(c256 + 3, _mm256_add_epi32(_mm256_load_si256(c256 + 3), _mm256_cvtepu8_epi32(_mm_srli_si128(cntHi, 8))));
+  }
+}
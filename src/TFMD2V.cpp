@@ -59,17 +59,17 @@ void TFM::parseD2V()
     else if (error == 2) throw TIVTCError("TFM:  ignored rff exists after fixing d2v file!");
     return;
   }
-  if (order == -1)
+  if (order_origSaved == -1)
   {
-    order = tff;
-    if (field == -1) field = tff;
+    order_origSaved = tff;
+    if (field_origSaved == -1) field_origSaved = tff;
 //    if (debug)
 //    {
 //      sprintf(buf, "TFM:  auto detected field order from d2v is %s.\n", order == 1 ? "TFF" : "BFF");
 //      OutputDebugString(buf);
 //    }
   }
-  else if (order != tff)
+  else if (order_origSaved != tff)
     throw TIVTCError("TFM:  the field order of the d2v does not match the user specified field order!");
   if (!found)
   {
@@ -29,6 +29,7 @@
 #include "TCommonASM.h"
 #include "emmintrin.h"
 #include "smmintrin.h"
+#include "immintrin.h"
 
 
 const VSFrameRef *TFMPP::GetFrame(int n, int activationReason, VSFrameContext *frameCtx, VSCore *core)
@@ -36,6 +37,9 @@ const VSFrameRef *TFMPP::GetFrame(int n, int activationReason, VSFrameContext *f
   if (n < 0) n = 0;
   else if (n > nfrms) n = nfrms;
 
+  int PP, mthresh;
+  getSetOvr(n, PP, mthresh);
+
   if (activationReason == arInitial) {
       if (PP > 4)
           vsapi->requestFrameFilter(std::max(0, n - 1), child, frameCtx);
@@ -59,9 +63,22 @@ const VSFrameRef *TFMPP::GetFrame(int n, int activationReason, VSFrameContext *f
   getProperties(src, fieldSrc, combed);
   if (!combed)
   {
+    if (display)
+    {
+      // draw the text that TFM left for the last filter
+      VSFrameRef *dst = vsapi->copyFrame(src, core);
+      vsapi->freeFrame(src);
+      int err;
+      const VSMap *props = vsapi->getFramePropsRO(dst);
+      const char *text = vsapi->propGetData(props, PROP_TFMDisplay, 0, &err);
+      if (!err)
+        drawDisplayText(dst, std::string(text, vsapi->propGetDataSize(props, PROP_TFMDisplay, 0, nullptr)), vsapi);
+      return dst;
+    }
     return src;
   }
-  getSetOvr(n);
+  ScratchPool<TFMPPScratch>::Handle scratchHandle(scratch, [&] { return createScratch(core); });
+  VSFrameRef *mmask = scratchHandle->mmask.get();
   VSFrameRef *dst;
   if (PP > 4)
   {
@@ -76,7 +93,7 @@ const VSFrameRef *TFMPP::GetFrame(int n, int activationReason, VSFrameContext *f
     if (use > 0)
     {
       dst = vsapi->newVideoFrame(vi->format, vi->width, vi->height, src, core);
-      buildMotionMask(prv, src, nxt, mmask, use);
+      buildMotionMask(prv, src, nxt, mmask, use, mthresh);
       if (uC2) {
         const VSFrameRef *frame = vsapi->getFrameFilter(n, clip2, frameCtx);
         maskClip2(src, frame, mmask, dst);
@@ -162,22 +179,45 @@ const VSFrameRef *TFMPP::GetFrame(int n, int activationReason, VSFrameContext *f
     }
   }
   vsapi->freeFrame(src);
-  if (display) writeDisplay(dst, n, fieldSrc);
+  if (display) writeDisplay(dst, n, fieldSrc, PP, mthresh);
+  if (debug) putScratchProperties(dst, *scratchHandle);
   return dst;
 }
 
+// motion mask of one frame, reused by later frames through the scratch pool
+std::unique_ptr<TFMPPScratch> TFMPP::createScratch(VSCore *core) const
+{
+  std::unique_ptr<TFMPPScratch> item(new TFMPPScratch());
+  item->mmask = decltype(item->mmask) (vsapi->newVideoFrame(vi->format, vi->width, vi->height, nullptr, core), vsapi->freeFrame);
+
+  item->bytes = 0;
+  for (int plane = 0; plane < vi->format->numPlanes; plane++)
+    item->bytes += (size_t)vsapi->getStride(item->mmask.get(), plane) * vsapi->getFrameHeight(item->mmask.get(), plane);
+
+  return item;
+}
+
+void TFMPP::putScratchProperties(VSFrameRef *dst, const TFMPPScratch &used)
+{
+  const int highWater = scratch.getHighWater();
+
+  VSMap *props = vsapi->getFramePropsRW(dst);
+  vsapi->propSetInt(props, PROP_TFMPPScratchHighWater, highWater, paReplace);
+  vsapi->propSetInt(props, PROP_TFMPPScratchBytes, (int64_t)(highWater * used.bytes), paReplace);
+}
+
 void TFMPP::buildMotionMask(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt,
-  VSFrameRef *mask, int use) const
+  VSFrameRef *mask, int use, int mthresh) const
 {
   if (vi->format->bytesPerSample == 1)
-    buildMotionMask_core<uint8_t>(prv, src, nxt, mask, use);
+    buildMotionMask_core<uint8_t>(prv, src, nxt, mask, use, mthresh);
   else
-    buildMotionMask_core<uint16_t>(prv, src, nxt, mask, use);
+    buildMotionMask_core<uint16_t>(prv, src, nxt, mask, use, mthresh);
 }
 
 template<typename pixel_t>
 void TFMPP::buildMotionMask_core(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt,
-  VSFrameRef* mask, int use) const
+  VSFrameRef* mask, int use, int mthresh) const
 {
   bool use_sse2 = cpuFlags.sse2;
 
@@ -215,7 +255,7 @@ void TFMPP::buildMotionMask_core(const VSFrameRef *prv, const VSFrameRef *src, c
     {
       // fixme: hbd SIMD
       if (sizeof(pixel_t) == 1 && use_sse2)
-        buildMotionMask1_SSE2((const uint8_t *)srcp, (const uint8_t*)prvp, maskw, src_pitch, prv_pitch, msk_pitch, width, height - 2, &cpuFlags);
+        buildMotionMask1_SSE2((const uint8_t *)srcp, (const uint8_t*)prvp, maskw, src_pitch, prv_pitch, msk_pitch, width, height - 2, mthresh, &cpuFlags);
       else
       {
         memset(maskw - msk_pitch, 0xFF, msk_pitch*height);
@@ -240,7 +280,7 @@ void TFMPP::buildMotionMask_core(const VSFrameRef *prv, const VSFrameRef *src, c
     {
       // fixme: hbd SIMD
       if (sizeof(pixel_t) == 1 && use_sse2)
-        buildMotionMask1_SSE2((const uint8_t*)srcp, (const uint8_t*)nxtp, maskw, src_pitch, nxt_pitch, msk_pitch, width, height - 2, &cpuFlags);
+        buildMotionMask1_SSE2((const uint8_t*)srcp, (const uint8_t*)nxtp, maskw, src_pitch, nxt_pitch, msk_pitch, width, height - 2, mthresh, &cpuFlags);
       else
       {
         memset(maskw - msk_pitch, 0xFF, msk_pitch*height);
@@ -267,7 +307,7 @@ void TFMPP::buildMotionMask_core(const VSFrameRef *prv, const VSFrameRef *src, c
       // use not 1 or 2
       if (sizeof(pixel_t) == 1 && use_sse2)
       {
-        buildMotionMask2_SSE2((const uint8_t*)prvp, (const uint8_t*)srcp, (const uint8_t*)nxtp, maskw, prv_pitch, src_pitch, nxt_pitch, msk_pitch, width, height - 2, &cpuFlags);
+        buildMotionMask2_SSE2((const uint8_t*)prvp, (const uint8_t*)srcp, (const uint8_t*)nxtp, maskw, prv_pitch, src_pitch, nxt_pitch, msk_pitch, width, height - 2, mthresh, &cpuFlags);
         for (int y = 1; y < height; ++y)
         {
           for (int x = 0; x < width; ++x)
@@ -328,7 +368,7 @@ void TFMPP::buildMotionMask_core(const VSFrameRef *prv, const VSFrameRef *src, c
 
 void TFMPP::buildMotionMask1_SSE2(const uint8_t *srcp1, const uint8_t *srcp2,
   uint8_t *dstp, int s1_pitch, int s2_pitch, int dst_pitch, int width,
-  int height, const CPUFeatures *cpu) const
+  int height, int mthresh, const CPUFeatures *cpu) const
 {
     (void)cpu;
 
@@ -371,7 +411,7 @@ void TFMPP::buildMotionMask1_SSE2(const uint8_t *srcp1, const uint8_t *srcp2,
 
 void TFMPP::buildMotionMask2_SSE2(const uint8_t *srcp1, const uint8_t *srcp2,
   const uint8_t *srcp3, uint8_t *dstp, int s1_pitch, int s2_pitch,
-  int s3_pitch, int dst_pitch, int width, int height, const CPUFeatures *cpu) const
+  int s3_pitch, int dst_pitch, int width, int height, int mthresh, const CPUFeatures *cpu) const
 {
     (void)cpu;
 
@@ -615,6 +655,7 @@ void TFMPP::BlendDeint_core(const VSFrameRef *src, const VSFrameRef* mask, VSFra
   bool nomask) const
 {
   bool use_sse2 = cpuFlags.sse2;
+  bool use_avx2 = cpuFlags.avx2;
 
   const int np = vi->format->numPlanes;
 
@@ -647,8 +688,9 @@ void TFMPP::BlendDeint_core(const VSFrameRef *src, const VSFrameRef* mask, VSFra
     const int lines_to_process = height - 2;
     if (nomask)
     {
-      // fixme: hbd SIMD
-      if (sizeof(pixel_t) == 1 && use_sse2)
+      if (use_avx2)
+        blendDeintMask_AVX2<pixel_t, false>(srcp, dstp, nullptr, src_pitch, dst_pitch, 0, width, lines_to_process);
+      else if (sizeof(pixel_t) == 1 && use_sse2)
         blendDeintMask_SSE2<false>((const uint8_t *)srcp, (uint8_t*)dstp, nullptr, src_pitch, dst_pitch, 0, width, lines_to_process);
       else
         blendDeintMask_C<pixel_t, false>(srcp, dstp, nullptr, src_pitch, dst_pitch, 0, width, lines_to_process);
@@ -656,7 +698,9 @@ void TFMPP::BlendDeint_core(const VSFrameRef *src, const VSFrameRef* mask, VSFra
     else
     {
       // with mask
-      if (sizeof(pixel_t) == 1 && use_sse2)
+      if (use_avx2)
+        blendDeintMask_AVX2<pixel_t, true>(srcp, dstp, maskp, src_pitch, dst_pitch, msk_pitch, width, lines_to_process);
+      else if (sizeof(pixel_t) == 1 && use_sse2)
         blendDeintMask_SSE2<true>((const uint8_t*)srcp, (uint8_t*)dstp, maskp, src_pitch, dst_pitch, msk_pitch, width, lines_to_process);
       else
         blendDeintMask_C<pixel_t, true>(srcp, dstp, maskp, src_pitch, dst_pitch, msk_pitch, width, lines_to_process);
@@ -722,6 +766,65 @@ void blendDeintMask_SSE2(const uint8_t *srcp, uint8_t *dstp,
   }
 }
 
+// (p + c*2 + n + 2) >> 2, 8 bit in 16 bit lanes, 10-16 bit in 32 bit lanes
+template<typename pixel_t, bool with_mask>
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void blendDeintMask_AVX2(const pixel_t *srcp, pixel_t *dstp,
+  const uint8_t *maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height)
+{
+  auto zero = _mm256_setzero_si256();
+  while (height--) {
+    for (int x = 0; x < width; x += 32 / sizeof(pixel_t)) {
+      auto prev = _mm256_load_si256(reinterpret_cast<const __m256i *>(srcp - src_pitch + x));
+      auto curr = _mm256_load_si256(reinterpret_cast<const __m256i *>(srcp + x));
+      auto next = _mm256_load_si256(reinterpret_cast<const __m256i *>(srcp + src_pitch + x));
+      __m256i res;
+      // unpack and pack both work within 128 bit lanes, so the order is kept
+      if constexpr (sizeof(pixel_t) == 1) {
+        auto twosWord = _mm256_set1_epi16(2);
+        auto sum_lo = _mm256_add_epi16(_mm256_unpacklo_epi8(prev, zero), _mm256_unpacklo_epi8(next, zero));
+        auto sum_hi = _mm256_add_epi16(_mm256_unpackhi_epi8(prev, zero), _mm256_unpackhi_epi8(next, zero));
+        sum_lo = _mm256_add_epi16(sum_lo, _mm256_slli_epi16(_mm256_unpacklo_epi8(curr, zero), 1));
+        sum_hi = _mm256_add_epi16(sum_hi, _mm256_slli_epi16(_mm256_unpackhi_epi8(curr, zero), 1));
+        auto res_lo = _mm256_srli_epi16(_mm256_add_epi16(sum_lo, twosWord), 2);
+        auto res_hi = _mm256_srli_epi16(_mm256_add_epi16(sum_hi, twosWord), 2);
+        res = _mm256_packus_epi16(res_lo, res_hi);
+      }
+      else {
+        auto twosDword = _mm256_set1_epi32(2);
+        auto sum_lo = _mm256_add_epi32(_mm256_unpacklo_epi16(prev, zero), _mm256_unpacklo_epi16(next, zero));
+        auto sum_hi = _mm256_add_epi32(_mm256_unpackhi_epi16(prev, zero), _mm256_unpackhi_epi16(next, zero));
+        sum_lo = _mm256_add_epi32(sum_lo, _mm256_slli_epi32(_mm256_unpacklo_epi16(curr, zero), 1));
+        sum_hi = _mm256_add_epi32(sum_hi, _mm256_slli_epi32(_mm256_unpackhi_epi16(curr, zero), 1));
+        auto res_lo = _mm256_srli_epi32(_mm256_add_epi32(sum_lo, twosDword), 2);
+        auto res_hi = _mm256_srli_epi32(_mm256_add_epi32(sum_hi, twosDword), 2);
+        res = _mm256_packus_epi32(res_lo, res_hi);
+      }
+
+      if constexpr (with_mask) {
+        // mask is always 8 bits 0x00 or 0xFF
+        __m256i mask;
+        if constexpr (sizeof(pixel_t) == 1)
+          mask = _mm256_load_si256(reinterpret_cast<const __m256i*>(maskp + x));
+        else
+          mask = _mm256_cvtepi8_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(maskp + x))); // keep FF to FFFF
+        res = _mm256_blendv_epi8(curr, res, mask); // if mask then res else curr
+      } else {
+          (void)maskp;
+          (void)msk_pitch;
+      }
+      _mm256_store_si256(reinterpret_cast<__m256i *>(dstp + x), res);
+    }
+    srcp += src_pitch;
+    dstp += dst_pitch;
+    if constexpr(with_mask)
+      maskp += msk_pitch;
+  }
+}
+
 template<typename pixel_t, bool with_mask>
 void blendDeintMask_C(const pixel_t* srcp, pixel_t* dstp,
   const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
@@ -744,6 +847,48 @@ void blendDeintMask_C(const pixel_t* srcp, pixel_t* dstp,
   }
 }
 
+// instantiate, the benchmark calls the kernels directly
+template void blendDeintMask_SSE2<true>(const uint8_t* srcp, uint8_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height);
+template void blendDeintMask_AVX2<uint8_t, true>(const uint8_t* srcp, uint8_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height);
+template void blendDeintMask_AVX2<uint16_t, true>(const uint16_t* srcp, uint16_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height);
+template void blendDeintMask_C<uint8_t, true>(const uint8_t* srcp, uint8_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height);
+template void blendDeintMask_C<uint16_t, true>(const uint16_t* srcp, uint16_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height);
+
+// middle rows of cubic deinterlacing, pitches are doubled (field rows)
+template<typename pixel_t, int bits_per_pixel, bool with_mask>
+static void cubicDeintMask(const CPUFeatures &cpuFlags, const pixel_t* srcp, pixel_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height)
+{
+  if constexpr (sizeof(pixel_t) == 1) {
+    if (cpuFlags.sse2) {
+      cubicDeintMask_SSE2<with_mask>(srcp, dstp, maskp, src_pitch, dst_pitch, msk_pitch, width, height);
+      return;
+    }
+  }
+  else {
+    if (cpuFlags.avx2) {
+      cubicDeintMask_uint16_AVX2<bits_per_pixel, with_mask>(srcp, dstp, maskp, src_pitch, dst_pitch, msk_pitch, width, height);
+      return;
+    }
+    if (cpuFlags.sse4_1) {
+      cubicDeintMask_uint16_SSE4<bits_per_pixel, with_mask>(srcp, dstp, maskp, src_pitch, dst_pitch, msk_pitch, width, height);
+      return;
+    }
+  }
+  cubicDeintMask_C<pixel_t, bits_per_pixel, with_mask>(srcp, dstp, maskp, src_pitch, dst_pitch, msk_pitch, width, height);
+}
+
 void TFMPP::CubicDeint(const VSFrameRef *src, const VSFrameRef *mask, VSFrameRef *dst, bool nomask,
   int field) const
 {
@@ -760,8 +905,6 @@ template<typename pixel_t, int bits_per_pixel>
 void TFMPP::CubicDeint_core(const VSFrameRef *src, const VSFrameRef* mask, VSFrameRef *dst, bool nomask,
   int field) const
 {
-  bool use_sse2 = cpuFlags.sse2;
-
   const int np = vi->format->numPlanes;
 
   for (int b = 0; b < np; ++b)
@@ -808,15 +951,8 @@ void TFMPP::CubicDeint_core(const VSFrameRef *src, const VSFrameRef* mask, VSFra
       dstp += dst_pitch;
       // middle
       const int lines_to_process = height / 2 - 3;
-      if (bits_per_pixel == 8 && use_sse2)
-      {
-        // false: no mask
-        cubicDeintMask_SSE2<false>((const uint8_t *)srcp, (uint8_t*)dstp, nullptr, src_pitch, dst_pitch, 0, width, lines_to_process);
-      }
-      else
-      {
-        cubicDeintMask_C<pixel_t, bits_per_pixel, false>(srcp, dstp, nullptr, src_pitch, dst_pitch, 0, width, lines_to_process);
-      }
+      // false: no mask
+      cubicDeintMask<pixel_t, bits_per_pixel, false>(cpuFlags, srcp, dstp, nullptr, src_pitch, dst_pitch, 0, width, lines_to_process);
       srcppp += src_pitch * lines_to_process;
       srcpp += src_pitch * lines_to_process;
       srcp += src_pitch * lines_to_process;
@@ -845,17 +981,9 @@ void TFMPP::CubicDeint_core(const VSFrameRef *src, const VSFrameRef* mask, VSFra
       dstp += dst_pitch;
       // middle
       const int lines_to_process = height / 2 - 3;
-      if (bits_per_pixel == 8 && use_sse2)
-      {
-        // fixme: hbd SIMD sse2 for 10+ bits
-        // true: with_mask
-        cubicDeintMask_SSE2<true>((const uint8_t*)srcp, (uint8_t*)dstp, maskp, src_pitch, dst_pitch, msk_pitch, width, lines_to_process);
-      }
-      else
-      {
-        //for (int y = 4 - field; y < height - 3; y += 2)
-        cubicDeintMask_C<pixel_t, bits_per_pixel, true>(srcp, dstp, maskp, src_pitch, dst_pitch, msk_pitch, width, lines_to_process);
-      }
+      //for (int y = 4 - field; y < height - 3; y += 2)
+      // true: with_mask
+      cubicDeintMask<pixel_t, bits_per_pixel, true>(cpuFlags, srcp, dstp, maskp, src_pitch, dst_pitch, msk_pitch, width, lines_to_process);
       srcppp += src_pitch * lines_to_process;
       srcpp += src_pitch * lines_to_process;
       srcr += src_pitch * lines_to_process;
@@ -980,6 +1108,166 @@ void cubicDeintMask_C(const pixel_t* srcp, pixel_t* dstp,
   }
 }
 
+// 19 * (p + c) - 3 * (pp + n) as 16 * (p + c) + 3 * ((p + c) - (pp + n)) on 32 bit lanes
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("sse4.1")))
+#endif
+static AVS_FORCEINLINE __m128i cubicInt_uint16_SSE4(__m128i pp, __m128i p, __m128i c, __m128i n)
+{
+  const auto sixteen = _mm_set1_epi32(16);
+  const auto inner = _mm_add_epi32(p, c);
+  const auto diff = _mm_sub_epi32(inner, _mm_add_epi32(pp, n));
+  auto res = _mm_add_epi32(_mm_slli_epi32(inner, 4), _mm_add_epi32(diff, _mm_slli_epi32(diff, 1)));
+  return _mm_srai_epi32(_mm_add_epi32(res, sixteen), 5);
+}
+
+template<int bits_per_pixel, bool with_mask>
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("sse4.1")))
+#endif
+void cubicDeintMask_uint16_SSE4(const uint16_t* srcp, uint16_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height)
+{
+  const int s1 = src_pitch >> 1; // pitch was multiplied *2 before the call
+
+  const auto zero = _mm_setzero_si128();
+  const auto max_pixel_value = _mm_set1_epi16((short)((1 << bits_per_pixel) - 1));
+  while (height--) {
+    for (int x = 0; x < width; x += 8) {
+      auto prevprev = _mm_load_si128(reinterpret_cast<const __m128i*>(srcp - src_pitch * 2 + x));
+      auto prev = _mm_load_si128(reinterpret_cast<const __m128i*>(srcp - src_pitch + x));
+      auto curr = _mm_load_si128(reinterpret_cast<const __m128i*>(srcp + x));
+      auto next = _mm_load_si128(reinterpret_cast<const __m128i*>(srcp + src_pitch + x));
+      auto res_lo = cubicInt_uint16_SSE4(_mm_unpacklo_epi16(prevprev, zero), _mm_unpacklo_epi16(prev, zero),
+        _mm_unpacklo_epi16(curr, zero), _mm_unpacklo_epi16(next, zero));
+      auto res_hi = cubicInt_uint16_SSE4(_mm_unpackhi_epi16(prevprev, zero), _mm_unpackhi_epi16(prev, zero),
+        _mm_unpackhi_epi16(curr, zero), _mm_unpackhi_epi16(next, zero));
+      auto res = _mm_packus_epi32(res_lo, res_hi); // clamps to 0..65535
+      if constexpr (bits_per_pixel < 16)
+        res = _mm_min_epu16(res, max_pixel_value);
+
+      if constexpr (with_mask) {
+        auto mask = _mm_cvtepi8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(maskp + x))); // keep FF to FFFF
+        auto curr2 = _mm_load_si128(reinterpret_cast<const __m128i*>(srcp - s1 + x));
+        res = _mm_blendv_epi8(curr2, res, mask); // if mask then res else curr
+      }
+      else {
+        (void)maskp;
+        (void)msk_pitch;
+        (void)s1;
+      }
+      _mm_store_si128(reinterpret_cast<__m128i*>(dstp + x), res);
+    }
+    srcp += src_pitch;
+    dstp += dst_pitch;
+    if constexpr (with_mask)
+      maskp += msk_pitch;
+  }
+}
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+static AVS_FORCEINLINE __m256i cubicInt_uint16_AVX2(__m256i pp, __m256i p, __m256i c, __m256i n)
+{
+  const auto sixteen = _mm256_set1_epi32(16);
+  const auto inner = _mm256_add_epi32(p, c);
+  const auto diff = _mm256_sub_epi32(inner, _mm256_add_epi32(pp, n));
+  auto res = _mm256_add_epi32(_mm256_slli_epi32(inner, 4), _mm256_add_epi32(diff, _mm256_slli_epi32(diff, 1)));
+  return _mm256_srai_epi32(_mm256_add_epi32(res, sixteen), 5);
+}
+
+template<int bits_per_pixel, bool with_mask>
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void cubicDeintMask_uint16_AVX2(const uint16_t* srcp, uint16_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height)
+{
+  const int s1 = src_pitch >> 1; // pitch was multiplied *2 before the call
+
+  const auto zero = _mm256_setzero_si256();
+  const auto max_pixel_value = _mm256_set1_epi16((short)((1 << bits_per_pixel) - 1));
+  while (height--) {
+    for (int x = 0; x < width; x += 16) {
+      auto prevprev = _mm256_load_si256(reinterpret_cast<const __m256i*>(srcp - src_pitch * 2 + x));
+      auto prev = _mm256_load_si256(reinterpret_cast<const __m256i*>(srcp - src_pitch + x));
+      auto curr = _mm256_load_si256(reinterpret_cast<const __m256i*>(srcp + x));
+      auto next = _mm256_load_si256(reinterpret_cast<const __m256i*>(srcp + src_pitch + x));
+      // unpack and pack are both per 128 bit lane, the pixel order is kept
+      auto res_lo = cubicInt_uint16_AVX2(_mm256_unpacklo_epi16(prevprev, zero), _mm256_unpacklo_epi16(prev, zero),
+        _mm256_unpacklo_epi16(curr, zero), _mm256_unpacklo_epi16(next, zero));
+      auto res_hi = cubicInt_uint16_AVX2(_mm256_unpackhi_epi16(prevprev, zero), _mm256_unpackhi_epi16(prev, zero),
+        _mm256_unpackhi_epi16(curr, zero), _mm256_unpackhi_epi16(next, zero));
+      auto res = _mm256_packus_epi32(res_lo, res_hi);
+      if constexpr (bits_per_pixel < 16)
+        res = _mm256_min_epu16(res, max_pixel_value);
+
+      if constexpr (with_mask) {
+        auto mask = _mm256_cvtepi8_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(maskp + x)));
+        auto curr2 = _mm256_load_si256(reinterpret_cast<const __m256i*>(srcp - s1 + x));
+        res = _mm256_blendv_epi8(curr2, res, mask);
+      }
+      else {
+        (void)maskp;
+        (void)msk_pitch;
+        (void)s1;
+      }
+      _mm256_store_si256(reinterpret_cast<__m256i*>(dstp + x), res);
+    }
+    srcp += src_pitch;
+    dstp += dst_pitch;
+    if constexpr (with_mask)
+      maskp += msk_pitch;
+  }
+}
+
+// instantiate, the benchmark calls the kernels directly
+template void cubicDeintMask_SSE2<true>(const uint8_t* srcp, uint8_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height);
+template void cubicDeintMask_C<uint8_t, 8, true>(const uint8_t* srcp, uint8_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height);
+template void cubicDeintMask_C<uint16_t, 10, true>(const uint16_t* srcp, uint16_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height);
+template void cubicDeintMask_C<uint16_t, 12, true>(const uint16_t* srcp, uint16_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height);
+template void cubicDeintMask_C<uint16_t, 14, true>(const uint16_t* srcp, uint16_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height);
+template void cubicDeintMask_C<uint16_t, 16, true>(const uint16_t* srcp, uint16_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height);
+template void cubicDeintMask_uint16_SSE4<10, true>(const uint16_t* srcp, uint16_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height);
+template void cubicDeintMask_uint16_AVX2<10, true>(const uint16_t* srcp, uint16_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height);
+template void cubicDeintMask_uint16_SSE4<12, true>(const uint16_t* srcp, uint16_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height);
+template void cubicDeintMask_uint16_AVX2<12, true>(const uint16_t* srcp, uint16_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height);
+template void cubicDeintMask_uint16_SSE4<14, true>(const uint16_t* srcp, uint16_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height);
+template void cubicDeintMask_uint16_AVX2<14, true>(const uint16_t* srcp, uint16_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height);
+template void cubicDeintMask_uint16_SSE4<16, true>(const uint16_t* srcp, uint16_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height);
+template void cubicDeintMask_uint16_AVX2<16, true>(const uint16_t* srcp, uint16_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height);
+
 
 //void TFMPP::destroyHint(VSFrameRef *dst, unsigned int hint)
 //{
@@ -1084,9 +1372,8 @@ void TFMPP::getProperties(const VSFrameRef *src, int& field, bool& combed) const
 //  return true;
 //}
 
-void TFMPP::getSetOvr(int n)
+void TFMPP::getSetOvr(int n, int &PP, int &mthresh) const
 {
-  if (setArray.size() == 0) return;
   mthresh = mthresh_origSaved;
   PP = PP_origSaved;
   for (int x = 0; x < (int)setArray.size(); x += 4)
@@ -1127,7 +1414,7 @@ void TFMPP::copyField(VSFrameRef *dst, const VSFrameRef *src, int field) const
   }
 }
 
-void TFMPP::writeDisplay(VSFrameRef *dst, int n, int field) const
+void TFMPP::writeDisplay(VSFrameRef *dst, int n, int field, int PP, int mthresh) const
 {
 #define SZ 160
     char buf[SZ];
@@ -1143,8 +1430,408 @@ void TFMPP::writeDisplay(VSFrameRef *dst, int n, int field) const
 
   VSMap *props = vsapi->getFramePropsRW(dst);
   vsapi->propSetData(props, PROP_TFMDisplay, text.c_str(), text.size(), paReplace);
+  drawDisplayText(dst, text, vsapi);
 }
 
+// Edge directed interpolation for a pixel that failed the flat area checks,
+// from the gradients of the rows above and below.
+template<typename pixel_t, int bits_per_pixel>
+static int elaDirection(const pixel_t *srcppp, const pixel_t *srcpp, const pixel_t *srcp, const pixel_t *srcpn, int x,
+  int Iy1, int Iy2, int Ix1, int Ix2, int edgeS1, int edgeS2)
+{
+  int Iye;
+  int temp, temp1, temp2;
+  int minN, maxN;
+  double dir1, dir2, dir, dirF;
+
+  constexpr int bitshift_to_8 = (bits_per_pixel - 8);
+
+  if (Ix1 == 0) dir1 = 3.1415926;
+  else
+  {
+    dir1 = atan(Iy1 / (Ix1*2.0f)) + 1.5707963;
+    if (Iy1 >= 0) { if (Ix1 < 0) dir1 += 3.1415927; }
+    else { if (Ix1 >= 0) dir1 += 3.1415927; }
+    if (dir1 >= 3.1415927) dir1 -= 3.1415927;
+  }
+  if (Ix2 == 0) dir2 = 3.1415926;
+  else
+  {
+    dir2 = atan(Iy2 / (Ix2*2.0f)) + 1.5707963;
+    if (Iy2 >= 0) { if (Ix2 < 0) dir2 += 3.1415927; }
+    else { if (Ix2 >= 0) dir2 += 3.1415927; }
+    if (dir2 >= 3.1415927) dir2 -= 3.1415927;
+  }
+  if (fabs(dir1 - dir2) < 0.5)
+  {
+    if (edgeS1 >= 3600 && edgeS2 >= 3600) dir = (dir1 + dir2) * 0.5;
+    else dir = edgeS1 >= edgeS2 ? dir1 : dir2;
+  }
+  else
+  {
+    if (edgeS1 >= 5000 && edgeS2 >= 5000)
+    {
+      // stay in safe 32 bit int by using 8 bit normalized data
+      Iye = (-srcp[x - 1] - srcp[x] - srcp[x] - srcp[x + 1] + srcpp[x - 1] + srcpp[x] + srcpp[x] + srcpp[x + 1]) >> bitshift_to_8;
+      if ((Iy1*Iye > 0) && (Iy2*Iye < 0)) dir = dir1;
+      else if ((Iy1*Iye < 0) && (Iy2*Iye > 0)) dir = dir2;
+      else
+      {
+        if (abs(Iye - Iy1) <= abs(Iye - Iy2)) dir = dir1;
+        else dir = dir2;
+      }
+    }
+    else dir = edgeS1 >= edgeS2 ? dir1 : dir2;
+  }
+  dirF = 0.5f / tan(dir);
+  if (dirF >= 0.0f)
+  {
+    if (dirF >= 0.5f)
+    {
+      if (dirF >= 1.0f)
+      {
+        if (dirF >= 1.5f)
+        {
+          if (dirF >= 2.0f)
+          {
+            if (dirF <= 2.50f)
+            {
+              temp1 = srcpp[x + 4];
+              temp2 = srcp[x - 4];
+              temp = (srcpp[x + 4] + srcp[x - 4] + 1) >> 1;
+            }
+            else
+            {
+              temp1 = temp2 = srcp[x];
+              temp = cubicInt<bits_per_pixel>(srcppp[x], srcpp[x], srcp[x], srcpn[x]);
+            }
+          }
+          else
+          {
+            temp1 = (int)((dirF - 1.5f)*(srcpp[x + 4]) + (2.0f - dirF)*(srcpp[x + 3]) + 0.5f);
+            temp2 = (int)((dirF - 1.5f)*(srcp[x - 4]) + (2.0f - dirF)*(srcp[x - 3]) + 0.5f);
+            temp = (int)((dirF - 1.5f)*(srcpp[x + 4] + srcp[x - 4]) + (2.0f - dirF)*(srcpp[x + 3] + srcp[x - 3]) + 0.5f);
+          }
+        }
+        else
+        {
+          temp1 = (int)((dirF - 1.0f)*(srcpp[x + 3]) + (1.5f - dirF)*(srcpp[x + 2]) + 0.5f);
+          temp2 = (int)((dirF - 1.0f)*(srcp[x - 3]) + (1.5f - dirF)*(srcp[x - 2]) + 0.5f);
+          temp = (int)((dirF - 1.0f)*(srcpp[x + 3] + srcp[x - 3]) + (1.5f - dirF)*(srcpp[x + 2] + srcp[x - 2]) + 0.5f);
+        }
+      }
+      else
+      {
+        temp1 = (int)((dirF - 0.5f)*(srcpp[x + 2]) + (1.0f - dirF)*(srcpp[x + 1]) + 0.5f);
+        temp2 = (int)((dirF - 0.5f)*(srcp[x - 2]) + (1.0f - dirF)*(srcp[x - 1]) + 0.5f);
+        temp = (int)((dirF - 0.5f)*(srcpp[x + 2] + srcp[x - 2]) + (1.0f - dirF)*(srcpp[x + 1] + srcp[x - 1]) + 0.5f);
+      }
+    }
+    else
+    {
+      temp1 = (int)(dirF*(srcpp[x + 1]) + (0.5f - dirF)*(srcpp[x]) + 0.5f);
+      temp2 = (int)(dirF*(srcp[x - 1]) + (0.5f - dirF)*(srcp[x]) + 0.5f);
+      temp = (int)(dirF*(srcpp[x + 1] + srcp[x - 1]) + (0.5f - dirF)*(srcpp[x] + srcp[x]) + 0.5f);
+    }
+  }
+  else
+  {
+    if (dirF <= -0.5f)
+    {
+      if (dirF <= -1.0f)
+      {
+        if (dirF <= -1.5f)
+        {
+          if (dirF <= -2.0f)
+          {
+            if (dirF >= -2.50f)
+            {
+              temp1 = srcpp[x - 4];
+              temp2 = srcp[x + 4];
+              temp = (srcpp[x - 4] + srcp[x + 4] + 1) >> 1;
+            }
+            else
+            {
+              temp1 = temp2 = srcp[x];
+              temp = cubicInt<bits_per_pixel>(srcppp[x], srcpp[x], srcp[x], srcpn[x]);
+            }
+          }
+          else
+          {
+            temp1 = (int)((-dirF - 1.5f)*(srcpp[x - 4]) + (2.0f + dirF)*(srcpp[x - 3]) + 0.5f);
+            temp2 = (int)((-dirF - 1.5f)*(srcp[x + 4]) + (2.0f + dirF)*(srcp[x + 3]) + 0.5f);
+            temp = (int)((-dirF - 1.5f)*(srcpp[x - 4] + srcp[x + 4]) + (2.0f + dirF)*(srcpp[x - 3] + srcp[x + 3]) + 0.5f);
+          }
+        }
+        else
+        {
+          temp1 = (int)((-dirF - 1.0f)*(srcpp[x - 3]) + (1.5f + dirF)*(srcpp[x - 2]) + 0.5f);
+          temp2 = (int)((-dirF - 1.0f)*(srcp[x + 3]) + (1.5f + dirF)*(srcp[x + 2]) + 0.5f);
+          temp = (int)((-dirF - 1.0f)*(srcpp[x - 3] + srcp[x + 3]) + (1.5f + dirF)*(srcpp[x - 2] + srcp[x + 2]) + 0.5f);
+        }
+      }
+      else
+      {
+        temp1 = (int)((-dirF - 0.5f)*(srcpp[x - 2]) + (1.0f + dirF)*(srcpp[x - 1]) + 0.5f);
+        temp2 = (int)((-dirF - 0.5f)*(srcp[x + 2]) + (1.0f + dirF)*(srcp[x + 1]) + 0.5f);
+        temp = (int)((-dirF - 0.5f)*(srcpp[x - 2] + srcp[x + 2]) + (1.0f + dirF)*(srcpp[x - 1] + srcp[x + 1]) + 0.5f);
+      }
+    }
+    else
+    {
+      temp1 = (int)((-dirF)*(srcpp[x - 1]) + (0.5f + dirF)*(srcpp[x]) + 0.5f);
+      temp2 = (int)((-dirF)*(srcp[x + 1]) + (0.5f + dirF)*(srcp[x]) + 0.5f);
+      temp = (int)((-dirF)*(srcpp[x - 1] + srcp[x + 1]) + (0.5f + dirF)*(srcpp[x] + srcp[x]) + 0.5f);
+    }
+  }
+
+  constexpr int Const20 = 20 << bitshift_to_8;
+  constexpr int Const25 = 25 << bitshift_to_8;
+  constexpr int Const60 = 60 << bitshift_to_8;
+
+  minN = std::min(srcpp[x], srcp[x]) - Const25;
+  maxN = std::max(srcpp[x], srcp[x]) + Const25;
+  if (abs(temp1 - temp2) > Const20 || abs(srcpp[x] + srcp[x] - temp - temp) > Const60 || temp < minN || temp > maxN)
+  {
+    temp = cubicInt<bits_per_pixel>(srcppp[x], srcpp[x], srcp[x], srcpn[x]);
+  }
+  else {
+    // clamp to valid. cubicint clamps O.K.
+    constexpr int max_pixel_value = (1 << bits_per_pixel) - 1;
+    if (temp > max_pixel_value) temp = max_pixel_value;
+    else if (temp < 0) temp = 0;
+  }
+  return temp;
+}
+
+// One interpolated luma pixel between rows srcpp and srcp, x must be at least
+// 4 pixels away from both edges. Shared by the C and SIMD row functions.
+template<typename pixel_t, int bits_per_pixel>
+static int elaInterpolate(const pixel_t *srcppp, const pixel_t *srcpp, const pixel_t *srcp, const pixel_t *srcpn, int x)
+{
+  int Iy1, Iy2;
+  int Ix1, Ix2;
+  int edgeS1, edgeS2;
+  int sum, sumsq;
+
+  constexpr int bitshift_to_8 = (bits_per_pixel - 8);
+
+  auto square = [](int i)
+  {
+    return i * i;
+  };
+
+  // stay in safe 32 bit int by using 8 bit normalized data
+  Iy1 = (-srcp[x - 1] - srcp[x] - srcp[x] - srcp[x + 1] + srcppp[x - 1] + srcppp[x] + srcppp[x] + srcppp[x + 1]) >> bitshift_to_8;
+  Iy2 = (-srcpn[x - 1] - srcpn[x] - srcpn[x] - srcpn[x + 1] + srcpp[x - 1] + srcpp[x] + srcpp[x] + srcpp[x + 1]) >> bitshift_to_8;
+  Ix1 = (srcppp[x + 1] + srcpp[x + 1] + srcpp[x + 1] + srcp[x + 1] - srcppp[x - 1] - srcpp[x - 1] - srcpp[x - 1] - srcp[x - 1]) >> bitshift_to_8;
+  Ix2 = (srcpp[x + 1] + srcp[x + 1] + srcp[x + 1] + srcpn[x + 1] - srcpp[x - 1] - srcp[x - 1] - srcp[x - 1] - srcpn[x - 1]) >> bitshift_to_8;
+  edgeS1 = Ix1 * Ix1 + Iy1 * Iy1;
+  edgeS2 = Ix2 * Ix2 + Iy2 * Iy2;
+  if (edgeS1 < 1600 && edgeS2 < 1600)
+  {
+    return (srcpp[x] + srcp[x] + 1) >> 1;
+  }
+  constexpr int Const10 = 10 << bitshift_to_8;
+  if (abs(srcpp[x] - srcp[x]) < Const10 && (edgeS1 < 1600 || edgeS2 < 1600))
+  {
+    return (srcpp[x] + srcp[x] + 1) >> 1;
+  }
+  // stay in safe 32 bit int by using 8 bit normalized data
+  sum = (srcpp[x - 1] + srcpp[x] + srcpp[x + 1] + srcp[x - 1] + srcp[x] + srcp[x + 1]) >> bitshift_to_8;
+  sumsq =
+    square(srcpp[x - 1] >> bitshift_to_8) +
+    square(srcpp[x] >> bitshift_to_8) +
+    square(srcpp[x + 1] >> bitshift_to_8) +
+    square(srcp[x - 1] >> bitshift_to_8) +
+    square(srcp[x] >> bitshift_to_8) +
+    square(srcp[x + 1] >> bitshift_to_8);
+  if (6 * sumsq - square(sum) < 432)
+  {
+    return (srcpp[x] + srcp[x] + 1) >> 1;
+  }
+  return elaDirection<pixel_t, bits_per_pixel>(srcppp, srcpp, srcp, srcpn, x, Iy1, Iy2, Ix1, Ix2, edgeS1, edgeS2);
+}
+
+template<typename pixel_t, int bits_per_pixel>
+void elaDeintRow_C(const pixel_t *srcppp, const pixel_t *srcpp, const pixel_t *srcp, const pixel_t *srcpn,
+  pixel_t *dstp, const uint8_t *maskp, int xstart, int xstop)
+{
+  for (int x = xstart; x < xstop; ++x)
+  {
+    if (maskp)
+    {
+      // skip unmasked spans 8 pixels at a time
+      uint64_t m8;
+      if (x + 8 <= xstop && (memcpy(&m8, maskp + x, 8), m8 == 0))
+      {
+        x += 7;
+        continue;
+      }
+      if (maskp[x] != 0xFF)
+        continue;
+    }
+    dstp[x] = elaInterpolate<pixel_t, bits_per_pixel>(srcppp, srcpp, srcp, srcpn, x);
+  }
+}
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+static AVS_FORCEINLINE __m256i elaLoad8_AVX2(const uint8_t *p)
+{
+  return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+}
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+static AVS_FORCEINLINE __m256i elaLoad8_AVX2(const uint16_t *p)
+{
+  return _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+}
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+static AVS_FORCEINLINE __m256i elaSum121_AVX2(__m256i a, __m256i b, __m256i c)
+{
+  return _mm256_add_epi32(_mm256_add_epi32(a, c), _mm256_add_epi32(b, b));
+}
+
+template<int bitshift_to_8>
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+static AVS_FORCEINLINE __m256i elaSquare_AVX2(__m256i v)
+{
+  v = _mm256_srli_epi32(v, bitshift_to_8);
+  return _mm256_mullo_epi32(v, v);
+}
+
+// The checks that end in a plain vertical average are done for 8 pixels at
+// once in 32 bit lanes, with the same integer math as elaInterpolate. Only
+// the pixels that need a direction search go to elaDirection.
+template<typename pixel_t, int bits_per_pixel>
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void elaDeintRow_AVX2(const pixel_t *srcppp, const pixel_t *srcpp, const pixel_t *srcp, const pixel_t *srcpn,
+  pixel_t *dstp, const uint8_t *maskp, int xstart, int xstop)
+{
+  constexpr int bitshift_to_8 = (bits_per_pixel - 8);
+  const __m256i c1600 = _mm256_set1_epi32(1600);
+  const __m256i c432 = _mm256_set1_epi32(432);
+  const __m256i const10 = _mm256_set1_epi32(10 << bitshift_to_8);
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i ff = _mm256_set1_epi32(0xFF);
+
+  int x = xstart;
+  for (; x + 8 <= xstop; x += 8)
+  {
+    __m256i active = _mm256_set1_epi32(-1);
+    if (maskp)
+    {
+      // skip unmasked spans
+      while (x + 40 <= xstop)
+      {
+        const __m256i m32 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(maskp + x));
+        if (!_mm256_testz_si256(m32, m32))
+          break;
+        x += 32;
+      }
+      uint64_t m8;
+      memcpy(&m8, maskp + x, 8);
+      if (m8 == 0)
+        continue;
+      active = _mm256_cmpeq_epi32(elaLoad8_AVX2(maskp + x), ff);
+    }
+
+    // rows srcppp (u), srcpp (a), srcp (b), srcpn (d) at x-1, x, x+1
+    const __m256i um = elaLoad8_AVX2(srcppp + x - 1), u0 = elaLoad8_AVX2(srcppp + x), up = elaLoad8_AVX2(srcppp + x + 1);
+    const __m256i am = elaLoad8_AVX2(srcpp + x - 1), a0 = elaLoad8_AVX2(srcpp + x), ap = elaLoad8_AVX2(srcpp + x + 1);
+    const __m256i bm = elaLoad8_AVX2(srcp + x - 1), b0 = elaLoad8_AVX2(srcp + x), bp = elaLoad8_AVX2(srcp + x + 1);
+    const __m256i dm = elaLoad8_AVX2(srcpn + x - 1), d0 = elaLoad8_AVX2(srcpn + x), dp = elaLoad8_AVX2(srcpn + x + 1);
+
+    const __m256i Iy1 = _mm256_srai_epi32(_mm256_sub_epi32(elaSum121_AVX2(um, u0, up), elaSum121_AVX2(bm, b0, bp)), bitshift_to_8);
+    const __m256i Iy2 = _mm256_srai_epi32(_mm256_sub_epi32(elaSum121_AVX2(am, a0, ap), elaSum121_AVX2(dm, d0, dp)), bitshift_to_8);
+    const __m256i Ix1 = _mm256_srai_epi32(_mm256_sub_epi32(elaSum121_AVX2(up, ap, bp), elaSum121_AVX2(um, am, bm)), bitshift_to_8);
+    const __m256i Ix2 = _mm256_srai_epi32(_mm256_sub_epi32(elaSum121_AVX2(ap, bp, dp), elaSum121_AVX2(am, bm, dm)), bitshift_to_8);
+    const __m256i edgeS1 = _mm256_add_epi32(_mm256_mullo_epi32(Ix1, Ix1), _mm256_mullo_epi32(Iy1, Iy1));
+    const __m256i edgeS2 = _mm256_add_epi32(_mm256_mullo_epi32(Ix2, Ix2), _mm256_mullo_epi32(Iy2, Iy2));
+    const __m256i weak1 = _mm256_cmpgt_epi32(c1600, edgeS1);
+    const __m256i weak2 = _mm256_cmpgt_epi32(c1600, edgeS2);
+    const __m256i smallDiff = _mm256_cmpgt_epi32(const10, _mm256_abs_epi32(_mm256_sub_epi32(a0, b0)));
+    __m256i simple = _mm256_and_si256(weak1, weak2);
+    simple = _mm256_or_si256(simple, _mm256_and_si256(smallDiff, _mm256_or_si256(weak1, weak2)));
+
+    const __m256i sum = _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(am, a0), _mm256_add_epi32(ap, bm)), _mm256_add_epi32(b0, bp)), bitshift_to_8);
+    const __m256i sumsq = _mm256_add_epi32(
+      _mm256_add_epi32(_mm256_add_epi32(elaSquare_AVX2<bitshift_to_8>(am), elaSquare_AVX2<bitshift_to_8>(a0)), _mm256_add_epi32(elaSquare_AVX2<bitshift_to_8>(ap), elaSquare_AVX2<bitshift_to_8>(bm))),
+      _mm256_add_epi32(elaSquare_AVX2<bitshift_to_8>(b0), elaSquare_AVX2<bitshift_to_8>(bp)));
+    const __m256i sumsq6 = _mm256_add_epi32(_mm256_slli_epi32(sumsq, 2), _mm256_slli_epi32(sumsq, 1));
+    simple = _mm256_or_si256(simple, _mm256_cmpgt_epi32(c432, _mm256_sub_epi32(sumsq6, _mm256_mullo_epi32(sum, sum))));
+
+    const __m256i easy = _mm256_and_si256(simple, active);
+    const int hard = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_andnot_si256(simple, active)));
+
+    // 32 bit lanes back to pixels, the packs work within 128 bit lanes
+    const __m256i avg = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(a0, b0), one), 1);
+    const __m128i avg16 = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi32(avg, avg), 0x08));
+    const __m128i easy16 = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packs_epi32(easy, easy), 0x08));
+    if constexpr (sizeof(pixel_t) == 1)
+    {
+      const __m128i old = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(dstp + x));
+      const __m128i res = _mm_blendv_epi8(old, _mm_packus_epi16(avg16, avg16), _mm_packs_epi16(easy16, easy16));
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(dstp + x), res);
+    }
+    else
+    {
+      const __m128i old = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dstp + x));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dstp + x), _mm_blendv_epi8(old, avg16, easy16));
+    }
+
+    if (hard)
+    {
+      alignas(32) int iy1[8], iy2[8], ix1[8], ix2[8], e1[8], e2[8];
+      _mm256_store_si256(reinterpret_cast<__m256i *>(iy1), Iy1);
+      _mm256_store_si256(reinterpret_cast<__m256i *>(iy2), Iy2);
+      _mm256_store_si256(reinterpret_cast<__m256i *>(ix1), Ix1);
+      _mm256_store_si256(reinterpret_cast<__m256i *>(ix2), Ix2);
+      _mm256_store_si256(reinterpret_cast<__m256i *>(e1), edgeS1);
+      _mm256_store_si256(reinterpret_cast<__m256i *>(e2), edgeS2);
+      for (int i = 0; i < 8; ++i)
+      {
+        if (hard & (1 << i))
+          dstp[x + i] = elaDirection<pixel_t, bits_per_pixel>(srcppp, srcpp, srcp, srcpn, x + i, iy1[i], iy2[i], ix1[i], ix2[i], e1[i], e2[i]);
+      }
+    }
+  }
+  elaDeintRow_C<pixel_t, bits_per_pixel>(srcppp, srcpp, srcp, srcpn, dstp, maskp, x, xstop);
+}
+
+// instantiate, the benchmark calls the kernels directly
+template void elaDeintRow_C<uint8_t, 8>(const uint8_t* srcppp, const uint8_t* srcpp, const uint8_t* srcp, const uint8_t* srcpn,
+  uint8_t* dstp, const uint8_t* maskp, int xstart, int xstop);
+template void elaDeintRow_AVX2<uint8_t, 8>(const uint8_t* srcppp, const uint8_t* srcpp, const uint8_t* srcp, const uint8_t* srcpn,
+  uint8_t* dstp, const uint8_t* maskp, int xstart, int xstop);
+template void elaDeintRow_C<uint16_t, 10>(const uint16_t* srcppp, const uint16_t* srcpp, const uint16_t* srcp, const uint16_t* srcpn,
+  uint16_t* dstp, const uint8_t* maskp, int xstart, int xstop);
+template void elaDeintRow_AVX2<uint16_t, 10>(const uint16_t* srcppp, const uint16_t* srcpp, const uint16_t* srcp, const uint16_t* srcpn,
+  uint16_t* dstp, const uint8_t* maskp, int xstart, int xstop);
+template void elaDeintRow_C<uint16_t, 12>(const uint16_t* srcppp, const uint16_t* srcpp, const uint16_t* srcp, const uint16_t* srcpn,
+  uint16_t* dstp, const uint8_t* maskp, int xstart, int xstop);
+template void elaDeintRow_AVX2<uint16_t, 12>(const uint16_t* srcppp, const uint16_t* srcpp, const uint16_t* srcp, const uint16_t* srcpn,
+  uint16_t* dstp, const uint8_t* maskp, int xstart, int xstop);
+template void elaDeintRow_C<uint16_t, 14>(const uint16_t* srcppp, const uint16_t* srcpp, const uint16_t* srcp, const uint16_t* srcpn,
+  uint16_t* dstp, const uint8_t* maskp, int xstart, int xstop);
+template void elaDeintRow_AVX2<uint16_t, 14>(const uint16_t* srcppp, const uint16_t* srcpp, const uint16_t* srcp, const uint16_t* srcpn,
+  uint16_t* dstp, const uint8_t* maskp, int xstart, int xstop);
+template void elaDeintRow_C<uint16_t, 16>(const uint16_t* srcppp, const uint16_t* srcpp, const uint16_t* srcp, const uint16_t* srcpn,
+  uint16_t* dstp, const uint8_t* maskp, int xstart, int xstop);
+template void elaDeintRow_AVX2<uint16_t, 16>(const uint16_t* srcppp, const uint16_t* srcpp, const uint16_t* srcp, const uint16_t* srcpn,
+  uint16_t* dstp, const uint8_t* maskp, int xstart, int xstop);
+
 void TFMPP::elaDeint(VSFrameRef *dst, const VSFrameRef* mask, const VSFrameRef *src, bool nomask, int field) const
 {
     switch (vi->format->bitsPerSample) {
@@ -1203,232 +1890,43 @@ void TFMPP::elaDeintPlanar(VSFrameRef *dst, const VSFrameRef *mask, const VSFram
   const pixel_t *srcpppY = srcppY - src_pitchY;
   const pixel_t *srcpnY = srcpY + src_pitchY;
   const pixel_t *srcppV = srcpV - src_pitchUV;
-  const pixel_t *srcpppV = srcppV - src_pitchUV;
   const pixel_t *srcpnV = srcpV + src_pitchUV;
   const pixel_t *srcppU = srcpU - src_pitchUV;
-  const pixel_t *srcpppU = srcppU - src_pitchUV;
   const pixel_t *srcpnU = srcpU + src_pitchUV;
-  int stopx = WidthY;
-  int startxuv = 0;
   int x, y;
-  int stopxuv = WidthUV;
-  int Iy1, Iy2, Iye;
-  int Ix1, Ix2;
-  int edgeS1, edgeS2;
-  int sum, sumsq;
-  int temp, temp1, temp2;
-  int minN, maxN;
-  double dir1, dir2, dir, dirF;
 
-  constexpr int bitshift_to_8 = (bits_per_pixel - 8);
+  const bool use_avx2 = cpuFlags.avx2;
 
-  auto square = [](int i)
-  {
-    return i * i;
-  };
+  // the four leftmost and rightmost columns are not searched
+  const int xstart = std::min(4, WidthY);
+  const int xstop = std::max(WidthY - 4, 4);
 
   for (y = 2 - field; y < HeightY - 1; y += 2)
   {
-    for (x = 0; x < stopx; ++x)
+    const uint8_t *maskRow = nomask ? nullptr : maskpY;
+    if (y > 2 && y < HeightY - 3)
     {
-      if (nomask || maskpY[x] == 0xFF)
+      for (x = 0; x < xstart; ++x)
       {
-        if (y > 2 && y < HeightY - 3 && x>3 && x < WidthY - 4)
-        {
-          // stay in safe 32 bit int by using 8 bit normalized data
-          Iy1 = (-srcpY[x - 1] - srcpY[x] - srcpY[x] - srcpY[x + 1] + srcpppY[x - 1] + srcpppY[x] + srcpppY[x] + srcpppY[x + 1]) >> bitshift_to_8;
-          Iy2 = (-srcpnY[x - 1] - srcpnY[x] - srcpnY[x] - srcpnY[x + 1] + srcppY[x - 1] + srcppY[x] + srcppY[x] + srcppY[x + 1]) >> bitshift_to_8;
-          Ix1 = (srcpppY[x + 1] + srcppY[x + 1] + srcppY[x + 1] + srcpY[x + 1] - srcpppY[x - 1] - srcppY[x - 1] - srcppY[x - 1] - srcpY[x - 1]) >> bitshift_to_8;
-          Ix2 = (srcppY[x + 1] + srcpY[x + 1] + srcpY[x + 1] + srcpnY[x + 1] - srcppY[x - 1] - srcpY[x - 1] - srcpY[x - 1] - srcpnY[x - 1]) >> bitshift_to_8;
-          edgeS1 = Ix1 * Ix1 + Iy1 * Iy1;
-          edgeS2 = Ix2 * Ix2 + Iy2 * Iy2;
-          if (edgeS1 < 1600 && edgeS2 < 1600)
-          {
-            dstpY[x] = (srcppY[x] + srcpY[x] + 1) >> 1;
-            continue;
-          }
-          constexpr int Const10 = 10 << bitshift_to_8;
-          if (abs(srcppY[x] - srcpY[x]) < Const10 && (edgeS1 < 1600 || edgeS2 < 1600))
-          {
-            dstpY[x] = (srcppY[x] + srcpY[x] + 1) >> 1;
-            continue;
-          }
-          // stay in safe 32 bit int by using 8 bit normalized data
-          sum = (srcppY[x - 1] + srcppY[x] + srcppY[x + 1] + srcpY[x - 1] + srcpY[x] + srcpY[x + 1]) >> bitshift_to_8;
-          sumsq =
-            square(srcppY[x - 1] >> bitshift_to_8) +
-            square(srcppY[x] >> bitshift_to_8) +
-            square(srcppY[x + 1] >> bitshift_to_8) +
-            square(srcpY[x - 1] >> bitshift_to_8) +
-            square(srcpY[x] >> bitshift_to_8) +
-            square(srcpY[x + 1] >> bitshift_to_8);
-          if (6 * sumsq - square(sum) < 432)
-          {
-            dstpY[x] = (srcppY[x] + srcpY[x] + 1) >> 1;
-            continue;
-          }
-          if (Ix1 == 0) dir1 = 3.1415926;
-          else
-          {
-            dir1 = atan(Iy1 / (Ix1*2.0f)) + 1.5707963;
-            if (Iy1 >= 0) { if (Ix1 < 0) dir1 += 3.1415927; }
-            else { if (Ix1 >= 0) dir1 += 3.1415927; }
-            if (dir1 >= 3.1415927) dir1 -= 3.1415927;
-          }
-          if (Ix2 == 0) dir2 = 3.1415926;
-          else
-          {
-            dir2 = atan(Iy2 / (Ix2*2.0f)) + 1.5707963;
-            if (Iy2 >= 0) { if (Ix2 < 0) dir2 += 3.1415927; }
-            else { if (Ix2 >= 0) dir2 += 3.1415927; }
-            if (dir2 >= 3.1415927) dir2 -= 3.1415927;
-          }
-          if (fabs(dir1 - dir2) < 0.5)
-          {
-            if (edgeS1 >= 3600 && edgeS2 >= 3600) dir = (dir1 + dir2) * 0.5;
-            else dir = edgeS1 >= edgeS2 ? dir1 : dir2;
-          }
-          else
-          {
-            if (edgeS1 >= 5000 && edgeS2 >= 5000)
-            {
-              // stay in safe 32 bit int by using 8 bit normalized data
-              Iye = (-srcpY[x - 1] - srcpY[x] - srcpY[x] - srcpY[x + 1] + srcppY[x - 1] + srcppY[x] + srcppY[x] + srcppY[x + 1]) >> bitshift_to_8;
-              if ((Iy1*Iye > 0) && (Iy2*Iye < 0)) dir = dir1;
-              else if ((Iy1*Iye < 0) && (Iy2*Iye > 0)) dir = dir2;
-              else
-              {
-                if (abs(Iye - Iy1) <= abs(Iye - Iy2)) dir = dir1;
-                else dir = dir2;
-              }
-            }
-            else dir = edgeS1 >= edgeS2 ? dir1 : dir2;
-          }
-          dirF = 0.5f / tan(dir);
-          if (dirF >= 0.0f)
-          {
-            if (dirF >= 0.5f)
-            {
-              if (dirF >= 1.0f)
-              {
-                if (dirF >= 1.5f)
-                {
-                  if (dirF >= 2.0f)
-                  {
-                    if (dirF <= 2.50f)
-                    {
-                      temp1 = srcppY[x + 4];
-                      temp2 = srcpY[x - 4];
-                      temp = (srcppY[x + 4] + srcpY[x - 4] + 1) >> 1;
-                    }
-                    else
-                    {
-                      temp1 = temp2 = srcpY[x];
-                      temp = cubicInt<bits_per_pixel>(srcpppY[x], srcppY[x], srcpY[x], srcpnY[x]);
-                    }
-                  }
-                  else
-                  {
-                    temp1 = (int)((dirF - 1.5f)*(srcppY[x + 4]) + (2.0f - dirF)*(srcppY[x + 3]) + 0.5f);
-                    temp2 = (int)((dirF - 1.5f)*(srcpY[x - 4]) + (2.0f - dirF)*(srcpY[x - 3]) + 0.5f);
-                    temp = (int)((dirF - 1.5f)*(srcppY[x + 4] + srcpY[x - 4]) + (2.0f - dirF)*(srcppY[x + 3] + srcpY[x - 3]) + 0.5f);
-                  }
-                }
-                else
-                {
-                  temp1 = (int)((dirF - 1.0f)*(srcppY[x + 3]) + (1.5f - dirF)*(srcppY[x + 2]) + 0.5f);
-                  temp2 = (int)((dirF - 1.0f)*(srcpY[x - 3]) + (1.5f - dirF)*(srcpY[x - 2]) + 0.5f);
-                  temp = (int)((dirF - 1.0f)*(srcppY[x + 3] + srcpY[x - 3]) + (1.5f - dirF)*(srcppY[x + 2] + srcpY[x - 2]) + 0.5f);
-                }
-              }
-              else
-              {
-                temp1 = (int)((dirF - 0.5f)*(srcppY[x + 2]) + (1.0f - dirF)*(srcppY[x + 1]) + 0.5f);
-                temp2 = (int)((dirF - 0.5f)*(srcpY[x - 2]) + (1.0f - dirF)*(srcpY[x - 1]) + 0.5f);
-                temp = (int)((dirF - 0.5f)*(srcppY[x + 2] + srcpY[x - 2]) + (1.0f - dirF)*(srcppY[x + 1] + srcpY[x - 1]) + 0.5f);
-              }
-            }
-            else
-            {
-              temp1 = (int)(dirF*(srcppY[x + 1]) + (0.5f - dirF)*(srcppY[x]) + 0.5f);
-              temp2 = (int)(dirF*(srcpY[x - 1]) + (0.5f - dirF)*(srcpY[x]) + 0.5f);
-              temp = (int)(dirF*(srcppY[x + 1] + srcpY[x - 1]) + (0.5f - dirF)*(srcppY[x] + srcpY[x]) + 0.5f);
-            }
-          }
-          else
-          {
-            if (dirF <= -0.5f)
-            {
-              if (dirF <= -1.0f)
-              {
-                if (dirF <= -1.5f)
-                {
-                  if (dirF <= -2.0f)
-                  {
-                    if (dirF >= -2.50f)
-                    {
-                      temp1 = srcppY[x - 4];
-                      temp2 = srcpY[x + 4];
-                      temp = (srcppY[x - 4] + srcpY[x + 4] + 1) >> 1;
-                    }
-                    else
-                    {
-                      temp1 = temp2 = srcpY[x];
-                      temp = cubicInt<bits_per_pixel>(srcpppY[x], srcppY[x], srcpY[x], srcpnY[x]);
-                    }
-                  }
-                  else
-                  {
-                    temp1 = (int)((-dirF - 1.5f)*(srcppY[x - 4]) + (2.0f + dirF)*(srcppY[x - 3]) + 0.5f);
-                    temp2 = (int)((-dirF - 1.5f)*(srcpY[x + 4]) + (2.0f + dirF)*(srcpY[x + 3]) + 0.5f);
-                    temp = (int)((-dirF - 1.5f)*(srcppY[x - 4] + srcpY[x + 4]) + (2.0f + dirF)*(srcppY[x - 3] + srcpY[x + 3]) + 0.5f);
-                  }
-                }
-                else
-                {
-                  temp1 = (int)((-dirF - 1.0f)*(srcppY[x - 3]) + (1.5f + dirF)*(srcppY[x - 2]) + 0.5f);
-                  temp2 = (int)((-dirF - 1.0f)*(srcpY[x + 3]) + (1.5f + dirF)*(srcpY[x + 2]) + 0.5f);
-                  temp = (int)((-dirF - 1.0f)*(srcppY[x - 3] + srcpY[x + 3]) + (1.5f + dirF)*(srcppY[x - 2] + srcpY[x + 2]) + 0.5f);
-                }
-              }
-              else
-              {
-                temp1 = (int)((-dirF - 0.5f)*(srcppY[x - 2]) + (1.0f + dirF)*(srcppY[x - 1]) + 0.5f);
-                temp2 = (int)((-dirF - 0.5f)*(srcpY[x + 2]) + (1.0f + dirF)*(srcpY[x + 1]) + 0.5f);
-                temp = (int)((-dirF - 0.5f)*(srcppY[x - 2] + srcpY[x + 2]) + (1.0f + dirF)*(srcppY[x - 1] + srcpY[x + 1]) + 0.5f);
-              }
-            }
-            else
-            {
-              temp1 = (int)((-dirF)*(srcppY[x - 1]) + (0.5f + dirF)*(srcppY[x]) + 0.5f);
-              temp2 = (int)((-dirF)*(srcpY[x + 1]) + (0.5f + dirF)*(srcpY[x]) + 0.5f);
-              temp = (int)((-dirF)*(srcppY[x - 1] + srcpY[x + 1]) + (0.5f + dirF)*(srcppY[x] + srcpY[x]) + 0.5f);
-            }
-          }
-
-          constexpr int Const20 = 20 << bitshift_to_8;
-          constexpr int Const25 = 25 << bitshift_to_8;
-          constexpr int Const60 = 60 << bitshift_to_8;
-
-          minN = std::min(srcppY[x], srcpY[x]) - Const25;
-          maxN = std::max(srcppY[x], srcpY[x]) + Const25;
-          if (abs(temp1 - temp2) > Const20 || abs(srcppY[x] + srcpY[x] - temp - temp) > Const60 || temp < minN || temp > maxN)
-          {
-            temp = cubicInt<bits_per_pixel>(srcpppY[x], srcppY[x], srcpY[x], srcpnY[x]);
-          }
-          else {
-            // clamp to valid. cubicint clamps O.K.
-            constexpr int max_pixel_value = (1 << bits_per_pixel) - 1;
-            if (temp > max_pixel_value) temp = max_pixel_value;
-            else if (temp < 0) temp = 0;
-          }
-          dstpY[x] = temp;
-        }
-        else
-        {
-          if (y<3 || y>HeightY - 4) dstpY[x] = ((srcpY[x] + srcppY[x] + 1) >> 1);
-          else dstpY[x] = cubicInt<bits_per_pixel>(srcpppY[x], srcppY[x], srcpY[x], srcpnY[x]);
-        }
+        if (nomask || maskpY[x] == 0xFF)
+          dstpY[x] = cubicInt<bits_per_pixel>(srcpppY[x], srcppY[x], srcpY[x], srcpnY[x]);
+      }
+      if (use_avx2)
+        elaDeintRow_AVX2<pixel_t, bits_per_pixel>(srcpppY, srcppY, srcpY, srcpnY, dstpY, maskRow, xstart, xstop);
+      else
+        elaDeintRow_C<pixel_t, bits_per_pixel>(srcpppY, srcppY, srcpY, srcpnY, dstpY, maskRow, xstart, xstop);
+      for (x = xstop; x < WidthY; ++x)
+      {
+        if (nomask || maskpY[x] == 0xFF)
+          dstpY[x] = cubicInt<bits_per_pixel>(srcpppY[x], srcppY[x], srcpY[x], srcpnY[x]);
+      }
+    }
+    else
+    {
+      for (x = 0; x < WidthY; ++x)
+      {
+        if (nomask || maskpY[x] == 0xFF)
+          dstpY[x] = ((srcpY[x] + srcppY[x] + 1) >> 1);
       }
     }
     srcpppY = srcppY;
@@ -1438,26 +1936,34 @@ void TFMPP::elaDeintPlanar(VSFrameRef *dst, const VSFrameRef *mask, const VSFram
     maskpY += mask_pitchY;
     dstpY += dst_pitchY;
   }
+
+  // Chroma is not searched, the middle rows are cubic interpolated like in
+  // CubicDeint. Unmasked pixels are rewritten from src, which dst is a copy of.
   for (y = 2 - field; y < HeightUV - 1; y += 2)
   {
-    for (x = startxuv; x < stopxuv; ++x)
+    if (y<3 || y>HeightUV - 4)
     {
-      if (nomask || maskpV[x] == 0xFF)
+      for (x = 0; x < WidthUV; ++x)
       {
-        if (y<3 || y>HeightUV - 4) dstpV[x] = ((srcpV[x] + srcppV[x] + 1) >> 1);
-        else dstpV[x] = cubicInt<bits_per_pixel>(srcpppV[x], srcppV[x], srcpV[x], srcpnV[x]);
-      }
-      if (nomask || maskpU[x] == 0xFF)
-      {
-        if (y<3 || y>HeightUV - 4) dstpU[x] = ((srcpU[x] + srcppU[x] + 1) >> 1);
-        else dstpU[x] = cubicInt<bits_per_pixel>(srcpppU[x], srcppU[x], srcpU[x], srcpnU[x]);
+        if (nomask || maskpV[x] == 0xFF)
+          dstpV[x] = ((srcpV[x] + srcppV[x] + 1) >> 1);
+        if (nomask || maskpU[x] == 0xFF)
+          dstpU[x] = ((srcpU[x] + srcppU[x] + 1) >> 1);
       }
     }
-    srcpppV = srcppV;
+    else if (nomask)
+    {
+      cubicDeintMask<pixel_t, bits_per_pixel, false>(cpuFlags, srcpV, dstpV, nullptr, src_pitchUV, dst_pitchUV, 0, WidthUV, 1);
+      cubicDeintMask<pixel_t, bits_per_pixel, false>(cpuFlags, srcpU, dstpU, nullptr, src_pitchUV, dst_pitchUV, 0, WidthUV, 1);
+    }
+    else
+    {
+      cubicDeintMask<pixel_t, bits_per_pixel, true>(cpuFlags, srcpV, dstpV, maskpV, src_pitchUV, dst_pitchUV, mask_pitchUV, WidthUV, 1);
+      cubicDeintMask<pixel_t, bits_per_pixel, true>(cpuFlags, srcpU, dstpU, maskpU, src_pitchUV, dst_pitchUV, mask_pitchUV, WidthUV, 1);
+    }
     srcppV = srcpV;
     srcpV = srcpnV;
     srcpnV += src_pitchUV;
-    srcpppU = srcppU;
     srcppU = srcpU;
     srcpU = srcpnU;
     srcpnU += src_pitchUV;
@@ -1698,6 +2204,7 @@ void TFMPP::maskClip2(const VSFrameRef *src, const VSFrameRef *deint, const VSFr
 {
   const bool use_sse2 = cpuFlags.sse2;
   const bool use_sse4 = cpuFlags.sse4_1;
+  const bool use_avx2 = cpuFlags.avx2;
 
   const uint8_t *srcp, *maskp, *dntp;
   uint8_t *dstp;
@@ -1727,7 +2234,9 @@ void TFMPP::maskClip2(const VSFrameRef *src, const VSFrameRef *deint, const VSFr
     maskClip2_fn_t* maskClip2_fn;
 
     if (pixelsize == 1) {
-      if (use_sse4)
+      if (use_avx2)
+        maskClip2_fn = maskClip2_AVX2<uint8_t>;
+      else if (use_sse4)
         maskClip2_fn = maskClip2_SSE4<uint8_t>;
       else if (use_sse2)
         maskClip2_fn = maskClip2_SSE2;
@@ -1735,7 +2244,9 @@ void TFMPP::maskClip2(const VSFrameRef *src, const VSFrameRef *deint, const VSFr
         maskClip2_fn = maskClip2_C<uint8_t>;
     }
     else if (pixelsize == 2) {
-      if (use_sse4)
+      if (use_avx2)
+        maskClip2_fn = maskClip2_AVX2<uint16_t>;
+      else if (use_sse4)
         maskClip2_fn = maskClip2_SSE4<uint16_t>;
       else
         maskClip2_fn = maskClip2_C<uint16_t>;
@@ -1799,6 +2310,54 @@ void maskClip2_SSE4(const uint8_t* srcp, const uint8_t* dntp,
   }
 }
 
+template<typename pixel_t>
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void maskClip2_AVX2(const uint8_t* srcp, const uint8_t* dntp,
+  const uint8_t* maskp, uint8_t* dstp, int src_pitch, int dnt_pitch,
+  int msk_pitch, int dst_pitch, int width, int height)
+{
+  // mask is always 8 bits 0x00 or 0xFF
+  while (height--) {
+    for (int x = 0; x < width; x += 32 / sizeof(pixel_t)) {
+      __m256i mask;
+      if constexpr (sizeof(pixel_t) == 1)
+        mask = _mm256_load_si256(reinterpret_cast<const __m256i*>(maskp + x));
+      else
+        mask = _mm256_cvtepi8_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(maskp + x))); // keep FF to FFFF
+      auto dnt = _mm256_load_si256(reinterpret_cast<const __m256i*>(dntp + x * sizeof(pixel_t)));
+      auto src = _mm256_load_si256(reinterpret_cast<const __m256i*>(srcp + x * sizeof(pixel_t)));
+      auto res = _mm256_blendv_epi8(src, dnt, mask);
+      _mm256_store_si256(reinterpret_cast<__m256i*>(dstp + x * sizeof(pixel_t)), res);
+    }
+    srcp += src_pitch;
+    dntp += dnt_pitch;
+    dstp += dst_pitch;
+    maskp += msk_pitch;
+  }
+}
+
+// instantiate
+template void maskClip2_C<uint8_t>(const uint8_t* srcp, const uint8_t* dntp,
+  const uint8_t* maskp, uint8_t* dstp, int src_pitch, int dnt_pitch,
+  int msk_pitch, int dst_pitch, int width, int height);
+template void maskClip2_C<uint16_t>(const uint8_t* srcp, const uint8_t* dntp,
+  const uint8_t* maskp, uint8_t* dstp, int src_pitch, int dnt_pitch,
+  int msk_pitch, int dst_pitch, int width, int height);
+template void maskClip2_SSE4<uint8_t>(const uint8_t* srcp, const uint8_t* dntp,
+  const uint8_t* maskp, uint8_t* dstp, int src_pitch, int dnt_pitch,
+  int msk_pitch, int dst_pitch, int width, int height);
+template void maskClip2_SSE4<uint16_t>(const uint8_t* srcp, const uint8_t* dntp,
+  const uint8_t* maskp, uint8_t* dstp, int src_pitch, int dnt_pitch,
+  int msk_pitch, int dst_pitch, int width, int height);
+template void maskClip2_AVX2<uint8_t>(const uint8_t* srcp, const uint8_t* dntp,
+  const uint8_t* maskp, uint8_t* dstp, int src_pitch, int dnt_pitch,
+  int msk_pitch, int dst_pitch, int width, int height);
+template void maskClip2_AVX2<uint16_t>(const uint8_t* srcp, const uint8_t* dntp,
+  const uint8_t* maskp, uint8_t* dstp, int src_pitch, int dnt_pitch,
+  int msk_pitch, int dst_pitch, int width, int height);
+
 // 8 bit only
 void maskClip2_SSE2(const uint8_t *srcp, const uint8_t *dntp,
   const uint8_t *maskp, uint8_t *dstp, int src_pitch, int dnt_pitch,
@@ -1825,15 +2384,13 @@ void maskClip2_SSE2(const uint8_t *srcp, const uint8_t *dntp,
 
 
 TFMPP::TFMPP(VSNodeRef *_child, int _PP, int _mthresh, const char* _ovr, bool _display,
-  VSNodeRef *_clip2, bool _usehints, int _opt, const VSAPI *_vsapi, VSCore *core)
+  VSNodeRef *_clip2, bool _usehints, int _opt, bool _debug, const VSAPI *_vsapi)
     : vsapi(_vsapi), child(_child),
-  PP(_PP), mthresh(_mthresh), ovr(_ovr), display(_display), clip2(_clip2),
-  usehints(_usehints), opt(_opt)
+  ovr(_ovr), display(_display), clip2(_clip2),
+  usehints(_usehints), opt(_opt), debug(_debug), PP_origSaved(_PP), mthresh_origSaved(_mthresh)
 {
     vi = vsapi->getVideoInfo(child);
 
-  mmask = nullptr;
-
   int w, i, z, b, q, countOvrS;
   char linein[1024], *linep, *linet;
   std::unique_ptr<FILE, decltype (&fclose)> f(nullptr, nullptr);
@@ -1849,7 +2406,7 @@ TFMPP::TFMPP(VSNodeRef *_child, int _PP, int _mthresh, const char* _ovr, bool _d
     throw TIVTCError("TFMPP:  YUV data only!");
   if (vi->height & 1 || vi->width & 1)
     throw TIVTCError("TFMPP:  height and width must be divisible by 2!");
-  if (PP < 2 || PP > 7)
+  if (PP_origSaved < 2 || PP_origSaved > 7)
     throw TIVTCError("TFMPP:  PP must be set to 2, 3, 4, 5, 6, or 7!");
   if (opt < 0 || opt > 4)
     throw TIVTCError("TFMPP:  opt must be set to 0, 1, 2, 3, or 4!");
@@ -1875,8 +2432,6 @@ TFMPP::TFMPP(VSNodeRef *_child, int _PP, int _mthresh, const char* _ovr, bool _d
 
 
   nfrms = vi->numFrames - 1;
-  PP_origSaved = PP;
-  mthresh_origSaved = mthresh;
   i = 0;
   if (ovr.size())
   {
@@ -1892,7 +2447,7 @@ TFMPP::TFMPP(VSNodeRef *_child, int _PP, int _mthresh, const char* _ovr, bool _d
         if (*linep != 0) ++countOvrS;
       }
 
-      if (countOvrS == 0) { goto emptyovrFM; }
+      if (countOvrS == 0) { return; }
       ++countOvrS;
       countOvrS *= 4;
       setArray.resize(countOvrS, 0xffffffff);
@@ -1994,14 +2549,10 @@ TFMPP::TFMPP(VSNodeRef *_child, int _PP, int _mthresh, const char* _ovr, bool _d
         throw TIVTCError("TFMPP:  ovr input error (could not open ovr file)!");
     }
   }
-emptyovrFM:
-  mmask = vsapi->newVideoFrame(vi->format, vi->width, vi->height, nullptr, core);
 }
 
 TFMPP::~TFMPP()
 {
-  if (mmask) vsapi->freeFrame(mmask);
-
   vsapi->freeNode(child);
   vsapi->freeNode(clip2);
 }
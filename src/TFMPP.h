@@ -28,6 +28,8 @@
 #include <math.h>
 #include <VapourSynth.h>
 #include "cpufeatures.h"
+#include "ScratchPool.h"
+#include "Font.h"
 #ifdef VERSION
 #undef VERSION
 #endif
@@ -50,11 +52,27 @@ void maskClip2_SSE4(const uint8_t* srcp, const uint8_t* dntp,
   const uint8_t* maskp, uint8_t* dstp, int src_pitch, int dnt_pitch,
   int msk_pitch, int dst_pitch, int width, int height);
 
+template<typename pixel_t>
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void maskClip2_AVX2(const uint8_t* srcp, const uint8_t* dntp,
+  const uint8_t* maskp, uint8_t* dstp, int src_pitch, int dnt_pitch,
+  int msk_pitch, int dst_pitch, int width, int height);
+
 template<bool with_mask>
 void blendDeintMask_SSE2(const uint8_t* srcp, uint8_t* dstp,
   const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
   int width, int height);
 
+template<typename pixel_t, bool with_mask>
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void blendDeintMask_AVX2(const pixel_t* srcp, pixel_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height);
+
 template<typename pixel_t, bool with_mask>
 void blendDeintMask_C(const pixel_t* srcp, pixel_t* dstp,
   const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
@@ -65,11 +83,46 @@ void cubicDeintMask_SSE2(const uint8_t* srcp, uint8_t* dstp,
   const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
   int width, int height);
 
+template<int bits_per_pixel, bool with_mask>
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("sse4.1")))
+#endif
+void cubicDeintMask_uint16_SSE4(const uint16_t* srcp, uint16_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height);
+
+template<int bits_per_pixel, bool with_mask>
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void cubicDeintMask_uint16_AVX2(const uint16_t* srcp, uint16_t* dstp,
+  const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
+  int width, int height);
+
 template<typename pixel_t, int bits_per_pixel, bool with_mask>
 void cubicDeintMask_C(const pixel_t* srcp, pixel_t* dstp,
   const uint8_t* maskp, int src_pitch, int dst_pitch, int msk_pitch,
   int width, int height);
 
+template<typename pixel_t, int bits_per_pixel>
+void elaDeintRow_C(const pixel_t* srcppp, const pixel_t* srcpp, const pixel_t* srcp, const pixel_t* srcpn,
+  pixel_t* dstp, const uint8_t* maskp, int xstart, int xstop);
+
+template<typename pixel_t, int bits_per_pixel>
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void elaDeintRow_AVX2(const pixel_t* srcppp, const pixel_t* srcpp, const pixel_t* srcp, const pixel_t* srcpn,
+  pixel_t* dstp, const uint8_t* maskp, int xstart, int xstop);
+
+// working buffers of one TFMPP::GetFrame call
+struct TFMPPScratch {
+  std::unique_ptr<VSFrameRef, decltype (VSAPI::freeFrame)> mmask;
+  size_t bytes; // size of the buffers above
+
+  TFMPPScratch() : mmask(nullptr, nullptr) {}
+};
+
 class TFMPP
 {
 private:
@@ -78,24 +131,27 @@ private:
 
   CPUFeatures cpuFlags;
 
-  int PP, mthresh;
   std::string ovr;
   bool display;
   VSNodeRef *clip2;
   bool usehints;
   int opt;
+  bool debug;
   bool uC2; // use clip2
   int PP_origSaved;
   int mthresh_origSaved;
   int nfrms;
   std::vector<int> setArray;
-  VSFrameRef *mmask;
+  ScratchPool<TFMPPScratch> scratch;
+
+  std::unique_ptr<TFMPPScratch> createScratch(VSCore *core) const;
+  void putScratchProperties(VSFrameRef *dst, const TFMPPScratch &used);
 
   void buildMotionMask(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt,
-    VSFrameRef *mask, int use) const;
+    VSFrameRef *mask, int use, int mthresh) const;
   template<typename pixel_t>
   void buildMotionMask_core(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt,
-    VSFrameRef* mask, int use) const;
+    VSFrameRef* mask, int use, int mthresh) const;
   void maskClip2(const VSFrameRef *src, const VSFrameRef *deint, const VSFrameRef *mask,
     VSFrameRef *dst) const;
 
@@ -106,7 +162,7 @@ private:
 //  template<typename pixel_t>
 //  bool getHint_core(const VSFrameRef *src, int& field, bool& combed, unsigned int& hint);
 
-  void getSetOvr(int n);
+  void getSetOvr(int n, int &PP, int &mthresh) const;
 
 //  void denoiseYUY2(VSFrameRef *mask);
   void denoisePlanar(VSFrameRef *mask) const;
@@ -139,18 +195,18 @@ private:
 
   void copyField(VSFrameRef *dst, const VSFrameRef *src, int field) const;
   void buildMotionMask1_SSE2(const uint8_t *srcp1, const uint8_t *srcp2,
-    uint8_t *dstp, int s1_pitch, int s2_pitch, int dst_pitch, int width, int height, const CPUFeatures *cpu) const;
+    uint8_t *dstp, int s1_pitch, int s2_pitch, int dst_pitch, int width, int height, int mthresh, const CPUFeatures *cpu) const;
   void buildMotionMask2_SSE2(const uint8_t *srcp1, const uint8_t *srcp2,
     const uint8_t *srcp3, uint8_t *dstp, int s1_pitch, int s2_pitch,
-    int s3_pitch, int dst_pitch, int width, int height, const CPUFeatures *cpu) const;
+    int s3_pitch, int dst_pitch, int width, int height, int mthresh, const CPUFeatures *cpu) const;
 
-  void writeDisplay(VSFrameRef *dst, int n, int field) const;
+  void writeDisplay(VSFrameRef *dst, int n, int field, int PP, int mthresh) const;
 
 public:
   const VSVideoInfo *vi;
 
   const VSFrameRef *GetFrame(int n, int activationReason, VSFrameContext *frameCtx, VSCore *core);
   TFMPP(VSNodeRef *_child, int _PP, int _mthresh, const char* _ovr, bool _display, VSNodeRef *_clip2,
-    bool _usehints, int _opt, const VSAPI *_vsapi, VSCore *core);
+    bool _usehints, int _opt, bool _debug, const VSAPI *_vsapi);
   ~TFMPP();
 };
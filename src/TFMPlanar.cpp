@@ -28,6 +28,7 @@
 #include "TFMasm.h"
 #include "TCommonASM.h"
 #include <algorithm>
+#include <vector>
 
 
 template<int planarType>
@@ -49,71 +50,69 @@ template void FillCombedPlanarUpdateCmaskByUV<420>(VSFrameRef* cmask, const VSAP
 template void FillCombedPlanarUpdateCmaskByUV<422>(VSFrameRef* cmask, const VSAPI *vsapi);
 template void FillCombedPlanarUpdateCmaskByUV<444>(VSFrameRef* cmask, const VSAPI *vsapi);
 
-//FIXME: once to make it common with TDeInterlace::CheckedCombedPlanar
-//similar, but cmask is real PVideoFrame there
+// Row y of the checked frame is rows[y]. Even rows come from srcEven and odd
+// rows from srcOdd, so passing the two frames of a field match checks their
+// weave without building it; a plain frame is checked by passing it twice.
 template<typename pixel_t>
-void checkCombedPlanarAnalyze_core(const VSVideoInfo *vi, int cthresh, bool chroma, const CPUFeatures *cpuFlags, int metric, const VSFrameRef *src, VSFrameRef* cmask, const VSAPI *vsapi)
+static void buildWeaveRows(std::vector<const pixel_t*> &rows, const VSFrameRef *srcEven, const VSFrameRef *srcOdd, int plane, const VSAPI *vsapi)
 {
-  const int bits_per_pixel = vi->format->bitsPerSample;
+  const pixel_t* srcpEven = reinterpret_cast<const pixel_t*>(vsapi->getReadPtr(srcEven, plane));
+  const pixel_t* srcpOdd = reinterpret_cast<const pixel_t*>(vsapi->getReadPtr(srcOdd, plane));
+  const int src_pitch_even = vsapi->getStride(srcEven, plane) / sizeof(pixel_t);
+  const int src_pitch_odd = vsapi->getStride(srcOdd, plane) / sizeof(pixel_t);
+  const int Height = vsapi->getFrameHeight(srcEven, plane);
+
+  rows.resize(Height);
+  for (int y = 0; y < Height; ++y)
+    rows[y] = (y & 1) ? srcpOdd + y * src_pitch_odd : srcpEven + y * src_pitch_even;
+}
 
+// Fills mask rows ystart to ystop-1 of one plane, cmkp points to mask row 0.
+// Any row range gives the same mask as doing the whole plane at once.
+template<typename pixel_t>
+static void checkCombedPlaneRows(const pixel_t* const* rows, uint8_t* cmkp, int cmk_pitch, int Width, int Height,
+  int ystart, int ystop, int scaled_cthresh, int metric, const CPUFeatures *cpuFlags)
+{
   const bool use_sse2 = cpuFlags->sse2;
   const bool use_sse4 = cpuFlags->sse4_1;
-  // cthresh: Area combing threshold used for combed frame detection.
-  // This essentially controls how "strong" or "visible" combing must be to be detected.
-  // Good values are from 6 to 12. If you know your source has a lot of combed frames set 
-  // this towards the low end(6 - 7). If you know your source has very few combed frames set 
-  // this higher(10 - 12). Going much lower than 5 to 6 or much higher than 12 is not recommended.
-
-  const int scaled_cthresh = cthresh << (bits_per_pixel - 8);
+  const bool use_avx2 = cpuFlags->avx2;
 
   const int cthresh6 = scaled_cthresh * 6;
 
-  const int np = vi->format->numPlanes;
-  const int stop = chroma ? np : 1;
+  memset(cmkp + ystart * cmk_pitch, 0, (ystop - ystart) * cmk_pitch);
 
-  for (int b = 0; b < stop; ++b)
+  if (metric == 0)
   {
-    const int plane = b;
-
-    const pixel_t* srcp = reinterpret_cast<const pixel_t*>(vsapi->getReadPtr(src, plane));
-    const int src_pitch = vsapi->getStride(src, plane) / sizeof(pixel_t);
-
-    const int Width = vsapi->getFrameWidth(src, plane);
-    const int Height = vsapi->getFrameHeight(src, plane);
-
-    const pixel_t* srcpp = srcp - src_pitch;
-    const pixel_t* srcppp = srcpp - src_pitch;
-    const pixel_t* srcpn = srcp + src_pitch;
-    const pixel_t* srcpnn = srcpn + src_pitch;
-
-    uint8_t* cmkp = vsapi->getWritePtr(cmask, b);
-    const int cmk_pitch = vsapi->getStride(cmask, b);
-
-    if (scaled_cthresh < 0) {
-      memset(cmkp, 255, Height * cmk_pitch); // mask. Always 8 bits 
-      continue;
-    }
-    memset(cmkp, 0, Height * cmk_pitch);
-
-    if (metric == 0)
+    const pixel_t* srcppp;
+    const pixel_t* srcpp;
+    const pixel_t* srcp;
+    const pixel_t* srcpn;
+    const pixel_t* srcpnn;
+    // top 1 
+    if (ystart == 0)
     {
-      // top 1 
+      uint8_t* cmkpt = cmkp;
+      srcp = rows[0];
+      srcpn = rows[1];
+      srcpnn = rows[2];
       for (int x = 0; x < Width; ++x)
       {
         const int sFirst = srcp[x] - srcpn[x];
         if (sFirst > scaled_cthresh || sFirst < -scaled_cthresh)
         {
           if (abs(srcpnn[x] + (srcp[x] << 2) + srcpnn[x] - (3 * (srcpn[x] + srcpn[x]))) > cthresh6)
-            cmkp[x] = 0xFF;
+            cmkpt[x] = 0xFF;
         }
       }
-      srcppp += src_pitch;
-      srcpp += src_pitch;
-      srcp += src_pitch;
-      srcpn += src_pitch;
-      srcpnn += src_pitch;
-      cmkp += cmk_pitch;
-      // top #2
+    }
+    // top #2
+    if (ystart <= 1 && ystop > 1)
+    {
+      uint8_t* cmkpt = cmkp + cmk_pitch;
+      srcpp = rows[0];
+      srcp = rows[1];
+      srcpn = rows[2];
+      srcpnn = rows[3];
       for (int x = 0; x < Width; ++x)
       {
         const int sFirst = srcp[x] - srcpp[x];
@@ -121,30 +120,36 @@ void checkCombedPlanarAnalyze_core(const VSVideoInfo *vi, int cthresh, bool chro
         if ((sFirst > scaled_cthresh && sSecond > scaled_cthresh) || (sFirst < -scaled_cthresh && sSecond < -scaled_cthresh))
         {
           if (abs(srcpnn[x] + (srcp[x] << 2) + srcpnn[x] - (3 * (srcpp[x] + srcpn[x]))) > cthresh6)
-            cmkp[x] = 0xFF;
+            cmkpt[x] = 0xFF;
         }
       }
-      srcppp += src_pitch;
-      srcpp += src_pitch;
-      srcp += src_pitch;
-      srcpn += src_pitch;
-      srcpnn += src_pitch;
-      cmkp += cmk_pitch;
-      // middle Height - 4
-      const int lines_to_process = Height - 4;
-      if (use_sse2 && sizeof(pixel_t) == 1)
-        check_combing_SSE2((const uint8_t*)srcp, cmkp, Width, lines_to_process, src_pitch, cmk_pitch, scaled_cthresh);
+    }
+    // middle Height - 4
+    const int ymiddle = std::max(ystart, 2);
+    const int lines_to_process = std::min(ystop, Height - 2) - ymiddle;
+    if (lines_to_process > 0)
+    {
+      const pixel_t* const* rowsm = rows + ymiddle;
+      uint8_t* cmkpm = cmkp + ymiddle * cmk_pitch;
+      if (use_avx2 && sizeof(pixel_t) == 1)
+        check_combing_AVX2((const uint8_t* const*)rowsm, cmkpm, Width, lines_to_process, cmk_pitch, scaled_cthresh);
+      else if (use_sse2 && sizeof(pixel_t) == 1)
+        check_combing_SSE2((const uint8_t* const*)rowsm, cmkpm, Width, lines_to_process, cmk_pitch, scaled_cthresh);
+      else if (use_avx2 && sizeof(pixel_t) == 2)
+        check_combing_uint16_AVX2((const uint16_t* const*)rowsm, cmkpm, Width, lines_to_process, cmk_pitch, scaled_cthresh);
       else if (use_sse4 && sizeof(pixel_t) == 2)
-        check_combing_uint16_SSE4((const uint16_t*)srcp, cmkp, Width, lines_to_process, src_pitch, cmk_pitch, scaled_cthresh);
+        check_combing_uint16_SSE4((const uint16_t* const*)rowsm, cmkpm, Width, lines_to_process, cmk_pitch, scaled_cthresh);
       else
-        check_combing_c<pixel_t>(srcp, cmkp, Width, lines_to_process, src_pitch, cmk_pitch, scaled_cthresh);
-      srcppp += src_pitch * lines_to_process;
-      srcpp += src_pitch * lines_to_process;
-      srcp += src_pitch * lines_to_process;
-      srcpn += src_pitch * lines_to_process;
-      srcpnn += src_pitch * lines_to_process;
-      cmkp += cmk_pitch * lines_to_process;
-      // bottom #-2
+        check_combing_c<pixel_t>(rowsm, cmkpm, Width, lines_to_process, cmk_pitch, scaled_cthresh);
+    }
+    // bottom #-2
+    if (ystart <= Height - 2 && ystop > Height - 2)
+    {
+      uint8_t* cmkpt = cmkp + (Height - 2) * cmk_pitch;
+      srcppp = rows[Height - 4];
+      srcpp = rows[Height - 3];
+      srcp = rows[Height - 2];
+      srcpn = rows[Height - 1];
       for (int x = 0; x < Width; ++x)
       {
         const int sFirst = srcp[x] - srcpp[x];
@@ -152,68 +157,131 @@ void checkCombedPlanarAnalyze_core(const VSVideoInfo *vi, int cthresh, bool chro
         if ((sFirst > scaled_cthresh && sSecond > scaled_cthresh) || (sFirst < -scaled_cthresh && sSecond < -scaled_cthresh))
         {
           if (abs(srcppp[x] + (srcp[x] << 2) + srcppp[x] - (3 * (srcpp[x] + srcpn[x]))) > cthresh6)
-            cmkp[x] = 0xFF;
+            cmkpt[x] = 0xFF;
         }
       }
-      srcppp += src_pitch;
-      srcpp += src_pitch;
-      srcp += src_pitch;
-      srcpn += src_pitch;
-      srcpnn += src_pitch;
-      cmkp += cmk_pitch;
-      // bottom #-1
+    }
+    // bottom #-1
+    if (ystop == Height)
+    {
+      uint8_t* cmkpt = cmkp + (Height - 1) * cmk_pitch;
+      srcppp = rows[Height - 3];
+      srcpp = rows[Height - 2];
+      srcp = rows[Height - 1];
       for (int x = 0; x < Width; ++x)
       {
         const int sFirst = srcp[x] - srcpp[x];
         if (sFirst > scaled_cthresh || sFirst < -scaled_cthresh)
         {
           if (abs(srcppp[x] + (srcp[x] << 2) + srcppp[x] - (3 * (srcpp[x] + srcpp[x]))) > cthresh6)
-            cmkp[x] = 0xFF;
+            cmkpt[x] = 0xFF;
         }
       }
     }
-    else
+  }
+  else
+  {
+    // metric == 1: squared
+    typedef typename std::conditional<sizeof(pixel_t) == 1, int, int64_t> ::type safeint_t;
+    const safeint_t cthreshsq = (safeint_t)scaled_cthresh * scaled_cthresh;
+    const pixel_t* srcpp;
+    const pixel_t* srcp;
+    const pixel_t* srcpn;
+    // top #1
+    if (ystart == 0)
     {
-      // metric == 1: squared
-      typedef typename std::conditional<sizeof(pixel_t) == 1, int, int64_t> ::type safeint_t;
-      const safeint_t cthreshsq = (safeint_t)scaled_cthresh * scaled_cthresh;
-      // top #1
+      srcp = rows[0];
+      srcpn = rows[1];
       for (int x = 0; x < Width; ++x)
       {
         if ((safeint_t)(srcp[x] - srcpn[x]) * (srcp[x] - srcpn[x]) > cthreshsq)
           cmkp[x] = 0xFF;
       }
-      srcpp += src_pitch;
-      srcp += src_pitch;
-      srcpn += src_pitch;
-      cmkp += cmk_pitch;
-      // middle Height - 2
-      const int lines_to_process = Height - 2;
-      if (use_sse2)
+    }
+    // middle Height - 2
+    const int ymiddle = std::max(ystart, 1);
+    const int lines_to_process = std::min(ystop, Height - 1) - ymiddle;
+    if (lines_to_process > 0)
+    {
+      const pixel_t* const* rowsm = rows + ymiddle;
+      uint8_t* cmkpm = cmkp + ymiddle * cmk_pitch;
+      if constexpr (sizeof(pixel_t) == 1)
       {
-        if constexpr (sizeof(pixel_t) == 1)
-          check_combing_SSE2_Metric1(srcp, cmkp, Width, lines_to_process, src_pitch, cmk_pitch, cthreshsq);
+        if (use_avx2)
+          check_combing_AVX2_Metric1(rowsm, cmkpm, Width, lines_to_process, cmk_pitch, cthreshsq);
+        else if (use_sse2)
+          check_combing_SSE2_Metric1(rowsm, cmkpm, Width, lines_to_process, cmk_pitch, cthreshsq);
         else
-          check_combing_c_Metric1<pixel_t, safeint_t>(srcp, cmkp, Width, lines_to_process, src_pitch, cmk_pitch, cthreshsq);
-        // fixme: write SIMD? later. int64 inside.
-        // check_combing_uint16_SSE2_Metric1(srcp, cmkp, Width, lines_to_process, src_pitch, cmk_pitch, cthreshsq);
+          check_combing_c_Metric1<pixel_t, safeint_t>(rowsm, cmkpm, Width, lines_to_process, cmk_pitch, cthreshsq);
       }
       else
       {
-        check_combing_c_Metric1<pixel_t, safeint_t>(srcp, cmkp, Width, lines_to_process, src_pitch, cmk_pitch, cthreshsq);
+        if (use_avx2)
+          check_combing_uint16_AVX2_Metric1(rowsm, cmkpm, Width, lines_to_process, cmk_pitch, cthreshsq);
+        else if (use_sse4)
+          check_combing_uint16_SSE4_Metric1(rowsm, cmkpm, Width, lines_to_process, cmk_pitch, cthreshsq);
+        else
+          check_combing_c_Metric1<pixel_t, safeint_t>(rowsm, cmkpm, Width, lines_to_process, cmk_pitch, cthreshsq);
       }
-      srcpp += src_pitch * lines_to_process;
-      srcp += src_pitch * lines_to_process;
-      srcpn += src_pitch * lines_to_process;
-      cmkp += cmk_pitch * lines_to_process;
-      // Bottom
+    }
+    // Bottom
+    if (ystop == Height)
+    {
+      uint8_t* cmkpt = cmkp + (Height - 1) * cmk_pitch;
+      srcpp = rows[Height - 2];
+      srcp = rows[Height - 1];
       for (int x = 0; x < Width; ++x)
       {
         if ((safeint_t)(srcp[x] - srcpp[x]) * (srcp[x] - srcpp[x]) > cthreshsq)
-          cmkp[x] = 0xFF;
+          cmkpt[x] = 0xFF;
       }
     }
   }
+}
+
+//FIXME: once to make it common with TDeInterlace::CheckedCombedPlanar
+//similar, but cmask is real PVideoFrame there
+template<typename pixel_t>
+void checkCombedPlanarAnalyze_core(const VSVideoInfo *vi, int cthresh, bool chroma, const CPUFeatures *cpuFlags, int metric, const VSFrameRef *srcEven, const VSFrameRef *srcOdd, VSFrameRef* cmask, const VSAPI *vsapi, StripePool *stripes)
+{
+  const int bits_per_pixel = vi->format->bitsPerSample;
+
+  // cthresh: Area combing threshold used for combed frame detection.
+  // This essentially controls how "strong" or "visible" combing must be to be detected.
+  // Good values are from 6 to 12. If you know your source has a lot of combed frames set 
+  // this towards the low end(6 - 7). If you know your source has very few combed frames set 
+  // this higher(10 - 12). Going much lower than 5 to 6 or much higher than 12 is not recommended.
+
+  const int scaled_cthresh = cthresh << (bits_per_pixel - 8);
+
+  const int np = vi->format->numPlanes;
+  const int stop = chroma ? np : 1;
+
+  std::vector<const pixel_t*> rows;
+
+  for (int b = 0; b < stop; ++b)
+  {
+    const int plane = b;
+
+    const int Width = vsapi->getFrameWidth(srcEven, plane);
+    const int Height = vsapi->getFrameHeight(srcEven, plane);
+
+    uint8_t* cmkp = vsapi->getWritePtr(cmask, b);
+    const int cmk_pitch = vsapi->getStride(cmask, b);
+
+    if (scaled_cthresh < 0) {
+      memset(cmkp, 255, Height * cmk_pitch); // mask. Always 8 bits 
+      continue;
+    }
+
+    buildWeaveRows<pixel_t>(rows, srcEven, srcOdd, plane, vsapi);
+    const int count = stripeCount(stripes, Height, 1, 32);
+    runStripes(stripes, count, [&](int i) {
+      int ystart, ystop;
+      StripePool::stripeRows(Height, 1, count, i, ystart, ystop);
+      checkCombedPlaneRows<pixel_t>(rows.data(), cmkp, cmk_pitch, Width, Height, ystart, ystop, scaled_cthresh, metric, cpuFlags);
+    });
+  }
 
   // next block is for mask, no hbd needed
   // Includes chroma combing in the decision about whether a frame is combed.
@@ -228,16 +296,16 @@ void checkCombedPlanarAnalyze_core(const VSVideoInfo *vi, int cthresh, bool chro
 }
 
 // instantiate
-template void checkCombedPlanarAnalyze_core<uint8_t>(const VSVideoInfo *vi, int cthresh, bool chroma, const CPUFeatures *cpuFlags, int metric, const VSFrameRef *src, VSFrameRef* cmask, const VSAPI *vsapi);
-template void checkCombedPlanarAnalyze_core<uint16_t>(const VSVideoInfo *vi, int cthresh, bool chroma, const CPUFeatures *cpuFlags, int metric, const VSFrameRef *src, VSFrameRef* cmask, const VSAPI *vsapi);
+template void checkCombedPlanarAnalyze_core<uint8_t>(const VSVideoInfo *vi, int cthresh, bool chroma, const CPUFeatures *cpuFlags, int metric, const VSFrameRef *srcEven, const VSFrameRef *srcOdd, VSFrameRef* cmask, const VSAPI *vsapi, StripePool *stripes);
+template void checkCombedPlanarAnalyze_core<uint16_t>(const VSVideoInfo *vi, int cthresh, bool chroma, const CPUFeatures *cpuFlags, int metric, const VSFrameRef *srcEven, const VSFrameRef *srcOdd, VSFrameRef* cmask, const VSAPI *vsapi, StripePool *stripes);
 
 
-bool TFM::checkCombedPlanar(const VSFrameRef *src, int n, int match,
-  int *blockN, int &xblocksi, int *mics, bool ddebug, bool _chroma)
+bool TFM::checkCombedPlanar(const VSFrameRef *srcEven, const VSFrameRef *srcOdd, int n, int match,
+  int *blockN, int &xblocksi, int *mics, bool ddebug, bool _chroma, TFMFrameState &fs) const
 {
   if (mics[match] != -20)
   {
-    if (mics[match] > MI)
+    if (mics[match] > fs.MI)
     {
 //      if (debug && !ddebug)
 //      {
@@ -256,174 +324,173 @@ bool TFM::checkCombedPlanar(const VSFrameRef *src, int n, int match,
     return false;
   }
 
+  // Only luma decides the verdict when chroma is off, so its mask can be
+  // built band by band and the counting stop at the first block over MI.
+  const bool verdictOnly = micexitActive && !_chroma && cthresh >= 0;
   const int bits_per_pixel = vi->format->bitsPerSample;
   if (vi->format->bytesPerSample == 1) {
-    checkCombedPlanarAnalyze_core<uint8_t>(vi, cthresh, _chroma, &cpuFlags, metric, src, cmask.get(), vsapi);
-    return checkCombedPlanar_core<uint8_t>(src, n, match, blockN, xblocksi, mics, ddebug, bits_per_pixel);
+    if (!verdictOnly)
+      checkCombedPlanarAnalyze_core<uint8_t>(vi, cthresh, _chroma, &cpuFlags, metric, srcEven, srcOdd, fs.cmask.get(), vsapi, stripes.get());
+    return checkCombedPlanar_core<uint8_t>(srcEven, srcOdd, n, match, blockN, xblocksi, mics, ddebug, bits_per_pixel, verdictOnly, fs);
   }
   else {
-    checkCombedPlanarAnalyze_core<uint16_t>(vi, cthresh, _chroma, &cpuFlags, metric, src, cmask.get(), vsapi);
-    return checkCombedPlanar_core<uint16_t>(src, n, match, blockN, xblocksi, mics, ddebug, bits_per_pixel);
+    if (!verdictOnly)
+      checkCombedPlanarAnalyze_core<uint16_t>(vi, cthresh, _chroma, &cpuFlags, metric, srcEven, srcOdd, fs.cmask.get(), vsapi, stripes.get());
+    return checkCombedPlanar_core<uint16_t>(srcEven, srcOdd, n, match, blockN, xblocksi, mics, ddebug, bits_per_pixel, verdictOnly, fs);
   }
 }
 
 template<typename pixel_t>
-bool TFM::checkCombedPlanar_core(const VSFrameRef *src, int n, int match,
-  int* blockN, int& xblocksi, int* mics, bool ddebug, int bits_per_pixel)
+bool TFM::checkCombedPlanar_core(const VSFrameRef *srcEven, const VSFrameRef *srcOdd, int n, int match,
+  int* blockN, int& xblocksi, int* mics, bool ddebug, int bits_per_pixel, bool verdictOnly, TFMFrameState &fs) const
 {
-    (void)src;
     (void)n;
     (void)ddebug;
-    (void)bits_per_pixel;
 
   const bool use_sse2 = cpuFlags.sse2;
+  const bool use_avx2 = cpuFlags.avx2;
+  const bool use_popcnt = cpuFlags.popcnt;
 
-  const int cmk_pitch = vsapi->getStride(cmask.get(), 0);
-  const uint8_t *cmkp = vsapi->getWritePtr(cmask.get(), 0) + cmk_pitch;
-  const uint8_t *cmkpp = cmkp - cmk_pitch;
-  const uint8_t *cmkpn = cmkp + cmk_pitch;
-  const int Width = vsapi->getFrameWidth(cmask.get(), 0);
-  const int Height = vsapi->getFrameHeight(cmask.get(), 0);
+  const int cmk_pitch = vsapi->getStride(fs.cmask.get(), 0);
+  uint8_t *cmkp = vsapi->getWritePtr(fs.cmask.get(), 0);
+  const int Width = vsapi->getFrameWidth(fs.cmask.get(), 0);
+  const int Height = vsapi->getFrameHeight(fs.cmask.get(), 0);
   const int xblocks = ((Width + xhalf) >> xshift) + 1;
   const int xblocks4 = xblocks << 2;
   xblocksi = xblocks4;
   const int yblocks = ((Height + yhalf) >> yshift) + 1;
   const int arraysize = (xblocks*yblocks) << 2;
-  memset(cArray.get(), 0, arraysize * sizeof(int));
+  int *cArray = fs.cArray.get();
+  memset(cArray, 0, arraysize * sizeof(int));
 
-  int Heighta = (Height >> (yshift - 1)) << (yshift - 1);
-  if (Heighta == Height) Heighta = Height - yhalf;
-  const int Widtha = (Width >> (xshift - 1)) << (xshift - 1);
-  const bool use_sse2_sum = (use_sse2 && xhalf == 8 && yhalf == 8) ? true : false; // 8x8: no alignment
-  for (int y = 1; y < yhalf; ++y)
-  {
-    const int temp1 = (y >> yshift)*xblocks4;
-    const int temp2 = ((y + yhalf) >> yshift)*xblocks4;
-    for (int x = 0; x < Width; ++x)
+  // The luma mask is packed to one bit per pixel, then the pixels that are
+  // set in three consecutive rows are counted with popcounts, one band of
+  // yhalf rows and xhalf wide blocks at a time. Every pixel of a block
+  // adds to the same four overlapping cArray entries.
+  const int words = cmaskBitsPitch;
+  uint64_t *bits = fs.cmaskBits.get();
+  auto packRows = [&](int ystart, int ystop) {
+    for (int y = ystart; y < ystop; ++y)
     {
-      if (cmkpp[x] == 0xFF && cmkp[x] == 0xFF && cmkpn[x] == 0xFF)
-      {
-        const int box1 = (x >> xshift) << 2;
-        const int box2 = ((x + xhalf) >> xshift) << 2;
-        ++cArray.get()[temp1 + box1 + 0];
-        ++cArray.get()[temp1 + box2 + 1];
-        ++cArray.get()[temp2 + box1 + 2];
-        ++cArray.get()[temp2 + box2 + 3];
-      }
+      const uint8_t *cmkpp = cmkp + y * cmk_pitch;
+      uint64_t *bitsp = bits + y * words;
+      if (use_avx2)
+        packCombMaskRow_AVX2(cmkpp, bitsp, Width, words);
+      else if (use_sse2)
+        packCombMaskRow_SSE2(cmkpp, bitsp, Width, words);
+      else
+        packCombMaskRow_c(cmkpp, bitsp, Width, words);
     }
-    cmkpp += cmk_pitch;
-    cmkp += cmk_pitch;
-    cmkpn += cmk_pitch;
-  }
-  for (int y = yhalf; y < Heighta; y += yhalf)
+  };
+
+  // In verdict only mode the mask rows are only made once a band needs them.
+  std::vector<const pixel_t*> rows;
+  int scaled_cthresh = 0;
+  int packed = 0;
+  if (verdictOnly)
   {
-    const int temp1 = (y >> yshift)*xblocks4;
-    const int temp2 = ((y + yhalf) >> yshift)*xblocks4;
-    if (use_sse2_sum)
+    buildWeaveRows<pixel_t>(rows, srcEven, srcOdd, 0, vsapi);
+    scaled_cthresh = cthresh << (bits_per_pixel - 8);
+  }
+
+  const int countsSize = words * (64 / std::min(xhalf, 64));
+  const int xblocksHalf = (Width + xhalf - 1) / xhalf;
+  // Adds the bands that start in rows [ybegin, yend) to cArray. Returns
+  // true once a verdict only check finds a block over MI.
+  auto countBands = [&](int ybegin, int yend, int *counts) {
+    for (int y = ybegin; y < std::min(yend, Height - 1); y += yhalf)
     {
-      for (int x = 0; x < Widtha; x += xhalf)
+      memset(counts, 0, countsSize * sizeof(int));
+      const int yfirst = std::max(y, 1);
+      const int ylast = std::min(y + yhalf, Height - 1);
+      if (verdictOnly && packed < ylast + 1)
       {
-        int sum = 0;
-        compute_sum_8xN_sse2<8>(cmkpp + x, cmk_pitch, sum);
-        if (sum)
-        {
-          const int box1 = (x >> xshift) << 2;
-          const int box2 = ((x + xhalf) >> xshift) << 2;
-          cArray.get()[temp1 + box1 + 0] += sum;
-          cArray.get()[temp1 + box2 + 1] += sum;
-          cArray.get()[temp2 + box1 + 2] += sum;
-          cArray.get()[temp2 + box2 + 3] += sum;
-        }
+        checkCombedPlaneRows<pixel_t>(rows.data(), cmkp, cmk_pitch, Width, Height, packed, ylast + 1, scaled_cthresh, metric, &cpuFlags);
+        packRows(packed, ylast + 1);
+        packed = ylast + 1;
       }
-    }
-    else
-    {
-      for (int x = 0; x < Widtha; x += xhalf)
+      for (int yy = yfirst; yy < ylast; ++yy)
       {
-        const uint8_t *cmkppT = cmkpp;
-        const uint8_t *cmkpT = cmkp;
-        const uint8_t *cmkpnT = cmkpn;
-        int sum = 0;
-        for (int u = 0; u < yhalf; ++u)
-        {
-          for (int v = 0; v < xhalf; ++v)
-          {
-            if (cmkppT[x + v] == 0xFF && cmkpT[x + v] == 0xFF &&
-              cmkpnT[x + v] == 0xFF) ++sum;
-          }
-          cmkppT += cmk_pitch;
-          cmkpT += cmk_pitch;
-          cmkpnT += cmk_pitch;
-        }
+        const uint64_t *bitsp = bits + (yy - 1) * words;
+        if (use_avx2 && xhalf == 8)
+          countCombMaskRow8_AVX2(bitsp, bitsp + words, bitsp + 2 * words, words, counts);
+        else if (use_popcnt)
+          countCombMaskRow_POPCNT(bitsp, bitsp + words, bitsp + 2 * words, words, xhalf, counts);
+        else
+          countCombMaskRow_c(bitsp, bitsp + words, bitsp + 2 * words, words, xhalf, counts);
+      }
+      const int temp1 = (y >> yshift)*xblocks4;
+      const int temp2 = ((y + yhalf) >> yshift)*xblocks4;
+      for (int k = 0; k < xblocksHalf; ++k)
+      {
+        const int sum = counts[k];
         if (sum)
         {
+          const int x = k * xhalf;
           const int box1 = (x >> xshift) << 2;
           const int box2 = ((x + xhalf) >> xshift) << 2;
-          cArray.get()[temp1 + box1 + 0] += sum;
-          cArray.get()[temp1 + box2 + 1] += sum;
-          cArray.get()[temp2 + box1 + 2] += sum;
-          cArray.get()[temp2 + box2 + 3] += sum;
+          cArray[temp1 + box1 + 0] += sum;
+          cArray[temp1 + box2 + 1] += sum;
+          cArray[temp2 + box1 + 2] += sum;
+          cArray[temp2 + box2 + 3] += sum;
+          if (verdictOnly)
+          {
+            // counts only grow, so the first block over MI settles the verdict
+            const int idx[4] = { temp1 + box1 + 0, temp1 + box2 + 1, temp2 + box1 + 2, temp2 + box2 + 3 };
+            for (int i = 0; i < 4; ++i)
+            {
+              if (cArray[idx[i]] > fs.MI)
+              {
+                mics[match] = cArray[idx[i]];
+                blockN[match] = idx[i];
+                return true;
+              }
+            }
+          }
         }
       }
     }
-    // rest
-    for (int x = Widtha; x < Width; ++x)
-    {
-      const uint8_t *cmkppT = cmkpp;
-      const uint8_t *cmkpT = cmkp;
-      const uint8_t *cmkpnT = cmkpn;
-      int sum = 0;
-      for (int u = 0; u < yhalf; ++u)
-      {
-        if (cmkppT[x] == 0xFF && cmkpT[x] == 0xFF &&
-          cmkpnT[x] == 0xFF) ++sum;
-        cmkppT += cmk_pitch;
-        cmkpT += cmk_pitch;
-        cmkpnT += cmk_pitch;
-      }
-      if (sum)
-      {
-        const int box1 = (x >> xshift) << 2;
-        const int box2 = ((x + xhalf) >> xshift) << 2;
-        cArray.get()[temp1 + box1 + 0] += sum;
-        cArray.get()[temp1 + box2 + 1] += sum;
-        cArray.get()[temp2 + box1 + 2] += sum;
-        cArray.get()[temp2 + box2 + 3] += sum;
-      }
-    }
-    cmkpp += cmk_pitch*yhalf;
-    cmkp += cmk_pitch*yhalf;
-    cmkpn += cmk_pitch*yhalf;
+    return false;
+  };
+
+  if (verdictOnly)
+  {
+    if (countBands(0, Height - 1, fs.cmaskCounts.get()))
+      return true;
   }
-  for (int y = Heighta; y < Height - 1; ++y)
+  else
   {
-    const int temp1 = (y >> yshift)*xblocks4;
-    const int temp2 = ((y + yhalf) >> yshift)*xblocks4;
-    for (int x = 0; x < Width; ++x)
-    {
-      if (cmkpp[x] == 0xFF && cmkp[x] == 0xFF && cmkpn[x] == 0xFF)
-      {
-        const int box1 = (x >> xshift) << 2;
-        const int box2 = ((x + xhalf) >> xshift) << 2;
-        ++cArray.get()[temp1 + box1 + 0];
-        ++cArray.get()[temp1 + box2 + 1];
-        ++cArray.get()[temp2 + box1 + 2];
-        ++cArray.get()[temp2 + box2 + 3];
-      }
-    }
-    cmkpp += cmk_pitch;
-    cmkp += cmk_pitch;
-    cmkpn += cmk_pitch;
+    StripePool *pool = stripes.get();
+    const int count = stripeCount(pool, Height, 1, 32);
+    runStripes(pool, count, [&](int i) {
+      int ystart, ystop;
+      StripePool::stripeRows(Height, 1, count, i, ystart, ystop);
+      packRows(ystart, ystop);
+    });
+    // Stripes of whole block rows (two bands). The block row at a seam gets
+    // counts from the bands on both sides, so every other stripe runs at a
+    // time, each with its own counts buffer.
+    const int bands = (Height - 1 + yhalf - 1) / yhalf;
+    const int bandStripes = stripeCount(pool, bands, 2, 8);
+    auto countStripe = [&](int i) {
+      int bstart, bstop;
+      StripePool::stripeRows(bands, 2, bandStripes, i, bstart, bstop);
+      countBands(bstart * yhalf, bstop * yhalf, fs.cmaskCounts.get() + i * cmaskCountsPitch);
+    };
+    if (pool)
+      pool->runAlternating(bandStripes, countStripe);
+    else
+      countStripe(0);
   }
   for (int x = 0; x < arraysize; ++x)
   {
-    if (cArray.get()[x] > mics[match])
+    if (cArray[x] > mics[match])
     {
-      mics[match] = cArray.get()[x];
+      mics[match] = cArray[x];
       blockN[match] = x;
     }
   }
-  if (mics[match] > MI)
+  if (mics[match] > fs.MI)
   {
 //    if (debug && !ddebug)
 //    {
@@ -444,25 +511,42 @@ bool TFM::checkCombedPlanar_core(const VSFrameRef *src, int n, int match,
 
 template<typename pixel_t>
 void TFM::buildDiffMapPlane_Planar(const uint8_t *prvp, const uint8_t *nxtp,
-  uint8_t *dstp, int prv_pitch, int nxt_pitch, int dst_pitch, int Height,
-  int Width, int tpitch, int bits_per_pixel)
+  uint8_t *dstp, uint8_t *tbuffer, int prv_pitch, int nxt_pitch, int dst_pitch, int Height,
+  int Width, int tpitch, int bits_per_pixel) const
 {
-  buildABSDiffMask<pixel_t>(prvp - prv_pitch, nxtp - nxt_pitch, prv_pitch, nxt_pitch, tpitch, Width, Height >> 1);
-  switch (bits_per_pixel) {
-  case 8: AnalyzeDiffMask_Planar<uint8_t, 8>(dstp, dst_pitch, tbuffer.get(), tpitch, Width, Height); break;
-  case 10: AnalyzeDiffMask_Planar<uint16_t, 10>(dstp, dst_pitch, tbuffer.get(), tpitch, Width, Height); break;
-  case 12: AnalyzeDiffMask_Planar<uint16_t, 12>(dstp, dst_pitch, tbuffer.get(), tpitch, Width, Height); break;
-  case 14: AnalyzeDiffMask_Planar<uint16_t, 14>(dstp, dst_pitch, tbuffer.get(), tpitch, Width, Height); break;
-  case 16: AnalyzeDiffMask_Planar<uint16_t, 16>(dstp, dst_pitch, tbuffer.get(), tpitch, Width, Height); break;
-  }
+  // Both passes go by rows: the field rows of the difference, then the map
+  // rows, which read the difference rows around them.
+  StripePool *pool = stripes.get();
+  const int diffRows = Height >> 1;
+  const int count = stripeCount(pool, diffRows, 1, 16);
+  runStripes(pool, count, [&](int i) {
+    int ystart, ystop;
+    StripePool::stripeRows(diffRows, 1, count, i, ystart, ystop);
+    buildABSDiffMask<pixel_t>(prvp + (ystart - 1) * prv_pitch, nxtp + (ystart - 1) * nxt_pitch, tbuffer + ystart * tpitch,
+      prv_pitch, nxt_pitch, tpitch, Width, ystop - ystart);
+  });
+  const int mapRows = std::max((Height - 3) / 2, 0);
+  const int mapCount = stripeCount(pool, mapRows, 1, 16);
+  runStripes(pool, mapCount, [&](int i) {
+    int kstart, kstop;
+    StripePool::stripeRows(mapRows, 1, mapCount, i, kstart, kstop);
+    const int ystart = 2 + 2 * kstart, ystop = 2 + 2 * kstop;
+    switch (bits_per_pixel) {
+    case 8: AnalyzeDiffMask_Planar<uint8_t, 8>(dstp, dst_pitch, tbuffer, tpitch, Width, Height, ystart, ystop); break;
+    case 10: AnalyzeDiffMask_Planar<uint16_t, 10>(dstp, dst_pitch, tbuffer, tpitch, Width, Height, ystart, ystop); break;
+    case 12: AnalyzeDiffMask_Planar<uint16_t, 12>(dstp, dst_pitch, tbuffer, tpitch, Width, Height, ystart, ystop); break;
+    case 14: AnalyzeDiffMask_Planar<uint16_t, 14>(dstp, dst_pitch, tbuffer, tpitch, Width, Height, ystart, ystop); break;
+    case 16: AnalyzeDiffMask_Planar<uint16_t, 16>(dstp, dst_pitch, tbuffer, tpitch, Width, Height, ystart, ystop); break;
+    }
+  });
 }
 
 // instantiate
 template void TFM::buildDiffMapPlane_Planar<uint8_t>(const uint8_t* prvp, const uint8_t* nxtp,
-  uint8_t* dstp, int prv_pitch, int nxt_pitch, int dst_pitch, int Height,
-  int Width, int tpitch, int bits_per_pixel);
+  uint8_t* dstp, uint8_t* tbuffer, int prv_pitch, int nxt_pitch, int dst_pitch, int Height,
+  int Width, int tpitch, int bits_per_pixel) const;
 template void TFM::buildDiffMapPlane_Planar<uint16_t>(const uint8_t* prvp, const uint8_t* nxtp,
-  uint8_t* dstp, int prv_pitch, int nxt_pitch, int dst_pitch, int Height,
-  int Width, int tpitch, int bits_per_pixel);
+  uint8_t* dstp, uint8_t* tbuffer, int prv_pitch, int nxt_pitch, int dst_pitch, int Height,
+  int Width, int tpitch, int bits_per_pixel) const;
 
 
@@ -40,4 +40,149 @@ void checkSceneChangePlanar_2_SSE2(const uint8_t* prvp, const uint8_t* srcp,
   const uint8_t* nxtp, int height, int width, int prv_pitch, int src_pitch,
   int nxt_pitch, uint64_t& diffp, uint64_t& diffn);
 
+// compareFields: one field row of the diff map (prev/next match vs. the
+// current field) built and accumulated in a single pass.
+// accum: Pc, Pm, Nc, Nm
+template<typename pixel_t>
+void compareFieldsRow_c(const pixel_t* prvpf, const pixel_t* prvnf,
+  const pixel_t* curpf, const pixel_t* curf, const pixel_t* curnf,
+  const pixel_t* nxtpf, const pixel_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum);
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("sse4.1")))
+#endif
+void compareFieldsRow_uint8_SSE4(const uint8_t* prvpf, const uint8_t* prvnf,
+  const uint8_t* curpf, const uint8_t* curf, const uint8_t* curnf,
+  const uint8_t* nxtpf, const uint8_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum);
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("sse4.1")))
+#endif
+void compareFieldsRow_uint16_SSE4(const uint16_t* prvpf, const uint16_t* prvnf,
+  const uint16_t* curpf, const uint16_t* curf, const uint16_t* curnf,
+  const uint16_t* nxtpf, const uint16_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum);
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void compareFieldsRow_uint8_AVX2(const uint8_t* prvpf, const uint8_t* prvnf,
+  const uint8_t* curpf, const uint8_t* curf, const uint8_t* curnf,
+  const uint8_t* nxtpf, const uint8_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum);
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void compareFieldsRow_uint16_AVX2(const uint16_t* prvpf, const uint16_t* prvnf,
+  const uint16_t* curpf, const uint16_t* curf, const uint16_t* curnf,
+  const uint16_t* nxtpf, const uint16_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum);
+
+// compareFieldsSlow/Slow2 rows over the AnalyzeDiffMask_Planar map.
+// accum: Pc, Pm, Pml, Nc, Nm, Nml
+template<typename pixel_t>
+void compareFieldsSlowRow_c(const uint8_t* mapp, const uint8_t* mapn,
+  const pixel_t* prvpf, const pixel_t* prvnf,
+  const pixel_t* curpf, const pixel_t* curf, const pixel_t* curnf,
+  const pixel_t* nxtpf, const pixel_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum);
+
+// Slow2 extra block: prv/nxt rows a-b-c against current rows a-b, flags from one map row
+template<typename pixel_t>
+void compareFieldsSlow2Row_c(const uint8_t* map,
+  const pixel_t* prva, const pixel_t* prvb, const pixel_t* prvc,
+  const pixel_t* cura, const pixel_t* curb,
+  const pixel_t* nxta, const pixel_t* nxtb, const pixel_t* nxtc,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum);
+
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("sse4.1")))
+#endif
+void compareFieldsSlowRow_uint8_SSE4(const uint8_t* mapp, const uint8_t* mapn,
+  const uint8_t* prvpf, const uint8_t* prvnf,
+  const uint8_t* curpf, const uint8_t* curf, const uint8_t* curnf,
+  const uint8_t* nxtpf, const uint8_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum);
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("sse4.1")))
+#endif
+void compareFieldsSlowRow_uint16_SSE4(const uint8_t* mapp, const uint8_t* mapn,
+  const uint16_t* prvpf, const uint16_t* prvnf,
+  const uint16_t* curpf, const uint16_t* curf, const uint16_t* curnf,
+  const uint16_t* nxtpf, const uint16_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum);
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void compareFieldsSlowRow_uint8_AVX2(const uint8_t* mapp, const uint8_t* mapn,
+  const uint8_t* prvpf, const uint8_t* prvnf,
+  const uint8_t* curpf, const uint8_t* curf, const uint8_t* curnf,
+  const uint8_t* nxtpf, const uint8_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum);
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void compareFieldsSlowRow_uint16_AVX2(const uint8_t* mapp, const uint8_t* mapn,
+  const uint16_t* prvpf, const uint16_t* prvnf,
+  const uint16_t* curpf, const uint16_t* curf, const uint16_t* curnf,
+  const uint16_t* nxtpf, const uint16_t* nxtnf,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum);
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("sse4.1")))
+#endif
+void compareFieldsSlow2Row_uint8_SSE4(const uint8_t* map,
+  const uint8_t* prva, const uint8_t* prvb, const uint8_t* prvc,
+  const uint8_t* cura, const uint8_t* curb,
+  const uint8_t* nxta, const uint8_t* nxtb, const uint8_t* nxtc,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum);
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("sse4.1")))
+#endif
+void compareFieldsSlow2Row_uint16_SSE4(const uint8_t* map,
+  const uint16_t* prva, const uint16_t* prvb, const uint16_t* prvc,
+  const uint16_t* cura, const uint16_t* curb,
+  const uint16_t* nxta, const uint16_t* nxtb, const uint16_t* nxtc,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum);
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void compareFieldsSlow2Row_uint8_AVX2(const uint8_t* map,
+  const uint8_t* prva, const uint8_t* prvb, const uint8_t* prvc,
+  const uint8_t* cura, const uint8_t* curb,
+  const uint8_t* nxta, const uint8_t* nxtb, const uint8_t* nxtc,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum);
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void compareFieldsSlow2Row_uint16_AVX2(const uint8_t* map,
+  const uint16_t* prva, const uint16_t* prvb, const uint16_t* prvc,
+  const uint16_t* cura, const uint16_t* curb,
+  const uint16_t* nxta, const uint16_t* nxtb, const uint16_t* nxtc,
+  int startx, int stopx, int bits_per_pixel, uint64_t* accum);
+
+// Comb mask as packed bits: pixel x of a row is bit (x & 63) of word x >> 6.
+// Rows are padded with zero bits to 'words' (a multiple of 4) words.
+void packCombMaskRow_c(const uint8_t* cmkp, uint64_t* dstp, int width, int words);
+void packCombMaskRow_SSE2(const uint8_t* cmkp, uint64_t* dstp, int width, int words);
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void packCombMaskRow_AVX2(const uint8_t* cmkp, uint64_t* dstp, int width, int words);
+
+// Counts the pixels set in all three packed rows: counts[k] gets the number
+// of them in pixels k * xhalf .. k * xhalf + xhalf - 1.
+void countCombMaskRow_c(const uint64_t* bitsp, const uint64_t* bits, const uint64_t* bitsn,
+  int words, int xhalf, int* counts);
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("popcnt")))
+#endif
+void countCombMaskRow_POPCNT(const uint64_t* bitsp, const uint64_t* bits, const uint64_t* bitsn,
+  int words, int xhalf, int* counts);
+// xhalf == 8 only: one byte of a row is one block
+#if defined(GCC) || defined(CLANG)
+__attribute__((__target__("avx2")))
+#endif
+void countCombMaskRow8_AVX2(const uint64_t* bitsp, const uint64_t* bits, const uint64_t* bitsn,
+  int words, int* counts);
+
 #endif // TFMASM_H__
@@ -25,8 +25,14 @@
 
 //#include "internal.h"
 #include "calcCRC.h"
+#include "internal.h"
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
 
-static const unsigned int Crc32Table[256] =
+static constexpr unsigned int Crc32Table[256] =
 {
   0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA,
   0x076DC419, 0x706AF48F, 0xE963A535, 0x9E6495A3,
@@ -94,30 +100,104 @@ static const unsigned int Crc32Table[256] =
   0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D,
 };
 
+// Slicing-by-8: table k gives the crc contribution of a byte followed by k
+// zero bytes, so eight bytes are folded in per step.
+struct Crc32Tables
+{
+  unsigned int t[8][256];
+};
+
+static constexpr Crc32Tables makeCrc32Tables()
+{
+  Crc32Tables tables = {};
+  for (int i = 0; i < 256; ++i)
+    tables.t[0][i] = Crc32Table[i];
+  for (int k = 1; k < 8; ++k)
+    for (int i = 0; i < 256; ++i)
+      tables.t[k][i] = (tables.t[k - 1][i] >> 8) ^ Crc32Table[tables.t[k - 1][i] & 0xFF];
+  return tables;
+}
+
+static constexpr Crc32Tables crcTables = makeCrc32Tables();
+
+static unsigned int crc32Update(unsigned int crc, const uint8_t *buffer, int size)
+{
+  const auto &t = crcTables.t;
+  for (; size >= 8; size -= 8, buffer += 8)
+  {
+    // little endian load
+    uint32_t one, two;
+    memcpy(&one, buffer, 4);
+    memcpy(&two, buffer + 4, 4);
+    one ^= crc;
+    crc = t[7][one & 0xFF] ^ t[6][(one >> 8) & 0xFF] ^ t[5][(one >> 16) & 0xFF] ^ t[4][one >> 24] ^
+      t[3][two & 0xFF] ^ t[2][(two >> 8) & 0xFF] ^ t[1][(two >> 16) & 0xFF] ^ t[0][two >> 24];
+  }
+  while (size--)
+    crc = t[0][(crc ^ *buffer++) & 0xFF] ^ (crc >> 8);
+  return crc;
+}
+
+// All frames are requested at once so a slow source can decode them in
+// parallel, they are still added to the crc in order as they arrive.
+struct CRCFrames
+{
+  std::mutex lock;
+  std::condition_variable arrived;
+  std::vector<const VSFrameRef *> frames;
+  std::vector<bool> ready;
+  std::string error;
+};
+
+static void VS_CC crcFrameDone(void *userData, const VSFrameRef *f, int n, VSNodeRef *, const char *errorMsg)
+{
+  CRCFrames *d = static_cast<CRCFrames *>(userData);
+  std::lock_guard<std::mutex> guard(d->lock);
+  d->frames[n] = f;
+  d->ready[n] = true;
+  if (!f && d->error.empty())
+    d->error = errorMsg ? errorMsg : "unknown error";
+  // notify under the lock, d is gone as soon as the waiter has everything
+  d->arrived.notify_all();
+}
+
 void calcCRC(VSNodeRef *hclip, int stop, unsigned int &crc, const VSAPI *vsapi)
 {
   crc = 0xFFFFFFFF;
-  const VSFrameRef *src;
-  const unsigned int *ptrCrcTable = Crc32Table;
-  const uint8_t *buffer;
-  int width, height, pitch, modulo, x;
   const VSVideoInfo *vi2 = vsapi->getVideoInfo(hclip);
   if (stop > vi2->numFrames) stop = vi2->numFrames;
-  for (x = 0; x < stop; ++x)
+  if (stop <= 0)
+    return;
+
+  CRCFrames d;
+  d.frames.resize(stop, nullptr);
+  d.ready.resize(stop, false);
+  for (int x = 0; x < stop; ++x)
+    vsapi->getFrameAsync(x, hclip, crcFrameDone, &d);
+
+  for (int x = 0; x < stop; ++x)
   {
-    src = vsapi->getFrame(x, hclip, nullptr, 0);
-    buffer = vsapi->getReadPtr(src, 0);
-    width = vsapi->getFrameWidth(src, 0) * vsapi->getFrameFormat(src)->bytesPerSample;
-    pitch = vsapi->getStride(src, 0);
-    height = vsapi->getFrameHeight(src, 0);
-    modulo = pitch - width;
-    while (height--) {
-      int size = width;
-      while (size--)
-        crc = ptrCrcTable[(crc ^ *buffer++) & 0xFF] ^ (crc >> 8);
-      buffer += modulo;
+    const VSFrameRef *src;
+    {
+      std::unique_lock<std::mutex> guard(d.lock);
+      d.arrived.wait(guard, [&] { return d.ready[x]; });
+      src = d.frames[x];
+    }
+    if (!src)
+      continue;
+    const uint8_t *buffer = vsapi->getReadPtr(src, 0);
+    const int width = vsapi->getFrameWidth(src, 0) * vsapi->getFrameFormat(src)->bytesPerSample;
+    const int pitch = vsapi->getStride(src, 0);
+    const int height = vsapi->getFrameHeight(src, 0);
+    for (int y = 0; y < height; ++y)
+    {
+      crc = crc32Update(crc, buffer, width);
+      buffer += pitch;
     }
     //crc = crc ^ ~0U;
     vsapi->freeFrame(src);
   }
+
+  if (!d.error.empty())
+    throw TIVTCError("TIVTC: failed to get a frame for the crc32: " + d.error);
 }
@@ -29,12 +29,18 @@
 #define PROP_TFMD2VFilm "TFMD2VFilm"
 #define PROP_TFMField "TFMField"
 #define PROP_TFMPP "TFMPP"
+#define PROP_TFMScratchHighWater "TFMScratchHighWater" // only with debug=True
+#define PROP_TFMScratchBytes "TFMScratchBytes" // only with debug=True
+#define PROP_TFMPPScratchHighWater "TFMPPScratchHighWater" // only with debug=True
+#define PROP_TFMPPScratchBytes "TFMPPScratchBytes" // only with debug=True
 
 // Frame properties set by TDecimate:
 #define PROP_TDecimateDisplay "TDecimateDisplay"
 #define PROP_TDecimateCycleStart "TDecimateCycleStart"
 #define PROP_TDecimateCycleMaxBlockDiff "TDecimateCycleMaxBlockDiff" // uint64_t[]
 #define PROP_TDecimateOriginalFrame "TDecimateOriginalFrame"
+#define PROP_TDecimateMetricCacheHits "TDecimateMetricCacheHits" // only with debug=True
+#define PROP_TDecimateMetricCacheMisses "TDecimateMetricCacheMisses" // only with debug=True
 #define PROP_DurationNum "_DurationNum"
 #define PROP_DurationDen "_DurationDen"
 
@@ -98,5 +104,20 @@ static FILE *tivtc_fopen(const char *name, const char *mode) {
 #endif
 }
 
+static int tivtc_remove(const char *name) {
+#ifdef _WIN32
+    int len = MultiByteToWideChar(CP_UTF8, 0, name, -1, nullptr, 0);
+    std::wstring wname(len, 0);
+
+    int ret = MultiByteToWideChar(CP_UTF8, 0, name, -1, wname.data(), len);
+    if (ret == len)
+        return _wremove(wname.c_str());
+    else
+        return -1;
+#else
+    return std::remove(name);
+#endif
+}
+
 
 #endif  // __Internal_H__